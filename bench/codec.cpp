@@ -0,0 +1,148 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the sans-IO codec without sockets. PUBLISH packets are encoded into
+// one buffer, and the buffer is fed to the decoder in chunks of the given size.
+//
+// Usage: bench_codec [packets] [chunk_size]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <mqtt/codec.hpp>
+
+namespace codec = MQTT_NS::codec;
+
+using namespace MQTT_NS::literals;
+
+template <typename F>
+double ns_per(std::size_t n, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+        static_cast<double>(n);
+}
+
+template <typename Message, typename Decode>
+void run(
+    char const* name,
+    MQTT_NS::protocol_version version,
+    Message const& m,
+    std::size_t packets,
+    std::size_t chunk_size,
+    Decode decode) {
+    codec::encoder enc;
+    std::string stream(m.size() * packets, '\0');
+    auto encode_ns = ns_per(
+        packets,
+        [&] {
+            char* out = &stream[0];
+            for (std::size_t i = 0; i != packets; ++i) {
+                out += enc.encode(m, out, m.size());
+            }
+        }
+    );
+
+    std::size_t decoded = 0;
+    std::size_t payload_bytes = 0;
+    auto decode_ns = ns_per(
+        packets,
+        [&] {
+            codec::decoder d(version);
+            for (std::size_t pos = 0; pos < stream.size(); pos += chunk_size) {
+                d.feed(stream.data() + pos, std::min(chunk_size, stream.size() - pos));
+                while (auto p = d.next()) {
+                    payload_bytes += decode(p.value());
+                    ++decoded;
+                }
+            }
+        }
+    );
+    if (decoded != packets) std::abort();
+
+    std::cout
+        << std::left << std::setw(12) << name
+        << std::right
+        << std::setw(12) << m.size()
+        << std::setw(12) << encode_ns
+        << std::setw(12) << decode_ns
+        << std::setw(12) << static_cast<double>(m.size()) / decode_ns * 1000.0
+        << "\n";
+    (void)payload_bytes;
+}
+
+int main(int argc, char** argv) {
+    std::size_t packets = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::size_t chunk_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+    std::string const payload(64, 'x');
+
+    std::cout
+        << std::left << std::setw(12) << "packet"
+        << std::right
+        << std::setw(12) << "bytes"
+        << std::setw(12) << "encode ns"
+        << std::setw(12) << "decode ns"
+        << std::setw(12) << "decode MB/s"
+        << "\n"
+        << std::fixed << std::setprecision(1);
+
+    run(
+        "v3.1.1",
+        MQTT_NS::protocol_version::v3_1_1,
+        MQTT_NS::v3_1_1::publish_message(
+            1,
+            as::buffer("sensor/telemetry"_mb),
+            as::buffer(payload),
+            MQTT_NS::qos::at_least_once
+        ),
+        packets,
+        chunk_size,
+        [](codec::packet const& p) {
+            return codec::decode_v3_1_1_publish<2>(p).payload().size();
+        }
+    );
+    run(
+        "v5",
+        MQTT_NS::protocol_version::v5,
+        MQTT_NS::v5::publish_message(
+            1,
+            as::buffer("sensor/telemetry"_mb),
+            as::buffer(payload),
+            MQTT_NS::qos::at_least_once,
+            MQTT_NS::v5::properties {
+                MQTT_NS::v5::property::content_type("application/json"_mb),
+                MQTT_NS::v5::property::user_property("key"_mb, "value"_mb),
+            }
+        ),
+        packets,
+        chunk_size,
+        [](codec::packet const& p) {
+            return codec::decode_v5_publish<2>(p).payload().size();
+        }
+    );
+    run(
+        "v5 frame",
+        MQTT_NS::protocol_version::v5,
+        MQTT_NS::v5::publish_message(
+            1,
+            as::buffer("sensor/telemetry"_mb),
+            as::buffer(payload),
+            MQTT_NS::qos::at_least_once,
+            MQTT_NS::v5::properties {}
+        ),
+        packets,
+        chunk_size,
+        [](codec::packet const& p) {
+            return p.remaining_length();
+        }
+    );
+}
@@ -0,0 +1,96 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the cost of calling the publish handler of callable_overlay
+// (std::function) and static_overlay (member function of the handler type).
+// The virtual call from endpoint to the overlay is the same for both, so the
+// overlay's on_publish() is called directly.
+//
+// Usage: bench_handler_dispatch [calls]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+
+#include <boost/asio.hpp>
+
+#include <mqtt/server.hpp>
+#include <mqtt/static_overlay.hpp>
+
+namespace as = boost::asio;
+
+struct counting_handler {
+    bool on_publish(MQTT_NS::optional<std::uint16_t> packet_id,
+                    MQTT_NS::publish_options,
+                    MQTT_NS::buffer topic_name,
+                    MQTT_NS::buffer contents) {
+        count += topic_name.size() + contents.size() + (packet_id ? 1 : 0);
+        return true;
+    }
+    std::size_t count = 0;
+};
+
+using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using callable_endpoint_t = MQTT_NS::callable_overlay<MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2>>;
+using static_endpoint_t = MQTT_NS::static_overlay<MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2>, counting_handler>;
+
+template <typename Endpoint>
+double ns_per_call(Endpoint& ep, std::size_t calls) {
+    auto topic = MQTT_NS::allocate_buffer("topic1");
+    auto contents = MQTT_NS::allocate_buffer("contents");
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != calls; ++i) {
+        // buffer is shared, so the copies don't allocate.
+        ep.on_publish(
+            static_cast<std::uint16_t>(i),
+            MQTT_NS::qos::at_least_once,
+            topic,
+            contents
+        );
+    }
+    auto end = std::chrono::steady_clock::now();
+    return
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+        static_cast<double>(calls);
+}
+
+int main(int argc, char** argv) {
+    std::size_t calls = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+
+    as::io_context ioc;
+
+    auto cep = std::make_shared<callable_endpoint_t>(std::make_shared<socket_t>(ioc), MQTT_NS::protocol_version::v3_1_1);
+    counting_handler ch;
+    cep->set_publish_handler(
+        [&ch]
+        (MQTT_NS::optional<std::uint16_t> packet_id,
+         MQTT_NS::publish_options pubopts,
+         MQTT_NS::buffer topic_name,
+         MQTT_NS::buffer contents) {
+            return ch.on_publish(packet_id, pubopts, MQTT_NS::force_move(topic_name), MQTT_NS::force_move(contents));
+        }
+    );
+
+    auto sep = std::make_shared<static_endpoint_t>(counting_handler(), std::make_shared<socket_t>(ioc), MQTT_NS::protocol_version::v3_1_1);
+
+    // warm up
+    ns_per_call(*cep, calls / 10);
+    ns_per_call(*sep, calls / 10);
+
+    auto callable_ns = ns_per_call(*cep, calls);
+    auto static_ns = ns_per_call(*sep, calls);
+
+    std::cout
+        << calls << " calls\n"
+        << std::left << std::setw(20) << "overlay" << std::right << std::setw(12) << "ns/call" << "\n"
+        << std::fixed << std::setprecision(2)
+        << std::left << std::setw(20) << "callable_overlay" << std::right << std::setw(12) << callable_ns << "\n"
+        << std::left << std::setw(20) << "static_overlay" << std::right << std::setw(12) << static_ns << "\n";
+
+    // Keep the results observable.
+    return (ch.count == 0 || sep->handler().count == 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
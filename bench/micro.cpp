@@ -0,0 +1,220 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Microbenchmarks of the encode/decode hot paths.
+// Each row reports the time, the number of allocations and the allocated bytes
+// per operation. The allocations are counted by replacing the global operator new.
+//
+// Usage: bench_micro [iterations]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <new>
+
+#include <mqtt/server.hpp>
+#include <mqtt/message.hpp>
+#include <mqtt/v5_message.hpp>
+#include <mqtt/property_parse.hpp>
+#include <mqtt/remaining_length.hpp>
+#include <mqtt/variable_length.hpp>
+#include <mqtt/utf8encoded_strings.hpp>
+
+namespace {
+
+std::size_t allocs = 0;
+std::size_t alloc_bytes = 0;
+
+} // anonymous namespace
+
+void* operator new(std::size_t size) {
+    ++allocs;
+    alloc_bytes += size;
+    if (auto p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace as = boost::asio;
+
+using namespace MQTT_NS::literals;
+
+namespace {
+
+volatile std::size_t sink;
+
+template <typename F>
+void bench(char const* name, std::size_t iterations, F f) {
+    // warm up
+    sink = f();
+
+    auto a = allocs;
+    auto b = alloc_bytes;
+    std::size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) {
+        total += f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = total;
+
+    auto n = static_cast<double>(iterations);
+    std::cout
+        << std::left << std::setw(36) << name
+        << std::right
+        << std::setw(12)
+        << static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / n
+        << std::setw(12) << static_cast<double>(allocs - a) / n
+        << std::setw(12) << static_cast<double>(alloc_bytes - b) / n
+        << "\n";
+}
+
+MQTT_NS::buffer encode(MQTT_NS::v5::properties const& props) {
+    std::string s;
+    for (auto const& p : props) {
+        auto size = MQTT_NS::v5::size(p);
+        s.resize(s.size() + size);
+        MQTT_NS::v5::fill(p, std::prev(s.end(), static_cast<std::ptrdiff_t>(size)), s.end());
+    }
+    return MQTT_NS::allocate_buffer(s);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    std::string const payload(64, 'x');
+
+    std::cout
+        << std::left << std::setw(36) << "operation"
+        << std::right
+        << std::setw(12) << "ns/op"
+        << std::setw(12) << "allocs/op"
+        << std::setw(12) << "bytes/op"
+        << "\n"
+        << std::fixed << std::setprecision(2);
+
+    bench(
+        "v3_1_1::publish_message qos1",
+        iterations,
+        [&] {
+            MQTT_NS::v3_1_1::publish_message m(
+                1,
+                as::buffer("sensor/telemetry"_mb),
+                as::buffer(payload),
+                MQTT_NS::qos::at_least_once
+            );
+            return m.size();
+        }
+    );
+
+    MQTT_NS::v5::properties props {
+        MQTT_NS::v5::property::content_type("application/json"_mb),
+        MQTT_NS::v5::property::message_expiry_interval(60),
+        MQTT_NS::v5::property::user_property("key"_mb, "value"_mb),
+    };
+    bench(
+        "v5::publish_message qos1 3 props",
+        iterations,
+        [&] {
+            MQTT_NS::v5::publish_message m(
+                1,
+                as::buffer("sensor/telemetry"_mb),
+                as::buffer(payload),
+                MQTT_NS::qos::at_least_once,
+                props
+            );
+            return m.size();
+        }
+    );
+
+    std::size_t const lengths[] = { 10, 200, 20000, 2000000 };
+    bench(
+        "remaining_bytes x4",
+        iterations,
+        [&] {
+            std::size_t total = 0;
+            for (auto l : lengths) total += MQTT_NS::remaining_bytes(l).size();
+            return total;
+        }
+    );
+
+    std::string const encoded_lengths =
+        MQTT_NS::variable_bytes(10) +
+        MQTT_NS::variable_bytes(200) +
+        MQTT_NS::variable_bytes(20000) +
+        MQTT_NS::variable_bytes(2000000);
+    bench(
+        "variable_length x4",
+        iterations,
+        [&] {
+            std::size_t total = 0;
+            auto b = encoded_lengths.begin();
+            while (b != encoded_lengths.end()) {
+                auto val_consumed = MQTT_NS::variable_length(b, encoded_lengths.end());
+                total += std::get<0>(val_consumed);
+                std::advance(b, static_cast<std::ptrdiff_t>(std::get<1>(val_consumed)));
+            }
+            return total;
+        }
+    );
+
+    auto raw_props = encode(props);
+    bench(
+        "property::parse_one x3",
+        iterations,
+        [&] {
+            std::size_t total = 0;
+            auto buf = raw_props;
+            while (auto pv = MQTT_NS::v5::property::parse_one(buf)) {
+                total += MQTT_NS::v5::size(pv.value());
+            }
+            return total;
+        }
+    );
+
+    std::string const ascii = "factory/line1/sensor/temperature";
+    std::string const utf8 = u8"工場/ライン1/センサー/温度";
+    bench(
+        "utf8string::validate_contents ascii",
+        iterations,
+        [&] {
+            return static_cast<std::size_t>(MQTT_NS::utf8string::validate_contents(ascii));
+        }
+    );
+    bench(
+        "utf8string::validate_contents utf8",
+        iterations,
+        [&] {
+            return static_cast<std::size_t>(MQTT_NS::utf8string::validate_contents(utf8));
+        }
+    );
+
+    as::io_context ioc;
+    using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+    using endpoint_t = MQTT_NS::callable_overlay<MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2>>;
+    endpoint_t ep(std::make_shared<socket_t>(ioc), MQTT_NS::protocol_version::v3_1_1);
+    // Keep some packet ids in use, as a client that has messages in flight.
+    for (std::size_t i = 0; i != 100; ++i) ep.acquire_unique_packet_id();
+    bench(
+        "acquire/release packet id",
+        iterations,
+        [&] {
+            auto id = ep.acquire_unique_packet_id();
+            ep.release_packet_id(id);
+            return static_cast<std::size_t>(id);
+        }
+    );
+}
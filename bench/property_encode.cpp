@@ -0,0 +1,165 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares writing v5 publish messages with user properties as one const buffer
+// per property piece (length prefixes, keys and values) and as one contiguous
+// property block. The messages are written to a local socket pair.
+//
+// Usage: bench_property_encode [messages]
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <boost/asio.hpp>
+
+#include <mqtt/v5_message.hpp>
+
+namespace as = boost::asio;
+
+using namespace MQTT_NS::literals;
+
+MQTT_NS::v5::properties make_props(std::size_t user_properties) {
+    MQTT_NS::v5::properties props;
+    props.emplace_back(MQTT_NS::v5::property::content_type("application/json"_mb));
+    for (std::size_t i = 0; i != user_properties; ++i) {
+        props.emplace_back(
+            MQTT_NS::v5::property::user_property(
+                MQTT_NS::allocate_buffer("key" + std::to_string(i)),
+                MQTT_NS::allocate_buffer("value" + std::to_string(i))
+            )
+        );
+    }
+    return props;
+}
+
+// The layout that adds the buffers of each property.
+// header is fixed header, remaining length, topic name length, topic name, and property length.
+void add_per_property(
+    std::vector<as::const_buffer>& v,
+    std::vector<as::const_buffer> const& header,
+    MQTT_NS::v5::properties const& props,
+    as::const_buffer payload) {
+    v.insert(v.end(), header.begin(), header.end());
+    for (auto const& p : props) {
+        MQTT_NS::v5::add_const_buffer_sequence(v, p);
+    }
+    v.push_back(payload);
+}
+
+// Cost of encoding the properties when the message is built.
+double encode_ns(std::size_t messages, MQTT_NS::v5::properties const& props) {
+    std::size_t len = 0;
+    for (auto const& p : props) len += MQTT_NS::v5::size(p);
+    std::size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != messages; ++i) {
+        total += MQTT_NS::v5::detail::encode_properties(props, len).size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (total != len * messages) std::abort();
+    return
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+        static_cast<double>(messages);
+}
+
+struct result {
+    std::size_t buffers;
+    double ns_per_message;
+};
+
+template <typename Gather>
+result run(std::size_t messages, Gather gather) {
+    as::io_context ioc;
+    as::local::stream_protocol::socket writer(ioc);
+    as::local::stream_protocol::socket reader(ioc);
+    as::local::connect_pair(writer, reader);
+
+    std::thread t(
+        [&] {
+            std::vector<char> buf(65536);
+            boost::system::error_code ec;
+            while (!ec) reader.read_some(as::buffer(buf), ec);
+        }
+    );
+
+    std::vector<as::const_buffer> v;
+    std::size_t buffers = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != messages; ++i) {
+        v.clear();
+        gather(v);
+        buffers = v.size();
+        as::write(writer, v);
+    }
+    auto end = std::chrono::steady_clock::now();
+    writer.close();
+    t.join();
+    return {
+        buffers,
+        static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+        static_cast<double>(messages)
+    };
+}
+
+int main(int argc, char** argv) {
+    std::size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    std::string const payload(64, 'x');
+
+    std::cout
+        << std::left << std::setw(16) << "user_properties"
+        << std::right
+        << std::setw(12) << "buffers"
+        << std::setw(12) << "ns/msg"
+        << std::setw(12) << "buffers"
+        << std::setw(12) << "ns/msg"
+        << std::setw(12) << "encode ns"
+        << "\n"
+        << std::left << std::setw(16) << ""
+        << std::right
+        << std::setw(24) << "per property"
+        << std::setw(36) << "contiguous"
+        << "\n"
+        << std::fixed << std::setprecision(1);
+
+    for (std::size_t n : { 0U, 3U, 10U, 30U }) {
+        auto props = make_props(n);
+        MQTT_NS::v5::publish_message m(
+            0,
+            as::buffer("sensor/telemetry", 16),
+            as::buffer(payload),
+            MQTT_NS::qos::at_most_once,
+            props
+        );
+
+        std::vector<as::const_buffer> whole;
+        m.add_const_buffer_sequence(whole);
+        std::vector<as::const_buffer> header(whole.begin(), std::next(whole.begin(), 5));
+
+        auto per_property = run(
+            messages,
+            [&](std::vector<as::const_buffer>& v) { add_per_property(v, header, props, whole.back()); }
+        );
+        auto contiguous = run(
+            messages,
+            [&](std::vector<as::const_buffer>& v) { m.add_const_buffer_sequence(v); }
+        );
+
+        std::cout
+            << std::left << std::setw(16) << n
+            << std::right
+            << std::setw(12) << per_property.buffers
+            << std::setw(12) << per_property.ns_per_message
+            << std::setw(12) << contiguous.buffers
+            << std::setw(12) << contiguous.ns_per_message
+            << std::setw(12) << encode_ns(messages, props)
+            << "\n";
+    }
+}
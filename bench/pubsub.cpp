@@ -0,0 +1,630 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// End-to-end throughput and latency of publish through the test broker.
+// The broker, the subscribers, and the publishers run on their own io_context
+// and thread. Each publisher publishes to its own topic, and every subscriber
+// subscribes all the topics, so each message is delivered to all subscribers.
+// The payload carries the send time, and the latency is measured on delivery.
+// Each publisher keeps at most `window` messages that are not delivered yet.
+//
+// All combinations of the comma separated values are measured. The table is
+// written to stderr, and the results are written to stdout (or `json`) as JSON
+// so that they can be compared between commits.
+//
+// Usage: bench_pubsub [key=value ...]
+//   transport=tcp,loopback   tcp, tls, ws, loopback (tls and ws need MQTT_USE_TLS and MQTT_USE_WS)
+//   client=async             sync, async
+//   qos=0,1                  0, 1, 2
+//   payload=64               payload bytes (at least 12)
+//   queue=1                  set_max_queue_send_count() of the clients and the broker, 0 is unlimited
+//   publishers=1
+//   subscribers=1
+//   messages=20000           messages per publisher
+//   window=16                undelivered messages per publisher
+//   timeout=60               seconds per case
+//   certs=.                  directory of server.crt.pem, server.key.pem, and cacert.pem
+//   json=                    output file of the results (default stdout)
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "../test/test_broker.hpp"
+
+#include <mqtt_client_cpp.hpp>
+
+namespace {
+
+struct options {
+    std::vector<std::string> transports { "tcp", "loopback" };
+    std::vector<std::string> clients { "async" };
+    std::vector<std::size_t> qoss { 0, 1 };
+    std::vector<std::size_t> payloads { 64 };
+    std::vector<std::size_t> queues { 1 };
+    std::size_t publishers = 1;
+    std::size_t subscribers = 1;
+    std::size_t messages = 20000;
+    std::size_t window = 16;
+    std::size_t timeout = 60;
+    std::string certs = ".";
+    std::string json;
+};
+
+struct params {
+    std::string transport;
+    bool async;
+    MQTT_NS::qos qos;
+    std::size_t payload;
+    std::size_t queue;
+};
+
+struct result {
+    double seconds;
+    double msgs_per_sec;
+    double mb_per_sec;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+};
+
+std::vector<std::string> split(std::string const& s) {
+    std::vector<std::string> v;
+    std::istringstream is(s);
+    std::string e;
+    while (std::getline(is, e, ',')) {
+        if (!e.empty()) v.push_back(e);
+    }
+    return v;
+}
+
+std::vector<std::size_t> split_numbers(std::string const& s) {
+    std::vector<std::size_t> v;
+    for (auto const& e : split(s)) v.push_back(std::strtoul(e.c_str(), nullptr, 10));
+    return v;
+}
+
+options parse(int argc, char** argv) {
+    options o;
+    for (int i = 1; i != argc; ++i) {
+        std::string arg(argv[i]);
+        auto pos = arg.find('=');
+        if (pos == std::string::npos) {
+            std::cerr << "invalid argument: " << arg << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        auto key = arg.substr(0, pos);
+        auto val = arg.substr(pos + 1);
+        if (key == "transport") o.transports = split(val);
+        else if (key == "client") o.clients = split(val);
+        else if (key == "qos") o.qoss = split_numbers(val);
+        else if (key == "payload") o.payloads = split_numbers(val);
+        else if (key == "queue") o.queues = split_numbers(val);
+        else if (key == "publishers") o.publishers = std::strtoul(val.c_str(), nullptr, 10);
+        else if (key == "subscribers") o.subscribers = std::strtoul(val.c_str(), nullptr, 10);
+        else if (key == "messages") o.messages = std::strtoul(val.c_str(), nullptr, 10);
+        else if (key == "window") o.window = std::strtoul(val.c_str(), nullptr, 10);
+        else if (key == "timeout") o.timeout = std::strtoul(val.c_str(), nullptr, 10);
+        else if (key == "certs") o.certs = val;
+        else if (key == "json") o.json = val;
+        else {
+            std::cerr << "unknown option: " << key << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    if (o.publishers == 0 || o.subscribers == 0 || o.messages == 0 || o.window == 0) {
+        std::cerr << "publishers, subscribers, messages, and window must not be 0" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return o;
+}
+
+// The payload starts with the send time and the publisher index.
+constexpr std::size_t header_size = sizeof(std::int64_t) + sizeof(std::uint32_t);
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Connection and publish operations of the sync and the async APIs.
+// The tag selects the API, so that the deleted functions of async_client are not instantiated.
+
+template <typename Client>
+void do_connect(Client& c, std::string const& id, std::false_type) {
+    c->set_client_id(id);
+    c->set_clean_session(true);
+    c->connect();
+}
+
+template <typename Client>
+void do_connect(Client& c, std::string const& id, std::true_type) {
+    c->set_client_id(id);
+    c->set_clean_session(true);
+    c->async_connect();
+}
+
+using loopback_endpoint_sp = std::shared_ptr<MQTT_NS::server_loopback<>::endpoint_t>;
+
+void do_connect(loopback_endpoint_sp& c, std::string const& id, std::false_type) {
+    c->start_session();
+    c->connect(id, MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+}
+
+void do_connect(loopback_endpoint_sp& c, std::string const& id, std::true_type) {
+    c->start_session();
+    c->async_connect(MQTT_NS::allocate_buffer(id), MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+}
+
+template <typename Client>
+void do_subscribe(Client& c, MQTT_NS::buffer topic, MQTT_NS::qos qos, std::false_type) {
+    c->subscribe(std::string(topic), qos);
+}
+
+template <typename Client>
+void do_subscribe(Client& c, MQTT_NS::buffer topic, MQTT_NS::qos qos, std::true_type) {
+    c->async_subscribe(MQTT_NS::force_move(topic), qos);
+}
+
+template <typename Client>
+void do_publish(Client& c, MQTT_NS::buffer topic, MQTT_NS::buffer contents, MQTT_NS::qos qos, std::false_type) {
+    c->publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(contents), qos);
+}
+
+template <typename Client>
+void do_publish(Client& c, MQTT_NS::buffer topic, MQTT_NS::buffer contents, MQTT_NS::qos qos, std::true_type) {
+    c->async_publish(MQTT_NS::force_move(topic), MQTT_NS::force_move(contents), qos);
+}
+
+template <typename Client>
+void do_disconnect(Client& c, std::false_type) {
+    c->disconnect();
+}
+
+template <typename Client>
+void do_disconnect(Client& c, std::true_type) {
+    c->async_disconnect();
+}
+
+double percentile_us(std::vector<std::int64_t>& v, double p) {
+    if (v.empty()) return 0;
+    auto n = static_cast<std::size_t>(p * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), std::next(v.begin(), static_cast<std::ptrdiff_t>(n)), v.end());
+    return static_cast<double>(v[n]) / 1000.0;
+}
+
+// Runs one case.
+// Transport provides listen(ioc, accept_handler) and make_client(ioc, async_tag).
+template <bool Async, typename Transport>
+result run(options const& o, params const& p, Transport& transport) {
+    using async_t = std::integral_constant<bool, Async>;
+
+    as::io_context ioc_broker;
+    as::io_context ioc_sub;
+    as::io_context ioc_pub;
+
+    test_broker b(ioc_broker);
+    transport.listen(
+        ioc_broker,
+        [&](con_sp_t spep) {
+            spep->set_max_queue_send_count(p.queue);
+            b.handle_accept(MQTT_NS::force_move(spep));
+        }
+    );
+
+    as::steady_timer watchdog(ioc_broker, std::chrono::seconds(o.timeout));
+    watchdog.async_wait(
+        [&](MQTT_NS::error_code ec) {
+            if (ec) return;
+            std::cerr << "timeout: " << p.transport << " qos=" << static_cast<int>(p.qos) << std::endl;
+            std::abort();
+        }
+    );
+    std::thread th_broker([&] { ioc_broker.run(); });
+
+    using client_t = decltype(transport.make_client(ioc_pub, async_t()));
+
+    std::vector<MQTT_NS::buffer> topics;
+    for (std::size_t i = 0; i != o.publishers; ++i) {
+        topics.push_back(MQTT_NS::allocate_buffer("bench/" + std::to_string(i)));
+    }
+
+    std::size_t const expected = o.publishers * o.messages * o.subscribers;
+    std::size_t const payload = std::max(p.payload, header_size);
+    // The number of the connacks of the publishers and the subacks of the subscribers.
+    std::atomic<std::size_t> pending(o.publishers + o.subscribers * o.publishers);
+    std::vector<std::size_t> sent(o.publishers);
+    std::unique_ptr<std::atomic<std::size_t>[]> delivered(new std::atomic<std::size_t>[o.publishers]);
+    for (std::size_t i = 0; i != o.publishers; ++i) delivered[i] = 0;
+    std::vector<std::int64_t> latencies;
+    latencies.reserve(expected);
+    std::int64_t start = 0;
+    std::int64_t end = 0;
+
+    std::vector<client_t> pubs;
+    std::vector<client_t> subs;
+    pubs.reserve(o.publishers);
+    subs.reserve(o.subscribers);
+
+    // Called on ioc_pub
+    auto pump =
+        [&](std::size_t i) {
+            while (sent[i] != o.messages && sent[i] - delivered[i] / o.subscribers < o.window) {
+                auto spa = MQTT_NS::make_shared_ptr_array(payload);
+                auto ptr = spa.get();
+                auto t = now_ns();
+                auto idx = static_cast<std::uint32_t>(i);
+                std::memcpy(ptr, &t, sizeof(t));
+                std::memcpy(ptr + sizeof(t), &idx, sizeof(idx));
+                std::memset(ptr + header_size, 'x', payload - header_size);
+                ++sent[i];
+                do_publish(
+                    pubs[i],
+                    topics[i],
+                    MQTT_NS::buffer(MQTT_NS::string_view(ptr, payload), MQTT_NS::force_move(spa)),
+                    p.qos,
+                    async_t()
+                );
+            }
+        };
+
+    auto ready =
+        [&] {
+            if (--pending != 0) return;
+            as::post(
+                ioc_pub,
+                [&] {
+                    start = now_ns();
+                    for (std::size_t i = 0; i != o.publishers; ++i) pump(i);
+                }
+            );
+        };
+
+    auto error =
+        [](MQTT_NS::error_code ec) {
+            std::cerr << "error: " << ec.message() << std::endl;
+        };
+
+    for (std::size_t i = 0; i != o.subscribers; ++i) {
+        subs.push_back(transport.make_client(ioc_sub, async_t()));
+        auto& c = subs.back();
+        c->set_max_queue_send_count(p.queue);
+        c->set_error_handler(error);
+        c->set_connack_handler(
+            [&c, &topics, &p]
+            (bool, MQTT_NS::connect_return_code) {
+                for (auto const& t : topics) do_subscribe(c, t, p.qos, async_t());
+                return true;
+            });
+        c->set_suback_handler(
+            [&]
+            (std::uint16_t, std::vector<MQTT_NS::suback_return_code>) {
+                ready();
+                return true;
+            });
+        c->set_publish_handler(
+            [&]
+            (MQTT_NS::optional<std::uint16_t>,
+             MQTT_NS::publish_options,
+             MQTT_NS::buffer,
+             MQTT_NS::buffer contents) {
+                std::int64_t t;
+                std::uint32_t idx;
+                std::memcpy(&t, contents.data(), sizeof(t));
+                std::memcpy(&idx, contents.data() + sizeof(t), sizeof(idx));
+                latencies.push_back(now_ns() - t);
+                if (++delivered[idx] % o.subscribers == 0) {
+                    as::post(ioc_pub, [&pump, idx] { pump(idx); });
+                }
+                if (latencies.size() == expected) {
+                    end = now_ns();
+                    as::post(ioc_pub, [&] { for (auto& c : pubs) do_disconnect(c, async_t()); });
+                    for (auto& c : subs) do_disconnect(c, async_t());
+                }
+                return true;
+            });
+    }
+    for (std::size_t i = 0; i != o.publishers; ++i) {
+        pubs.push_back(transport.make_client(ioc_pub, async_t()));
+        auto& c = pubs.back();
+        c->set_max_queue_send_count(p.queue);
+        c->set_error_handler(error);
+        c->set_connack_handler(
+            [&]
+            (bool, MQTT_NS::connect_return_code) {
+                ready();
+                return true;
+            });
+    }
+
+    for (std::size_t i = 0; i != o.subscribers; ++i) do_connect(subs[i], "sub" + std::to_string(i), async_t());
+    for (std::size_t i = 0; i != o.publishers; ++i) do_connect(pubs[i], "pub" + std::to_string(i), async_t());
+
+    std::thread th_sub([&] { ioc_sub.run(); });
+    ioc_pub.run();
+    th_sub.join();
+    ioc_broker.stop();
+    th_broker.join();
+    // The timer belongs to ioc_broker, so it is touched only after th_broker has finished.
+    watchdog.cancel();
+    transport.close();
+
+    result r;
+    r.seconds = static_cast<double>(end - start) / 1e9;
+    r.msgs_per_sec = static_cast<double>(expected) / r.seconds;
+    r.mb_per_sec = r.msgs_per_sec * static_cast<double>(payload) / 1e6;
+    r.p50_us = percentile_us(latencies, 0.5);
+    r.p99_us = percentile_us(latencies, 0.99);
+    r.p999_us = percentile_us(latencies, 0.999);
+    return r;
+}
+
+// Transports
+// make_client() is called after listen().
+
+class tcp_transport {
+public:
+    template <typename AcceptHandler>
+    void listen(as::io_context& ioc, AcceptHandler&& h) {
+        s_ = std::make_unique<MQTT_NS::server<>>(
+            as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0),
+            ioc
+        );
+        s_->set_accept_handler(std::forward<AcceptHandler>(h));
+        s_->set_error_handler([](MQTT_NS::error_code) {});
+        s_->listen();
+    }
+
+    void close() {
+        s_.reset();
+    }
+
+    auto make_client(as::io_context& ioc, std::false_type) {
+        return MQTT_NS::make_sync_client(ioc, "127.0.0.1", s_->port());
+    }
+
+    auto make_client(as::io_context& ioc, std::true_type) {
+        return MQTT_NS::make_async_client(ioc, "127.0.0.1", s_->port());
+    }
+
+private:
+    std::unique_ptr<MQTT_NS::server<>> s_;
+};
+
+class loopback_transport {
+public:
+    template <typename AcceptHandler>
+    void listen(as::io_context& ioc, AcceptHandler&& h) {
+        s_ = std::make_unique<MQTT_NS::server_loopback<>>(ioc);
+        s_->set_accept_handler(std::forward<AcceptHandler>(h));
+        s_->listen();
+    }
+
+    void close() {
+        s_.reset();
+    }
+
+    template <typename AsyncTag>
+    loopback_endpoint_sp make_client(as::io_context& ioc, AsyncTag) {
+        return s_->connect(ioc);
+    }
+
+private:
+    std::unique_ptr<MQTT_NS::server_loopback<>> s_;
+};
+
+#if defined(MQTT_USE_TLS)
+
+class tls_transport {
+public:
+    explicit tls_transport(std::string certs)
+        : certs_(MQTT_NS::force_move(certs)) {}
+
+    template <typename AcceptHandler>
+    void listen(as::io_context& ioc, AcceptHandler&& h) {
+        as::ssl::context ctx(as::ssl::context::tlsv12);
+        ctx.set_options(
+            as::ssl::context::default_workarounds |
+            as::ssl::context::single_dh_use);
+        ctx.use_certificate_file(certs_ + "/server.crt.pem", as::ssl::context::pem);
+        ctx.use_private_key_file(certs_ + "/server.key.pem", as::ssl::context::pem);
+        s_ = std::make_unique<MQTT_NS::server_tls<>>(
+            as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0),
+            MQTT_NS::force_move(ctx),
+            ioc
+        );
+        s_->set_accept_handler(std::forward<AcceptHandler>(h));
+        s_->set_error_handler([](MQTT_NS::error_code) {});
+        s_->listen();
+    }
+
+    void close() {
+        s_.reset();
+    }
+
+    auto make_client(as::io_context& ioc, std::false_type) {
+        auto c = MQTT_NS::make_tls_sync_client(ioc, "localhost", s_->port());
+        c->get_ssl_context().load_verify_file(certs_ + "/cacert.pem");
+        return c;
+    }
+
+    auto make_client(as::io_context& ioc, std::true_type) {
+        auto c = MQTT_NS::make_tls_async_client(ioc, "localhost", s_->port());
+        c->get_ssl_context().load_verify_file(certs_ + "/cacert.pem");
+        return c;
+    }
+
+private:
+    std::string certs_;
+    std::unique_ptr<MQTT_NS::server_tls<>> s_;
+};
+
+#endif // defined(MQTT_USE_TLS)
+
+#if defined(MQTT_USE_WS)
+
+class ws_transport {
+public:
+    template <typename AcceptHandler>
+    void listen(as::io_context& ioc, AcceptHandler&& h) {
+        s_ = std::make_unique<MQTT_NS::server_ws<>>(
+            as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0),
+            ioc
+        );
+        s_->set_accept_handler(std::forward<AcceptHandler>(h));
+        s_->set_error_handler([](MQTT_NS::error_code) {});
+        s_->listen();
+    }
+
+    void close() {
+        s_.reset();
+    }
+
+    auto make_client(as::io_context& ioc, std::false_type) {
+        return MQTT_NS::make_sync_client_ws(ioc, "127.0.0.1", s_->port());
+    }
+
+    auto make_client(as::io_context& ioc, std::true_type) {
+        return MQTT_NS::make_async_client_ws(ioc, "127.0.0.1", s_->port());
+    }
+
+private:
+    std::unique_ptr<MQTT_NS::server_ws<>> s_;
+};
+
+#endif // defined(MQTT_USE_WS)
+
+template <typename Transport>
+result run(options const& o, params const& p, Transport&& transport) {
+    if (p.async) return run<true>(o, p, transport);
+    return run<false>(o, p, transport);
+}
+
+result run(options const& o, params const& p) {
+    if (p.transport == "tcp") return run(o, p, tcp_transport());
+    if (p.transport == "loopback") return run(o, p, loopback_transport());
+#if defined(MQTT_USE_TLS)
+    if (p.transport == "tls") return run(o, p, tls_transport(o.certs));
+#endif // defined(MQTT_USE_TLS)
+#if defined(MQTT_USE_WS)
+    if (p.transport == "ws") return run(o, p, ws_transport());
+#endif // defined(MQTT_USE_WS)
+    std::cerr << "unsupported transport: " << p.transport << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    auto o = parse(argc, argv);
+
+    std::ostringstream json;
+    json
+        << "{\n"
+        << "  \"benchmark\": \"pubsub\",\n"
+        << "  \"publishers\": " << o.publishers << ",\n"
+        << "  \"subscribers\": " << o.subscribers << ",\n"
+        << "  \"messages\": " << o.messages << ",\n"
+        << "  \"window\": " << o.window << ",\n"
+        << "  \"results\": ["
+        << std::fixed << std::setprecision(3);
+
+    std::cerr
+        << std::left
+        << std::setw(10) << "transport"
+        << std::setw(7) << "client"
+        << std::right
+        << std::setw(5) << "qos"
+        << std::setw(9) << "payload"
+        << std::setw(7) << "queue"
+        << std::setw(12) << "msgs/s"
+        << std::setw(10) << "MB/s"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(10) << "p999 us"
+        << "\n"
+        << std::fixed << std::setprecision(1);
+
+    bool first = true;
+    for (auto const& transport : o.transports) {
+        for (auto const& client : o.clients) {
+            for (auto qos : o.qoss) {
+                for (auto payload : o.payloads) {
+                    for (auto queue : o.queues) {
+                        if (qos > 2 || (client != "sync" && client != "async")) {
+                            std::cerr << "invalid qos or client" << std::endl;
+                            return EXIT_FAILURE;
+                        }
+                        params p {
+                            transport,
+                            client == "async",
+                            static_cast<MQTT_NS::qos>(qos),
+                            std::max(payload, header_size),
+                            queue
+                        };
+                        auto r = run(o, p);
+
+                        std::cerr
+                            << std::left
+                            << std::setw(10) << transport
+                            << std::setw(7) << client
+                            << std::right
+                            << std::setw(5) << qos
+                            << std::setw(9) << p.payload
+                            << std::setw(7) << queue
+                            << std::setw(12) << r.msgs_per_sec
+                            << std::setw(10) << r.mb_per_sec
+                            << std::setw(10) << r.p50_us
+                            << std::setw(10) << r.p99_us
+                            << std::setw(10) << r.p999_us
+                            << std::endl;
+
+                        json
+                            << (first ? "\n" : ",\n")
+                            << "    {"
+                            << "\"transport\": \"" << transport << "\", "
+                            << "\"client\": \"" << client << "\", "
+                            << "\"qos\": " << qos << ", "
+                            << "\"payload\": " << p.payload << ", "
+                            << "\"queue\": " << queue << ", "
+                            << "\"seconds\": " << r.seconds << ", "
+                            << "\"msgs_per_sec\": " << r.msgs_per_sec << ", "
+                            << "\"mb_per_sec\": " << r.mb_per_sec << ", "
+                            << "\"latency_us\": {"
+                            << "\"p50\": " << r.p50_us << ", "
+                            << "\"p99\": " << r.p99_us << ", "
+                            << "\"p999\": " << r.p999_us
+                            << "}}";
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (o.json.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream ofs(o.json);
+        ofs << json.str();
+    }
+}
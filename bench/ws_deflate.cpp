@@ -0,0 +1,162 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares CPU time and bytes on the wire of WebSocket messages with
+// permessage-deflate settings. The messages are JSON telemetry.
+//
+// Usage: bench_ws_deflate [messages]
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <boost/asio.hpp>
+
+#include <mqtt/ws_endpoint.hpp>
+#include <mqtt/optional.hpp>
+
+namespace as = boost::asio;
+
+using endpoint_t = MQTT_NS::ws_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using peer_t = boost::beast::websocket::stream<as::ip::tcp::socket>;
+
+struct config {
+    char const* name;
+    MQTT_NS::optional<MQTT_NS::ws_deflate_options> deflate;
+};
+
+std::string reading(std::mt19937& gen, std::size_t device) {
+    std::uniform_real_distribution<double> temp(15.0, 30.0);
+    std::uniform_real_distribution<double> humidity(20.0, 80.0);
+    std::uniform_int_distribution<int> battery(0, 100);
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2)
+       << "{\"device\":\"sensor-" << std::setw(4) << std::setfill('0') << device
+       << "\",\"ts\":" << 1600000000000ULL + gen() % 1000000
+       << ",\"temperature\":" << temp(gen)
+       << ",\"humidity\":" << humidity(gen)
+       << ",\"battery\":" << battery(gen)
+       << ",\"status\":\"ok\"}";
+    return os.str();
+}
+
+// readings_per_message readings are sent as a JSON array.
+std::vector<std::string> make_messages(std::size_t messages, std::size_t readings_per_message) {
+    std::mt19937 gen(1);
+    std::vector<std::string> ret;
+    ret.reserve(messages);
+    for (std::size_t i = 0; i != messages; ++i) {
+        std::string m = "[";
+        for (std::size_t r = 0; r != readings_per_message; ++r) {
+            if (r != 0) m += ',';
+            m += reading(gen, (i * readings_per_message + r) % 1000);
+        }
+        m += ']';
+        ret.push_back(std::move(m));
+    }
+    return ret;
+}
+
+void run(config const& c, std::vector<std::string> const& messages) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    peer_t peer(ioc);
+    endpoint_t ep(ioc);
+    if (c.deflate) {
+        boost::beast::websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        peer.set_option(pmd);
+        ep.set_deflate(*c.deflate);
+    }
+    ep.lowest_layer().connect(ac.local_endpoint());
+    ac.accept(peer.next_layer());
+    peer.async_accept([](MQTT_NS::error_code) {});
+    ep.async_handshake("localhost", "/", [](MQTT_NS::error_code) {});
+    ioc.run();
+
+    // Count the bytes on the wire without decoding them.
+    std::size_t wire = 0;
+    std::thread reader(
+        [&] {
+            std::vector<char> buf(64 * 1024);
+            MQTT_NS::error_code ec;
+            while (!ec) {
+                wire += peer.next_layer().read_some(as::buffer(buf), ec);
+            }
+        }
+    );
+
+    std::size_t payload = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const& m : messages) {
+        MQTT_NS::write(ep, std::vector<as::const_buffer>{ as::buffer(m) });
+        payload += m.size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    ep.lowest_layer().shutdown(as::ip::tcp::socket::shutdown_send);
+    reader.join();
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    std::cout
+        << std::left << std::setw(24) << c.name << std::right << std::fixed
+        << std::setw(12) << std::setprecision(0) << static_cast<double>(ns) / messages.size()
+        << std::setw(12) << std::setprecision(1) << static_cast<double>(payload) / messages.size()
+        << std::setw(12) << std::setprecision(1) << static_cast<double>(wire) / messages.size()
+        << std::setw(9) << std::setprecision(3) << static_cast<double>(wire) / payload
+        << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+
+    std::vector<config> configs;
+    configs.push_back({ "off", MQTT_NS::nullopt });
+    configs.push_back({ "default", MQTT_NS::ws_deflate_options() });
+    {
+        MQTT_NS::ws_deflate_options o;
+        o.comp_level = 1;
+        configs.push_back({ "level 1", o });
+    }
+    {
+        MQTT_NS::ws_deflate_options o;
+        o.window_bits = 9;
+        o.mem_level = 1;
+        configs.push_back({ "window 9, mem 1", o });
+    }
+    {
+        MQTT_NS::ws_deflate_options o;
+        o.no_context_takeover = true;
+        configs.push_back({ "no context takeover", o });
+    }
+    {
+        MQTT_NS::ws_deflate_options o;
+        o.threshold = 256;
+        configs.push_back({ "threshold 256", o });
+    }
+
+    for (std::size_t readings : { 1, 32 }) {
+        auto m = make_messages(messages, readings);
+        std::cout
+            << readings << " reading(s) per message, " << messages << " messages\n"
+            << std::left << std::setw(24) << "deflate" << std::right
+            << std::setw(12) << "ns/msg"
+            << std::setw(12) << "bytes/msg"
+            << std::setw(12) << "wire/msg"
+            << std::setw(9) << "ratio"
+            << std::endl;
+        for (auto const& c : configs) run(c, m);
+        std::cout << std::endl;
+    }
+#if BOOST_VERSION < 107900
+    std::cout << "threshold requires Boost 1.79.0 or later, it is ignored." << std::endl;
+#endif // BOOST_VERSION < 107900
+}
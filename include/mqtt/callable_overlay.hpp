@@ -398,6 +398,35 @@ struct callable_overlay final : public Impl
                                 MQTT_NS::force_move(props));
     }
 
+    /**
+     * @brief Publish handler with the encoded properties
+     *        It is called instead of on_v5_publish() while v5_publish_view_handler is set.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is MQTT_NS::nullopt.
+     * @param pubopts
+     *        qos, retain flag, and dup flag.
+     * @param topic_name
+     *        Topic name
+     * @param contents
+     *        Publish Payload
+     * @param props
+     *        View of the properties
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     */
+    MQTT_ALWAYS_INLINE bool on_v5_publish_view(MQTT_NS::optional<packet_id_t> packet_id,
+                                               MQTT_NS::publish_options pubopts,
+                                               MQTT_NS::buffer topic_name,
+                                               MQTT_NS::buffer contents,
+                                               v5::property_view props) noexcept override final {
+        return    ! h_v5_publish_view_
+               || h_v5_publish_view_(packet_id,
+                                     pubopts,
+                                     MQTT_NS::force_move(topic_name),
+                                     MQTT_NS::force_move(contents),
+                                     MQTT_NS::force_move(props));
+    }
+
     /**
      * @brief Puback handler
      * @param packet_id
@@ -716,6 +745,24 @@ struct callable_overlay final : public Impl
         if (h_pre_send_) h_pre_send_();
     }
 
+    /**
+     * @brief Queue high watermark handler
+     *        This handler is called when the outbound queue reaches the high watermark.
+     */
+    MQTT_ALWAYS_INLINE void on_queue_high_watermark() noexcept override final {
+        base::on_queue_high_watermark();
+        if (h_queue_high_watermark_) h_queue_high_watermark_();
+    }
+
+    /**
+     * @brief Queue low watermark handler
+     *        This handler is called when the congested outbound queue falls to the low watermark.
+     */
+    MQTT_ALWAYS_INLINE void on_queue_low_watermark() noexcept override final {
+        base::on_queue_low_watermark();
+        if (h_queue_low_watermark_) h_queue_low_watermark_();
+    }
+
     /**
      * @brief is valid length handler
      *        This handler is called when remaining length is received.
@@ -1059,6 +1106,29 @@ struct callable_overlay final : public Impl
              v5::properties props)
     >;
 
+    /**
+     * @brief Publish handler with the encoded properties
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is MQTT_NS::nullopt.
+     * @param pubopts
+     *        qos, retain flag, and dup flag.
+     * @param topic_name
+     *        Topic name
+     * @param contents
+     *        Publish Payload
+     * @param props
+     *        View of the properties. They are decoded on demand.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     */
+    using v5_publish_view_handler = std::function<
+        bool(MQTT_NS::optional<packet_id_t> packet_id,
+             MQTT_NS::publish_options pubopts,
+             MQTT_NS::buffer topic_name,
+             MQTT_NS::buffer contents,
+             v5::property_view props)
+    >;
+
     /**
      * @brief Puback handler
      * @param packet_id
@@ -1367,6 +1437,22 @@ struct callable_overlay final : public Impl
      */
     using pre_send_handler = std::function<void()>;
 
+    /**
+     * @brief Queue high watermark handler
+     *        This handler is called when the outbound queue reaches the high watermark.
+     *        It is called in the thread that calls the async send function.
+     *        See endpoint::set_queue_watermarks().
+     */
+    using queue_high_watermark_handler = std::function<void()>;
+
+    /**
+     * @brief Queue low watermark handler
+     *        This handler is called when the congested outbound queue falls to the low watermark.
+     *        It is called in the completion handler of the write.
+     *        See endpoint::set_queue_watermarks().
+     */
+    using queue_low_watermark_handler = std::function<void()>;
+
     /**
      * @brief is valid length handler
      *        This handler is called when remaining length is received.
@@ -1643,6 +1729,16 @@ struct callable_overlay final : public Impl
         h_v5_publish_ = force_move(h);
     }
 
+    /**
+     * @brief Set publish handler with the encoded properties
+     *        While it is set, it is called instead of v5_publish_handler.
+     * @param h handler
+     */
+    void set_v5_publish_view_handler(v5_publish_view_handler h = v5_publish_view_handler()) {
+        base::set_publish_property_view(static_cast<bool>(h));
+        h_v5_publish_view_ = force_move(h);
+    }
+
     /**
      * @brief Set puback handler
      * @param h handler
@@ -1747,6 +1843,14 @@ struct callable_overlay final : public Impl
         return h_v5_publish_;
     }
 
+    /**
+     * @brief Get publish handler with the encoded properties
+     * @return handler
+     */
+    v5_publish_view_handler const& get_v5_publish_view_handler() const {
+        return h_v5_publish_view_;
+    }
+
     /**
      * @brief Get puback handler
      * @return handler
@@ -1945,6 +2049,22 @@ struct callable_overlay final : public Impl
         h_pre_send_ = force_move(h);
     }
 
+    /**
+     * @brief Set queue high watermark handler
+     * @param h handler
+     */
+    void set_queue_high_watermark_handler(queue_high_watermark_handler h = queue_high_watermark_handler()) {
+        h_queue_high_watermark_ = force_move(h);
+    }
+
+    /**
+     * @brief Set queue low watermark handler
+     * @param h handler
+     */
+    void set_queue_low_watermark_handler(queue_low_watermark_handler h = queue_low_watermark_handler()) {
+        h_queue_low_watermark_ = force_move(h);
+    }
+
     /**
      * @brief Set check length handler
      * @param h handler
@@ -2009,6 +2129,22 @@ struct callable_overlay final : public Impl
         return h_pre_send_;
     }
 
+    /**
+     * @brief Get queue high watermark handler
+     * @return handler
+     */
+    queue_high_watermark_handler const& get_queue_high_watermark_handler() const {
+        return h_queue_high_watermark_;
+    }
+
+    /**
+     * @brief Get queue low watermark handler
+     * @return handler
+     */
+    queue_low_watermark_handler const& get_queue_low_watermark_handler() const {
+        return h_queue_low_watermark_;
+    }
+
     /**
      * @brief Get check length handler
      * @return handler
@@ -2102,6 +2238,7 @@ private:
     v5_connect_handler h_v5_connect_;
     v5_connack_handler h_v5_connack_;
     v5_publish_handler h_v5_publish_;
+    v5_publish_view_handler h_v5_publish_view_;
     v5_puback_handler h_v5_puback_;
     v5_pubrec_handler h_v5_pubrec_;
     v5_pubrel_handler h_v5_pubrel_;
@@ -2123,6 +2260,8 @@ private:
     serialize_v5_pubrel_message_handler h_serialize_v5_pubrel_;
     serialize_remove_handler h_serialize_remove_;
     pre_send_handler h_pre_send_;
+    queue_high_watermark_handler h_queue_high_watermark_;
+    queue_low_watermark_handler h_queue_low_watermark_;
     is_valid_length_handler h_is_valid_length_;
     mqtt_message_processed_handler h_mqtt_message_processed_;
 }; // callable_overlay
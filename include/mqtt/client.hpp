@@ -39,6 +39,10 @@
 #include <mqtt/ws_endpoint.hpp>
 #endif // defined(MQTT_USE_WS)
 
+#if defined(MQTT_USE_TLS)
+#include <mqtt/tls_session.hpp>
+#endif // defined(MQTT_USE_TLS)
+
 #include <mqtt/endpoint.hpp>
 #include <mqtt/null_strand.hpp>
 #include <mqtt/move.hpp>
@@ -353,8 +357,57 @@ public:
         static_assert(has_tls<std::decay_t<decltype(*this)>>::value, "Client is required to support TLS.");
         return ctx_;
     }
+
+    /**
+     * @brief Set TLS session reuse.
+     * @param reuse if true, the TLS session of the last connection is resumed at the next connection.
+     *
+     * The resumed handshake skips the certificate exchange and the key agreement, if the broker
+     * accepts the session. The session is kept in the ssl context (See get_ssl_context()).<BR>
+     * The default value is false.
+     */
+    void set_tls_session_reuse(bool reuse) {
+        static_assert(has_tls<std::decay_t<decltype(*this)>>::value, "Client is required to support TLS.");
+        if (reuse) tls_session_.attach(ctx_);
+        else tls_session_.detach(ctx_);
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that didn't resume a session.
+     * @return the number of full handshakes
+     */
+    std::size_t tls_full_handshakes() const {
+        static_assert(has_tls<std::decay_t<decltype(*this)>>::value, "Client is required to support TLS.");
+        return tls_handshakes_.full();
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that resumed a session.
+     * @return the number of resumed handshakes
+     */
+    std::size_t tls_resumed_handshakes() const {
+        static_assert(has_tls<std::decay_t<decltype(*this)>>::value, "Client is required to support TLS.");
+        return tls_handshakes_.resumed();
+    }
 #endif // defined(MQTT_USE_TLS)
 
+#if defined(MQTT_USE_WS)
+
+    /**
+     * @brief Set permessage-deflate settings.
+     * @param opts deflate settings
+     *
+     * The settings are offered at the next WebSocket handshake, and the messages are
+     * compressed if the broker accepts them.<BR>
+     * By default, permessage-deflate is disabled.
+     */
+    void set_ws_deflate(ws_deflate_options opts) {
+        static_assert(has_ws<std::decay_t<decltype(*this)>>::value, "Client is required to support WebSocket.");
+        ws_deflate_ = force_move(opts);
+    }
+
+#endif // defined(MQTT_USE_WS)
+
 
     /**
      * @brief Set a keep alive second and a ping duration.
@@ -1019,6 +1072,7 @@ private:
     template <typename Strand>
     void setup_socket(std::shared_ptr<ws_endpoint<as::ip::tcp::socket, Strand>>& socket) {
         socket = std::make_shared<Socket>(ioc_);
+        if (ws_deflate_) socket->set_deflate(*ws_deflate_);
         base::socket_optional().emplace(socket);
     }
 #endif // defined(MQTT_USE_WS)
@@ -1034,6 +1088,7 @@ private:
     template <typename Strand>
     void setup_socket(std::shared_ptr<ws_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>>& socket) {
         socket = std::make_shared<Socket>(ioc_, ctx_);
+        if (ws_deflate_) socket->set_deflate(*ws_deflate_);
         base::socket_optional().emplace(socket);
     }
 #endif // defined(MQTT_USE_WS)
@@ -1122,7 +1177,9 @@ private:
         tcp_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>& socket,
         v5::properties props,
         any session_life_keeper) {
+        tls_session_.apply(socket.native_handle());
         socket.handshake(as::ssl::stream_base::client);
+        tls_handshakes_.count(socket.native_handle());
         start_session(force_move(props), force_move(session_life_keeper));
     }
 
@@ -1132,8 +1189,10 @@ private:
         v5::properties props,
         any session_life_keeper,
         error_code& ec) {
+        tls_session_.apply(socket.native_handle());
         socket.handshake(as::ssl::stream_base::client, ec);
         if (ec) return;
+        tls_handshakes_.count(socket.native_handle());
         start_session(force_move(props), force_move(session_life_keeper));
     }
 
@@ -1144,7 +1203,9 @@ private:
         ws_endpoint<as::ssl::stream<as::ip::tcp::socket>, Strand>& socket,
         v5::properties props,
         any session_life_keeper) {
+        tls_session_.apply(socket.next_layer().native_handle());
         socket.next_layer().handshake(as::ssl::stream_base::client);
+        tls_handshakes_.count(socket.next_layer().native_handle());
         socket.handshake(host_, path_);
         start_session(force_move(props), force_move(session_life_keeper));
     }
@@ -1155,8 +1216,10 @@ private:
         v5::properties props,
         any session_life_keeper,
         error_code& ec) {
+        tls_session_.apply(socket.next_layer().native_handle());
         socket.next_layer().handshake(as::ssl::stream_base::client, ec);
         if (ec) return;
+        tls_handshakes_.count(socket.next_layer().native_handle());
         socket.handshake(host_, path_, ec);
         if (ec) return;
         start_session(force_move(props), force_move(session_life_keeper));
@@ -1208,16 +1271,19 @@ private:
         v5::properties props,
         any session_life_keeper,
         async_handler_t func) {
+        tls_session_.apply(socket.native_handle());
         socket.async_handshake(
             as::ssl::stream_base::client,
             [
                 this,
                 self = this->shared_from_this(),
                 session_life_keeper = force_move(session_life_keeper),
+                &socket,
                 props = force_move(props),
                 func = force_move(func)
             ]
             (error_code ec) mutable {
+                if (!ec) tls_handshakes_.count(socket.native_handle());
                 if (func) func(ec);
                 if (ec) return;
                 start_session(force_move(props), force_move(session_life_keeper));
@@ -1231,6 +1297,7 @@ private:
         v5::properties props,
         any session_life_keeper,
         async_handler_t func) {
+        tls_session_.apply(socket.next_layer().native_handle());
         socket.next_layer().async_handshake(
             as::ssl::stream_base::client,
             [
@@ -1246,6 +1313,7 @@ private:
                     if (func) func(ec);
                     return;
                 }
+                tls_handshakes_.count(socket.next_layer().native_handle());
                 socket.async_handshake(
                     host_,
                     path_,
@@ -1403,6 +1471,18 @@ private:
 
 #endif // defined(MQTT_USE_TLS)
 
+#if defined(MQTT_USE_WS)
+
+    template <typename T>
+    struct has_ws : std::false_type {
+    };
+
+    template <typename U, typename Strand, std::size_t Bytes>
+    struct has_ws<client<ws_endpoint<U, Strand>, Bytes>> : std::true_type {
+    };
+
+#endif // defined(MQTT_USE_WS)
+
     std::shared_ptr<Socket> socket_;
     as::io_context& ioc_;
     as::steady_timer tim_ping_;
@@ -1418,9 +1498,12 @@ private:
     bool async_pingreq_ = false;
 #if defined(MQTT_USE_TLS)
     as::ssl::context ctx_{as::ssl::context::tlsv12};
+    tls_client_session tls_session_;
+    tls_handshake_counter tls_handshakes_;
 #endif // defined(MQTT_USE_TLS)
 #if defined(MQTT_USE_WS)
     std::string path_;
+    optional<ws_deflate_options> ws_deflate_;
 #endif // defined(MQTT_USE_WS)
 };
 
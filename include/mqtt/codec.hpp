@@ -0,0 +1,1017 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_CODEC_HPP)
+#define MQTT_CODEC_HPP
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/connect_flags.hpp>
+#include <mqtt/connect_return_code.hpp>
+#include <mqtt/const_buffer_util.hpp>
+#include <mqtt/control_packet_type.hpp>
+#include <mqtt/exception.hpp>
+#include <mqtt/fixed_header.hpp>
+#include <mqtt/message.hpp>
+#include <mqtt/message_variant.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/packet_id_type.hpp>
+#include <mqtt/property_parse.hpp>
+#include <mqtt/property_view.hpp>
+#include <mqtt/protocol_version.hpp>
+#include <mqtt/publish.hpp>
+#include <mqtt/reason_code.hpp>
+#include <mqtt/session_present.hpp>
+#include <mqtt/shared_ptr_array.hpp>
+#include <mqtt/subscribe_options.hpp>
+#include <mqtt/two_byte_util.hpp>
+#include <mqtt/utf8encoded_strings.hpp>
+#include <mqtt/v5_message.hpp>
+#include <mqtt/variable_length.hpp>
+#include <mqtt/will.hpp>
+
+/**
+ * Sans-IO codec
+ * It encodes and decodes MQTT packets without sockets, so that the packets can be
+ * used over any I/O, e.g. a custom event loop or captured packets.
+ */
+
+namespace MQTT_NS {
+
+namespace codec {
+
+/**
+ * @brief Add one byte of a variable length integer to the value
+ * @param v value. Set 0 before the first byte.
+ * @param multiplier multiplier. Set 1 before the first byte.
+ * @param c byte
+ * @return false if the integer is longer than 4 bytes
+ */
+inline bool add_variable_length_byte(std::size_t& v, std::size_t& multiplier, char c) {
+    v += (static_cast<std::size_t>(c) & 0b01111111) * multiplier;
+    multiplier *= 128;
+    return multiplier <= 128 * 128 * 128 * 128;
+}
+
+/**
+ * @brief Check the remaining length of the packet
+ * @tparam PacketIdBytes the size of packet id
+ * @param version protocol version
+ * @param type control packet type
+ * @param remaining_length remaining length
+ * @param check_variable function that checks the remaining length of the packets that have
+ *        variable length. bool(control_packet_type, std::size_t)
+ * @return true if the remaining length is valid
+ */
+template <std::size_t PacketIdBytes, typename CheckVariable>
+inline bool check_remaining_length(
+    protocol_version version,
+    control_packet_type type,
+    std::size_t remaining_length,
+    CheckVariable&& check_variable) {
+    switch (version) {
+    case protocol_version::v3_1_1:
+        switch (type) {
+        case control_packet_type::connect:
+        case control_packet_type::publish:
+        case control_packet_type::subscribe:
+        case control_packet_type::suback:
+        case control_packet_type::unsubscribe:
+            return check_variable(type, remaining_length);
+        case control_packet_type::connack:
+            return remaining_length == 2;
+        case control_packet_type::puback:
+        case control_packet_type::pubrec:
+        case control_packet_type::pubrel:
+        case control_packet_type::pubcomp:
+        case control_packet_type::unsuback:
+            return remaining_length == PacketIdBytes;
+        case control_packet_type::pingreq:
+        case control_packet_type::pingresp:
+        case control_packet_type::disconnect:
+            return remaining_length == 0;
+        default:
+            return false;
+        }
+    case protocol_version::v5:
+    default:
+        switch (type) {
+        case control_packet_type::connect:
+        case control_packet_type::publish:
+        case control_packet_type::subscribe:
+        case control_packet_type::suback:
+        case control_packet_type::unsubscribe:
+        case control_packet_type::connack:
+        case control_packet_type::puback:
+        case control_packet_type::pubrec:
+        case control_packet_type::pubrel:
+        case control_packet_type::pubcomp:
+        case control_packet_type::unsuback:
+        case control_packet_type::disconnect:
+        case control_packet_type::auth:
+            return check_variable(type, remaining_length);
+        case control_packet_type::pingreq:
+        case control_packet_type::pingresp:
+            return remaining_length == 0;
+        default:
+            return false;
+        }
+    }
+}
+
+/**
+ * @brief Received packet
+ * It holds the whole packet in a shared storage. The buffers share it.
+ */
+class packet {
+public:
+    packet(buffer all, std::size_t header_size)
+        : all_(force_move(all)), header_size_(header_size) {}
+
+    std::uint8_t fixed_header() const {
+        return static_cast<std::uint8_t>(all_.front());
+    }
+
+    control_packet_type type() const {
+        return get_control_packet_type(fixed_header());
+    }
+
+    /**
+     * @brief Get the whole packet
+     * @return the fixed header, the remaining length, the variable header, and the payload
+     */
+    buffer const& all() const {
+        return all_;
+    }
+
+    /**
+     * @brief Get the packet without the fixed header and the remaining length
+     * @return the variable header and the payload
+     */
+    buffer body() const {
+        return all_.substr(header_size_);
+    }
+
+    std::size_t remaining_length() const {
+        return all_.size() - header_size_;
+    }
+
+private:
+    buffer all_;
+    std::size_t header_size_;
+};
+
+/**
+ * @brief Decoder that splits received bytes into packets
+ *        Push the received bytes by feed(), and pull the packets by next().
+ *        Each packet is copied once into its own storage, so the packets
+ *        and the buffers of the packets can outlive the decoder.
+ * @tparam PacketIdBytes the size of packet id
+ */
+template <std::size_t PacketIdBytes>
+class basic_decoder {
+public:
+    /**
+     * @brief constructor
+     * @param version protocol version
+     * @param maximum_packet_size the maximum size of the whole packet
+     */
+    explicit basic_decoder(
+        protocol_version version,
+        std::size_t maximum_packet_size = std::numeric_limits<std::size_t>::max())
+        : version_(version), maximum_packet_size_(maximum_packet_size) {}
+
+    /**
+     * @brief Push received bytes
+     *        All bytes are consumed. The decoder can't be used after it throws.
+     * @param data received bytes
+     * @param size the size of data
+     * @throw variable_length_error if the remaining length is longer than 4 bytes
+     * @throw remaining_length_error if the remaining length is invalid for the packet,
+     *        or the packet is larger than the maximum packet size.
+     */
+    void feed(char const* data, std::size_t size) {
+        while (size != 0) {
+            if (!spa_) {
+                auto c = *data++;
+                --size;
+                if (header_size_ == sizeof(header_)) throw variable_length_error();
+                header_[header_size_++] = c;
+                if (header_size_ == 1) {
+                    remaining_length_ = 0;
+                    multiplier_ = 1;
+                    continue;
+                }
+                if (!add_variable_length_byte(remaining_length_, multiplier_, c)) {
+                    throw variable_length_error();
+                }
+                if (c & 0b10000000) continue;
+                start_body();
+            }
+            else {
+                auto len = std::min(size, total_size_ - received_);
+                std::memcpy(spa_.get() + received_, data, len);
+                received_ += len;
+                data += len;
+                size -= len;
+                if (received_ == total_size_) finish_packet();
+            }
+        }
+    }
+
+    /**
+     * @brief Get the next decoded packet
+     * @return the packet, or nullopt if no packet is completed yet
+     */
+    optional<packet> next() {
+        if (packets_.empty()) return nullopt;
+        optional<packet> p(force_move(packets_.front()));
+        packets_.pop_front();
+        return p;
+    }
+
+    /**
+     * @brief Check that a packet is partially received
+     * @return true if the decoder is in the middle of a packet
+     */
+    bool partial() const {
+        return header_size_ != 0;
+    }
+
+    protocol_version get_protocol_version() const {
+        return version_;
+    }
+
+private:
+    void start_body() {
+        auto type = get_control_packet_type(static_cast<std::uint8_t>(header_[0]));
+        if (!check_remaining_length<PacketIdBytes>(
+                version_,
+                type,
+                remaining_length_,
+                [](control_packet_type, std::size_t) { return true; })) {
+            throw remaining_length_error();
+        }
+        total_size_ = header_size_ + remaining_length_;
+        if (total_size_ > maximum_packet_size_) throw remaining_length_error();
+        spa_ = make_shared_ptr_array(total_size_);
+        std::memcpy(spa_.get(), header_, header_size_);
+        received_ = header_size_;
+        if (received_ == total_size_) finish_packet();
+    }
+
+    void finish_packet() {
+        packets_.emplace_back(buffer(string_view(spa_.get(), total_size_), spa_), header_size_);
+        spa_.reset();
+        header_size_ = 0;
+    }
+
+    protocol_version version_;
+    std::size_t maximum_packet_size_;
+    char header_[5];
+    std::size_t header_size_ = 0;
+    std::size_t remaining_length_ = 0;
+    std::size_t multiplier_ = 1;
+    shared_ptr_array spa_;
+    std::size_t total_size_ = 0;
+    std::size_t received_ = 0;
+    std::deque<packet> packets_;
+};
+
+using decoder = basic_decoder<2>;
+
+/**
+ * @brief Get the packet id of the packet
+ * @tparam PacketIdBytes the size of packet id
+ * @param p packet
+ * @return packet id, or nullopt if the packet doesn't have packet id
+ */
+template <std::size_t PacketIdBytes>
+inline optional<typename packet_id_type<PacketIdBytes>::type> get_packet_id(packet const& p) {
+    auto body = p.body();
+    switch (p.type()) {
+    case control_packet_type::publish: {
+        if (publish::get_qos(p.fixed_header()) == qos::at_most_once) return nullopt;
+        if (body.size() < 2) throw remaining_length_error();
+        auto topic_name_length = make_uint16_t(body.begin(), std::next(body.begin(), 2));
+        body.remove_prefix(2);
+        if (body.size() < topic_name_length) throw remaining_length_error();
+        body.remove_prefix(topic_name_length);
+    } break;
+    case control_packet_type::puback:
+    case control_packet_type::pubrec:
+    case control_packet_type::pubrel:
+    case control_packet_type::pubcomp:
+    case control_packet_type::subscribe:
+    case control_packet_type::suback:
+    case control_packet_type::unsubscribe:
+    case control_packet_type::unsuback:
+        break;
+    default:
+        return nullopt;
+    }
+    if (body.size() < PacketIdBytes) throw remaining_length_error();
+    return make_packet_id<PacketIdBytes>::apply(
+        body.begin(),
+        std::next(body.begin(), PacketIdBytes)
+    );
+}
+
+/**
+ * @brief Decode the v3.1.1 PUBLISH packet
+ *        The topic name and the payload share the storage of the packet.
+ * @param p packet
+ * @return message
+ */
+template <std::size_t PacketIdBytes>
+inline MQTT_NS::v3_1_1::basic_publish_message<PacketIdBytes> decode_v3_1_1_publish(packet const& p) {
+    if (p.type() != control_packet_type::publish) throw protocol_error();
+    return MQTT_NS::v3_1_1::basic_publish_message<PacketIdBytes>(p.all());
+}
+
+/**
+ * @brief Decode the v5 PUBLISH packet
+ *        The topic name, the properties and the payload share the storage of the packet.
+ * @param p packet
+ * @return message
+ */
+template <std::size_t PacketIdBytes>
+inline MQTT_NS::v5::basic_publish_message<PacketIdBytes> decode_v5_publish(packet const& p) {
+    if (p.type() != control_packet_type::publish) throw protocol_error();
+    return MQTT_NS::v5::basic_publish_message<PacketIdBytes>(p.all());
+}
+
+/**
+ * @brief Get the protocol version of the CONNECT packet
+ * @param p packet
+ * @return protocol version. It is not checked that the version is supported.
+ */
+inline protocol_version get_protocol_version(packet const& p) {
+    static constexpr char protocol_name[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T' };
+    if (p.type() != control_packet_type::connect) throw protocol_error();
+    auto body = p.body();
+    if (body.size() < sizeof(protocol_name) + 1) throw remaining_length_error();
+    if (std::memcmp(body.data(), protocol_name, sizeof(protocol_name)) != 0) throw protocol_error();
+    return static_cast<protocol_version>(body[sizeof(protocol_name)]);
+}
+
+namespace detail {
+
+inline void check_type(packet const& p, control_packet_type type) {
+    if (p.type() != type) throw protocol_error();
+}
+
+inline void check_consumed(buffer const& buf) {
+    if (!buf.empty()) throw remaining_length_error();
+}
+
+inline std::uint8_t decode_uint8(buffer& buf) {
+    if (buf.empty()) throw remaining_length_error();
+    auto v = static_cast<std::uint8_t>(buf.front());
+    buf.remove_prefix(1);
+    return v;
+}
+
+inline std::uint16_t decode_uint16(buffer& buf) {
+    if (buf.size() < 2) throw remaining_length_error();
+    auto v = make_uint16_t(buf.begin(), std::next(buf.begin(), 2));
+    buf.remove_prefix(2);
+    return v;
+}
+
+template <std::size_t PacketIdBytes>
+inline typename packet_id_type<PacketIdBytes>::type decode_packet_id(buffer& buf) {
+    if (buf.size() < PacketIdBytes) throw remaining_length_error();
+    auto v = make_packet_id<PacketIdBytes>::apply(buf.begin(), std::next(buf.begin(), PacketIdBytes));
+    buf.remove_prefix(PacketIdBytes);
+    return v;
+}
+
+inline buffer decode_binary(buffer& buf) {
+    auto size = decode_uint16(buf);
+    if (buf.size() < size) throw remaining_length_error();
+    auto b = buf.substr(0, size);
+    buf.remove_prefix(size);
+    return b;
+}
+
+inline buffer decode_string(buffer& buf) {
+    auto b = decode_binary(buf);
+    auto r = utf8string::validate_contents(b);
+    if (r != utf8string::validation::well_formed) throw utf8string_contents_error(r);
+    return b;
+}
+
+inline buffer decode_raw_properties(buffer& buf) {
+    auto len_consumed = variable_length(buf.begin(), buf.end());
+    auto consumed = std::get<1>(len_consumed);
+    if (consumed == 0 || (buf[consumed - 1] & 0b10000000)) throw property_length_error();
+    buf.remove_prefix(consumed);
+    auto size = std::get<0>(len_consumed);
+    if (buf.size() < size) throw property_length_error();
+    auto b = buf.substr(0, size);
+    buf.remove_prefix(size);
+    return b;
+}
+
+inline MQTT_NS::v5::properties parse_properties(buffer raw) {
+    MQTT_NS::v5::properties props;
+    while (!raw.empty()) {
+        auto prop = MQTT_NS::v5::property::parse_one(raw);
+        if (!prop) throw property_parse_error();
+        props.push_back(force_move(prop.value()));
+    }
+    return props;
+}
+
+inline MQTT_NS::v5::properties decode_properties(buffer& buf) {
+    return parse_properties(decode_raw_properties(buf));
+}
+
+template <typename ReasonCode>
+inline std::vector<ReasonCode> decode_reason_codes(buffer const& buf) {
+    std::vector<ReasonCode> codes;
+    codes.reserve(buf.size());
+    for (auto c : buf) codes.push_back(static_cast<ReasonCode>(c));
+    return codes;
+}
+
+struct connect_fields {
+    buffer client_id;
+    optional<buffer> user_name;
+    optional<buffer> password;
+    optional<will> w;
+    bool clean_session;
+    std::uint16_t keep_alive;
+    MQTT_NS::v5::properties props;
+};
+
+inline connect_fields decode_connect(packet const& p, protocol_version version) {
+    if (get_protocol_version(p) != version) throw protocol_error();
+    auto buf = p.body();
+    buf.remove_prefix(
+        2 +  // string length
+        4 +  // "MQTT" string
+        1    // ProtocolVersion
+    );
+    auto flags = static_cast<char>(decode_uint8(buf));
+    connect_fields f;
+    f.clean_session = connect_flags::has_clean_session(flags);
+    f.keep_alive = decode_uint16(buf);
+    if (version == protocol_version::v5) f.props = decode_properties(buf);
+    f.client_id = decode_string(buf);
+    if (connect_flags::has_will_flag(flags)) {
+        MQTT_NS::v5::properties will_props;
+        if (version == protocol_version::v5) will_props = decode_properties(buf);
+        auto will_topic = decode_string(buf);
+        auto will_payload = decode_binary(buf);
+        f.w.emplace(
+            force_move(will_topic),
+            force_move(will_payload),
+            connect_flags::has_will_retain(flags) | connect_flags::will_qos(flags),
+            force_move(will_props)
+        );
+    }
+    if (connect_flags::has_user_name_flag(flags)) f.user_name = decode_string(buf);
+    if (connect_flags::has_password_flag(flags)) f.password = decode_binary(buf);
+    check_consumed(buf);
+    return f;
+}
+
+template <std::size_t PacketIdBytes>
+struct publish_fields {
+    optional<typename packet_id_type<PacketIdBytes>::type> packet_id;
+    publish_options opts;
+    buffer topic_name;
+};
+
+template <std::size_t PacketIdBytes>
+inline publish_fields<PacketIdBytes> decode_publish_header(packet const& p, buffer& buf) {
+    check_type(p, control_packet_type::publish);
+    publish_fields<PacketIdBytes> f { nullopt, publish_options(p.fixed_header()), buffer() };
+    f.topic_name = decode_string(buf);
+    switch (f.opts.get_qos()) {
+    case qos::at_most_once:
+        break;
+    case qos::at_least_once:
+    case qos::exactly_once:
+        f.packet_id.emplace(decode_packet_id<PacketIdBytes>(buf));
+        break;
+    default:
+        throw protocol_error();
+    }
+    return f;
+}
+
+inline std::vector<std::tuple<buffer, subscribe_options>> decode_subscribe_entries(buffer& buf) {
+    std::vector<std::tuple<buffer, subscribe_options>> entries;
+    do {
+        auto topic_filter = decode_string(buf);
+        subscribe_options option(decode_uint8(buf));
+        switch (option.get_qos()) {
+        case qos::at_most_once:
+        case qos::at_least_once:
+        case qos::exactly_once:
+            break;
+        default:
+            throw protocol_error();
+        }
+        entries.emplace_back(force_move(topic_filter), option);
+    } while (!buf.empty());
+    return entries;
+}
+
+inline std::vector<buffer> decode_unsubscribe_entries(buffer& buf) {
+    std::vector<buffer> entries;
+    do {
+        entries.emplace_back(decode_string(buf));
+    } while (!buf.empty());
+    return entries;
+}
+
+template <std::size_t PacketIdBytes, typename Ack>
+inline Ack decode_v3_1_1_ack(packet const& p, control_packet_type type) {
+    check_type(p, type);
+    auto buf = p.body();
+    Ack r { decode_packet_id<PacketIdBytes>(buf) };
+    check_consumed(buf);
+    return r;
+}
+
+// https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901126
+// If the Remaining Length is 0, the reason code is success (0x00).
+// If the Remaining Length is less than 4, there is no property length.
+template <std::size_t PacketIdBytes, typename Ack>
+inline Ack decode_v5_ack(packet const& p, control_packet_type type) {
+    using reason_code_t = decltype(Ack::reason_code);
+    check_type(p, type);
+    auto buf = p.body();
+    Ack r { decode_packet_id<PacketIdBytes>(buf), static_cast<reason_code_t>(0), MQTT_NS::v5::properties() };
+    if (buf.empty()) return r;
+    r.reason_code = static_cast<reason_code_t>(decode_uint8(buf));
+    if (buf.empty()) return r;
+    r.props = decode_properties(buf);
+    check_consumed(buf);
+    return r;
+}
+
+} // namespace detail
+
+/**
+ * Typed decoders
+ * They decode the packet into the values that the endpoint passes to the handlers.
+ * The buffers share the storage of the packet.
+ * They throw protocol_error if the packet is not the expected type or breaks the protocol,
+ * utf8string_contents_error if a string is not well formed UTF-8,
+ * remaining_length_error, property_length_error, or property_parse_error if the packet is truncated,
+ * or has extra bytes.
+ */
+
+namespace v3_1_1 {
+
+struct connect_packet {
+    buffer client_id;
+    optional<buffer> user_name;
+    optional<buffer> password;
+    optional<will> w;
+    bool clean_session;
+    std::uint16_t keep_alive;
+};
+
+struct connack_packet {
+    bool session_present;
+    connect_return_code return_code;
+};
+
+template <std::size_t PacketIdBytes>
+struct publish_packet {
+    optional<typename packet_id_type<PacketIdBytes>::type> packet_id;
+    publish_options opts;
+    buffer topic_name;
+    buffer payload;
+};
+
+/**
+ * @brief PUBACK, PUBREC, PUBREL, PUBCOMP, and UNSUBACK
+ */
+template <std::size_t PacketIdBytes>
+struct ack_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+};
+
+template <std::size_t PacketIdBytes>
+struct subscribe_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<std::tuple<buffer, subscribe_options>> entries;
+};
+
+template <std::size_t PacketIdBytes>
+struct suback_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<suback_return_code> return_codes;
+};
+
+template <std::size_t PacketIdBytes>
+struct unsubscribe_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<buffer> entries;
+};
+
+struct disconnect_packet {
+};
+
+inline connect_packet decode_connect(packet const& p) {
+    auto f = detail::decode_connect(p, protocol_version::v3_1_1);
+    return {
+        force_move(f.client_id),
+        force_move(f.user_name),
+        force_move(f.password),
+        force_move(f.w),
+        f.clean_session,
+        f.keep_alive
+    };
+}
+
+inline connack_packet decode_connack(packet const& p) {
+    detail::check_type(p, control_packet_type::connack);
+    auto buf = p.body();
+    connack_packet r;
+    r.session_present = is_session_present(static_cast<char>(detail::decode_uint8(buf)));
+    r.return_code = static_cast<connect_return_code>(detail::decode_uint8(buf));
+    detail::check_consumed(buf);
+    return r;
+}
+
+template <std::size_t PacketIdBytes>
+inline publish_packet<PacketIdBytes> decode_publish(packet const& p) {
+    auto buf = p.body();
+    auto f = detail::decode_publish_header<PacketIdBytes>(p, buf);
+    return { f.packet_id, f.opts, force_move(f.topic_name), force_move(buf) };
+}
+
+template <std::size_t PacketIdBytes>
+inline ack_packet<PacketIdBytes> decode_puback(packet const& p) {
+    return detail::decode_v3_1_1_ack<PacketIdBytes, ack_packet<PacketIdBytes>>(p, control_packet_type::puback);
+}
+
+template <std::size_t PacketIdBytes>
+inline ack_packet<PacketIdBytes> decode_pubrec(packet const& p) {
+    return detail::decode_v3_1_1_ack<PacketIdBytes, ack_packet<PacketIdBytes>>(p, control_packet_type::pubrec);
+}
+
+template <std::size_t PacketIdBytes>
+inline ack_packet<PacketIdBytes> decode_pubrel(packet const& p) {
+    return detail::decode_v3_1_1_ack<PacketIdBytes, ack_packet<PacketIdBytes>>(p, control_packet_type::pubrel);
+}
+
+template <std::size_t PacketIdBytes>
+inline ack_packet<PacketIdBytes> decode_pubcomp(packet const& p) {
+    return detail::decode_v3_1_1_ack<PacketIdBytes, ack_packet<PacketIdBytes>>(p, control_packet_type::pubcomp);
+}
+
+template <std::size_t PacketIdBytes>
+inline subscribe_packet<PacketIdBytes> decode_subscribe(packet const& p) {
+    detail::check_type(p, control_packet_type::subscribe);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    return { packet_id, detail::decode_subscribe_entries(buf) };
+}
+
+template <std::size_t PacketIdBytes>
+inline suback_packet<PacketIdBytes> decode_suback(packet const& p) {
+    detail::check_type(p, control_packet_type::suback);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    return { packet_id, detail::decode_reason_codes<suback_return_code>(buf) };
+}
+
+template <std::size_t PacketIdBytes>
+inline unsubscribe_packet<PacketIdBytes> decode_unsubscribe(packet const& p) {
+    detail::check_type(p, control_packet_type::unsubscribe);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    return { packet_id, detail::decode_unsubscribe_entries(buf) };
+}
+
+template <std::size_t PacketIdBytes>
+inline ack_packet<PacketIdBytes> decode_unsuback(packet const& p) {
+    return detail::decode_v3_1_1_ack<PacketIdBytes, ack_packet<PacketIdBytes>>(p, control_packet_type::unsuback);
+}
+
+inline disconnect_packet decode_disconnect(packet const& p) {
+    detail::check_type(p, control_packet_type::disconnect);
+    detail::check_consumed(p.body());
+    return {};
+}
+
+} // namespace v3_1_1
+
+namespace v5 {
+
+struct connect_packet {
+    buffer client_id;
+    optional<buffer> user_name;
+    optional<buffer> password;
+    optional<will> w;
+    bool clean_start;
+    std::uint16_t keep_alive;
+    MQTT_NS::v5::properties props;
+};
+
+struct connack_packet {
+    bool session_present;
+    MQTT_NS::v5::connect_reason_code reason_code;
+    MQTT_NS::v5::properties props;
+};
+
+/**
+ * @brief PUBLISH
+ * raw_props is the properties before parsing. props is empty if the properties are not parsed.
+ */
+template <std::size_t PacketIdBytes>
+struct publish_packet {
+    optional<typename packet_id_type<PacketIdBytes>::type> packet_id;
+    publish_options opts;
+    buffer topic_name;
+    buffer payload;
+    buffer raw_props;
+    MQTT_NS::v5::properties props;
+};
+
+/**
+ * @brief PUBACK, PUBREC, PUBREL, and PUBCOMP
+ */
+template <std::size_t PacketIdBytes, typename ReasonCode>
+struct ack_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    ReasonCode reason_code;
+    MQTT_NS::v5::properties props;
+};
+
+template <std::size_t PacketIdBytes>
+using puback_packet = ack_packet<PacketIdBytes, MQTT_NS::v5::puback_reason_code>;
+template <std::size_t PacketIdBytes>
+using pubrec_packet = ack_packet<PacketIdBytes, MQTT_NS::v5::pubrec_reason_code>;
+template <std::size_t PacketIdBytes>
+using pubrel_packet = ack_packet<PacketIdBytes, MQTT_NS::v5::pubrel_reason_code>;
+template <std::size_t PacketIdBytes>
+using pubcomp_packet = ack_packet<PacketIdBytes, MQTT_NS::v5::pubcomp_reason_code>;
+
+template <std::size_t PacketIdBytes>
+struct subscribe_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<std::tuple<buffer, subscribe_options>> entries;
+    MQTT_NS::v5::properties props;
+};
+
+template <std::size_t PacketIdBytes>
+struct suback_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<MQTT_NS::v5::suback_reason_code> reason_codes;
+    MQTT_NS::v5::properties props;
+};
+
+template <std::size_t PacketIdBytes>
+struct unsubscribe_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<buffer> entries;
+    MQTT_NS::v5::properties props;
+};
+
+template <std::size_t PacketIdBytes>
+struct unsuback_packet {
+    typename packet_id_type<PacketIdBytes>::type packet_id;
+    std::vector<MQTT_NS::v5::unsuback_reason_code> reason_codes;
+    MQTT_NS::v5::properties props;
+};
+
+struct disconnect_packet {
+    MQTT_NS::v5::disconnect_reason_code reason_code;
+    MQTT_NS::v5::properties props;
+};
+
+struct auth_packet {
+    MQTT_NS::v5::auth_reason_code reason_code;
+    MQTT_NS::v5::properties props;
+};
+
+inline connect_packet decode_connect(packet const& p) {
+    auto f = detail::decode_connect(p, protocol_version::v5);
+    return {
+        force_move(f.client_id),
+        force_move(f.user_name),
+        force_move(f.password),
+        force_move(f.w),
+        f.clean_session,
+        f.keep_alive,
+        force_move(f.props)
+    };
+}
+
+inline connack_packet decode_connack(packet const& p) {
+    detail::check_type(p, control_packet_type::connack);
+    auto buf = p.body();
+    connack_packet r;
+    r.session_present = is_session_present(static_cast<char>(detail::decode_uint8(buf)));
+    r.reason_code = static_cast<MQTT_NS::v5::connect_reason_code>(detail::decode_uint8(buf));
+    r.props = detail::decode_properties(buf);
+    detail::check_consumed(buf);
+    return r;
+}
+
+/**
+ * @param p packet
+ * @param parse_props if false, the properties are only checked by property_view::well_formed()
+ *                    and set to raw_props, e.g. to make property_view.
+ */
+template <std::size_t PacketIdBytes>
+inline publish_packet<PacketIdBytes> decode_publish(packet const& p, bool parse_props = true) {
+    auto buf = p.body();
+    auto f = detail::decode_publish_header<PacketIdBytes>(p, buf);
+    auto raw_props = detail::decode_raw_properties(buf);
+    MQTT_NS::v5::properties props;
+    if (parse_props) {
+        props = detail::parse_properties(raw_props);
+    }
+    else if (!MQTT_NS::v5::property_view::well_formed(raw_props)) {
+        throw property_parse_error();
+    }
+    return {
+        f.packet_id,
+        f.opts,
+        force_move(f.topic_name),
+        force_move(buf),
+        force_move(raw_props),
+        force_move(props)
+    };
+}
+
+template <std::size_t PacketIdBytes>
+inline puback_packet<PacketIdBytes> decode_puback(packet const& p) {
+    return detail::decode_v5_ack<PacketIdBytes, puback_packet<PacketIdBytes>>(p, control_packet_type::puback);
+}
+
+template <std::size_t PacketIdBytes>
+inline pubrec_packet<PacketIdBytes> decode_pubrec(packet const& p) {
+    return detail::decode_v5_ack<PacketIdBytes, pubrec_packet<PacketIdBytes>>(p, control_packet_type::pubrec);
+}
+
+template <std::size_t PacketIdBytes>
+inline pubrel_packet<PacketIdBytes> decode_pubrel(packet const& p) {
+    return detail::decode_v5_ack<PacketIdBytes, pubrel_packet<PacketIdBytes>>(p, control_packet_type::pubrel);
+}
+
+template <std::size_t PacketIdBytes>
+inline pubcomp_packet<PacketIdBytes> decode_pubcomp(packet const& p) {
+    return detail::decode_v5_ack<PacketIdBytes, pubcomp_packet<PacketIdBytes>>(p, control_packet_type::pubcomp);
+}
+
+template <std::size_t PacketIdBytes>
+inline subscribe_packet<PacketIdBytes> decode_subscribe(packet const& p) {
+    detail::check_type(p, control_packet_type::subscribe);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    auto props = detail::decode_properties(buf);
+    auto entries = detail::decode_subscribe_entries(buf);
+    return { packet_id, force_move(entries), force_move(props) };
+}
+
+template <std::size_t PacketIdBytes>
+inline suback_packet<PacketIdBytes> decode_suback(packet const& p) {
+    detail::check_type(p, control_packet_type::suback);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    auto props = detail::decode_properties(buf);
+    return {
+        packet_id,
+        detail::decode_reason_codes<MQTT_NS::v5::suback_reason_code>(buf),
+        force_move(props)
+    };
+}
+
+template <std::size_t PacketIdBytes>
+inline unsubscribe_packet<PacketIdBytes> decode_unsubscribe(packet const& p) {
+    detail::check_type(p, control_packet_type::unsubscribe);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    auto props = detail::decode_properties(buf);
+    auto entries = detail::decode_unsubscribe_entries(buf);
+    return { packet_id, force_move(entries), force_move(props) };
+}
+
+template <std::size_t PacketIdBytes>
+inline unsuback_packet<PacketIdBytes> decode_unsuback(packet const& p) {
+    detail::check_type(p, control_packet_type::unsuback);
+    auto buf = p.body();
+    auto packet_id = detail::decode_packet_id<PacketIdBytes>(buf);
+    auto props = detail::decode_properties(buf);
+    return {
+        packet_id,
+        detail::decode_reason_codes<MQTT_NS::v5::unsuback_reason_code>(buf),
+        force_move(props)
+    };
+}
+
+// https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901209
+// If the Remaining Length is 0, the reason code is normal disconnection (0x00).
+// If the Remaining Length is less than 2, there is no property length.
+inline disconnect_packet decode_disconnect(packet const& p) {
+    detail::check_type(p, control_packet_type::disconnect);
+    auto buf = p.body();
+    disconnect_packet r { MQTT_NS::v5::disconnect_reason_code::normal_disconnection, MQTT_NS::v5::properties() };
+    if (buf.empty()) return r;
+    r.reason_code = static_cast<MQTT_NS::v5::disconnect_reason_code>(detail::decode_uint8(buf));
+    if (buf.empty()) return r;
+    r.props = detail::decode_properties(buf);
+    detail::check_consumed(buf);
+    return r;
+}
+
+inline auth_packet decode_auth(packet const& p) {
+    detail::check_type(p, control_packet_type::auth);
+    auto buf = p.body();
+    auth_packet r { MQTT_NS::v5::auth_reason_code::success, MQTT_NS::v5::properties() };
+    if (buf.empty()) return r;
+    r.reason_code = static_cast<MQTT_NS::v5::auth_reason_code>(detail::decode_uint8(buf));
+    if (buf.empty()) return r;
+    r.props = detail::decode_properties(buf);
+    detail::check_consumed(buf);
+    return r;
+}
+
+} // namespace v5
+
+/**
+ * @brief Encoder that writes messages into buffers provided by the caller
+ *        It keeps the buffer sequence between messages, so it doesn't allocate
+ *        once the sequence has grown.
+ */
+class encoder {
+public:
+    /**
+     * @brief Write the message into out
+     * @param m message, e.g. v5::publish_message, or message_variant
+     * @param out output buffer
+     * @param size the size of out
+     * @return the size of the written packet, or 0 if out is too small.
+     *         Nothing is written if out is too small.
+     */
+    template <typename Message>
+    std::size_t encode(Message const& m, char* out, std::size_t size) {
+        cbs_.clear();
+        add(m);
+        std::size_t total = 0;
+        for (auto const& cb : cbs_) total += get_size(cb);
+        if (total > size) return 0;
+        for (auto const& cb : cbs_) {
+            std::memcpy(out, get_pointer(cb), get_size(cb));
+            out += get_size(cb);
+        }
+        return total;
+    }
+
+    /**
+     * @brief Get the const buffer sequence of the message
+     *        The sequence is valid until the next call. Nothing is copied.
+     * @param m message, e.g. v5::publish_message, or message_variant
+     * @return const buffer sequence
+     */
+    template <typename Message>
+    std::vector<as::const_buffer> const& const_buffer_sequence(Message const& m) {
+        cbs_.clear();
+        add(m);
+        return cbs_;
+    }
+
+private:
+    template <typename Message>
+    void add(Message const& m) {
+        m.add_const_buffer_sequence(cbs_);
+    }
+
+    template <std::size_t PacketIdBytes>
+    void add(basic_message_variant<PacketIdBytes> const& mv) {
+        add_const_buffer_sequence(cbs_, mv);
+    }
+
+    std::vector<as::const_buffer> cbs_;
+};
+
+} // namespace codec
+
+} // namespace MQTT_NS
+
+#endif // MQTT_CODEC_HPP
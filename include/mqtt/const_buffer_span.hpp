@@ -0,0 +1,80 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_CONST_BUFFER_SPAN_HPP)
+#define MQTT_CONST_BUFFER_SPAN_HPP
+
+#include <cstddef>
+#include <type_traits>
+
+#if ASIO_STANDALONE
+#include <asio/buffer.hpp>
+#else
+#include <boost/asio/buffer.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+/**
+ * @brief Non-owning buffer sequence
+ * It refers to the contiguous const_buffer elements of std::vector, std::array,
+ * boost::container::static_vector, and so on. Copying it doesn't copy the elements,
+ * so the type erased socket takes it by value without allocation.
+ * The elements must be alive until the write is completed.
+ */
+class const_buffer_span {
+public:
+    using value_type = as::const_buffer;
+    using const_iterator = as::const_buffer const*;
+
+    const_buffer_span() = default;
+
+    const_buffer_span(as::const_buffer const* data, std::size_t size)
+        :data_(data), size_(size) {}
+
+    template <
+        typename Container,
+        typename std::enable_if_t<
+            std::is_same<typename Container::value_type, as::const_buffer>::value
+        >* = nullptr
+    >
+    const_buffer_span(Container const& c)
+        :data_(c.data()), size_(c.size()) {}
+
+    const_iterator begin() const {
+        return data_;
+    }
+
+    const_iterator end() const {
+        return data_ + size_;
+    }
+
+    as::const_buffer const* data() const {
+        return data_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    as::const_buffer const* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+static_assert(as::is_const_buffer_sequence<const_buffer_span>::value, "const_buffer_span must be a ConstBufferSequence");
+
+} // namespace MQTT_NS
+
+#endif // MQTT_CONST_BUFFER_SPAN_HPP
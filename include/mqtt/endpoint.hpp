@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <deque>
+#include <limits>
 #include <functional>
 #include <set>
 #include <memory>
@@ -41,6 +42,7 @@
 #include <mqtt/attributes.hpp>
 #include <mqtt/any.hpp>
 #include <mqtt/fixed_header.hpp>
+#include <mqtt/codec.hpp>
 #include <mqtt/remaining_length.hpp>
 #include <mqtt/utf8encoded_strings.hpp>
 #include <mqtt/connect_flags.hpp>
@@ -58,11 +60,15 @@
 #include <mqtt/packet_id_type.hpp>
 #include <mqtt/optional.hpp>
 #include <mqtt/property_variant.hpp>
+#include <mqtt/property_view.hpp>
 #include <mqtt/protocol_version.hpp>
 #include <mqtt/reason_code.hpp>
 #include <mqtt/buffer.hpp>
 #include <mqtt/shared_ptr_array.hpp>
 #include <mqtt/type_erased_socket.hpp>
+#include <mqtt/static_socket.hpp>
+#include <mqtt/const_buffer_span.hpp>
+#include <mqtt/mpsc_queue.hpp>
 #include <mqtt/move.hpp>
 #include <mqtt/deprecated.hpp>
 #include <mqtt/deprecated_msg.hpp>
@@ -161,9 +167,23 @@ namespace as = boost::asio;
 
 namespace mi = boost::multi_index;
 
-template <typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard, std::size_t PacketIdBytes = 2>
-class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes>> {
-    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes>;
+/**
+ * @brief What the endpoint does with a QoS0 PUBLISH sent while the outbound queue is congested
+ */
+enum class queue_overflow_policy {
+    enqueue,     ///< Queue it like the other messages.
+    drop_qos0,   ///< Discard it. The handler of the async function is called with success.
+    reject_qos0, ///< Discard it. The handler of the async function is called with no_buffer_space.
+};
+
+/**
+ * @brief MQTT endpoint
+ * @tparam Socket MQTT_NS::socket (type erased, default) or MQTT_NS::static_socket<T>.
+ *         static_socket removes the dynamic dispatch of the I/O path for the socket type T.
+ */
+template <typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard, std::size_t PacketIdBytes = 2, typename Socket = MQTT_NS::socket>
+class endpoint : public std::enable_shared_from_this<endpoint<Mutex, LockGuard, PacketIdBytes, Socket>> {
+    using this_type = endpoint<Mutex, LockGuard, PacketIdBytes, Socket>;
     using this_type_sp = std::shared_ptr<this_type>;
 
 public:
@@ -182,8 +202,8 @@ public:
      * @brief Constructor for server.
      *        socket should have already been connected with another endpoint.
      */
-    template <typename Socket>
-    explicit endpoint(std::shared_ptr<Socket> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
+    template <typename T>
+    explicit endpoint(std::shared_ptr<T> socket, protocol_version version = protocol_version::undetermined, bool async_send_store = false)
         :socket_(force_move(socket)),
          connected_(true),
          async_send_store_{async_send_store},
@@ -490,6 +510,33 @@ private:
                                MQTT_NS::buffer contents,
                                v5::properties props) noexcept = 0;
 
+    /**
+     * @brief Publish handler with the encoded properties
+     *        It is called instead of on_v5_publish() after set_publish_property_view(true) is called.
+     *        The properties are not decoded until props is iterated or looked up.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is MQTT_NS::nullopt.
+     * @param pubopts
+     *        qos, retain flag, and dup flag.
+     * @param topic_name
+     *        Topic name
+     * @param contents
+     *        Publish Payload
+     * @param props
+     *        View of the properties<BR>
+     *        See https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901109<BR>
+     *        3.3.2.3 PUBLISH Properties
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     */
+    virtual bool on_v5_publish_view(MQTT_NS::optional<packet_id_t> /*packet_id*/,
+                                    MQTT_NS::publish_options /*pubopts*/,
+                                    MQTT_NS::buffer /*topic_name*/,
+                                    MQTT_NS::buffer /*contents*/,
+                                    v5::property_view /*props*/) noexcept {
+        return true;
+    }
+
     /**
      * @brief Puback handler
      * @param packet_id
@@ -758,6 +805,20 @@ protected:
      */
     virtual void on_pre_send() noexcept = 0;
 
+    /**
+     * @brief Queue high watermark handler
+     *        This handler is called when the outbound queue reaches the high watermark.
+     *        It is called in the thread that calls the async send function.
+     */
+    virtual void on_queue_high_watermark() noexcept {}
+
+    /**
+     * @brief Queue low watermark handler
+     *        This handler is called when the congested outbound queue falls to the low watermark.
+     *        It is called in the completion handler of the write.
+     */
+    virtual void on_queue_low_watermark() noexcept {}
+
 private:
     /**
      * @brief is valid length handler
@@ -839,6 +900,12 @@ public:
         auto_pub_response_async_ = async;
     }
 
+    /**
+     * @brief Set the size limit of the packets that are read at once
+     *        The packets smaller than the limit are decoded by the codec.
+     *        The other packets are read field by field.
+     * @param size limit
+     */
     void set_packet_bulk_read_limit(std::size_t size) {
         packet_bulk_read_limit_ = size;
     }
@@ -847,6 +914,18 @@ public:
         props_bulk_read_limit_ = size;
     }
 
+    /**
+     * @brief Set publish property view mode.
+     * @param b set value
+     *
+     * When set publish property view mode to true, the properties of the received v5 publish
+     * are passed to on_v5_publish_view() as v5::property_view without decoding.<BR>
+     * Only the ids and the lengths of the properties are checked.
+     */
+    void set_publish_property_view(bool b = true) {
+        publish_property_view_ = b;
+    }
+
     /**
      * @brief start session with a connected endpoint.
      * @param func finish handler that is called when the session is finished
@@ -3527,18 +3606,43 @@ public:
 
     /**
      * @brief Apply f to stored messages.
+     *        The serialized messages are built in one buffer that is reused for all messages.
      * @param f applying function. f should be void(char const*, std::size_t)
+     *          The pointer is valid only while f is called.
      */
     void for_each_store(std::function<void(char const*, std::size_t)> const& f) {
         LockGuard<Mutex> lck (store_mtx_);
         auto const& idx = store_.template get<tag_seq>();
+        std::vector<as::const_buffer> cbs;
+        std::string cb;
         for (auto const & e : idx) {
-            auto const& m = e.message();
-            auto cb = continuous_buffer(m);
+            cbs.clear();
+            add_const_buffer_sequence(cbs, e.message());
+            cb.clear();
+            for (auto const& b : cbs) {
+                cb.append(get_pointer(b), get_size(b));
+            }
             f(cb.data(), cb.size());
         }
     }
 
+    /**
+     * @brief Apply f to stored messages without serializing them into a continuous buffer.
+     *        The buffers refer to the stored messages. Nothing is copied.
+     * @param f applying function. f should be void(std::vector<as::const_buffer> const&)
+     *          The buffers are valid only while f is called.
+     */
+    void for_each_store_const_buffer_sequence(std::function<void(std::vector<as::const_buffer> const&)> const& f) {
+        LockGuard<Mutex> lck (store_mtx_);
+        auto const& idx = store_.template get<tag_seq>();
+        std::vector<as::const_buffer> cbs;
+        for (auto const & e : idx) {
+            cbs.clear();
+            add_const_buffer_sequence(cbs, e.message());
+            f(cbs);
+        }
+    }
+
     /**
      * @brief Apply f to stored messages.
      * @param f applying function. f should be void(message_variant)
@@ -3931,15 +4035,81 @@ public:
         max_queue_send_size_ = size;
     }
 
+    /**
+     * @brief Set the watermarks of the outbound queue.
+     *        The outbound queue holds the messages that are sent by the async functions
+     *        and not written to the socket yet. A slow peer makes it grow.
+     *        When the queued bytes or messages reach the high watermark, the queue becomes congested
+     *        and on_queue_high_watermark() is called.
+     *        When both fall to the low watermarks, the queue becomes uncongested
+     *        and on_queue_low_watermark() is called.
+     *        Producers can throttle with the handlers or by polling queue_congested().
+     *        The watermarks are disabled by default.
+     *
+     * @param high_bytes high watermark of the queued bytes. 0 means infinity.
+     * @param low_bytes low watermark of the queued bytes. It should be less than high_bytes.
+     * @param high_messages high watermark of the queued messages. 0 means infinity.
+     * @param low_messages low watermark of the queued messages. It should be less than high_messages.
+     *
+     */
+    void set_queue_watermarks(
+        std::size_t high_bytes,
+        std::size_t low_bytes,
+        std::size_t high_messages = 0,
+        std::size_t low_messages = 0) {
+        queue_high_bytes_ = high_bytes;
+        queue_low_bytes_ = low_bytes;
+        queue_high_messages_ = high_messages;
+        queue_low_messages_ = low_messages;
+    }
+
+    /**
+     * @brief Set what to do with QoS0 PUBLISH sent while the outbound queue is congested.
+     *        QoS0 messages may be lost anyway, so dropping them protects the memory
+     *        without breaking the delivery guarantee.
+     *        The default value is queue_overflow_policy::enqueue.
+     *
+     * @param policy policy
+     *
+     */
+    void set_queue_overflow_policy(queue_overflow_policy policy) {
+        queue_overflow_policy_ = policy;
+    }
+
+    /**
+     * @brief Get the size of the messages in the outbound queue
+     * @return bytes
+     */
+    std::size_t queued_bytes() const {
+        return queued_bytes_;
+    }
+
+    /**
+     * @brief Get the number of the messages in the outbound queue
+     * @return the number of messages
+     */
+    std::size_t queued_messages() const {
+        return queued_messages_;
+    }
+
+    /**
+     * @brief Check if the outbound queue is over the high watermark
+     *        It is true from the high watermark until the low watermark.
+     * @return true if congested
+     */
+    bool queue_congested() const {
+        return queue_congested_;
+    }
+
     protocol_version get_protocol_version() const {
         return version_;
     }
 
-    MQTT_NS::socket const& socket() const {
+    Socket const& socket() const {
         return socket_.value();
     }
 
-    MQTT_NS::socket& socket() {
+    Socket& socket() {
         return socket_.value();
     }
 
@@ -3953,7 +4123,7 @@ protected:
      * @brief Get shared_any of socket
      * @return reference of shared_any socket
      */
-    optional<MQTT_NS::socket>& socket_optional() {
+    optional<Socket>& socket_optional() {
         return socket_;
     }
 
@@ -4147,14 +4317,8 @@ private:
         );
     }
 
-    bool calc_variable_length(std::size_t& v, std::size_t& multiplier, char buf) {
-        v += (buf & 0b01111111) * multiplier;
-        multiplier *= 128;
-        return multiplier <= 128 * 128 * 128 * 128;
-    }
-
     void handle_remaining_length(any session_life_keeper, this_type_sp self) {
-        if (!calc_variable_length(remaining_length_, remaining_length_multiplier_, buf_.front())) {
+        if (!codec::add_variable_length_byte(remaining_length_, remaining_length_multiplier_, buf_.front())) {
             clean_sub_unsub_inflight_on_error(error_code(static_cast<int>(message_size_errc), generic_category()));
             return;
         }
@@ -4179,56 +4343,14 @@ private:
         else {
             auto check =
                 [&]() -> bool {
-                    auto cpt = get_control_packet_type(fixed_header_);
-                    switch (version_) {
-                    case protocol_version::v3_1_1:
-                        switch (cpt) {
-                        case control_packet_type::connect:
-                        case control_packet_type::publish:
-                        case control_packet_type::subscribe:
-                        case control_packet_type::suback:
-                        case control_packet_type::unsubscribe:
-                            return check_is_valid_length(cpt, remaining_length_);
-                        case control_packet_type::connack:
-                            return remaining_length_ == 2;
-                        case control_packet_type::puback:
-                        case control_packet_type::pubrec:
-                        case control_packet_type::pubrel:
-                        case control_packet_type::pubcomp:
-                        case control_packet_type::unsuback:
-                            return remaining_length_ == sizeof(packet_id_t);
-                        case control_packet_type::pingreq:
-                        case control_packet_type::pingresp:
-                        case control_packet_type::disconnect:
-                            return remaining_length_ == 0;
-                        default:
-                            return false;
-                        }
-                        break;
-                    case protocol_version::v5:
-                    default:
-                        switch (cpt) {
-                        case control_packet_type::connect:
-                        case control_packet_type::publish:
-                        case control_packet_type::subscribe:
-                        case control_packet_type::suback:
-                        case control_packet_type::unsubscribe:
-                        case control_packet_type::connack:
-                        case control_packet_type::puback:
-                        case control_packet_type::pubrec:
-                        case control_packet_type::pubrel:
-                        case control_packet_type::pubcomp:
-                        case control_packet_type::unsuback:
-                        case control_packet_type::disconnect:
-                            return check_is_valid_length(cpt, remaining_length_);
-                        case control_packet_type::pingreq:
-                        case control_packet_type::pingresp:
-                            return remaining_length_ == 0;
-                        default:
-                            return false;
+                    return codec::check_remaining_length<PacketIdBytes>(
+                        version_,
+                        get_control_packet_type(fixed_header_),
+                        remaining_length_,
+                        [this](control_packet_type cpt, std::size_t remaining_length) {
+                            return check_is_valid_length(cpt, remaining_length);
                         }
-                        break;
-                    }
+                    );
                 };
             if (!check()) {
                 clean_sub_unsub_inflight_on_error(error_code(static_cast<int>(message_size_errc), generic_category()));
@@ -4243,104 +4365,68 @@ private:
         auto control_packet_type = get_control_packet_type(fixed_header_);
         switch (control_packet_type) {
         case control_packet_type::connect:
-            process_connect(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            break;
         case control_packet_type::connack:
-            process_connack(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
+        case control_packet_type::disconnect:
+        case control_packet_type::auth:
             break;
-        case control_packet_type::publish:
-            if (mqtt_connected_) {
-                process_publish(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
+        default:
+            if (!mqtt_connected_) {
                 call_protocol_error_handlers();
+                return;
             }
             break;
+        }
+
+        if (remaining_length_ < packet_bulk_read_limit_) {
+            process_packet(force_move(session_life_keeper), force_move(self));
+            return;
+        }
+
+        switch (control_packet_type) {
+        case control_packet_type::connect:
+            process_connect(force_move(session_life_keeper), force_move(self));
+            break;
+        case control_packet_type::connack:
+            process_connack(force_move(session_life_keeper), force_move(self));
+            break;
+        case control_packet_type::publish:
+            process_publish(force_move(session_life_keeper), force_move(self));
+            break;
         case control_packet_type::puback:
-            if (mqtt_connected_) {
-                process_puback(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_puback(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::pubrec:
-            if (mqtt_connected_) {
-                process_pubrec(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_pubrec(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::pubrel:
-            if (mqtt_connected_) {
-                process_pubrel(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_pubrel(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::pubcomp:
-            if (mqtt_connected_) {
-                process_pubcomp(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_pubcomp(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::subscribe:
-            if (mqtt_connected_) {
-                process_subscribe(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_subscribe(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::suback:
-            if (mqtt_connected_) {
-                process_suback(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_suback(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::unsubscribe:
-            if (mqtt_connected_) {
-                process_unsubscribe(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_unsubscribe(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::unsuback:
-            if (mqtt_connected_) {
-                process_unsuback(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_unsuback(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::pingreq:
-            if (mqtt_connected_) {
-                process_pingreq(force_move(session_life_keeper));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_pingreq(force_move(session_life_keeper));
             break;
         case control_packet_type::pingresp:
-            if (mqtt_connected_) {
-                process_pingresp(force_move(session_life_keeper));
-            }
-            else {
-                call_protocol_error_handlers();
-            }
+            process_pingresp(force_move(session_life_keeper));
             break;
         case control_packet_type::disconnect:
-            process_disconnect(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
+            process_disconnect(force_move(session_life_keeper), force_move(self));
             break;
         case control_packet_type::auth:
-            process_auth(force_move(session_life_keeper), remaining_length_ < packet_bulk_read_limit_, force_move(self));
+            process_auth(force_move(session_life_keeper), force_move(self));
             break;
         default:
             break;
@@ -4520,7 +4606,7 @@ private:
                 std::size_t multiplier,
                 this_type_sp&& self
             ) mutable {
-                if (!calc_variable_length(size, multiplier, buf.front())) {
+                if (!codec::add_variable_length_byte(size, multiplier, buf.front())) {
                     call_message_size_error_handlers();
                     return;
                 }
@@ -4777,6 +4863,51 @@ private:
         );
     }
 
+    // Reads the properties as one buffer without decoding.
+    void process_raw_properties(
+        any session_life_keeper,
+        buffer buf,
+        std::function<void(buffer, buffer, any, this_type_sp)> handler,
+        this_type_sp self
+    ) {
+        process_variable_length(
+            force_move(session_life_keeper),
+            force_move(buf),
+            [
+                this,
+                handler = force_move(handler)
+            ]
+            (std::size_t property_length, buffer buf, any session_life_keeper, this_type_sp self) mutable {
+                if (property_length > remaining_length_) {
+                    call_message_size_error_handlers();
+                    return;
+                }
+                if (property_length == 0) {
+                    handler(buffer(), force_move(buf), force_move(session_life_keeper), force_move(self));
+                    return;
+                }
+                process_nbytes(
+                    force_move(session_life_keeper),
+                    force_move(buf),
+                    property_length,
+                    [
+                        this,
+                        handler = force_move(handler)
+                    ]
+                    (buffer raw_props, buffer buf, any session_life_keeper, this_type_sp self) mutable {
+                        if (!v5::property_view::well_formed(raw_props)) {
+                            call_protocol_error_handlers();
+                            return;
+                        }
+                        handler(force_move(raw_props), force_move(buf), force_move(session_life_keeper), force_move(self));
+                    },
+                    force_move(self)
+                );
+            },
+            force_move(self)
+        );
+    }
+
     void process_property_id(
         any session_life_keeper,
         buffer buf,
@@ -5697,108 +5828,511 @@ private:
                 force_move(self)
             );
         } break;
+        default:
+            // unknown property id
+            call_protocol_error_handlers();
+            return;
         }
     }
 
-    // process common
-
-    template <typename InfoType,
-              void (this_type::*NextFunc)(any, buffer, InfoType&&, this_type_sp)>
-    void process_header(
-        any session_life_keeper,
-        bool all_read,
-        std::size_t header_len,
-        InfoType&& info,
-        this_type_sp self
-    ) {
+    // process packet
+    // The packets smaller than packet_bulk_read_limit_ are read at once, and decoded by the codec.
+    // The decoded values are passed to the finish phase that is shared with the field by field reading.
 
-        if (all_read) {
-            auto spa = make_shared_ptr_array(remaining_length_);
-            auto ptr = spa.get();
-            socket_->async_read(
-                as::buffer(ptr, remaining_length_),
-                [
-                    this,
-                    session_life_keeper = force_move(session_life_keeper),
-                    buf = buffer(string_view(ptr, remaining_length_), force_move(spa)),
-                    info = std::forward<InfoType>(info),
-                    self = force_move(self)
-                ]
-                (error_code ec, std::size_t bytes_transferred) mutable {
-                    this->total_bytes_received_ = bytes_transferred;
-                    if (!check_error_and_transferred_length(ec, bytes_transferred, remaining_length_)) return;
-                    (this->*NextFunc)(
-                        force_move(session_life_keeper),
-                        force_move(buf),
-                        force_move(info),
-                        force_move(self)
-                    );
-                }
-            );
-            return;
-        }
+    void process_packet(any session_life_keeper, this_type_sp self) {
+        auto rb = remaining_bytes(remaining_length_);
+        auto header_size = 1 + rb.size();
+        auto size = header_size + remaining_length_;
+        auto spa = make_shared_ptr_array(size);
+        auto ptr = spa.get();
+        ptr[0] = static_cast<char>(fixed_header_);
+        std::copy(rb.begin(), rb.end(), ptr + 1);
+        codec::packet p(buffer(string_view(ptr, size), force_move(spa)), header_size);
 
-        if (header_len == 0) {
-            (this->*NextFunc)(
-                force_move(session_life_keeper),
-                buffer(),
-                force_move(info),
-                force_move(self)
-            );
+        if (remaining_length_ == 0) {
+            process_decoded_packet(force_move(session_life_keeper), p, force_move(self));
             return;
         }
-
         socket_->async_read(
-            as::buffer(buf_.data(), header_len),
+            as::buffer(ptr + header_size, remaining_length_),
             [
                 this,
                 session_life_keeper = force_move(session_life_keeper),
-                header_len,
-                info = std::forward<InfoType>(info),
+                p = force_move(p),
                 self = force_move(self)
             ]
-            (error_code ec,
-             std::size_t bytes_transferred) mutable {
+            (error_code ec, std::size_t bytes_transferred) mutable {
                 this->total_bytes_received_ = bytes_transferred;
-                if (!check_error_and_transferred_length(ec, bytes_transferred, header_len)) return;
-                (this->*NextFunc)(
-                    force_move(session_life_keeper),
-                    buffer(string_view(buf_.data(), header_len)),
-                    force_move(info),
-                    force_move(self)
-                );
+                if (!check_error_and_transferred_length(ec, bytes_transferred, remaining_length_)) return;
+                process_decoded_packet(force_move(session_life_keeper), p, force_move(self));
             }
         );
     }
 
-    // process connect
-
-    enum class connect_phase {
-        header,
-        properties,
-        client_id,
-        will,
-        user_name,
-        password,
-        finish,
-    };
+    /**
+     * @brief Call the decoder, and call the error handlers if the packet is malformed
+     * @param decode function that returns the decoded packet
+     * @return decoded packet, or nullopt if the packet is malformed
+     */
+    template <typename Decode>
+    auto decode_packet(Decode&& decode) -> optional<decltype(decode())> {
+        try {
+            return decode();
+        }
+        catch (protocol_error const&) {
+            call_protocol_error_handlers();
+        }
+        catch (utf8string_contents_error const&) {
+            call_protocol_error_handlers();
+        }
+        catch (property_parse_error const&) {
+            call_protocol_error_handlers();
+        }
+        catch (remaining_length_error const&) {
+            call_message_size_error_handlers();
+        }
+        catch (property_length_error const&) {
+            call_message_size_error_handlers();
+        }
+        return nullopt;
+    }
 
-    struct connect_info {
-        std::size_t header_len;
-        char connect_flag;
-        std::uint16_t keep_alive;
-        v5::properties props;
-        buffer client_id;
-        v5::properties will_props;
-        buffer will_topic;
-        buffer will_payload;
-        optional<buffer> user_name;
+    void process_decoded_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        // All bytes of the packet are consumed.
+        remaining_length_ = 0;
+        switch (p.type()) {
+        case control_packet_type::connect:
+            process_connect_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::connack:
+            process_connack_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::publish:
+            process_publish_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::puback:
+            process_ack_packet<puback_info, &this_type::process_puback_impl<puback_phase::finish>>(
+                force_move(session_life_keeper),
+                p,
+                [](codec::packet const& p) { return codec::v3_1_1::decode_puback<PacketIdBytes>(p); },
+                [](codec::packet const& p) { return codec::v5::decode_puback<PacketIdBytes>(p); },
+                force_move(self)
+            );
+            break;
+        case control_packet_type::pubrec:
+            process_ack_packet<pubrec_info, &this_type::process_pubrec_impl<pubrec_phase::finish>>(
+                force_move(session_life_keeper),
+                p,
+                [](codec::packet const& p) { return codec::v3_1_1::decode_pubrec<PacketIdBytes>(p); },
+                [](codec::packet const& p) { return codec::v5::decode_pubrec<PacketIdBytes>(p); },
+                force_move(self)
+            );
+            break;
+        case control_packet_type::pubrel:
+            process_ack_packet<pubrel_info, &this_type::process_pubrel_impl<pubrel_phase::finish>>(
+                force_move(session_life_keeper),
+                p,
+                [](codec::packet const& p) { return codec::v3_1_1::decode_pubrel<PacketIdBytes>(p); },
+                [](codec::packet const& p) { return codec::v5::decode_pubrel<PacketIdBytes>(p); },
+                force_move(self)
+            );
+            break;
+        case control_packet_type::pubcomp:
+            process_ack_packet<pubcomp_info, &this_type::process_pubcomp_impl<pubcomp_phase::finish>>(
+                force_move(session_life_keeper),
+                p,
+                [](codec::packet const& p) { return codec::v3_1_1::decode_pubcomp<PacketIdBytes>(p); },
+                [](codec::packet const& p) { return codec::v5::decode_pubcomp<PacketIdBytes>(p); },
+                force_move(self)
+            );
+            break;
+        case control_packet_type::subscribe:
+            process_subscribe_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::suback:
+            process_suback_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::unsubscribe:
+            process_unsubscribe_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::unsuback:
+            process_unsuback_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::pingreq:
+            process_pingreq(force_move(session_life_keeper));
+            break;
+        case control_packet_type::pingresp:
+            process_pingresp(force_move(session_life_keeper));
+            break;
+        case control_packet_type::disconnect:
+            process_disconnect_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        case control_packet_type::auth:
+            process_auth_packet(force_move(session_life_keeper), p, force_move(self));
+            break;
+        default:
+            break;
+        }
+    }
+
+    void process_connect_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        auto version = decode_packet([&] { return codec::get_protocol_version(p); });
+        if (!version) return;
+        if (*version != protocol_version::v3_1_1 && *version != protocol_version::v5) {
+            call_protocol_error_handlers();
+            return;
+        }
+
+        if (version_ == protocol_version::undetermined) {
+            version_ = *version;
+        }
+        else if (version_ != *version) {
+            call_protocol_error_handlers();
+            return;
+        }
+
+        connect_info info;
+        if (version_ == protocol_version::v5) {
+            auto c = decode_packet([&] { return codec::v5::decode_connect(p); });
+            if (!c) return;
+            clean_session_ = c->clean_start;
+            info.keep_alive = c->keep_alive;
+            info.props = force_move(c->props);
+            info.client_id = force_move(c->client_id);
+            info.w = force_move(c->w);
+            info.user_name = force_move(c->user_name);
+            info.password = force_move(c->password);
+        }
+        else {
+            auto c = decode_packet([&] { return codec::v3_1_1::decode_connect(p); });
+            if (!c) return;
+            clean_session_ = c->clean_session;
+            info.keep_alive = c->keep_alive;
+            info.client_id = force_move(c->client_id);
+            info.w = force_move(c->w);
+            info.user_name = force_move(c->user_name);
+            info.password = force_move(c->password);
+        }
+        process_connect_impl<connect_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_connack_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        connack_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto c = decode_packet([&] { return codec::v3_1_1::decode_connack(p); });
+            if (!c) return;
+            info.session_present = c->session_present;
+            info.reason_code = c->return_code;
+        } break;
+        case protocol_version::v5: {
+            auto c = decode_packet([&] { return codec::v5::decode_connack(p); });
+            if (!c) return;
+            info.session_present = c->session_present;
+            info.reason_code = c->reason_code;
+            info.props = force_move(c->props);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_connack_impl<connack_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_publish_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        publish_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto pp = decode_packet([&] { return codec::v3_1_1::decode_publish<PacketIdBytes>(p); });
+            if (!pp) return;
+            info.topic_name = force_move(pp->topic_name);
+            info.packet_id = pp->packet_id;
+            info.payload = force_move(pp->payload);
+        } break;
+        case protocol_version::v5: {
+            auto pp = decode_packet([&] { return codec::v5::decode_publish<PacketIdBytes>(p, !publish_property_view_); });
+            if (!pp) return;
+            info.topic_name = force_move(pp->topic_name);
+            info.packet_id = pp->packet_id;
+            info.props = force_move(pp->props);
+            info.raw_props = force_move(pp->raw_props);
+            info.payload = force_move(pp->payload);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_publish_impl<publish_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    // PUBACK, PUBREC, PUBREL, and PUBCOMP
+    // InfoType is the same as the v5 decoded packet.
+    template <typename InfoType,
+              void (this_type::*FinishFunc)(any, buffer, InfoType&&, this_type_sp),
+              typename DecodeV3_1_1,
+              typename DecodeV5>
+    void process_ack_packet(
+        any session_life_keeper,
+        codec::packet const& p,
+        DecodeV3_1_1 const& decode_v3_1_1,
+        DecodeV5 const& decode_v5,
+        this_type_sp self
+    ) {
+        InfoType info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto a = decode_packet([&] { return decode_v3_1_1(p); });
+            if (!a) return;
+            info.packet_id = a->packet_id;
+            info.reason_code = static_cast<decltype(info.reason_code)>(0); // success
+        } break;
+        case protocol_version::v5: {
+            auto a = decode_packet([&] { return decode_v5(p); });
+            if (!a) return;
+            info = force_move(*a);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        (this->*FinishFunc)(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_subscribe_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        subscribe_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto sp = decode_packet([&] { return codec::v3_1_1::decode_subscribe<PacketIdBytes>(p); });
+            if (!sp) return;
+            info.packet_id = sp->packet_id;
+            info.entries = force_move(sp->entries);
+        } break;
+        case protocol_version::v5: {
+            auto sp = decode_packet([&] { return codec::v5::decode_subscribe<PacketIdBytes>(p); });
+            if (!sp) return;
+            info = force_move(*sp);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_subscribe_impl<subscribe_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_suback_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        suback_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto sp = decode_packet([&] { return codec::v3_1_1::decode_suback<PacketIdBytes>(p); });
+            if (!sp) return;
+            info.packet_id = sp->packet_id;
+            info.return_codes = force_move(sp->return_codes);
+        } break;
+        case protocol_version::v5: {
+            auto sp = decode_packet([&] { return codec::v5::decode_suback<PacketIdBytes>(p); });
+            if (!sp) return;
+            info.packet_id = sp->packet_id;
+            info.props = force_move(sp->props);
+            info.reason_codes = force_move(sp->reason_codes);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_suback_impl<suback_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_unsubscribe_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        unsubscribe_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto up = decode_packet([&] { return codec::v3_1_1::decode_unsubscribe<PacketIdBytes>(p); });
+            if (!up) return;
+            info.packet_id = up->packet_id;
+            info.entries = force_move(up->entries);
+        } break;
+        case protocol_version::v5: {
+            auto up = decode_packet([&] { return codec::v5::decode_unsubscribe<PacketIdBytes>(p); });
+            if (!up) return;
+            info = force_move(*up);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_unsubscribe_impl<unsubscribe_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_unsuback_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        unsuback_info info;
+        switch (version_) {
+        case protocol_version::v3_1_1: {
+            auto up = decode_packet([&] { return codec::v3_1_1::decode_unsuback<PacketIdBytes>(p); });
+            if (!up) return;
+            info.packet_id = up->packet_id;
+        } break;
+        case protocol_version::v5: {
+            auto up = decode_packet([&] { return codec::v5::decode_unsuback<PacketIdBytes>(p); });
+            if (!up) return;
+            info.packet_id = up->packet_id;
+            info.props = force_move(up->props);
+            info.reason_codes = force_move(up->reason_codes);
+        } break;
+        default:
+            BOOST_ASSERT(false);
+            return;
+        }
+        process_unsuback_impl<unsuback_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_disconnect_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        disconnect_info info { v5::disconnect_reason_code::normal_disconnection, v5::properties() };
+        switch (version_) {
+        case protocol_version::v3_1_1:
+            if (!decode_packet([&] { return codec::v3_1_1::decode_disconnect(p); })) return;
+            break;
+        case protocol_version::v5: {
+            auto d = decode_packet([&] { return codec::v5::decode_disconnect(p); });
+            if (!d) return;
+            info = force_move(*d);
+        } break;
+        default:
+            call_protocol_error_handlers();
+            return;
+        }
+        process_disconnect_impl<disconnect_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(info),
+            force_move(self)
+        );
+    }
+
+    void process_auth_packet(any session_life_keeper, codec::packet const& p, this_type_sp self) {
+        if (version_ != protocol_version::v5) {
+            call_protocol_error_handlers();
+            return;
+        }
+        auto a = decode_packet([&] { return codec::v5::decode_auth(p); });
+        if (!a) return;
+        process_auth_impl<auth_phase::finish>(
+            force_move(session_life_keeper),
+            buffer(),
+            force_move(*a),
+            force_move(self)
+        );
+    }
+
+    // process common
+
+    template <typename InfoType,
+              void (this_type::*NextFunc)(any, buffer, InfoType&&, this_type_sp)>
+    void process_header(
+        any session_life_keeper,
+        std::size_t header_len,
+        InfoType&& info,
+        this_type_sp self
+    ) {
+        if (header_len == 0) {
+            (this->*NextFunc)(
+                force_move(session_life_keeper),
+                buffer(),
+                force_move(info),
+                force_move(self)
+            );
+            return;
+        }
+
+        socket_->async_read(
+            as::buffer(buf_.data(), header_len),
+            [
+                this,
+                session_life_keeper = force_move(session_life_keeper),
+                header_len,
+                info = std::forward<InfoType>(info),
+                self = force_move(self)
+            ]
+            (error_code ec,
+             std::size_t bytes_transferred) mutable {
+                this->total_bytes_received_ = bytes_transferred;
+                if (!check_error_and_transferred_length(ec, bytes_transferred, header_len)) return;
+                (this->*NextFunc)(
+                    force_move(session_life_keeper),
+                    buffer(string_view(buf_.data(), header_len)),
+                    force_move(info),
+                    force_move(self)
+                );
+            }
+        );
+    }
+
+    // process connect
+
+    enum class connect_phase {
+        header,
+        properties,
+        client_id,
+        will,
+        user_name,
+        password,
+        finish,
+    };
+
+    struct connect_info {
+        std::size_t header_len;
+        char connect_flag;
+        std::uint16_t keep_alive;
+        v5::properties props;
+        buffer client_id;
+        v5::properties will_props;
+        buffer will_topic;
+        optional<will> w;
+        optional<buffer> user_name;
         optional<buffer> password;
     };
 
     void process_connect(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -5819,7 +6353,6 @@ private:
         process_header<connect_info,
                        &this_type::process_connect_impl<connect_phase::header>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             force_move(info),
             force_move(self)
@@ -5979,7 +6512,12 @@ private:
                                     info = force_move(info)
                                 ]
                                 (buffer will_payload, buffer buf, any session_life_keeper, this_type_sp self) mutable {
-                                    info.will_payload = force_move(will_payload);
+                                    info.w.emplace(
+                                        force_move(info.will_topic),
+                                        force_move(will_payload),
+                                        connect_flags::has_will_retain(info.connect_flag) | connect_flags::will_qos(info.connect_flag),
+                                        force_move(info.will_props)
+                                    );
                                     if (connect_flags::has_user_name_flag(info.connect_flag)) {
                                         process_connect_impl<connect_phase::user_name>(
                                             force_move(session_life_keeper),
@@ -6103,12 +6641,7 @@ private:
                         force_move(info.client_id),
                         force_move(info.user_name),
                         force_move(info.password),
-                          connect_flags::has_will_flag(info.connect_flag)
-                        ? optional<will>(in_place_init,
-                                         force_move(info.will_topic),
-                                         force_move(info.will_payload),
-                                         connect_flags::has_will_retain(info.connect_flag) | connect_flags::will_qos(info.connect_flag))
-                        : optional<will>(nullopt),
+                        force_move(info.w),
                         clean_session_,
                         info.keep_alive
                     )
@@ -6121,13 +6654,7 @@ private:
                         force_move(info.client_id),
                         force_move(info.user_name),
                         force_move(info.password),
-                          connect_flags::has_will_flag(info.connect_flag)
-                        ? optional<will>(in_place_init,
-                                         force_move(info.will_topic),
-                                         force_move(info.will_payload),
-                                         connect_flags::has_will_retain(info.connect_flag) | connect_flags::will_qos(info.connect_flag),
-                                         force_move(info.will_props))
-                        : optional<will>(nullopt),
+                        force_move(info.w),
                         clean_session_,
                         info.keep_alive,
                         force_move(info.props)
@@ -6152,15 +6679,14 @@ private:
     };
 
     struct connack_info {
-        std::size_t header_len;
-        bool session_present;
+        std::size_t header_len = 0;
+        bool session_present = false;
         variant<connect_return_code, v5::connect_reason_code> reason_code;
         v5::properties props;
     };
 
     void process_connack(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -6178,7 +6704,6 @@ private:
         process_header<connack_info,
                        &this_type::process_connack_impl<connack_phase::header>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             force_move(info),
             force_move(self)
@@ -6328,17 +6853,19 @@ private:
         packet_id,
         properties,
         payload,
+        finish,
     };
 
     struct publish_info {
         buffer topic_name;
         optional<packet_id_t> packet_id;
         v5::properties props;
+        buffer raw_props;
+        buffer payload;
     };
 
     void process_publish(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t min_len =
@@ -6352,7 +6879,6 @@ private:
         process_header<publish_info,
                        &this_type::process_publish_impl<publish_phase::topic_name>>(
             force_move(session_life_keeper),
-            all_read,
             0,
             publish_info(),
             force_move(self)
@@ -6445,6 +6971,27 @@ private:
             );
             break;
         case publish_phase::properties:
+            if (publish_property_view_) {
+                process_raw_properties(
+                    force_move(session_life_keeper),
+                    force_move(buf),
+                    [
+                        this,
+                        info = force_move(info)
+                    ]
+                    (buffer raw_props, buffer buf, any session_life_keeper, this_type_sp self) mutable {
+                        info.raw_props = force_move(raw_props);
+                        process_publish_impl<publish_phase::payload>(
+                            force_move(session_life_keeper),
+                            force_move(buf),
+                            force_move(info),
+                            force_move(self)
+                        );
+                    },
+                    force_move(self)
+                );
+                break;
+            }
             process_properties(
                 force_move(session_life_keeper),
                 force_move(buf),
@@ -6473,94 +7020,111 @@ private:
                     this,
                     info = force_move(info)
                 ]
-                (buffer payload, buffer /*buf*/, any session_life_keeper, this_type_sp /*self*/) mutable {
-                    auto handler_call =
-                        [&] {
-                            switch (version_) {
-                            case protocol_version::v3_1_1:
-                                if (on_publish(
-                                            info.packet_id,
-                                            publish_options(fixed_header_),
-                                            force_move(info.topic_name),
-                                            force_move(payload))) {
-                                    on_mqtt_message_processed(force_move(session_life_keeper));
-                                    return true;
-                                }
-                                break;
-                            case protocol_version::v5:
-                                if (on_v5_publish(
-                                            info.packet_id,
-                                            publish_options(fixed_header_),
-                                            force_move(info.topic_name),
-                                            force_move(payload),
-                                            force_move(info.props)
-                                    )
-                                ) {
-                                    on_mqtt_message_processed(force_move(session_life_keeper));
-                                    return true;
-                                }
-                                break;
-                            default:
-                                BOOST_ASSERT(false);
-                            }
-                            return false;
-                        };
-                    switch (publish::get_qos(fixed_header_)) {
-                    case qos::at_most_once:
-                        handler_call();
-                        break;
-                    case qos::at_least_once:
-                        if (handler_call()) {
-                            auto_pub_response(
-                                [this, &info] {
-                                    if (connected_) {
-                                        send_puback(*info.packet_id,
-                                                    v5::puback_reason_code::success,
-                                                    v5::properties{});
-                                    }
-                                },
-                                [this, &info, &session_life_keeper] {
-                                    if (connected_) {
-                                        async_send_puback(
-                                            *info.packet_id,
-                                            v5::puback_reason_code::success,
-                                            v5::properties{},
-                                            [session_life_keeper](auto){}
-                                        );
-                                    }
-                                }
-                            );
+                (buffer payload, buffer buf, any session_life_keeper, this_type_sp self) mutable {
+                    info.payload = force_move(payload);
+                    process_publish_impl<publish_phase::finish>(
+                        force_move(session_life_keeper),
+                        force_move(buf),
+                        force_move(info),
+                        force_move(self)
+                    );
+                },
+                force_move(self)
+            );
+            break;
+        case publish_phase::finish: {
+            auto handler_call =
+                [&] {
+                    switch (version_) {
+                    case protocol_version::v3_1_1:
+                        if (on_publish(
+                                    info.packet_id,
+                                    publish_options(fixed_header_),
+                                    force_move(info.topic_name),
+                                    force_move(info.payload))) {
+                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            return true;
                         }
                         break;
-                    case qos::exactly_once:
-                        if (handler_call()) {
-                            qos2_publish_handled_.emplace(*info.packet_id);
-                            auto_pub_response(
-                                [this, &info] {
-                                    if (connected_) {
-                                        send_pubrec(*info.packet_id,
-                                                    v5::pubrec_reason_code::success,
-                                                    v5::properties{});
-                                    }
-                                },
-                                [this, &info, &session_life_keeper] {
-                                    if (connected_) {
-                                        async_send_pubrec(
-                                            *info.packet_id,
-                                            v5::pubrec_reason_code::success,
-                                            v5::properties{},
-                                            [session_life_keeper](auto){}
-                                        );
-                                    }
-                                }
-                            );
+                    case protocol_version::v5:
+                        if (publish_property_view_
+                            ? on_v5_publish_view(
+                                  info.packet_id,
+                                  publish_options(fixed_header_),
+                                  force_move(info.topic_name),
+                                  force_move(info.payload),
+                                  v5::property_view(force_move(info.raw_props))
+                              )
+                            : on_v5_publish(
+                                  info.packet_id,
+                                  publish_options(fixed_header_),
+                                  force_move(info.topic_name),
+                                  force_move(info.payload),
+                                  force_move(info.props)
+                              )
+                        ) {
+                            on_mqtt_message_processed(force_move(session_life_keeper));
+                            return true;
                         }
                         break;
+                    default:
+                        BOOST_ASSERT(false);
                     }
-                },
-                force_move(self)
-            );
-            break;
+                    return false;
+                };
+            switch (publish::get_qos(fixed_header_)) {
+            case qos::at_most_once:
+                handler_call();
+                break;
+            case qos::at_least_once:
+                if (handler_call()) {
+                    auto_pub_response(
+                        [this, &info] {
+                            if (connected_) {
+                                send_puback(*info.packet_id,
+                                            v5::puback_reason_code::success,
+                                            v5::properties{});
+                            }
+                        },
+                        [this, &info, &session_life_keeper] {
+                            if (connected_) {
+                                async_send_puback(
+                                    *info.packet_id,
+                                    v5::puback_reason_code::success,
+                                    v5::properties{},
+                                    [session_life_keeper](auto){}
+                                );
+                            }
+                        }
+                    );
+                }
+                break;
+            case qos::exactly_once:
+                if (handler_call()) {
+                    qos2_publish_handled_.emplace(*info.packet_id);
+                    auto_pub_response(
+                        [this, &info] {
+                            if (connected_) {
+                                send_pubrec(*info.packet_id,
+                                            v5::pubrec_reason_code::success,
+                                            v5::properties{});
+                            }
+                        },
+                        [this, &info, &session_life_keeper] {
+                            if (connected_) {
+                                async_send_pubrec(
+                                    *info.packet_id,
+                                    v5::pubrec_reason_code::success,
+                                    v5::properties{},
+                                    [session_life_keeper](auto){}
+                                );
+                            }
+                        }
+                    );
+                }
+                break;
+            }
+        } break;
         }
     }
 
@@ -6573,15 +7137,10 @@ private:
         finish,
     };
 
-    struct puback_info {
-        packet_id_t packet_id;
-        v5::puback_reason_code reason_code;
-        v5::properties props;
-    };
+    using puback_info = codec::v5::puback_packet<PacketIdBytes>;
 
     void process_puback(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -6595,7 +7154,6 @@ private:
         process_header<puback_info,
                        &this_type::process_puback_impl<puback_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             puback_info(),
             force_move(self)
@@ -6733,15 +7291,10 @@ private:
         finish,
     };
 
-    struct pubrec_info {
-        packet_id_t packet_id;
-        v5::pubrec_reason_code reason_code;
-        v5::properties props;
-    };
+    using pubrec_info = codec::v5::pubrec_packet<PacketIdBytes>;
 
     void process_pubrec(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -6755,7 +7308,6 @@ private:
         process_header<pubrec_info,
                        &this_type::process_pubrec_impl<pubrec_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             pubrec_info(),
             force_move(self)
@@ -6931,15 +7483,10 @@ private:
         finish,
     };
 
-    struct pubrel_info {
-        packet_id_t packet_id;
-        v5::pubrel_reason_code reason_code;
-        v5::properties props;
-    };
+    using pubrel_info = codec::v5::pubrel_packet<PacketIdBytes>;
 
     void process_pubrel(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -6953,7 +7500,6 @@ private:
         process_header<pubrel_info,
                        &this_type::process_pubrel_impl<pubrel_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             pubrel_info(),
             force_move(self)
@@ -7108,15 +7654,10 @@ private:
         finish,
     };
 
-    struct pubcomp_info {
-        packet_id_t packet_id;
-        v5::pubcomp_reason_code reason_code;
-        v5::properties props;
-    };
+    using pubcomp_info = codec::v5::pubcomp_packet<PacketIdBytes>;
 
     void process_pubcomp(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -7130,7 +7671,6 @@ private:
         process_header<pubcomp_info,
                        &this_type::process_pubcomp_impl<pubcomp_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             pubcomp_info(),
             force_move(self)
@@ -7268,15 +7808,10 @@ private:
         finish,
     };
 
-    struct subscribe_info {
-        packet_id_t packet_id;
-        v5::properties props;
-        std::vector<std::tuple<buffer, subscribe_options>> entries;
-    };
+    using subscribe_info = codec::v5::subscribe_packet<PacketIdBytes>;
 
     void process_subscribe(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -7290,7 +7825,6 @@ private:
         process_header<subscribe_info,
                        &this_type::process_subscribe_impl<subscribe_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             subscribe_info(),
             force_move(self)
@@ -7431,16 +7965,18 @@ private:
         packet_id,
         properties,
         reasons,
+        finish,
     };
 
     struct suback_info {
         packet_id_t packet_id;
         v5::properties props;
+        std::vector<suback_return_code> return_codes;
+        std::vector<v5::suback_reason_code> reason_codes;
     };
 
     void process_suback(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -7454,7 +7990,6 @@ private:
         process_header<suback_info,
                        &this_type::process_suback_impl<suback_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             suback_info(),
             force_move(self)
@@ -7528,25 +8063,17 @@ private:
                     this,
                     info = force_move(info)
                 ]
-                (buffer body, buffer /*buf*/, any session_life_keeper, this_type_sp /*self*/) mutable {
-                    {
-                        LockGuard<Mutex> lck_store (store_mtx_);
-                        LockGuard<Mutex> lck_sub_unsub (sub_unsub_inflight_mtx_);
-                        packet_id_.erase(info.packet_id);
-                        sub_unsub_inflight_.erase(info.packet_id);
-                    }
+                (buffer body, buffer buf, any session_life_keeper, this_type_sp self) mutable {
                     switch (version_) {
                     case protocol_version::v3_1_1:
-                    {
                         // TODO: We can avoid an allocation by casting the raw bytes of the
                         // mqtt::buffer that is being parsed, and instead call the suback
                         // handler with an std::span and the mqtt::buffer (as lifekeeper)
-                        std::vector<suback_return_code> results;
-                        results.resize(body.size());
+                        info.return_codes.resize(body.size());
                         std::transform(
                             body.begin(),
                             body.end(),
-                            results.begin(),
+                            info.return_codes.begin(),
                             // http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/errata01/os/mqtt-v3.1.1-errata01-os-complete.html#_Toc442180880
                             // The SUBACK Packet sent by the Server to the Client MUST
                             // contain a return code for each Topic Filter/QoS pair.
@@ -7557,22 +8084,16 @@ private:
                                 return static_cast<suback_return_code>(e);
                             }
                         );
-                        if (on_suback(info.packet_id, force_move(results))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
-                        }
                         break;
-                    }
                     case protocol_version::v5:
-                    {
                         // TODO: We can avoid an allocation by casting the raw bytes of the
                         // mqtt::buffer that is being parsed, and instead call the suback
                         // handler with an std::span and the mqtt::buffer (as lifekeeper)
-                        std::vector<v5::suback_reason_code> reasons;
-                        reasons.resize(body.size());
+                        info.reason_codes.resize(body.size());
                         std::transform(
                             body.begin(),
                             body.end(),
-                            reasons.begin(),
+                            info.reason_codes.begin(),
                             // https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901170
                             // The SUBACK packet sent by the Server to the Client MUST
                             // contain a Reason Code for each Topic Filter/Subscription
@@ -7584,18 +8105,42 @@ private:
                                 return static_cast<v5::suback_reason_code>(e);
                             }
                         );
-                        if (on_v5_suback(info.packet_id, force_move(reasons), force_move(info.props))) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
-                        }
                         break;
-                    }
                     default:
                         BOOST_ASSERT(false);
                     }
+                    process_suback_impl<suback_phase::finish>(
+                        force_move(session_life_keeper),
+                        force_move(buf),
+                        force_move(info),
+                        force_move(self)
+                    );
                 },
                 force_move(self)
             );
             break;
+        case suback_phase::finish:
+            {
+                LockGuard<Mutex> lck_store (store_mtx_);
+                LockGuard<Mutex> lck_sub_unsub (sub_unsub_inflight_mtx_);
+                packet_id_.erase(info.packet_id);
+                sub_unsub_inflight_.erase(info.packet_id);
+            }
+            switch (version_) {
+            case protocol_version::v3_1_1:
+                if (on_suback(info.packet_id, force_move(info.return_codes))) {
+                    on_mqtt_message_processed(force_move(session_life_keeper));
+                }
+                break;
+            case protocol_version::v5:
+                if (on_v5_suback(info.packet_id, force_move(info.reason_codes), force_move(info.props))) {
+                    on_mqtt_message_processed(force_move(session_life_keeper));
+                }
+                break;
+            default:
+                BOOST_ASSERT(false);
+            }
+            break;
         }
     }
 
@@ -7608,15 +8153,10 @@ private:
         finish,
     };
 
-    struct unsubscribe_info {
-        packet_id_t packet_id;
-        v5::properties props;
-        std::vector<buffer> entries;
-    };
+    using unsubscribe_info = codec::v5::unsubscribe_packet<PacketIdBytes>;
 
     void process_unsubscribe(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -7630,7 +8170,6 @@ private:
         process_header<unsubscribe_info,
                        &this_type::process_unsubscribe_impl<unsubscribe_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             unsubscribe_info(),
             force_move(self)
@@ -7750,16 +8289,17 @@ private:
         packet_id,
         properties,
         reasons,
+        finish,
     };
 
     struct unsuback_info {
         packet_id_t packet_id;
         v5::properties props;
+        std::vector<v5::unsuback_reason_code> reason_codes;
     };
 
     void process_unsuback(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         static constexpr std::size_t header_len =
@@ -7773,7 +8313,6 @@ private:
         process_header<unsuback_info,
                        &this_type::process_unsuback_impl<unsuback_phase::packet_id>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             unsuback_info(),
             force_move(self)
@@ -7798,17 +8337,14 @@ private:
                 ]
                 (packet_id_t packet_id, buffer buf, any session_life_keeper, this_type_sp self) mutable {
                     info.packet_id = packet_id;
-                    {
-                        LockGuard<Mutex> lck_store (store_mtx_);
-                        LockGuard<Mutex> lck_sub_unsub (sub_unsub_inflight_mtx_);
-                        packet_id_.erase(info.packet_id);
-                        sub_unsub_inflight_.erase(info.packet_id);
-                    }
                     switch (version_) {
                     case protocol_version::v3_1_1:
-                        if (on_unsuback(info.packet_id)) {
-                            on_mqtt_message_processed(force_move(session_life_keeper));
-                        }
+                        process_unsuback_impl<unsuback_phase::finish>(
+                            force_move(session_life_keeper),
+                            force_move(buf),
+                            force_move(info),
+                            force_move(self)
+                        );
                         break;
                     case protocol_version::v5:
                         process_unsuback_impl<unsuback_phase::properties>(
@@ -7854,32 +8390,48 @@ private:
                     this,
                     info = force_move(info)
                 ]
-                (buffer body, buffer /*buf*/, any session_life_keeper, this_type_sp /*self*/) mutable {
-                    BOOST_ASSERT(version_ == protocol_version::v5);
-                    {
-                        LockGuard<Mutex> lck_store (store_mtx_);
-                        LockGuard<Mutex> lck_sub_unsub (sub_unsub_inflight_mtx_);
-                        packet_id_.erase(info.packet_id);
-                        sub_unsub_inflight_.erase(info.packet_id);
-                    }
-
-                    std::vector<v5::unsuback_reason_code> reasons;
-                    reasons.resize(body.size());
+                (buffer body, buffer buf, any session_life_keeper, this_type_sp self) mutable {
+                    info.reason_codes.resize(body.size());
                     std::transform(
                         body.begin(),
                         body.end(),
-                        reasons.begin(),
+                        info.reason_codes.begin(),
                         [&](auto const& e) {
                             return static_cast<v5::unsuback_reason_code>(e);
                         }
                     );
-                    if (on_v5_unsuback(info.packet_id, force_move(reasons), force_move(info.props))) {
-                        on_mqtt_message_processed(force_move(session_life_keeper));
-                    }
+                    process_unsuback_impl<unsuback_phase::finish>(
+                        force_move(session_life_keeper),
+                        force_move(buf),
+                        force_move(info),
+                        force_move(self)
+                    );
                 },
                 force_move(self)
             );
             break;
+        case unsuback_phase::finish:
+            {
+                LockGuard<Mutex> lck_store (store_mtx_);
+                LockGuard<Mutex> lck_sub_unsub (sub_unsub_inflight_mtx_);
+                packet_id_.erase(info.packet_id);
+                sub_unsub_inflight_.erase(info.packet_id);
+            }
+            switch (version_) {
+            case protocol_version::v3_1_1:
+                if (on_unsuback(info.packet_id)) {
+                    on_mqtt_message_processed(force_move(session_life_keeper));
+                }
+                break;
+            case protocol_version::v5:
+                if (on_v5_unsuback(info.packet_id, force_move(info.reason_codes), force_move(info.props))) {
+                    on_mqtt_message_processed(force_move(session_life_keeper));
+                }
+                break;
+            default:
+                BOOST_ASSERT(false);
+            }
+            break;
         }
     }
 
@@ -7923,14 +8475,10 @@ private:
         finish,
     };
 
-    struct disconnect_info {
-        v5::disconnect_reason_code reason_code;
-        v5::properties props;
-    };
+    using disconnect_info = codec::v5::disconnect_packet;
 
     void process_disconnect(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         if (remaining_length_ == 0) {
@@ -7960,7 +8508,6 @@ private:
         process_header<disconnect_info,
                        &this_type::process_disconnect_impl<disconnect_phase::reason_code>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             disconnect_info(),
             force_move(self)
@@ -8039,14 +8586,10 @@ private:
         finish,
     };
 
-    struct auth_info {
-        v5::auth_reason_code reason_code;
-        v5::properties props;
-    };
+    using auth_info = codec::v5::auth_packet;
 
     void process_auth(
         any session_life_keeper,
-        bool all_read,
         this_type_sp self
     ) {
         if (version_ != protocol_version::v5) {
@@ -8075,7 +8618,6 @@ private:
         process_header<auth_info,
                        &this_type::process_auth_impl<auth_phase::reason_code>>(
             force_move(session_life_keeper),
-            all_read,
             header_len,
             auth_info(),
             force_move(self)
@@ -8605,16 +9147,39 @@ private:
     }
 
     // Blocking write
-    template <typename MessageVariant>
-    void do_sync_write(MessageVariant&& mv) {
+    template <typename Message>
+    void do_sync_write(Message const& m) {
         error_code ec;
         if (!connected_) return;
         on_pre_send();
-        total_bytes_sent_ += socket_->write(const_buffer_sequence<PacketIdBytes>(std::forward<MessageVariant>(mv)), ec);
+        total_bytes_sent_ += write_to_socket(m.const_buffer_sequence(), ec, std::is_same<Socket, MQTT_NS::socket>());
         // If ec is set as error, the error will be handled by async_read.
         // If `handle_error(ec);` is called here, error_handler would be called twice.
     }
 
+    void do_sync_write(basic_message_variant<PacketIdBytes> const& mv) {
+        MQTT_NS::visit(
+            [this](auto const& m) {
+                do_sync_write(m);
+            },
+            mv
+        );
+    }
+
+    // MQTT_NS::socket takes const_buffer_span. It refers to the sequence of the message
+    // (std::array, static_vector, or std::vector) without copying it.
+    template <typename ConstBufferSequence>
+    std::size_t write_to_socket(ConstBufferSequence const& buffers, error_code& ec, std::true_type) {
+        return socket_->write(const_buffer_span(buffers), ec);
+    }
+
+    // static_socket takes the buffer sequence of the message as is,
+    // so the fixed-shape messages (acks of v3.1.1, pings) are written from std::array without allocation.
+    template <typename ConstBufferSequence>
+    std::size_t write_to_socket(ConstBufferSequence const& buffers, error_code& ec, std::false_type) {
+        return socket_->write(buffers, ec);
+    }
+
     // Non blocking (async) senders
     void async_send_connect(
         buffer client_id,
@@ -9157,9 +9722,11 @@ private:
     public:
         async_packet(
             basic_message_variant<PacketIdBytes> mv,
-            async_handler_t h = {})
+            async_handler_t h,
+            std::size_t size)
             : mv_(force_move(mv))
-            , handler_(force_move(h)) {}
+            , handler_(force_move(h))
+            , size_(size) {}
         basic_message_variant<PacketIdBytes> const& message() const {
             return mv_;
         }
@@ -9168,161 +9735,254 @@ private:
         }
         async_handler_t const& handler() const { return handler_; }
         async_handler_t& handler() { return handler_; }
+        std::size_t size() const { return size_; }
     private:
         basic_message_variant<PacketIdBytes> mv_;
         async_handler_t handler_;
+        std::size_t size_;
     };
 
     struct write_completion_handler {
         write_completion_handler(
             std::shared_ptr<this_type> self,
-            async_handler_t func,
+            std::size_t num_of_priority_messages,
             std::size_t num_of_messages,
             std::size_t expected)
             :self_(force_move(self)),
-             func_(force_move(func)),
+             num_of_priority_messages_(num_of_priority_messages),
              num_of_messages_(num_of_messages),
              bytes_to_transfer_(expected)
-        {
-            // write_completion_handler is only constructed in one place
-            // and a handler is provided in that location.
-            // Since we don't check that the handler is valid before calling it
-            // it's a bug if the handler is invalid when constructed.
-            BOOST_ASSERT(func_);
-        }
+        {}
         void operator()(error_code ec) const {
-            func_(ec);
-            for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
-            }
+            self_->pop_written(ec, num_of_priority_messages_, num_of_messages_);
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
                 self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    // Handlers for outgoing packets need not be valid.
-                    if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
-                }
+                self_->abort_queued(ec);
                 return;
             }
-            if (!self_->queue_.empty()) {
+            // The messages pushed while writing join the next write, so that acknowledgements
+            // and pings among them are sent at this write boundary.
+            self_->consume_async_queue();
+            if (!self_->queue_empty()) {
                 self_->do_async_write();
             }
         }
         void operator()(
             error_code ec,
             std::size_t bytes_transferred) const {
-            func_(ec);
             self_->total_bytes_sent_ += bytes_transferred;
-            for (std::size_t i = 0; i != num_of_messages_; ++i) {
-                self_->queue_.pop_front();
-            }
+            self_->pop_written(ec, num_of_priority_messages_, num_of_messages_);
             if (ec || // Error is handled by async_read.
                 !self_->connected_) {
                 self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    // Handlers for outgoing packets need not be valid.
-                    if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
-                }
+                self_->abort_queued(ec);
                 return;
             }
             if (bytes_to_transfer_ != bytes_transferred) {
                 self_->connected_ = false;
-                while (!self_->queue_.empty()) {
-                    // Handlers for outgoing packets need not be valid.
-                    if(auto&& h = self_->queue_.front().handler()) h(ec);
-                    self_->queue_.pop_front();
-                }
+                self_->abort_queued(ec);
                 throw write_bytes_transferred_error(bytes_to_transfer_, bytes_transferred);
             }
-            if (!self_->queue_.empty()) {
+            // The messages pushed while writing join the next write, so that acknowledgements
+            // and pings among them are sent at this write boundary.
+            self_->consume_async_queue();
+            if (!self_->queue_empty()) {
                 self_->do_async_write();
             }
         }
         std::shared_ptr<this_type> self_;
-        async_handler_t func_;
+        std::size_t num_of_priority_messages_;
         std::size_t num_of_messages_;
         std::size_t bytes_to_transfer_;
     };
 
-    void do_async_write() {
-        // Only attempt to send up to the user specified maximum items
-        using difference_t = typename decltype(queue_)::difference_type;
-        std::size_t iterator_count =   (max_queue_send_count_ == 0)
-                                ? queue_.size()
-                                : std::min(max_queue_send_count_, queue_.size());
-        auto const& start = queue_.cbegin();
-        auto end = std::next(start, boost::numeric_cast<difference_t>(iterator_count));
+    // The messages being written stay at the front of the queues until the write completes.
+    // So the queues are not empty while writing.
+    bool queue_empty() const {
+        return priority_queue_.empty() && queue_.empty();
+    }
 
-        // And further, only up to the specified maximum bytes
-        std::size_t total_bytes = 0;
-        std::size_t total_const_buffer_sequence = 0;
-        for (auto it = start; it != end; ++it) {
-            auto const& elem = *it;
-            auto const& mv = elem.message();
-            std::size_t const size = MQTT_NS::size<PacketIdBytes>(mv);
-
-            // If we hit the byte limit, we don't include this buffer for this send.
-            if (max_queue_send_size_ != 0 && max_queue_send_size_ < total_bytes + size) {
-                end = it;
-                iterator_count = boost::numeric_cast<std::size_t>(std::distance(start, end));
-                break;
+    // The handlers are called from the queues, so the handlers of the written messages are never copied.
+    void pop_written(error_code ec, std::size_t num_of_priority_messages, std::size_t num_of_messages) {
+        auto pop =
+            [&](std::deque<async_packet>& q, std::size_t n) {
+                for (std::size_t i = 0; i != n; ++i) {
+                    auto h = force_move(q.front().handler());
+                    dequeued(q.front().size());
+                    q.pop_front();
+                    // Handlers for outgoing packets need not be valid.
+                    if (h) h(ec);
+                }
+            };
+        pop(priority_queue_, num_of_priority_messages);
+        pop(queue_, num_of_messages);
+    }
+
+    void abort_queued(error_code ec) {
+        for (auto q : { &priority_queue_, &queue_ }) {
+            while (!q->empty()) {
+                // Handlers for outgoing packets need not be valid.
+                if(auto&& h = q->front().handler()) h(ec);
+                dequeued(q->front().size());
+                q->pop_front();
             }
-            total_bytes += size;
-            total_const_buffer_sequence += num_of_const_buffer_sequence(mv);
         }
+    }
 
-        std::vector<as::const_buffer> buf;
-        std::vector<async_handler_t> handlers;
-
-        buf.reserve(total_const_buffer_sequence);
-        handlers.reserve(iterator_count);
+    void do_async_write() {
+        // Only attempt to send up to the user specified maximum items
+        std::size_t const max_count =   (max_queue_send_count_ == 0)
+                                      ? std::numeric_limits<std::size_t>::max()
+                                      : max_queue_send_count_;
 
-        for (auto it = start; it != end; ++it) {
-            auto const& elem = *it;
-            auto const& mv = elem.message();
-            auto const& cbs = const_buffer_sequence(mv);
-            std::copy(cbs.begin(), cbs.end(), std::back_inserter(buf));
-            handlers.emplace_back(elem.handler());
-        }
+        // And further, only up to the specified maximum bytes
+        std::size_t total_bytes = 0;
+        std::size_t iterator_count = 0;
+
+        // The messages are selected and their buffers are appended in one pass.
+        // The sizes are cached on the queued packets, and send_buffers_ keeps its capacity
+        // between writes, so no per-message allocation happens here.
+        // send_buffers_ is not touched until the write completes, so the socket refers to it
+        // without copying it.
+        send_buffers_.clear();
+        auto collect =
+            [&](std::deque<async_packet> const& q) {
+                std::size_t count = 0;
+                for (auto const& elem : q) {
+                    if (iterator_count == max_count) break;
+                    std::size_t const size = elem.size();
+
+                    // If we hit the byte limit, we don't include this buffer for this send.
+                    if (max_queue_send_size_ != 0 && max_queue_send_size_ < total_bytes + size) {
+                        break;
+                    }
+                    MQTT_NS::add_const_buffer_sequence(send_buffers_, elem.message());
+                    total_bytes += size;
+                    ++iterator_count;
+                    ++count;
+                }
+                return count;
+            };
+        // Acknowledgements and pings go ahead of the other messages.
+        std::size_t const priority_count = collect(priority_queue_);
+        std::size_t const count =
+            (priority_count == priority_queue_.size()) ? collect(queue_) : 0;
 
         on_pre_send();
 
         socket_->async_write(
-            force_move(buf),
+            const_buffer_span(send_buffers_),
             write_completion_handler(
                 this->shared_from_this(),
-                [handlers = force_move(handlers)]
-                (error_code ec) {
-                    for (auto const& h : handlers) {
-                        if (h) h(ec);
-                    }
-                },
-                iterator_count,
+                priority_count,
+                count,
                 total_bytes
             )
         );
     }
 
     void do_async_write(basic_message_variant<PacketIdBytes> mv, async_handler_t func) {
-        // Move this job to the socket's strand so that it can be queued without mutexes.
+        if (queue_congested_ &&
+            queue_overflow_policy_ != queue_overflow_policy::enqueue &&
+            is_qos0_publish(mv)) {
+            if (func) {
+                auto ec =
+                    queue_overflow_policy_ == queue_overflow_policy::drop_qos0
+                    ? error_code()
+                    : error_code(as::error::no_buffer_space);
+                socket_->post(
+                    [func = force_move(func), ec, self = this->shared_from_this()]
+                    () {
+                        func(ec);
+                    }
+                );
+            }
+            return;
+        }
+        std::size_t const size = MQTT_NS::size<PacketIdBytes>(mv);
+        // Count the message before it is visible to the strand, so that it is never counted out first.
+        enqueued(size);
+        // Any thread can push the message. Only the push that makes the queue non-empty
+        // moves the job to the socket's strand, and the strand moves all the pushed messages to queue_.
+        if (async_queue_.push(async_packet(force_move(mv), force_move(func), size))) {
+            post_drain_async_queue();
+        }
+    }
+
+    void post_drain_async_queue() {
         socket_->post(
-            [this, self = this->shared_from_this(), mv = force_move(mv), func = force_move(func)]
-            () mutable {
+            [this, self = this->shared_from_this()]
+            () {
+                drain_async_queue();
+            }
+        );
+    }
+
+    // Move the pushed messages to the queues.
+    void consume_async_queue() {
+        async_queue_.consume_all(
+            [&](async_packet&& p) {
                 if (!connected_) {
                     // offline async publish is successfully finished, because there's nothing to do.
-                    if (func) func(error_code(static_cast<int>(message_size_errc), generic_category()));
+                    if (auto&& h = p.handler()) h(error_code(static_cast<int>(message_size_errc), generic_category()));
+                    dequeued(p.size());
                     return;
                 }
-                queue_.emplace_back(force_move(mv), force_move(func));
-                // Only need to start async writes if there was nothing in the queue before the above item.
-                if (queue_.size() > 1) return;
-                do_async_write();
+                if (is_priority_message(p.message())) {
+                    priority_queue_.push_back(force_move(p));
+                }
+                else {
+                    queue_.push_back(force_move(p));
+                }
             }
         );
     }
 
+    void drain_async_queue() {
+        // Only need to start async writes if there was nothing in the queues before the pushed items.
+        bool const writing = !queue_empty();
+        try {
+            consume_async_queue();
+        }
+        catch (...) {
+            // The next push doesn't post the drain, so post it for the rest.
+            post_drain_async_queue();
+            throw;
+        }
+        if (!writing && !queue_empty()) do_async_write();
+    }
+
+    bool queue_over_high_watermark(std::size_t bytes, std::size_t messages) const {
+        return
+            (queue_high_bytes_ != 0 && bytes >= queue_high_bytes_) ||
+            (queue_high_messages_ != 0 && messages >= queue_high_messages_);
+    }
+
+    bool queue_under_low_watermark(std::size_t bytes, std::size_t messages) const {
+        return
+            (queue_high_bytes_ == 0 || bytes <= queue_low_bytes_) &&
+            (queue_high_messages_ == 0 || messages <= queue_low_messages_);
+    }
+
+    // Called in the thread that pushes the message.
+    void enqueued(std::size_t size) {
+        std::size_t const bytes = queued_bytes_ += size;
+        std::size_t const messages = ++queued_messages_;
+        if (queue_over_high_watermark(bytes, messages) && !queue_congested_.exchange(true)) {
+            on_queue_high_watermark();
+        }
+    }
+
+    // Called in the socket's strand.
+    void dequeued(std::size_t size) {
+        std::size_t const bytes = queued_bytes_ -= size;
+        std::size_t const messages = --queued_messages_;
+        if (queue_congested_ && queue_under_low_watermark(bytes, messages) && queue_congested_.exchange(false)) {
+            on_queue_low_watermark();
+        }
+    }
+
     static constexpr std::uint16_t make_uint16_t(char b1, char b2) {
         return
             static_cast<std::uint16_t>(
@@ -9356,7 +10016,7 @@ protected:
     bool clean_session_{false};
 
 private:
-    optional<MQTT_NS::socket> socket_;
+    optional<Socket> socket_;
     std::atomic<bool> connected_{false};
     std::atomic<bool> mqtt_connected_{false};
 
@@ -9369,7 +10029,10 @@ private:
     Mutex store_mtx_;
     mi_store store_;
     std::set<packet_id_t> qos2_publish_handled_;
+    std::deque<async_packet> priority_queue_;
     std::deque<async_packet> queue_;
+    mpsc_queue<async_packet> async_queue_;
+    std::vector<as::const_buffer> send_buffers_;
     packet_id_t packet_id_master_{0};
     std::set<packet_id_t> packet_id_;
     Mutex sub_unsub_inflight_mtx_;
@@ -9378,10 +10041,19 @@ private:
     bool auto_pub_response_async_{false};
     bool async_send_store_ { false };
     bool async_read_on_message_processed_ { true };
+    bool publish_property_view_{false};
     bool disconnect_requested_{false};
     bool connect_requested_{false};
     std::size_t max_queue_send_count_{1};
     std::size_t max_queue_send_size_{0};
+    std::size_t queue_high_bytes_{0};
+    std::size_t queue_low_bytes_{0};
+    std::size_t queue_high_messages_{0};
+    std::size_t queue_low_messages_{0};
+    queue_overflow_policy queue_overflow_policy_{queue_overflow_policy::enqueue};
+    std::atomic<std::size_t> queued_bytes_{0};
+    std::atomic<std::size_t> queued_messages_{0};
+    std::atomic<bool> queue_congested_{false};
     protocol_version version_{protocol_version::undetermined};
     std::size_t packet_bulk_read_limit_ = 256;
     std::size_t props_bulk_read_limit_ = packet_bulk_read_limit_;
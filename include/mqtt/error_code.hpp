@@ -13,6 +13,7 @@
 #include <system_error>
 #else
 #include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
 #endif // ASIO_STANDALONE
 
 namespace MQTT_NS {
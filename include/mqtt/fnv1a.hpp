@@ -0,0 +1,37 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_FNV1A_HPP)
+#define MQTT_FNV1A_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/string_view.hpp>
+
+namespace MQTT_NS {
+
+namespace detail {
+
+/**
+ * @brief 32bit FNV-1a hash of the string
+ * It is cheap for short strings such as topic names.
+ */
+inline std::size_t fnv1a(string_view s) {
+    std::uint32_t h = 2166136261u;
+    for (auto c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+} // namespace detail
+
+} // namespace MQTT_NS
+
+#endif // MQTT_FNV1A_HPP
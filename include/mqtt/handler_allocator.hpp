@@ -0,0 +1,172 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_HANDLER_ALLOCATOR_HPP)
+#define MQTT_HANDLER_ALLOCATOR_HPP
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Recycling memory for the asynchronous operations of a connection
+ * A connection has at most one read, one write, and a few posts in flight.
+ * Their operation states are placed in the fixed slots, so the steady state I/O
+ * doesn't allocate. If all slots are in use, or the requested size is larger
+ * than the slot, then the memory is allocated from the heap.
+ * allocate() and deallocate() can be called from any thread.
+ * tcp_endpoint, ws_endpoint, shm_endpoint, loopback_endpoint, and uring_endpoint
+ * allocate their completion handlers from it.
+ * Only the asio operation states are recycled. The std::function that the socket
+ * interface converts the handlers to, the per phase lambdas of the endpoint, and
+ * the messages themselves are still allocated from the heap, so a QoS1 PUBLISH/PUBACK
+ * round trip costs about 14 global allocations (see test/handler_allocator.cpp).
+ */
+class handler_memory {
+public:
+    static constexpr std::size_t slot_size = 512;
+    static constexpr std::size_t slot_count = 4;
+
+    handler_memory() = default;
+    handler_memory(handler_memory const&) = delete;
+    handler_memory& operator=(handler_memory const&) = delete;
+
+    void* allocate(std::size_t size) {
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        if (size <= slot_size) {
+            for (auto& s : slots_) {
+                bool expected = false;
+                if (s.in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return &s.storage;
+                }
+            }
+        }
+        heap_allocations_.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p) {
+        for (auto& s : slots_) {
+            if (p == &s.storage) {
+                s.in_use.store(false, std::memory_order_release);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+    /**
+     * @brief Get the number of allocations
+     * @return the number of allocations including heap_allocations()
+     */
+    std::size_t allocations() const {
+        return allocations_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the number of allocations that fell back to the heap
+     * @return the number of heap allocations
+     */
+    std::size_t heap_allocations() const {
+        return heap_allocations_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct slot {
+        typename std::aligned_storage<slot_size>::type storage;
+        std::atomic<bool> in_use{false};
+    };
+    std::array<slot, slot_count> slots_;
+    std::atomic<std::size_t> allocations_{0};
+    std::atomic<std::size_t> heap_allocations_{0};
+};
+
+/**
+ * @brief Allocator that allocates from handler_memory
+ * The operations keep the memory alive, so the memory can outlive its connection
+ * until the aborted operations are destroyed.
+ */
+template <typename T>
+class handler_allocator {
+public:
+    using value_type = T;
+
+    explicit handler_allocator(std::shared_ptr<handler_memory> mem)
+        :mem_(force_move(mem)) {}
+
+    template <typename U>
+    handler_allocator(handler_allocator<U> const& other) noexcept
+        :mem_(other.mem_) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(mem_->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t /*n*/) {
+        mem_->deallocate(p);
+    }
+
+    template <typename U>
+    bool operator==(handler_allocator<U> const& rhs) const noexcept {
+        return mem_ == rhs.mem_;
+    }
+
+    template <typename U>
+    bool operator!=(handler_allocator<U> const& rhs) const noexcept {
+        return mem_ != rhs.mem_;
+    }
+
+private:
+    template <typename U>
+    friend class handler_allocator;
+
+    std::shared_ptr<handler_memory> mem_;
+};
+
+/**
+ * @brief Completion handler that has handler_allocator as the associated allocator
+ */
+template <typename Handler>
+class allocating_handler {
+public:
+    using allocator_type = handler_allocator<Handler>;
+
+    template <typename H>
+    allocating_handler(std::shared_ptr<handler_memory> const& mem, H&& h)
+        :mem_(mem),
+         handler_(std::forward<H>(h)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(mem_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    std::shared_ptr<handler_memory> mem_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline allocating_handler<std::decay_t<Handler>>
+make_allocating_handler(std::shared_ptr<handler_memory> const& mem, Handler&& h) {
+    return allocating_handler<std::decay_t<Handler>>(mem, std::forward<Handler>(h));
+}
+
+} // namespace MQTT_NS
+
+#endif // MQTT_HANDLER_ALLOCATOR_HPP
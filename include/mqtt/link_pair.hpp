@@ -0,0 +1,97 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_LINK_PAIR_HPP)
+#define MQTT_LINK_PAIR_HPP
+
+#include <utility>
+
+#if ASIO_STANDALONE
+#include <asio.hpp>
+#else
+#include <boost/asio.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+namespace detail {
+
+using link_pair = std::pair<as::ip::tcp::socket, as::ip::tcp::socket>;
+
+/**
+ * @brief Create a pair of TCP sockets connected to each other on the loopback interface.
+ * The transports that don't carry bytes on a socket (shm, loopback) use one end as
+ * lowest_layer(). No data flows on it. TCP socket options can be set on it, closing it
+ * locally (e.g. endpoint::force_disconnect()) aborts the pending wait on it, and the
+ * peer observes EOF.
+ *
+ * It is a real TCP connection because the type erased socket requires
+ * as::ip::tcp::socket::lowest_layer_type. Each pair costs two file descriptors and an
+ * ephemeral port while it is alive, and loopback networking must be available.
+ * The temporary listener is closed before returning.
+ * @param ioc1 io_context of the first socket
+ * @param ioc2 io_context of the second socket
+ * @param ec error code
+ * @return connected sockets. Both are closed on error.
+ */
+inline link_pair make_link_pair(as::io_context& ioc1, as::io_context& ioc2, error_code& ec) {
+    link_pair lp { as::ip::tcp::socket(ioc1), as::ip::tcp::socket(ioc2) };
+    as::ip::tcp::acceptor ac(ioc1);
+    as::ip::tcp::endpoint ep(as::ip::address_v4::loopback(), 0);
+    ac.open(ep.protocol(), ec);
+    if (!ec) ac.bind(ep, ec);
+    // The backlog is large enough that a foreign connection doesn't block the own connect.
+    if (!ec) ac.listen(as::socket_base::max_listen_connections, ec);
+    if (!ec) ep = ac.local_endpoint(ec);
+    if (!ec) lp.first.connect(ep, ec);
+    as::ip::tcp::endpoint local;
+    if (!ec) local = lp.first.local_endpoint(ec);
+    // Another local process could connect to the port first.
+    // Its connection is dropped, and the next one in the backlog is accepted.
+    constexpr std::size_t max_accepts = 16;
+    for (std::size_t i = 0; !ec; ++i) {
+        if (i == max_accepts) {
+            ec = make_error_code(as::error::connection_refused);
+            break;
+        }
+        ac.accept(lp.second, ec);
+        if (ec) break;
+        auto remote = lp.second.remote_endpoint(ec);
+        if (!ec && remote == local) break;
+        error_code ignored;
+        lp.second.close(ignored);
+        ec = error_code();
+    }
+    if (ec) {
+        error_code ignored;
+        lp.first.close(ignored);
+        lp.second.close(ignored);
+    }
+    return lp;
+}
+
+inline link_pair make_link_pair(as::io_context& ioc1, as::io_context& ioc2) {
+    error_code ec;
+    auto lp = make_link_pair(ioc1, ioc2, ec);
+    if (ec) throw system_error(ec);
+    return lp;
+}
+
+} // namespace detail
+
+} // namespace MQTT_NS
+
+#endif // MQTT_LINK_PAIR_HPP
@@ -0,0 +1,464 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_LOOPBACK_ENDPOINT_HPP)
+#define MQTT_LOOPBACK_ENDPOINT_HPP
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <utility>
+#include <functional>
+
+#include <boost/container/small_vector.hpp>
+
+#if ASIO_STANDALONE
+#include <asio.hpp>
+#else
+#include <boost/asio.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/link_pair.hpp>
+#include <mqtt/handler_allocator.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+namespace detail {
+
+/**
+ * @brief One direction of the in-process connection.
+ * Written buffers are queued as they are. The reader copies them directly
+ * into its own buffer, then the completion handler of the writer is called.
+ */
+struct loopback_pipe {
+    using handler_type = std::function<void(error_code, std::size_t)>;
+
+    struct chunk {
+        std::vector<as::const_buffer> bufs;
+        std::string owned; // storage for synchronous write
+        std::size_t index = 0;
+        std::size_t offset = 0;
+        std::size_t size = 0;
+        handler_type handler;
+    };
+
+    std::deque<chunk> chunks;
+    as::mutable_buffer read_buf;
+    std::size_t read_transferred = 0;
+    handler_type read_handler;
+    as::executor reader_ex; // strand of the reading side
+    as::executor writer_ex; // strand of the writing side
+    std::shared_ptr<handler_memory> reader_mem; // handler memory of the reading side
+    std::shared_ptr<handler_memory> writer_mem; // handler memory of the writing side
+    bool write_closed = false;
+    bool read_closed = false;
+};
+
+/**
+ * @brief State shared by the two sides of the in-process connection.
+ * pipes[0] carries bytes from the side 0 to the side 1, pipes[1] is the opposite.
+ */
+struct loopback_channel {
+    std::mutex mtx;
+    loopback_pipe pipes[2];
+};
+
+/**
+ * @brief Completion collected under the channel mutex and posted after it is unlocked.
+ */
+struct loopback_completion {
+    loopback_pipe::handler_type handler;
+    error_code ec;
+    std::size_t size;
+    as::executor ex;
+    std::shared_ptr<handler_memory> mem;
+};
+
+using loopback_completions = boost::container::small_vector<loopback_completion, 2>;
+
+} // namespace detail
+
+/**
+ * @brief In-process transport.
+ * The pair of loopback_endpoint is connected each other via memory.
+ * No system call is issued to transfer the bytes.
+ *
+ * lowest_layer() returns one end of a connected TCP loopback pair (see detail::make_link_pair())
+ * that never carries data. It exists for the socket configuration code and
+ * endpoint::force_disconnect(). Closing it closes the transport.
+ */
+template <typename Strand>
+class loopback_endpoint : public std::enable_shared_from_this<loopback_endpoint<Strand>> {
+public:
+    using this_type = loopback_endpoint<Strand>;
+
+    /**
+     * @brief Constructor
+     * @param ioc io_context that runs the handlers
+     * @param channel state shared with the peer
+     * @param side 0 or 1. The peer has the other one.
+     * @param link one end of the link pair. Its io_context must be ioc.
+     */
+    loopback_endpoint(
+        as::io_context& ioc,
+        std::shared_ptr<detail::loopback_channel> channel,
+        std::size_t side,
+        as::ip::tcp::socket link)
+        :strand_(ioc),
+         link_(force_move(link)),
+         channel_(force_move(channel)),
+         out_(channel_->pipes[side]),
+         in_(channel_->pipes[1 - side]) {
+        std::lock_guard<std::mutex> g(channel_->mtx);
+        out_.writer_ex = as::executor(strand_);
+        in_.reader_ex = as::executor(strand_);
+        out_.writer_mem = handler_memory_;
+        in_.reader_mem = handler_memory_;
+    }
+
+    loopback_endpoint(this_type const&) = delete;
+    loopback_endpoint& operator=(this_type const&) = delete;
+
+    ~loopback_endpoint() {
+        shutdown();
+    }
+
+    void close(error_code& ec) {
+        if (link_.is_open()) link_.close(ec);
+        else ec = error_code();
+        shutdown();
+    }
+
+    auto get_executor() {
+        return lowest_layer().get_executor();
+    }
+
+    as::ip::tcp::socket::lowest_layer_type& lowest_layer() {
+        return link_;
+    }
+
+    as::ip::tcp::socket::native_handle_type native_handle() {
+        return link_.native_handle();
+    }
+
+    template <typename ReadHandler>
+    void async_read(
+        as::mutable_buffer buffers,
+        ReadHandler&& handler) {
+        start_watch();
+        detail::loopback_completions done;
+        {
+            std::lock_guard<std::mutex> g(channel_->mtx);
+            hold(in_.reader_ex);
+            if (in_.read_closed) {
+                done.push_back({ std::forward<ReadHandler>(handler), as::error::bad_descriptor, 0, in_.reader_ex, in_.reader_mem });
+            }
+            else {
+                in_.read_buf = buffers;
+                in_.read_transferred = 0;
+                in_.read_handler = std::forward<ReadHandler>(handler);
+                transfer(in_, done);
+            }
+        }
+        invoke(done);
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(
+        ConstBufferSequence const& buffers,
+        WriteHandler&& handler) {
+        start_watch();
+        detail::loopback_completions done;
+        {
+            std::lock_guard<std::mutex> g(channel_->mtx);
+            hold(out_.writer_ex);
+            if (auto ec = write_error()) {
+                done.push_back({ std::forward<WriteHandler>(handler), ec, 0, out_.writer_ex, out_.writer_mem });
+            }
+            else {
+                out_.chunks.emplace_back();
+                auto& c = out_.chunks.back();
+                c.bufs.assign(as::buffer_sequence_begin(buffers), as::buffer_sequence_end(buffers));
+                c.size = as::buffer_size(buffers);
+                c.handler = std::forward<WriteHandler>(handler);
+                transfer(out_, done);
+            }
+        }
+        invoke(done);
+    }
+
+    /**
+     * @brief Synchronous write
+     * The bytes are copied into the pipe and this function returns immediately.
+     * It never waits for the peer, so it is safe to call from the handler even if both
+     * sides run on the same thread.
+     */
+    template <typename ConstBufferSequence>
+    std::size_t write(
+        ConstBufferSequence const& buffers,
+        error_code& ec) {
+        start_watch();
+        detail::loopback_completions done;
+        std::size_t size = 0;
+        {
+            std::lock_guard<std::mutex> g(channel_->mtx);
+            ec = write_error();
+            if (!ec) {
+                size = as::buffer_size(buffers);
+                out_.chunks.emplace_back();
+                auto& c = out_.chunks.back();
+                c.owned.resize(size);
+                as::buffer_copy(as::buffer(&c.owned[0], size), buffers);
+                c.bufs.emplace_back(as::buffer(c.owned));
+                c.size = size;
+                transfer(out_, done);
+            }
+        }
+        invoke(done);
+        return size;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(
+        ConstBufferSequence const& buffers) {
+        error_code ec;
+        auto size = write(buffers, ec);
+        if (ec) throw system_error(ec);
+        return size;
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        as::post(
+            strand_,
+            make_allocating_handler(handler_memory_, std::forward<PostHandler>(handler))
+        );
+    }
+
+    /**
+     * @brief Get the memory of the asynchronous operations
+     * @return handler_memory. Its counters show how many allocations fell back to the heap.
+     */
+    handler_memory const& get_handler_memory() const {
+        return *handler_memory_;
+    }
+
+private:
+    // The pending operation keeps the io_context running as the socket operation does.
+    // The work is finished in invoke() after the completion is posted.
+    static void hold(as::executor const& ex) {
+        ex.on_work_started();
+    }
+
+    // Completion handlers are always invoked via the strand of the side that
+    // initiated the operation, never inside the initiating function.
+    // The handler is moved into the posted function that is allocated from the
+    // handler memory of that side.
+    static void invoke(detail::loopback_completions& done) {
+        for (auto& c : done) {
+            as::post(
+                c.ex,
+                make_allocating_handler(
+                    c.mem,
+                    [h = force_move(c.handler), ec = c.ec, size = c.size] {
+                        h(ec, size);
+                    }
+                )
+            );
+            c.ex.on_work_finished();
+        }
+    }
+
+    error_code write_error() const {
+        if (out_.write_closed) return as::error::bad_descriptor;
+        if (out_.read_closed) return as::error::broken_pipe;
+        return error_code();
+    }
+
+    // Copy queued chunks into the pending read buffer.
+    // Called with the channel mutex locked. Completions are collected into done and
+    // posted after the mutex is unlocked.
+    static void transfer(detail::loopback_pipe& p, detail::loopback_completions& done) {
+        while (p.read_handler) {
+            if (p.read_transferred == p.read_buf.size()) {
+                complete_read(p, error_code(), done);
+                return;
+            }
+            if (p.chunks.empty()) {
+                if (p.write_closed) complete_read(p, as::error::eof, done);
+                return;
+            }
+            auto& c = p.chunks.front();
+            while (c.index != c.bufs.size() && p.read_transferred != p.read_buf.size()) {
+                auto n = as::buffer_copy(p.read_buf + p.read_transferred, c.bufs[c.index] + c.offset);
+                p.read_transferred += n;
+                c.offset += n;
+                if (c.offset == c.bufs[c.index].size()) {
+                    ++c.index;
+                    c.offset = 0;
+                }
+            }
+            if (c.index == c.bufs.size()) {
+                if (c.handler) {
+                    done.push_back({ force_move(c.handler), error_code(), c.size, p.writer_ex, p.writer_mem });
+                }
+                p.chunks.pop_front();
+            }
+        }
+    }
+
+    static void complete_read(detail::loopback_pipe& p, error_code ec, detail::loopback_completions& done) {
+        done.push_back({ force_move(p.read_handler), ec, p.read_transferred, p.reader_ex, p.reader_mem });
+        p.read_handler = nullptr;
+    }
+
+    void shutdown() {
+        detail::loopback_completions done;
+        {
+            std::lock_guard<std::mutex> g(channel_->mtx);
+            if (out_.write_closed) return;
+            // The peer reads the remaining bytes and then gets EOF.
+            out_.write_closed = true;
+            transfer(out_, done);
+            // The bytes the peer has written but this side hasn't read are discarded.
+            in_.read_closed = true;
+            if (in_.read_handler) {
+                complete_read(in_, as::error::operation_aborted, done);
+            }
+            for (auto& c : in_.chunks) {
+                if (c.handler) {
+                    done.push_back({ force_move(c.handler), as::error::broken_pipe, 0, in_.writer_ex, in_.writer_mem });
+                }
+            }
+            in_.chunks.clear();
+        }
+        invoke(done);
+    }
+
+    // The link never carries data. Only the local close, e.g. force_disconnect(),
+    // aborts the wait. The close of the peer is notified via the channel, so that
+    // the bytes the peer has written before closing are still read.
+    // It is called on any thread by write(), so the wait is started once on the strand.
+    void start_watch() {
+        if (watching_.exchange(true)) return;
+        std::weak_ptr<this_type> wp(this->shared_from_this());
+        as::post(
+            strand_,
+            [this, wp] {
+                auto sp = wp.lock();
+                if (!sp) return;
+                // Closed locally before the wait is started.
+                if (!link_.is_open()) {
+                    shutdown();
+                    return;
+                }
+                link_.async_wait(
+                    as::socket_base::wait_read,
+                    as::bind_executor(
+                        strand_,
+                        [wp](error_code ec) {
+                            auto sp = wp.lock();
+                            if (!sp) return;
+                            if (ec == as::error::operation_aborted || !sp->link_.is_open()) {
+                                sp->shutdown();
+                            }
+                        }
+                    )
+                );
+            }
+        );
+    }
+
+private:
+    Strand strand_;
+    as::ip::tcp::socket link_;
+    std::shared_ptr<detail::loopback_channel> channel_;
+    detail::loopback_pipe& out_;
+    detail::loopback_pipe& in_;
+    std::atomic<bool> watching_{false};
+    std::shared_ptr<handler_memory> handler_memory_ = std::make_shared<handler_memory>();
+};
+
+template <typename Strand, typename MutableBufferSequence, typename ReadHandler>
+inline void async_read(
+    loopback_endpoint<Strand>& ep,
+    MutableBufferSequence && buffers,
+    ReadHandler&& handler) {
+    ep.async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    loopback_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    loopback_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    error_code& ec) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers), ec);
+}
+
+template <typename Strand, typename ConstBufferSequence, typename WriteHandler>
+inline void async_write(
+    loopback_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    WriteHandler&& handler) {
+    ep.async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+}
+
+/**
+ * @brief Create a connected pair of in-process transports.
+ * @param ioc1 io_context for the first transport
+ * @param ioc2 io_context for the second transport
+ * @param ec error code
+ * @return pair of the connected transports. Both are nullptr on error.
+ */
+template <typename Strand = as::io_context::strand>
+inline std::pair<std::shared_ptr<loopback_endpoint<Strand>>, std::shared_ptr<loopback_endpoint<Strand>>>
+make_loopback_pair(as::io_context& ioc1, as::io_context& ioc2, error_code& ec) {
+    auto link = detail::make_link_pair(ioc1, ioc2, ec);
+    if (ec) return {};
+    auto channel = std::make_shared<detail::loopback_channel>();
+    return std::make_pair(
+        std::make_shared<loopback_endpoint<Strand>>(ioc1, channel, 0, force_move(link.first)),
+        std::make_shared<loopback_endpoint<Strand>>(ioc2, channel, 1, force_move(link.second))
+    );
+}
+
+/**
+ * @brief Create a connected pair of in-process transports.
+ * @param ioc1 io_context for the first transport
+ * @param ioc2 io_context for the second transport
+ * @return pair of the connected transports
+ */
+template <typename Strand = as::io_context::strand>
+inline std::pair<std::shared_ptr<loopback_endpoint<Strand>>, std::shared_ptr<loopback_endpoint<Strand>>>
+make_loopback_pair(as::io_context& ioc1, as::io_context& ioc2) {
+    error_code ec;
+    auto sockets = make_loopback_pair<Strand>(ioc1, ioc2, ec);
+    if (ec) throw system_error(ec);
+    return sockets;
+}
+
+} // namespace MQTT_NS
+
+#endif // MQTT_LOOPBACK_ENDPOINT_HPP
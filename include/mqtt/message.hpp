@@ -8,6 +8,7 @@
 #define MQTT_MESSAGE_HPP
 
 #include <string>
+#include <array>
 #include <vector>
 #include <memory>
 #include <algorithm>
@@ -67,10 +68,20 @@ public:
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The size is fixed, so the sequence is held in place without allocation.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        return { as::buffer(message_.data(), message_.size()) };
+    std::array<as::const_buffer, 1> const_buffer_sequence() const {
+        return {{ as::buffer(message_.data(), message_.size()) }};
+    }
+
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(message_.data(), message_.size()));
     }
 
     /**
@@ -131,10 +142,20 @@ public:
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The size is fixed, so the sequence is held in place without allocation.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        return { as::buffer(message_.data(), size()) };
+    std::array<as::const_buffer, 1> const_buffer_sequence() const {
+        return {{ as::buffer(message_.data(), size()) }};
+    }
+
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(message_.data(), size()));
     }
 
     /**
@@ -268,10 +289,20 @@ public:
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The size is fixed, so the sequence is held in place without allocation.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        return { as::buffer(message_.data(), size()) };
+    std::array<as::const_buffer, 1> const_buffer_sequence() const {
+        return {{ as::buffer(message_.data(), size()) }};
+    }
+
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(message_.data(), size()));
     }
 
     /**
@@ -384,34 +415,41 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(protocol_name_and_level_.data(), protocol_name_and_level_.size()));
-        ret.emplace_back(as::buffer(&connect_flags_, 1));
-        ret.emplace_back(as::buffer(keep_alive_buf_.data(), keep_alive_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(protocol_name_and_level_.data(), protocol_name_and_level_.size()));
+        v.emplace_back(as::buffer(&connect_flags_, 1));
+        v.emplace_back(as::buffer(keep_alive_buf_.data(), keep_alive_buf_.size()));
 
-        ret.emplace_back(as::buffer(client_id_length_buf_.data(), client_id_length_buf_.size()));
-        ret.emplace_back(as::buffer(client_id_));
+        v.emplace_back(as::buffer(client_id_length_buf_.data(), client_id_length_buf_.size()));
+        v.emplace_back(as::buffer(client_id_));
 
         if (connect_flags::has_will_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(will_topic_name_length_buf_.data(), will_topic_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(will_topic_name_));
-            ret.emplace_back(as::buffer(will_message_length_buf_.data(), will_message_length_buf_.size()));
-            ret.emplace_back(as::buffer(will_message_));
+            v.emplace_back(as::buffer(will_topic_name_length_buf_.data(), will_topic_name_length_buf_.size()));
+            v.emplace_back(as::buffer(will_topic_name_));
+            v.emplace_back(as::buffer(will_message_length_buf_.data(), will_message_length_buf_.size()));
+            v.emplace_back(as::buffer(will_message_));
         }
 
         if (connect_flags::has_user_name_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(user_name_length_buf_.data(), user_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(user_name_));
+            v.emplace_back(as::buffer(user_name_length_buf_.data(), user_name_length_buf_.size()));
+            v.emplace_back(as::buffer(user_name_));
         }
 
         if (connect_flags::has_password_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(password_length_buf_.data(), password_length_buf_.size()));
-            ret.emplace_back(as::buffer(password_));
+            v.emplace_back(as::buffer(password_length_buf_.data(), password_length_buf_.size()));
+            v.emplace_back(as::buffer(password_));
         }
-
-        return ret;
     }
 
     /**
@@ -619,6 +657,22 @@ public:
         }
     }
 
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(topic_name_length_buf_.data(), topic_name_length_buf_.size()));
+        v.emplace_back(as::buffer(topic_name_));
+        if (!packet_id_.empty()) {
+            v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        }
+        v.emplace_back(as::buffer(payload_));
+    }
+
     /**
      * @brief Get whole size of sequence
      * @return whole size
@@ -799,20 +853,27 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
 
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         for (auto const& e : entries_) {
-            ret.emplace_back(as::buffer(e.topic_name_length_buf_.data(), e.topic_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(e.topic_name_));
-            ret.emplace_back(as::buffer(&e.qos_, 1));
+            v.emplace_back(as::buffer(e.topic_name_length_buf_.data(), e.topic_name_length_buf_.size()));
+            v.emplace_back(as::buffer(e.topic_name_));
+            v.emplace_back(as::buffer(&e.qos_, 1));
         }
-
-        return ret;
     }
 
     /**
@@ -903,15 +964,22 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
-
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
-        ret.emplace_back(as::buffer(entries_));
-
+        add_const_buffer_sequence(ret);
         return ret;
     }
 
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        v.emplace_back(as::buffer(entries_));
+    }
+
     /**
      * @brief Get whole size of sequence
      * @return whole size
@@ -1010,18 +1078,25 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         for (auto const& e : entries_) {
-            ret.emplace_back(as::buffer(e.topic_name_length_buf_.data(), e.topic_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(e.topic_name_));
+            v.emplace_back(as::buffer(e.topic_name_length_buf_.data(), e.topic_name_length_buf_.size()));
+            v.emplace_back(as::buffer(e.topic_name_));
         }
-
-        return ret;
     }
 
     /**
@@ -53,11 +53,30 @@ using message_variant = basic_message_variant<2>;
 
 namespace detail {
 
+// The endpoint doesn't use it. It writes the sequence of each message as is.
 struct const_buffer_sequence_visitor {
     template <typename T>
     std::vector<as::const_buffer> operator()(T&& t) const {
-        return t.const_buffer_sequence();
+        return to_vector(t.const_buffer_sequence());
     }
+private:
+    static std::vector<as::const_buffer> to_vector(std::vector<as::const_buffer> v) {
+        return v;
+    }
+    // Fixed-shape messages return std::array, and the v5 acks return static_vector.
+    template <typename ConstBufferSequence>
+    static std::vector<as::const_buffer> to_vector(ConstBufferSequence const& s) {
+        return std::vector<as::const_buffer>(s.begin(), s.end());
+    }
+};
+
+struct add_const_buffer_sequence_visitor {
+    add_const_buffer_sequence_visitor(std::vector<as::const_buffer>& v):v(v) {}
+    template <typename T>
+    void operator()(T&& t) const {
+        t.add_const_buffer_sequence(v);
+    }
+    std::vector<as::const_buffer>& v;
 };
 
 struct size_visitor {
@@ -81,14 +100,98 @@ struct continuous_buffer_visitor {
     }
 };
 
+struct priority_message_visitor {
+    template <typename T>
+    bool operator()(T const&) const {
+        return false;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v3_1_1::basic_puback_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v3_1_1::basic_pubrec_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v3_1_1::basic_pubrel_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v3_1_1::basic_pubcomp_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    bool operator()(v3_1_1::pingreq_message const&) const {
+        return true;
+    }
+    bool operator()(v3_1_1::pingresp_message const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v5::basic_puback_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v5::basic_pubrec_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v5::basic_pubrel_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v5::basic_pubcomp_message<PacketIdBytes> const&) const {
+        return true;
+    }
+    bool operator()(v5::pingreq_message const&) const {
+        return true;
+    }
+    bool operator()(v5::pingresp_message const&) const {
+        return true;
+    }
+};
+
+struct qos0_publish_visitor {
+    template <typename T>
+    bool operator()(T const&) const {
+        return false;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v3_1_1::basic_publish_message<PacketIdBytes> const& m) const {
+        return m.get_qos() == qos::at_most_once;
+    }
+    template <std::size_t PacketIdBytes>
+    bool operator()(v5::basic_publish_message<PacketIdBytes> const& m) const {
+        return m.get_qos() == qos::at_most_once;
+    }
+};
+
 } // namespace detail
 
+/**
+ * @brief Get the const buffer sequence of the message as an owning std::vector
+ * Use add_const_buffer_sequence() with a reused vector to avoid the allocation.
+ * @param mv message
+ * @return const buffer sequence
+ */
 template <std::size_t PacketIdBytes>
 inline std::vector<as::const_buffer> const_buffer_sequence(
     basic_message_variant<PacketIdBytes> const& mv) {
     return MQTT_NS::visit(detail::const_buffer_sequence_visitor(), mv);
 }
 
+/**
+ * @brief Append the const buffer sequence of the message
+ * @param v buffer sequence to be appended. It can be reused between messages to avoid allocations.
+ * @param mv message
+ */
+template <std::size_t PacketIdBytes>
+inline void add_const_buffer_sequence(
+    std::vector<as::const_buffer>& v,
+    basic_message_variant<PacketIdBytes> const& mv) {
+    MQTT_NS::visit(detail::add_const_buffer_sequence_visitor(v), mv);
+}
+
 template <std::size_t PacketIdBytes>
 inline std::size_t size(basic_message_variant<PacketIdBytes> const& mv) {
     return MQTT_NS::visit(detail::size_visitor(), mv);
@@ -105,6 +208,28 @@ inline std::string continuous_buffer(basic_message_variant<PacketIdBytes> const&
     return MQTT_NS::visit(detail::continuous_buffer_visitor(), mv);
 }
 
+/**
+ * @brief Check if the message is sent ahead of the other messages
+ * @param mv message
+ * @return true if the message is a publish acknowledgement (PUBACK, PUBREC, PUBREL, PUBCOMP),
+ *         PINGREQ, or PINGRESP.
+ * They are small, and the peer's flow control and keep alive wait for them.
+ */
+template <std::size_t PacketIdBytes>
+inline bool is_priority_message(basic_message_variant<PacketIdBytes> const& mv) {
+    return MQTT_NS::visit(detail::priority_message_visitor(), mv);
+}
+
+/**
+ * @brief Check if the message is a QoS0 PUBLISH
+ * @param mv message
+ * @return true if the message is a PUBLISH whose QoS is at_most_once
+ */
+template <std::size_t PacketIdBytes>
+inline bool is_qos0_publish(basic_message_variant<PacketIdBytes> const& mv) {
+    return MQTT_NS::visit(detail::qos0_publish_visitor(), mv);
+}
+
 
 //  store_message_variant
 
@@ -0,0 +1,186 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_MPSC_QUEUE_HPP)
+#define MQTT_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief Lock-free multi producer single consumer queue
+ * Any thread can push(). Only one thread at a time (e.g. a strand) can consume_all().
+ * push() tells the producer whether the consumer needs to be woken up, so the consumer
+ * is scheduled once per batch of pushes instead of once per push.
+ *
+ * The producers push onto a lock-free stack. The consumer takes the whole stack at once
+ * and reverses it, so the values are consumed in the pushed order.
+ * When the consumer finds the stack empty, it replaces the top with the blocked marker.
+ * The producer that replaces the marker wakes up the consumer. The consumer never waits
+ * for a producer, and no push is missed.
+ *
+ * The consumed nodes are kept in a pool of up to pool_size nodes and reused by push(),
+ * so the steady state doesn't allocate.
+ */
+template <typename T>
+class mpsc_queue {
+public:
+    static constexpr std::size_t pool_size = 64;
+
+    mpsc_queue() = default;
+
+    mpsc_queue(mpsc_queue const&) = delete;
+    mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+    ~mpsc_queue() {
+        auto top = head_.load(std::memory_order_acquire);
+        if (top == blocked()) top = nullptr;
+        destroy(top);
+        destroy(taken_);
+        destroy(free_.load(std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Push the value
+     * @param value value to push
+     * @return true if the consumer needs to be woken up to call consume_all().
+     *         Only one of the concurrent producers gets true.
+     */
+    bool push(T value) {
+        node* n = acquire_node();
+        n->value.emplace(force_move(value));
+        node* top = head_.load(std::memory_order_relaxed);
+        do {
+            n->next = top == blocked() ? nullptr : top;
+        } while (!head_.compare_exchange_weak(top, n, std::memory_order_acq_rel, std::memory_order_relaxed));
+        return top == blocked();
+    }
+
+    /**
+     * @brief Pop all the pushed values
+     * When it returns, the queue is empty and the next push() wakes up the consumer.
+     * It can be called without being woken up, e.g. at a write boundary.
+     * If f throws, the values that are not consumed yet are kept, and the next push()
+     * doesn't wake up the consumer. Call consume_all() again later.
+     * @param f function that is called with each value in the pushed order
+     */
+    template <typename Func>
+    void consume_all(Func&& f) {
+        while (true) {
+            if (!taken_) {
+                // Already consumed by the previous call. Only the consumer sets the marker,
+                // so the top can't become the marker before the exchange.
+                if (head_.load(std::memory_order_acquire) == blocked()) return;
+                node* top = head_.exchange(nullptr, std::memory_order_acq_rel);
+                if (!top) {
+                    // The pushes after the exchange are consumed in the next iteration.
+                    if (head_.compare_exchange_strong(
+                            top, blocked(), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        return;
+                    }
+                    continue;
+                }
+                taken_ = reverse(top);
+            }
+            while (taken_) {
+                node* n = taken_;
+                taken_ = n->next;
+                T value = force_move(n->value.value());
+                release_node(n);
+                f(force_move(value));
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of the nodes kept for reuse
+     * @return number of the pooled nodes. At most pool_size.
+     */
+    std::size_t pooled() const {
+        return free_count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct node {
+        node* next = nullptr;
+        optional<T> value;
+    };
+
+    node* blocked() {
+        return &blocked_;
+    }
+
+    static node* reverse(node* n) {
+        node* r = nullptr;
+        while (n) {
+            node* next = n->next;
+            n->next = r;
+            r = n;
+            n = next;
+        }
+        return r;
+    }
+
+    static void destroy(node* n) {
+        while (n) {
+            node* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    // Only one producer at a time pops the pool, so the top can't be popped and pushed
+    // back during the pop (ABA). The other producers allocate instead of waiting.
+    node* acquire_node() {
+        if (!popping_.test_and_set(std::memory_order_acquire)) {
+            node* top = free_.load(std::memory_order_acquire);
+            while (top && !free_.compare_exchange_weak(
+                       top, top->next, std::memory_order_acquire, std::memory_order_acquire)) {
+            }
+            popping_.clear(std::memory_order_release);
+            if (top) {
+                free_count_.fetch_sub(1, std::memory_order_relaxed);
+                return top;
+            }
+        }
+        return new node;
+    }
+
+    // Called by the consumer.
+    void release_node(node* n) {
+        n->value = nullopt;
+        if (free_count_.load(std::memory_order_relaxed) >= pool_size) {
+            delete n;
+            return;
+        }
+        free_count_.fetch_add(1, std::memory_order_relaxed);
+        node* top = free_.load(std::memory_order_relaxed);
+        do {
+            n->next = top;
+        } while (!free_.compare_exchange_weak(top, n, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    node blocked_;
+    std::atomic<node*> head_{&blocked_};
+    node* taken_ = nullptr; // the values taken by the consumer in the pushed order
+    std::atomic<node*> free_{nullptr};
+    std::atomic<std::size_t> free_count_{0};
+    std::atomic_flag popping_ = ATOMIC_FLAG_INIT;
+};
+
+template <typename T>
+constexpr std::size_t mpsc_queue<T>::pool_size;
+
+} // namespace MQTT_NS
+
+#endif // MQTT_MPSC_QUEUE_HPP
@@ -0,0 +1,250 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_ORDERED_DISPATCHER_HPP)
+#define MQTT_ORDERED_DISPATCHER_HPP
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if ASIO_STANDALONE
+#include <asio.hpp>
+#else
+#include <boost/asio.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/any.hpp>
+#include <mqtt/fnv1a.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+/**
+ * @brief Worker thread pool that runs the functions of the same key in order
+ * Each key is mapped to one of the lanes by its hash. The functions of a lane
+ * are run one by one in the order they are posted, and the lanes are run
+ * concurrently on the worker threads.
+ */
+class ordered_dispatcher {
+public:
+    /**
+     * @brief Error handler
+     *        It is called on the worker thread with the exception thrown by a posted function.
+     *        An exception thrown by the error handler calls std::terminate().
+     * @param e the exception
+     */
+    using error_handler = std::function<void(std::exception_ptr e)>;
+
+    /**
+     * @brief constructor
+     * @param threads the number of the worker threads. It must not be 0.
+     * @param lanes the number of the lanes. 0 means threads * 4.
+     *              Keys that are mapped to the same lane are also run in order.
+     * @param h error handler. If it is empty, the exceptions are ignored.
+     * @throw std::invalid_argument if threads is 0
+     */
+    explicit ordered_dispatcher(std::size_t threads, std::size_t lanes = 0, error_handler h = error_handler())
+        : h_error_(force_move(h)),
+          guard_(as::make_work_guard(ioc_)) {
+        if (threads == 0) throw std::invalid_argument("ordered_dispatcher requires at least one thread");
+        if (lanes == 0) lanes = threads * 4;
+        lanes_.reserve(lanes);
+        for (std::size_t i = 0; i != lanes; ++i) {
+            lanes_.push_back(std::make_unique<as::io_context::strand>(ioc_));
+        }
+        threads_.reserve(threads);
+        for (std::size_t i = 0; i != threads; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ordered_dispatcher(ordered_dispatcher const&) = delete;
+    ordered_dispatcher& operator=(ordered_dispatcher const&) = delete;
+
+    /**
+     * @brief destructor
+     * The posted functions are run before the worker threads are joined.
+     */
+    ~ordered_dispatcher() {
+        join();
+    }
+
+    /**
+     * @brief Post the function to the lane of the key
+     * @param key key of the order, e.g. topic name
+     * @param f function to run on a worker thread.
+     *          An exception thrown by f is passed to the error handler. The worker thread and
+     *          the following functions of the same key keep running.
+     */
+    template <typename Func>
+    void post(string_view key, Func&& f) {
+        as::post(*lanes_[detail::fnv1a(key) % lanes_.size()], std::forward<Func>(f));
+    }
+
+    /**
+     * @brief Wait until the posted functions are run and stop the worker threads
+     */
+    void join() {
+        guard_.reset();
+        for (auto& t : threads_) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+private:
+    // run() can be called again after an exception escaped from it.
+    // The strand of the lane continues with the next function.
+    void run() {
+        for (;;) {
+            try {
+                ioc_.run();
+                return;
+            }
+            catch (...) {
+                if (h_error_) h_error_(std::current_exception());
+            }
+        }
+    }
+
+    error_handler h_error_;
+    as::io_context ioc_;
+    as::executor_work_guard<as::io_context::executor_type> guard_;
+    std::vector<std::unique_ptr<as::io_context::strand>> lanes_;
+    std::vector<std::thread> threads_;
+};
+
+/**
+ * @brief Offloads the received messages of an endpoint to an ordered_dispatcher
+ * The endpoint stops reading while max_in_flight posted functions are not finished,
+ * and resumes reading when the number drops below the limit.
+ * Create it by make_ordered_offload().
+ * @tparam Endpoint endpoint type, e.g. callable_overlay<server_endpoint<...>>
+ */
+template <typename Endpoint>
+class ordered_offload : public std::enable_shared_from_this<ordered_offload<Endpoint>> {
+public:
+    ordered_offload(ordered_dispatcher& d, std::shared_ptr<Endpoint> const& ep, std::size_t max_in_flight)
+        : dispatcher_(d), ep_(ep), max_in_flight_(max_in_flight) {}
+
+    /**
+     * @brief Post the function to the worker thread pool
+     *        Call it from the handlers of the endpoint, e.g. the publish handler.
+     * @param key key of the order, e.g. topic name
+     * @param f function to run on a worker thread. See ordered_dispatcher::post() about the exception.
+     *          It is counted as finished even if it throws.
+     */
+    template <typename Func>
+    void post(string_view key, Func&& f) {
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            ++in_flight_;
+        }
+        dispatcher_.post(
+            key,
+            [self = this->shared_from_this(), f = std::forward<Func>(f)] () mutable {
+                // in_flight_ is decremented even if f throws. The dispatcher reports the exception.
+                try {
+                    f();
+                }
+                catch (...) {
+                    self->finished();
+                    throw;
+                }
+                self->finished();
+            }
+        );
+    }
+
+    /**
+     * @brief Read the next message, or wait until the number of in flight functions drops
+     *        Call it when the endpoint has processed the message instead of on_mqtt_message_processed().
+     *        make_ordered_offload() sets it to the mqtt_message_processed handler.
+     * @param session_life_keeper the parameter of on_mqtt_message_processed()
+     */
+    void message_processed(any session_life_keeper) {
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            if (in_flight_ >= max_in_flight_) {
+                paused_.emplace(force_move(session_life_keeper));
+                return;
+            }
+        }
+        if (auto ep = ep_.lock()) ep->async_read_next_message(force_move(session_life_keeper));
+    }
+
+    /**
+     * @brief Get the number of the posted functions that are not finished
+     * @return the number of in flight functions
+     */
+    std::size_t in_flight() const {
+        std::lock_guard<std::mutex> g(mtx_);
+        return in_flight_;
+    }
+
+private:
+    void finished() {
+        optional<any> keeper;
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            --in_flight_;
+            if (!paused_ || in_flight_ >= max_in_flight_) return;
+            keeper.emplace(force_move(paused_.value()));
+            paused_ = nullopt;
+        }
+        auto ep = ep_.lock();
+        if (!ep) return;
+        // Reading is resumed on the strand of the endpoint.
+        ep->socket().post(
+            [ep, keeper = force_move(keeper.value())] () mutable {
+                ep->async_read_next_message(force_move(keeper));
+            }
+        );
+    }
+
+    ordered_dispatcher& dispatcher_;
+    std::weak_ptr<Endpoint> ep_;
+    std::size_t const max_in_flight_;
+    mutable std::mutex mtx_;
+    std::size_t in_flight_ = 0;
+    optional<any> paused_;
+};
+
+/**
+ * @brief Create ordered_offload and set it to the mqtt_message_processed handler of ep
+ * @param d dispatcher. It must outlive the returned ordered_offload.
+ * @param ep callable_overlay endpoint
+ * @param max_in_flight the number of in flight functions that stops reading
+ * @return ordered_offload
+ */
+template <typename Endpoint>
+inline std::shared_ptr<ordered_offload<Endpoint>>
+make_ordered_offload(ordered_dispatcher& d, std::shared_ptr<Endpoint> const& ep, std::size_t max_in_flight) {
+    auto o = std::make_shared<ordered_offload<Endpoint>>(d, ep, max_in_flight);
+    ep->set_mqtt_message_processed_handler(
+        [o] (any session_life_keeper) {
+            o->message_processed(force_move(session_life_keeper));
+        }
+    );
+    return o;
+}
+
+} // namespace MQTT_NS
+
+#endif // MQTT_ORDERED_DISPATCHER_HPP
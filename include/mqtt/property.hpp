@@ -140,7 +140,7 @@ struct binary_property {
     template <typename It>
     void fill(It b, It e) const {
         (void)e; // Avoid warning in release builds about unused variable
-        using dt = typename It::difference_type;
+        using dt = typename std::iterator_traits<It>::difference_type;
 
         BOOST_ASSERT(static_cast<std::size_t>(std::distance(b, e)) >= size());
         *b++ = static_cast<typename std::iterator_traits<It>::value_type>(id_);
@@ -534,7 +534,7 @@ public:
     template <typename It>
     void fill(It b, It e) const {
         (void)e; // Avoid warning in release builds about unused variable
-        using dt = typename It::difference_type;
+        using dt = typename std::iterator_traits<It>::difference_type;
         BOOST_ASSERT(static_cast<std::size_t>(std::distance(b, e)) >= size());
 
         *b++ = static_cast<typename std::iterator_traits<It>::value_type>(id_);
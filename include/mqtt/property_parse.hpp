@@ -229,8 +229,8 @@ optional<property_variant> parse_one(buffer& buf) {
 }
 
 inline
-std::vector<property_variant> parse(buffer buf) {
-    std::vector<property_variant> props;
+properties parse(buffer buf) {
+    properties props;
     while (true) {
         if (auto ret = parse_one(buf)) {
             props.push_back(force_move(ret.value()));
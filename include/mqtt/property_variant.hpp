@@ -13,6 +13,13 @@
 
 #include <vector>
 
+#include <boost/container/small_vector.hpp>
+
+// The number of properties that v5::properties holds without allocation.
+#if !defined(MQTT_PROPERTIES_INLINE_CAPACITY)
+#define MQTT_PROPERTIES_INLINE_CAPACITY 3
+#endif // !defined(MQTT_PROPERTIES_INLINE_CAPACITY)
+
 namespace MQTT_NS {
 
 namespace v5 {
@@ -48,7 +55,7 @@ using property_variant = variant<
     property::shared_subscription_available
 >;
 
-using properties = std::vector<property_variant>;
+using properties = boost::container::small_vector<property_variant, MQTT_PROPERTIES_INLINE_CAPACITY>;
 
 namespace property {
 
@@ -0,0 +1,244 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PROPERTY_VIEW_HPP)
+#define MQTT_PROPERTY_VIEW_HPP
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <cstddef>
+#include <iterator>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/property_id.hpp>
+#include <mqtt/property_parse.hpp>
+#include <mqtt/property_variant.hpp>
+#include <mqtt/two_byte_util.hpp>
+#include <mqtt/variable_length.hpp>
+
+namespace MQTT_NS {
+
+namespace v5 {
+
+/**
+ * @brief View of the encoded properties of a received packet
+ * The properties are decoded on demand. Nothing is copied, the view shares
+ * the received bytes. The view is cheap to copy.
+ */
+class property_view {
+public:
+    /**
+     * @brief Iterator that decodes the properties one by one
+     */
+    class const_iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = property_variant;
+        using difference_type = std::ptrdiff_t;
+        using pointer = property_variant const*;
+        using reference = property_variant const&;
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            return cur_.value();
+        }
+
+        pointer operator->() const {
+            return &cur_.value();
+        }
+
+        const_iterator& operator++() {
+            cur_ = property::parse_one(rest_);
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+
+        friend bool operator==(const_iterator const& lhs, const_iterator const& rhs) {
+            // All iterators that reach the end are equal.
+            if (!lhs.cur_ || !rhs.cur_) return !lhs.cur_ && !rhs.cur_;
+            return lhs.rest_.data() == rhs.rest_.data();
+        }
+
+        friend bool operator!=(const_iterator const& lhs, const_iterator const& rhs) {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class property_view;
+
+        explicit const_iterator(buffer raw)
+            : rest_(force_move(raw)) {
+            ++*this;
+        }
+
+        buffer rest_;
+        optional<property_variant> cur_;
+    };
+
+    property_view() = default;
+
+    /**
+     * @brief constructor
+     * @param raw encoded properties without the property length
+     */
+    explicit property_view(buffer raw)
+        : raw_(force_move(raw)) {}
+
+    /**
+     * @brief Get the encoded properties
+     * @return the encoded properties without the property length
+     */
+    buffer const& raw() const {
+        return raw_;
+    }
+
+    bool empty() const {
+        return raw_.empty();
+    }
+
+    /**
+     * @brief Get the iterator of the first property
+     * The iteration stops at the malformed property.
+     * @return iterator
+     */
+    const_iterator begin() const {
+        return const_iterator(raw_);
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    /**
+     * @brief Find the first property that has the id
+     *        Only the found property is decoded. The others are skipped.
+     * @param id property id
+     * @return the property if found, otherwise nullopt
+     */
+    optional<property_variant> find(property::id id) const {
+        buffer rest = raw_;
+        while (!rest.empty()) {
+            if (static_cast<property::id>(rest.front()) == id) return property::parse_one(rest);
+            auto len = encoded_size(rest);
+            if (len == 0) break;
+            rest.remove_prefix(len);
+        }
+        return nullopt;
+    }
+
+    /**
+     * @brief Find the first property that has the id
+     * @tparam Property property type of id, e.g. property::topic_alias
+     * @param id property id
+     * @return the property if found, otherwise nullopt
+     */
+    template <typename Property>
+    optional<Property> get(property::id id) const {
+        if (auto pv = find(id)) return variant_get<Property>(pv.value());
+        return nullopt;
+    }
+
+    /**
+     * @brief Decode all properties
+     * @return properties
+     */
+    properties to_properties() const {
+        return property::parse(raw_);
+    }
+
+    /**
+     * @brief Check that the ids and the lengths of all properties are valid
+     *        The values are not decoded.
+     * @param raw encoded properties without the property length
+     * @return true if valid
+     */
+    static bool well_formed(string_view raw) {
+        while (!raw.empty()) {
+            auto len = encoded_size(raw);
+            if (len == 0) return false;
+            raw.remove_prefix(len);
+        }
+        return true;
+    }
+
+private:
+    // Returns the size of the first property including the id, or 0 if it is malformed.
+    static std::size_t encoded_size(string_view buf) {
+        auto fixed =
+            [&](std::size_t len) -> std::size_t {
+                return buf.size() < 1 + len ? 0 : 1 + len;
+            };
+        auto binary =
+            [&](std::size_t offset) -> std::size_t {
+                if (buf.size() < offset + 2) return 0;
+                auto len = make_uint16_t(
+                    std::next(buf.begin(), static_cast<string_view::difference_type>(offset)),
+                    std::next(buf.begin(), static_cast<string_view::difference_type>(offset + 2))
+                );
+                return buf.size() < offset + 2 + len ? 0 : offset + 2 + len;
+            };
+
+        switch (static_cast<property::id>(buf.front())) {
+        case property::id::payload_format_indicator:
+        case property::id::request_problem_information:
+        case property::id::request_response_information:
+        case property::id::maximum_qos:
+        case property::id::retain_available:
+        case property::id::wildcard_subscription_available:
+        case property::id::subscription_identifier_available:
+        case property::id::shared_subscription_available:
+            return fixed(1);
+        case property::id::server_keep_alive:
+        case property::id::receive_maximum:
+        case property::id::topic_alias_maximum:
+        case property::id::topic_alias:
+            return fixed(2);
+        case property::id::message_expiry_interval:
+        case property::id::session_expiry_interval:
+        case property::id::will_delay_interval:
+        case property::id::maximum_packet_size:
+            return fixed(4);
+        case property::id::subscription_identifier: {
+            auto val_consumed = variable_length(std::next(buf.begin()), buf.end());
+            auto consumed = std::get<1>(val_consumed);
+            return consumed == 0 ? 0 : 1 + consumed;
+        }
+        case property::id::content_type:
+        case property::id::response_topic:
+        case property::id::correlation_data:
+        case property::id::assigned_client_identifier:
+        case property::id::authentication_method:
+        case property::id::authentication_data:
+        case property::id::response_information:
+        case property::id::server_reference:
+        case property::id::reason_string:
+            return binary(1);
+        case property::id::user_property: {
+            auto key_end = binary(1);
+            if (key_end == 0) return 0;
+            return binary(key_end);
+        }
+        }
+        return 0;
+    }
+
+    buffer raw_;
+};
+
+} // namespace v5
+
+} // namespace MQTT_NS
+
+#endif // MQTT_PROPERTY_VIEW_HPP
@@ -9,6 +9,7 @@
 
 #include <mqtt/variant.hpp> // should be top to configure variant limit
 
+#include <atomic>
 #include <memory>
 
 #if ASIO_STANDALONE
@@ -26,8 +27,15 @@
 #include <boost/asio/ssl.hpp>
 #endif // ASIO_STANDALONE
 
+#include <mqtt/tls_session.hpp>
 #endif // defined(MQTT_USE_TLS)
 #include <mqtt/tcp_endpoint.hpp>
+#include <mqtt/shm_endpoint.hpp>
+#include <mqtt/loopback_endpoint.hpp>
+
+#if defined(MQTT_USE_IO_URING)
+#include <mqtt/uring_endpoint.hpp>
+#endif // defined(MQTT_USE_IO_URING)
 
 #if defined(MQTT_USE_WS)
 #include <mqtt/ws_endpoint.hpp>
@@ -46,10 +54,10 @@ namespace as = asio;
 namespace as = boost::asio;
 #endif // ASIO_STANDALONE
 
-template <typename Mutex, template<typename...> class LockGuard, std::size_t PacketIdBytes>
-class server_endpoint : public endpoint<Mutex, LockGuard, PacketIdBytes> {
+template <typename Mutex, template<typename...> class LockGuard, std::size_t PacketIdBytes, typename Socket = MQTT_NS::socket>
+class server_endpoint : public endpoint<Mutex, LockGuard, PacketIdBytes, Socket> {
 public:
-    using endpoint<Mutex, LockGuard, PacketIdBytes>::endpoint;
+    using endpoint<Mutex, LockGuard, PacketIdBytes, Socket>::endpoint;
 protected:
     void on_pre_send() noexcept override {}
     void on_close() noexcept override {}
@@ -200,6 +208,49 @@ private:
 
 #if defined(MQTT_USE_TLS)
 
+namespace detail {
+
+/**
+ * @brief TLS handshake on ioc_con.
+ * The handlers are called as they are, and the connection is delivered directly.
+ */
+struct direct_handshake {
+    template <typename Handler>
+    std::decay_t<Handler> wrap(Handler&& h) const {
+        return std::forward<Handler>(h);
+    }
+
+    template <typename Function>
+    void deliver(Function&& f) const {
+        std::forward<Function>(f)();
+    }
+};
+
+/**
+ * @brief TLS handshake on the separate io_context.
+ * The handlers are bound to a strand of the handshake io_context, and the connection
+ * is handed back to ioc_con after the handshake.
+ */
+struct offloaded_handshake {
+    offloaded_handshake(as::io_context& ioc_handshake, as::io_context& ioc_con)
+        :strand(ioc_handshake), ioc_con(ioc_con) {}
+
+    template <typename Handler>
+    auto wrap(Handler&& h) const {
+        return as::bind_executor(strand, std::forward<Handler>(h));
+    }
+
+    template <typename Function>
+    void deliver(Function&& f) const {
+        as::dispatch(ioc_con, std::forward<Function>(f));
+    }
+
+    as::io_context::strand strand;
+    as::io_context& ioc_con;
+};
+
+} // namespace detail
+
 template <
     typename Strand = as::io_context::strand,
     typename Mutex = std::mutex,
@@ -341,6 +392,55 @@ public:
         return ctx_;
     }
 
+    /**
+     * @brief Set TLS session cache size.
+     * @param size The number of sessions that are cached. 0 disables the cache.
+     * The cached sessions are resumed by the clients that reconnect while the server is running.
+     * To resume the sessions after the server is restarted, use set_tls_session_ticket_keys().
+     */
+    void set_tls_session_cache_size(std::size_t size) {
+        set_tls_session_cache(ctx_, size);
+    }
+
+    /**
+     * @brief Set the keys to encrypt TLS session tickets.
+     * @param keys key material. See MQTT_NS::set_tls_session_ticket_keys().
+     * Servers that use the same keys resume the sessions established by each other,
+     * including the sessions established before the server is restarted.
+     */
+    void set_tls_session_ticket_keys(std::string const& keys) {
+        MQTT_NS::set_tls_session_ticket_keys(ctx_, keys);
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that didn't resume a session.
+     * @return the number of full handshakes
+     */
+    std::size_t tls_full_handshakes() const {
+        return tls_handshakes_->full();
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that resumed a session.
+     * @return the number of resumed handshakes
+     */
+    std::size_t tls_resumed_handshakes() const {
+        return tls_handshakes_->resumed();
+    }
+
+    /**
+     * @brief Set io_context for TLS handshakes.
+     * @param ioc io_context that runs the handshakes of the accepted connections.
+     * The cryptographic work of the handshakes is done by the threads that run ioc, so a burst of
+     * new connections doesn't delay the established connections on ioc_con.
+     * The connection is handed to ioc_con after the handshake, and then the accept handler is called.
+     * The default is ioc_con. In that case, the handshake completes on ioc_con directly without
+     * the strand and the hand over.
+     */
+    void set_handshake_io_context(as::io_context& ioc) {
+        ioc_handshake_ = &ioc;
+    }
+
 private:
     void do_accept() {
         if (close_request_) return;
@@ -355,37 +455,58 @@ private:
                     if (h_error_) h_error_(ec);
                     return;
                 }
-                auto underlying_finished = std::make_shared<bool>(false);
-                auto tim = std::make_shared<as::steady_timer>(ioc_con_);
-                tim->expires_after(underlying_connect_timeout_);
-                tim->async_wait(
-                    [socket, tim, underlying_finished]
-                    (error_code ec) {
-                        if (*underlying_finished) return;
-                        if (ec) return;
-                        error_code close_ec;
-                        socket->lowest_layer().close(close_ec);
-                    }
-                );
-                auto ps = socket.get();
-                ps->async_handshake(
-                    as::ssl::stream_base::server,
-                    [this, socket = force_move(socket), tim, underlying_finished]
-                    (error_code ec) mutable {
-                        *underlying_finished = true;
-                        tim->cancel();
-                        if (ec) {
-                            return;
-                        }
-                        auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
-                        if (h_accept_) h_accept_(force_move(sp));
-                    }
-                );
+                // The direct path is kept if the handshakes run on ioc_con.
+                if (ioc_handshake_ && ioc_handshake_ != &ioc_con_) {
+                    handshake(force_move(socket), detail::offloaded_handshake(*ioc_handshake_, ioc_con_));
+                }
+                else {
+                    handshake(force_move(socket), detail::direct_handshake());
+                }
                 do_accept();
             }
         );
     }
 
+    template <typename Handshake>
+    void handshake(std::shared_ptr<socket_t> socket, Handshake const& hs) {
+        auto underlying_finished = std::make_shared<bool>(false);
+        auto tim = std::make_shared<as::steady_timer>(ioc_con_);
+        tim->expires_after(underlying_connect_timeout_);
+        tim->async_wait(
+            hs.wrap(
+                [socket, tim, underlying_finished]
+                (error_code ec) {
+                    if (*underlying_finished) return;
+                    if (ec) return;
+                    error_code close_ec;
+                    socket->lowest_layer().close(close_ec);
+                }
+            )
+        );
+        auto ps = socket.get();
+        ps->async_handshake(
+            as::ssl::stream_base::server,
+            hs.wrap(
+                [this, socket = force_move(socket), tim, underlying_finished, hs]
+                (error_code ec) mutable {
+                    *underlying_finished = true;
+                    tim->cancel();
+                    if (ec) {
+                        return;
+                    }
+                    tls_handshakes_->count(socket->native_handle());
+                    hs.deliver(
+                        [this, socket = force_move(socket)]
+                        () mutable {
+                            auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
+                            if (h_accept_) h_accept_(force_move(sp));
+                        }
+                    );
+                }
+            )
+        );
+    }
+
 private:
     as::ip::tcp::endpoint ep_;
     as::io_context& ioc_accept_;
@@ -396,6 +517,8 @@ private:
     accept_handler h_accept_;
     error_handler h_error_;
     as::ssl::context ctx_;
+    std::shared_ptr<tls_handshake_counter> tls_handshakes_ = std::make_shared<tls_handshake_counter>();
+    as::io_context* ioc_handshake_ = nullptr;
     protocol_version version_ = protocol_version::undetermined;
     std::chrono::steady_clock::duration underlying_connect_timeout_ = std::chrono::seconds(10);
 };
@@ -524,10 +647,21 @@ public:
         underlying_connect_timeout_ = force_move(timeout);
     }
 
+    /**
+     * @brief Set permessage-deflate settings of the accepted connections.
+     * @param opts deflate settings
+     * The messages are compressed if the client also enables permessage-deflate.
+     * By default, permessage-deflate is disabled.
+     */
+    void set_ws_deflate(ws_deflate_options opts) {
+        deflate_ = force_move(opts);
+    }
+
 private:
     void do_accept() {
         if (close_request_) return;
         auto socket = std::make_shared<socket_t>(ioc_con_);
+        if (deflate_) socket->set_deflate(*deflate_);
         auto ps = socket.get();
         acceptor_.value().async_accept(
             ps->next_layer(),
@@ -644,6 +778,7 @@ private:
     error_handler h_error_;
     protocol_version version_ = protocol_version::undetermined;
     std::chrono::steady_clock::duration underlying_connect_timeout_ = std::chrono::seconds(10);
+    optional<ws_deflate_options> deflate_;
 };
 
 
@@ -774,6 +909,16 @@ public:
         underlying_connect_timeout_ = force_move(timeout);
     }
 
+    /**
+     * @brief Set permessage-deflate settings of the accepted connections.
+     * @param opts deflate settings
+     * The messages are compressed if the client also enables permessage-deflate.
+     * By default, permessage-deflate is disabled.
+     */
+    void set_ws_deflate(ws_deflate_options opts) {
+        deflate_ = force_move(opts);
+    }
+
     /**
      * @brief Get boost asio ssl context.
      * @return ssl context
@@ -790,10 +935,60 @@ public:
         return ctx_;
     }
 
+    /**
+     * @brief Set TLS session cache size.
+     * @param size The number of sessions that are cached. 0 disables the cache.
+     * The cached sessions are resumed by the clients that reconnect while the server is running.
+     * To resume the sessions after the server is restarted, use set_tls_session_ticket_keys().
+     */
+    void set_tls_session_cache_size(std::size_t size) {
+        set_tls_session_cache(ctx_, size);
+    }
+
+    /**
+     * @brief Set the keys to encrypt TLS session tickets.
+     * @param keys key material. See MQTT_NS::set_tls_session_ticket_keys().
+     * Servers that use the same keys resume the sessions established by each other,
+     * including the sessions established before the server is restarted.
+     */
+    void set_tls_session_ticket_keys(std::string const& keys) {
+        MQTT_NS::set_tls_session_ticket_keys(ctx_, keys);
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that didn't resume a session.
+     * @return the number of full handshakes
+     */
+    std::size_t tls_full_handshakes() const {
+        return tls_handshakes_->full();
+    }
+
+    /**
+     * @brief Get the number of TLS handshakes that resumed a session.
+     * @return the number of resumed handshakes
+     */
+    std::size_t tls_resumed_handshakes() const {
+        return tls_handshakes_->resumed();
+    }
+
+    /**
+     * @brief Set io_context for TLS handshakes.
+     * @param ioc io_context that runs the handshakes of the accepted connections.
+     * The cryptographic work of the handshakes is done by the threads that run ioc, so a burst of
+     * new connections doesn't delay the established connections on ioc_con.
+     * The connection is handed to ioc_con after the handshake, and then the accept handler is called.
+     * The default is ioc_con. In that case, the handshake completes on ioc_con directly without
+     * the strand and the hand over.
+     */
+    void set_handshake_io_context(as::io_context& ioc) {
+        ioc_handshake_ = &ioc;
+    }
+
 private:
     void do_accept() {
         if (close_request_) return;
         auto socket = std::make_shared<socket_t>(ioc_con_, ctx_);
+        if (deflate_) socket->set_deflate(*deflate_);
         auto ps = socket.get();
         acceptor_.value().async_accept(
             ps->next_layer().next_layer(),
@@ -804,37 +999,56 @@ private:
                     if (h_error_) h_error_(ec);
                     return;
                 }
-                auto underlying_finished = std::make_shared<bool>(false);
-                auto tim = std::make_shared<as::steady_timer>(ioc_con_);
-                tim->expires_after(underlying_connect_timeout_);
-                tim->async_wait(
-                    [socket, tim, underlying_finished]
-                    (error_code ec) {
-                        if (*underlying_finished) return;
-                        if (ec) return;
-                        error_code close_ec;
-                        socket->lowest_layer().close(close_ec);
-                    }
-                );
+                // The direct path is kept if the handshakes run on ioc_con.
+                if (ioc_handshake_ && ioc_handshake_ != &ioc_con_) {
+                    handshake(force_move(socket), detail::offloaded_handshake(*ioc_handshake_, ioc_con_));
+                }
+                else {
+                    handshake(force_move(socket), detail::direct_handshake());
+                }
+                do_accept();
+            }
+        );
+    }
 
-                auto ps = socket.get();
-                ps->next_layer().async_handshake(
-                    as::ssl::stream_base::server,
-                    [this, socket = force_move(socket), tim, underlying_finished]
-                    (error_code ec) mutable {
-                        if (ec) {
-                            *underlying_finished = true;
-                            tim->cancel();
-                            return;
-                        }
-                        auto sb = std::make_shared<as::streambuf>();
-                        auto request = std::make_shared<boost::beast::http::request<boost::beast::http::string_body>>();
-                        auto ps = socket.get();
-                        boost::beast::http::async_read(
-                            ps->next_layer(),
-                            *sb,
-                            *request,
-                            [this, socket = force_move(socket), sb, request, tim, underlying_finished]
+    template <typename Handshake>
+    void handshake(std::shared_ptr<socket_t> socket, Handshake const& hs) {
+        auto underlying_finished = std::make_shared<bool>(false);
+        auto tim = std::make_shared<as::steady_timer>(ioc_con_);
+        tim->expires_after(underlying_connect_timeout_);
+        tim->async_wait(
+            hs.wrap(
+                [socket, tim, underlying_finished]
+                (error_code ec) {
+                    if (*underlying_finished) return;
+                    if (ec) return;
+                    error_code close_ec;
+                    socket->lowest_layer().close(close_ec);
+                }
+            )
+        );
+
+        auto ps = socket.get();
+        ps->next_layer().async_handshake(
+            as::ssl::stream_base::server,
+            hs.wrap(
+                [this, socket = force_move(socket), tim, underlying_finished, hs]
+                (error_code ec) mutable {
+                    if (ec) {
+                        *underlying_finished = true;
+                        tim->cancel();
+                        return;
+                    }
+                    tls_handshakes_->count(socket->next_layer().native_handle());
+                    auto sb = std::make_shared<as::streambuf>();
+                    auto request = std::make_shared<boost::beast::http::request<boost::beast::http::string_body>>();
+                    auto ps = socket.get();
+                    boost::beast::http::async_read(
+                        ps->next_layer(),
+                        *sb,
+                        *request,
+                        hs.wrap(
+                            [this, socket = force_move(socket), sb, request, tim, underlying_finished, hs]
                             (error_code ec, std::size_t) mutable {
                                 if (ec) {
                                     *underlying_finished = true;
@@ -864,16 +1078,23 @@ private:
                                 }
                                 ps->async_accept(
                                     *request,
-                                    [this, socket = force_move(socket), tim, underlying_finished]
-                                    (error_code ec) mutable {
-                                        *underlying_finished = true;
-                                        tim->cancel();
-                                        if (ec) {
-                                            return;
+                                    hs.wrap(
+                                        [this, socket = force_move(socket), tim, underlying_finished, hs]
+                                        (error_code ec) mutable {
+                                            *underlying_finished = true;
+                                            tim->cancel();
+                                            if (ec) {
+                                                return;
+                                            }
+                                            hs.deliver(
+                                                [this, socket = force_move(socket)]
+                                                () mutable {
+                                                    auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
+                                                    if (h_accept_) h_accept_(force_move(sp));
+                                                }
+                                            );
                                         }
-                                        auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
-                                        if (h_accept_) h_accept_(force_move(sp));
-                                    }
+                                    )
                                 );
 
 #else  // BOOST_BEAST_VERSION >= 248
@@ -887,30 +1108,36 @@ private:
                                             m.insert(it->name(), it->value());
                                         }
                                     },
-                                    [this, socket = force_move(socket), tim, underlying_finished]
-                                    (error_code ec) mutable {
-                                        *underlying_finished = true;
-                                        tim->cancel();
-                                        if (ec) {
-                                            return;
+                                    hs.wrap(
+                                        [this, socket = force_move(socket), tim, underlying_finished, hs]
+                                        (error_code ec) mutable {
+                                            *underlying_finished = true;
+                                            tim->cancel();
+                                            if (ec) {
+                                                return;
+                                            }
+                                            hs.deliver(
+                                                [this, socket]
+                                                () {
+                                                    // TODO: The use of force_move on this line of code causes
+                                                    // a static assertion that socket is a const object when
+                                                    // TLS is enabled, and WS is enabled, with Boost 1.70, and gcc 8.3.0
+                                                    auto sp = std::make_shared<endpoint_t>(socket, version_);
+                                                    if (h_accept_) h_accept_(force_move(sp));
+                                                }
+                                            );
                                         }
-                                        // TODO: The use of force_move on this line of code causes
-                                        // a static assertion that socket is a const object when
-                                        // TLS is enabled, and WS is enabled, with Boost 1.70, and gcc 8.3.0
-                                        auto sp = std::make_shared<endpoint_t>(socket, version_);
-                                        if (h_accept_) h_accept_(force_move(sp));
-                                    }
+                                    )
                                 );
 
 #endif // BOOST_BEAST_VERSION >= 248
 
                                 // scope out point *1
                             }
-                        );
-                    }
-                );
-                do_accept();
-            }
+                        )
+                    );
+                }
+            )
         );
     }
 
@@ -924,14 +1151,490 @@ private:
     accept_handler h_accept_;
     error_handler h_error_;
     as::ssl::context ctx_;
+    std::shared_ptr<tls_handshake_counter> tls_handshakes_ = std::make_shared<tls_handshake_counter>();
+    as::io_context* ioc_handshake_ = nullptr;
     protocol_version version_ = protocol_version::undetermined;
     std::chrono::steady_clock::duration underlying_connect_timeout_ = std::chrono::seconds(10);
+    optional<ws_deflate_options> deflate_;
 };
 
 #endif // defined(MQTT_USE_TLS)
 
 #endif // defined(MQTT_USE_WS)
 
+/**
+ * @brief In-process server. The client and the server exchange bytes via memory.
+ * Each connection also holds a TCP connection on the loopback interface as lowest_layer()
+ * of both endpoints (see detail::make_link_pair()). It costs two file descriptors and an
+ * ephemeral port per connection, and loopback networking must be available.
+ * No data flows on it.
+ */
+template <
+    typename Strand = as::io_context::strand,
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2
+>
+class server_loopback {
+public:
+    using socket_t = loopback_endpoint<Strand>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+
+    /**
+     * @brief Accept handler
+     * @param ep endpoint of the connecting client
+     */
+    using accept_handler = std::function<void(std::shared_ptr<endpoint_t> ep)>;
+
+    /**
+     * @brief Error handler
+     * @param ec error code
+     */
+    using error_handler = std::function<void(error_code ec)>;
+
+    /**
+     * @brief Constructor
+     * @param ioc_accept io_context that calls the accept handler
+     * @param ioc_con io_context for the accepted connections
+     */
+    server_loopback(
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con)
+        : ioc_accept_(ioc_accept),
+          ioc_con_(ioc_con) {
+    }
+
+    server_loopback(
+        as::io_context& ioc)
+        : server_loopback(ioc, ioc) {}
+
+    void listen() {
+        close_request_ = false;
+    }
+
+    void close() {
+        close_request_ = true;
+    }
+
+    /**
+     * @brief Connect to this server in-process.
+     *        The server side endpoint is passed to the accept handler via ioc_accept.
+     * @param ioc io_context for the returned endpoint
+     * @param version MQTT protocol version of the returned endpoint
+     * @param ec error code. as::error::connection_refused if the server is not listening.
+     * @return client side endpoint. Call start_session() and connect() on it.
+     *         nullptr on error.
+     */
+    std::shared_ptr<endpoint_t> connect(
+        as::io_context& ioc,
+        protocol_version version,
+        error_code& ec) {
+        if (close_request_) {
+            ec = as::error::connection_refused;
+            return nullptr;
+        }
+        auto sockets = make_loopback_pair<Strand>(ioc, ioc_con_, ec);
+        if (ec) {
+            as::post(
+                ioc_accept_,
+                [this, ec] {
+                    if (h_error_) h_error_(ec);
+                }
+            );
+            return nullptr;
+        }
+        as::post(
+            ioc_accept_,
+            [this, socket = force_move(sockets.second)] () mutable {
+                if (close_request_) {
+                    error_code ec;
+                    socket->close(ec);
+                    return;
+                }
+                auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
+                if (h_accept_) h_accept_(force_move(sp));
+            }
+        );
+        ec = error_code();
+        return std::make_shared<endpoint_t>(force_move(sockets.first), version);
+    }
+
+    std::shared_ptr<endpoint_t> connect(
+        as::io_context& ioc,
+        protocol_version version = protocol_version::v3_1_1) {
+        error_code ec;
+        auto sp = connect(ioc, version, ec);
+        if (ec) throw system_error(ec);
+        return sp;
+    }
+
+    void set_accept_handler(accept_handler h = accept_handler()) {
+        h_accept_ = force_move(h);
+    }
+
+    /**
+     * @brief Set error handler
+     *        It is called via ioc_accept when connect() fails to create the in-process connection.
+     * @param h handler
+     */
+    void set_error_handler(error_handler h = error_handler()) {
+        h_error_ = force_move(h);
+    }
+
+    /**
+     * @brief Set MQTT protocol version
+     * @param version accepting protocol version
+     * If the specific version is set, only set version is accepted.
+     * If the version is set to protocol_version::undetermined, all versions are accepted.
+     * Initial value is protocol_version::undetermined.
+     */
+    void set_protocol_version(protocol_version version) {
+        version_ = version;
+    }
+
+private:
+    as::io_context& ioc_accept_;
+    as::io_context& ioc_con_;
+    std::atomic<bool> close_request_{true};
+    accept_handler h_accept_;
+    error_handler h_error_;
+    protocol_version version_ = protocol_version::undetermined;
+};
+
+#if defined(MQTT_HAS_IO_URING)
+
+template <
+    typename Strand = as::io_context::strand,
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2
+>
+class server_uring {
+public:
+    using socket_t = uring_endpoint<Strand>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+
+    /**
+     * @brief Accept handler
+     * @param ep endpoint of the connecting client
+     */
+    using accept_handler = std::function<void(std::shared_ptr<endpoint_t> ep)>;
+
+    /**
+     * @brief Error handler
+     * @param ec error code
+     */
+    using error_handler = std::function<void(error_code ec)>;
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con,
+        AcceptorConfig&& config)
+        : ep_(std::forward<AsioEndpoint>(ep)),
+          ioc_accept_(ioc_accept),
+          ioc_con_(ioc_con),
+          acceptor_(as::ip::tcp::acceptor(ioc_accept_, ep_)),
+          config_(std::forward<AcceptorConfig>(config)),
+          uring_(std::make_shared<uring_context>(ioc_con_)) {
+        config_(acceptor_.value());
+    }
+
+    template <typename AsioEndpoint>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc_accept, ioc_con, [](as::ip::tcp::acceptor&) {}) {}
+
+    template <typename AsioEndpoint, typename AcceptorConfig>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc,
+        AcceptorConfig&& config)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc, ioc, std::forward<AcceptorConfig>(config)) {}
+
+    template <typename AsioEndpoint>
+    server_uring(
+        AsioEndpoint&& ep,
+        as::io_context& ioc)
+        : server_uring(std::forward<AsioEndpoint>(ep), ioc, ioc, [](as::ip::tcp::acceptor&) {}) {}
+
+    void listen() {
+        close_request_ = false;
+
+        if (!acceptor_) {
+            try {
+                acceptor_.emplace(ioc_accept_, ep_);
+                config_(acceptor_.value());
+            }
+            catch (system_error const& e) {
+                as::post(
+                    ioc_accept_,
+                    [this, ec = e.code()] {
+                        if (h_error_) h_error_(ec);
+                    }
+                );
+                return;
+            }
+        }
+        do_accept();
+    }
+
+    unsigned short port() const { return acceptor_.value().local_endpoint().port(); }
+
+    void close() {
+        close_request_ = true;
+        acceptor_.reset();
+    }
+
+    void set_accept_handler(accept_handler h = accept_handler()) {
+        h_accept_ = force_move(h);
+    }
+
+    /**
+     * @brief Set error handler
+     * @param h handler
+     */
+    void set_error_handler(error_handler h = error_handler()) {
+        h_error_ = force_move(h);
+    }
+
+    /**
+     * @brief Set MQTT protocol version
+     * @param version accepting protocol version
+     * If the specific version is set, only set version is accepted.
+     * If the version is set to protocol_version::undetermined, all versions are accepted.
+     * Initial value is protocol_version::undetermined.
+     */
+    void set_protocol_version(protocol_version version) {
+        version_ = version;
+    }
+
+    /**
+     * @brief Set io_uring context for the accepted connections
+     * @param uring context. If its enabled() is false, the regular asio socket operations are used.
+     * Initial value is the context that is created on ioc_con with the default parameters.
+     */
+    void set_uring_context(std::shared_ptr<uring_context> uring) {
+        uring_ = force_move(uring);
+    }
+
+    /**
+     * @brief Get io_uring context for the accepted connections
+     */
+    std::shared_ptr<uring_context> const& get_uring_context() const {
+        return uring_;
+    }
+
+private:
+    void do_accept() {
+        if (close_request_) return;
+        auto socket = std::make_shared<socket_t>(ioc_con_, uring_);
+        acceptor_.value().async_accept(
+            socket->lowest_layer(),
+            [this, socket]
+            (error_code ec) mutable {
+                if (ec) {
+                    acceptor_.reset();
+                    if (h_error_) h_error_(ec);
+                    return;
+                }
+                auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
+                if (h_accept_) h_accept_(force_move(sp));
+                do_accept();
+            }
+        );
+    }
+
+private:
+    as::ip::tcp::endpoint ep_;
+    as::io_context& ioc_accept_;
+    as::io_context& ioc_con_;
+    optional<as::ip::tcp::acceptor> acceptor_;
+    std::function<void(as::ip::tcp::acceptor&)> config_;
+    bool close_request_{false};
+    accept_handler h_accept_;
+    error_handler h_error_;
+    protocol_version version_ = protocol_version::undetermined;
+    std::shared_ptr<uring_context> uring_;
+};
+
+#endif // defined(MQTT_HAS_IO_URING)
+
+#if defined(__linux__)
+
+/**
+ * @brief Shared memory server for clients on the same host.
+ * The clients rendezvous on a unix domain socket, then the bytes are exchanged through
+ * shared memory rings (see shm_endpoint).
+ * Each connection also holds a TCP connection on the loopback interface as lowest_layer()
+ * of both endpoints (see detail::make_link_pair()). It is used for socket options,
+ * force_disconnect() and to detect the close of the peer. It costs two file descriptors and
+ * an ephemeral port per connection, and loopback networking must be available.
+ * No data flows on it, so it adds no system call per packet.
+ */
+template <
+    typename Strand = as::io_context::strand,
+    typename Mutex = std::mutex,
+    template<typename...> class LockGuard = std::lock_guard,
+    std::size_t PacketIdBytes = 2
+>
+class server_shm {
+public:
+    using socket_t = shm_endpoint<Strand>;
+    using endpoint_t = callable_overlay<server_endpoint<Mutex, LockGuard, PacketIdBytes>>;
+
+    /**
+     * @brief Accept handler
+     * @param ep endpoint of the connecting client
+     */
+    using accept_handler = std::function<void(std::shared_ptr<endpoint_t> ep)>;
+
+    /**
+     * @brief Error handler
+     * @param ec error code
+     */
+    using error_handler = std::function<void(error_code ec)>;
+
+    /**
+     * @brief Constructor
+     * @param path unix domain socket path that is used for the rendezvous.
+     *        Clients connect to it via shm_connect(). The existing file is removed on listen().
+     * @param ioc_accept io_context for the rendezvous
+     * @param ioc_con io_context for the accepted connections
+     */
+    server_shm(
+        std::string path,
+        as::io_context& ioc_accept,
+        as::io_context& ioc_con)
+        : path_(force_move(path)),
+          ioc_accept_(ioc_accept),
+          ioc_con_(ioc_con) {
+    }
+
+    server_shm(
+        std::string path,
+        as::io_context& ioc)
+        : server_shm(force_move(path), ioc, ioc) {}
+
+    ~server_shm() {
+        close();
+    }
+
+    void listen() {
+        close_request_ = false;
+
+        if (!acceptor_) {
+            try {
+                ::unlink(path_.c_str());
+                acceptor_.emplace(ioc_accept_, as::local::stream_protocol::endpoint(path_));
+            }
+            catch (system_error const& e) {
+                as::post(
+                    ioc_accept_,
+                    [this, ec = e.code()] {
+                        if (h_error_) h_error_(ec);
+                    }
+                );
+                return;
+            }
+        }
+        do_accept();
+    }
+
+    std::string const& path() const { return path_; }
+
+    void close() {
+        close_request_ = true;
+        if (acceptor_) {
+            acceptor_.reset();
+            ::unlink(path_.c_str());
+        }
+    }
+
+    void set_accept_handler(accept_handler h = accept_handler()) {
+        h_accept_ = force_move(h);
+    }
+
+    /**
+     * @brief Set error handler
+     * @param h handler
+     */
+    void set_error_handler(error_handler h = error_handler()) {
+        h_error_ = force_move(h);
+    }
+
+    /**
+     * @brief Set MQTT protocol version
+     * @param version accepting protocol version
+     * If the specific version is set, only set version is accepted.
+     * If the version is set to protocol_version::undetermined, all versions are accepted.
+     * Initial value is protocol_version::undetermined.
+     */
+    void set_protocol_version(protocol_version version) {
+        version_ = version;
+    }
+
+    /**
+     * @brief Set ring buffer capacity of each direction
+     * @param capacity capacity in bytes. Rounded up to the power of two.
+     * Initial value is 1MiB.
+     */
+    void set_ring_capacity(std::size_t capacity) {
+        ring_capacity_ = capacity;
+    }
+
+private:
+    void do_accept() {
+        if (close_request_) return;
+        auto sock = std::make_shared<as::local::stream_protocol::socket>(ioc_accept_);
+        acceptor_.value().async_accept(
+            *sock,
+            [this, sock]
+            (error_code ec) mutable {
+                if (ec) {
+                    acceptor_.reset();
+                    if (h_error_) h_error_(ec);
+                    return;
+                }
+                // A failure of one rendezvous doesn't stop accepting.
+                auto fds = detail::shm_create(ring_capacity_, ec);
+                if (ec) {
+                    do_accept();
+                    return;
+                }
+                // The client receives the second end of the link pair. The server keeps the first end.
+                auto lp = detail::make_link_pair(ioc_accept_, ioc_accept_, ec);
+                if (!ec) detail::shm_send(sock->native_handle(), fds, lp.second.native_handle(), ec);
+                if (!ec) fds.link.reset(lp.first.release(ec));
+                if (ec) {
+                    do_accept();
+                    return;
+                }
+                auto socket = std::make_shared<socket_t>(ioc_con_, shm_role::server, force_move(fds));
+                auto sp = std::make_shared<endpoint_t>(force_move(socket), version_);
+                if (h_accept_) h_accept_(force_move(sp));
+                do_accept();
+            }
+        );
+    }
+
+private:
+    std::string path_;
+    as::io_context& ioc_accept_;
+    as::io_context& ioc_con_;
+    optional<as::local::stream_protocol::acceptor> acceptor_;
+    bool close_request_{false};
+    accept_handler h_accept_;
+    error_handler h_error_;
+    protocol_version version_ = protocol_version::undetermined;
+    std::size_t ring_capacity_ = 1024 * 1024;
+};
+
+#endif // defined(__linux__)
+
 } // namespace MQTT_NS
 
 #endif // MQTT_SERVER_HPP
@@ -0,0 +1,929 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_SHM_ENDPOINT_HPP)
+#define MQTT_SHM_ENDPOINT_HPP
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#if ASIO_STANDALONE
+#include <asio.hpp>
+#else
+#include <boost/asio.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/link_pair.hpp>
+#include <mqtt/handler_allocator.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+/**
+ * @brief Side of the shared memory connection.
+ * The server side creates the shared memory region, the eventfds and the link pair,
+ * the client side receives them via the rendezvous unix domain socket.
+ */
+enum class shm_role {
+    server,
+    client
+};
+
+namespace detail {
+
+/**
+ * @brief Control block of one single producer single consumer ring.
+ * head is written only by the consumer, tail is written only by the producer.
+ * Each of them is placed on its own cache line to avoid false sharing.
+ * Each side keeps its own index privately and only publishes it here, and the index
+ * of the peer is checked against the capacity before it is used.
+ */
+struct shm_ring_control {
+    alignas(64) std::atomic<std::uint64_t> head;
+    alignas(64) std::atomic<std::uint64_t> tail;
+    alignas(64) std::atomic<std::uint32_t> reader_waiting;
+    std::atomic<std::uint32_t> writer_waiting;
+};
+
+/**
+ * @brief Layout of the head of the shared memory region.
+ * rings[0] carries server to client bytes, rings[1] carries client to server bytes.
+ * The two data areas follow the header, capacity bytes each.
+ */
+struct shm_header {
+    shm_ring_control rings[2];
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shm transport requires lock free 64bit atomics");
+
+/**
+ * @brief Owner of a file descriptor. The descriptor is closed on destruction.
+ */
+class unique_fd {
+public:
+    unique_fd() = default;
+    explicit unique_fd(int fd):fd_(fd) {}
+    unique_fd(unique_fd&& other) noexcept :fd_(other.release()) {}
+    unique_fd& operator=(unique_fd&& other) noexcept {
+        reset(other.release());
+        return *this;
+    }
+    unique_fd(unique_fd const&) = delete;
+    unique_fd& operator=(unique_fd const&) = delete;
+    ~unique_fd() {
+        reset();
+    }
+
+    int get() const {
+        return fd_;
+    }
+
+    int release() {
+        int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
+
+    void reset(int fd = -1) {
+        if (fd_ != -1) ::close(fd_);
+        fd_ = fd;
+    }
+
+    explicit operator bool() const {
+        return fd_ != -1;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+/**
+ * @brief File descriptors that make up one shared memory connection.
+ */
+struct shm_fds {
+    unique_fd memfd;
+    unique_fd server_data;  // signaled when the client produced bytes for the server
+    unique_fd server_space; // signaled when the client consumed bytes of the server
+    unique_fd client_data;  // signaled when the server produced bytes for the client
+    unique_fd client_space; // signaled when the server consumed bytes of the client
+    unique_fd link;         // one end of the link pair, kept open to detect the peer close
+    std::uint64_t capacity = 0;
+
+    static constexpr std::size_t num = 6;
+};
+
+/**
+ * @brief Largest ring capacity accepted from the peer.
+ */
+constexpr std::uint64_t shm_max_capacity = std::uint64_t(1) << 30;
+
+inline std::size_t shm_region_size(std::uint64_t capacity) {
+    return sizeof(shm_header) + static_cast<std::size_t>(capacity) * 2;
+}
+
+inline error_code shm_last_error() {
+    return error_code(errno, generic_category());
+}
+
+/**
+ * @brief Create the shared memory region and the eventfds.
+ * @param capacity ring capacity in bytes. Rounded up to the power of two.
+ */
+inline shm_fds shm_create(std::uint64_t capacity, error_code& ec) {
+    shm_fds fds;
+    if (capacity > shm_max_capacity) {
+        ec = as::error::invalid_argument;
+        return fds;
+    }
+    std::uint64_t cap = 64;
+    while (cap < capacity) cap <<= 1;
+
+    fds.capacity = cap;
+    fds.memfd.reset(::memfd_create("mqtt_cpp_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!fds.memfd) {
+        ec = shm_last_error();
+        return fds;
+    }
+    // The client can't shrink the region under the mapping of the server.
+    if (::ftruncate(fds.memfd.get(), static_cast<off_t>(shm_region_size(cap))) == -1 ||
+        ::fcntl(fds.memfd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        ec = shm_last_error();
+        return fds;
+    }
+    for (auto fd : { &fds.server_data, &fds.server_space, &fds.client_data, &fds.client_space }) {
+        fd->reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+        if (!*fd) {
+            ec = shm_last_error();
+            return fds;
+        }
+    }
+    void* addr = ::mmap(nullptr, shm_region_size(cap), PROT_READ | PROT_WRITE, MAP_SHARED, fds.memfd.get(), 0);
+    if (addr == MAP_FAILED) {
+        ec = shm_last_error();
+        return fds;
+    }
+    new (addr) shm_header{};
+    ::munmap(addr, shm_region_size(cap));
+    ec = error_code();
+    return fds;
+}
+
+/**
+ * @brief Check the capacity and the size of the shared memory region before it is mapped.
+ * The capacity must be a power of two not greater than shm_max_capacity, and the memfd must
+ * cover the whole region. Otherwise the access to the mapping could fault.
+ */
+inline void shm_check(int memfd, std::uint64_t cap, error_code& ec) {
+    if (cap == 0 || (cap & (cap - 1)) != 0 || cap > shm_max_capacity) {
+        ec = make_error_code(protocol_error_errc);
+        return;
+    }
+    struct ::stat st;
+    if (::fstat(memfd, &st) == -1) {
+        ec = shm_last_error();
+        return;
+    }
+    if (st.st_size < 0 || static_cast<std::uint64_t>(st.st_size) < shm_region_size(cap)) {
+        ec = make_error_code(protocol_error_errc);
+        return;
+    }
+    ec = error_code();
+}
+
+/**
+ * @brief Pass the memfd, the eventfds and the peer's end of the link pair via SCM_RIGHTS.
+ * @param link the end of the link pair for the peer. The sender closes it after sending.
+ */
+inline void shm_send(int sock, shm_fds const& fds, int link, error_code& ec) {
+    constexpr std::size_t num = shm_fds::num;
+    int raw[num] = {
+        fds.memfd.get(),
+        fds.server_data.get(),
+        fds.server_space.get(),
+        fds.client_data.get(),
+        fds.client_space.get(),
+        link
+    };
+    std::uint64_t cap = fds.capacity;
+    ::iovec iov{ &cap, sizeof(cap) };
+    char ctrl[CMSG_SPACE(sizeof(int) * num)];
+    std::memset(ctrl, 0, sizeof(ctrl));
+    ::msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    ::cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num);
+    std::memcpy(CMSG_DATA(cmsg), raw, sizeof(raw));
+    if (::sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(cap))) {
+        ec = shm_last_error();
+        return;
+    }
+    ec = error_code();
+}
+
+/**
+ * @brief Receive the memfd, the eventfds and the end of the link pair from the peer.
+ * The received capacity and region are checked by shm_check().
+ */
+inline shm_fds shm_recv(int sock, error_code& ec) {
+    constexpr std::size_t num = shm_fds::num;
+    shm_fds fds;
+    std::uint64_t cap = 0;
+    ::iovec iov{ &cap, sizeof(cap) };
+    char ctrl[CMSG_SPACE(sizeof(int) * num)];
+    ::msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    auto received = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    if (received == -1) {
+        ec = shm_last_error();
+        return fds;
+    }
+    ::cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != nullptr &&
+        cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS) {
+        // Take the ownership first, so that the received descriptors are closed on error.
+        int raw[num];
+        std::fill(std::begin(raw), std::end(raw), -1);
+        std::memcpy(
+            raw,
+            CMSG_DATA(cmsg),
+            std::min<std::size_t>(sizeof(raw), cmsg->cmsg_len - CMSG_LEN(0)));
+        fds.memfd.reset(raw[0]);
+        fds.server_data.reset(raw[1]);
+        fds.server_space.reset(raw[2]);
+        fds.client_data.reset(raw[3]);
+        fds.client_space.reset(raw[4]);
+        fds.link.reset(raw[5]);
+    }
+    if (received != static_cast<ssize_t>(sizeof(cap)) ||
+        cmsg == nullptr ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * num)) {
+        ec = make_error_code(protocol_error_errc);
+        return fds;
+    }
+    fds.capacity = cap;
+    shm_check(fds.memfd.get(), cap, ec);
+    return fds;
+}
+
+} // namespace detail
+
+/**
+ * @brief Shared memory transport.
+ * Bytes are exchanged through two single producer single consumer rings in a memfd
+ * mapped by both peers. eventfds wake up the peer only when it is actually waiting,
+ * so a busy connection doesn't issue a syscall per packet.
+ *
+ * lowest_layer() returns one end of a connected TCP loopback pair (see detail::make_link_pair())
+ * that is kept open for the lifetime of the connection. No data flows on it. Closing it
+ * (e.g. endpoint::force_disconnect()) closes the transport, and the peer detects it as EOF.
+ * The pair costs two file descriptors and an ephemeral port per connection. The rendezvous
+ * socket can't take its place because lowest_layer() has to be a TCP socket.
+ *
+ * The state of the read and the write is preallocated in the object. As with a socket,
+ * at most one async_read() and one async_write() can be outstanding at a time.
+ *
+ * The peer can write to the whole shared region. If its ring index is inconsistent,
+ * the operation fails with protocol_error and the transport is closed.
+ */
+template <typename Strand>
+class shm_endpoint : public std::enable_shared_from_this<shm_endpoint<Strand>> {
+public:
+    using this_type = shm_endpoint<Strand>;
+
+    /**
+     * @brief Constructor
+     * @param ioc io_context that runs the handlers
+     * @param role side of the connection
+     * @param fds descriptors created by detail::shm_create() or received by detail::shm_recv().
+     *            The ownership is transferred to this object.
+     */
+    shm_endpoint(as::io_context& ioc, shm_role role, detail::shm_fds fds)
+        :strand_(ioc),
+         link_(ioc, as::ip::tcp::v4(), fds.link.release()),
+         data_wait_(ioc, (role == shm_role::server ? fds.server_data : fds.client_data).release()),
+         space_wait_(ioc, (role == shm_role::server ? fds.server_space : fds.client_space).release()),
+         peer_data_(force_move(role == shm_role::server ? fds.client_data : fds.server_data)),
+         peer_space_(force_move(role == shm_role::server ? fds.client_space : fds.server_space)),
+         memfd_(force_move(fds.memfd)),
+         capacity_(fds.capacity),
+         mask_(fds.capacity - 1) {
+        error_code ec;
+        detail::shm_check(memfd_.get(), capacity_, ec);
+        if (ec) throw system_error(ec);
+        void* addr = ::mmap(
+            nullptr,
+            detail::shm_region_size(capacity_),
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            memfd_.get(),
+            0);
+        if (addr == MAP_FAILED) {
+            throw system_error(detail::shm_last_error());
+        }
+        header_ = static_cast<detail::shm_header*>(addr);
+        auto data = static_cast<char*>(addr) + sizeof(detail::shm_header);
+        std::size_t out_idx = role == shm_role::server ? 0 : 1;
+        out_ = &header_->rings[out_idx];
+        in_ = &header_->rings[1 - out_idx];
+        out_data_ = data + capacity_ * out_idx;
+        in_data_ = data + capacity_ * (1 - out_idx);
+    }
+
+    shm_endpoint(this_type const&) = delete;
+    shm_endpoint& operator=(this_type const&) = delete;
+
+    ~shm_endpoint() {
+        ::munmap(header_, detail::shm_region_size(capacity_));
+    }
+
+    void close(error_code& ec) {
+        closed_ = true;
+        link_.close(ec);
+        error_code ignored;
+        data_wait_.cancel(ignored);
+        space_wait_.cancel(ignored);
+    }
+
+    auto get_executor() {
+        return lowest_layer().get_executor();
+    }
+
+    as::ip::tcp::socket::lowest_layer_type& lowest_layer() {
+        return link_;
+    }
+
+    int native_handle() {
+        return memfd_.get();
+    }
+
+    /**
+     * @brief Ring capacity in bytes for each direction.
+     */
+    std::uint64_t capacity() const {
+        return capacity_;
+    }
+
+    template <typename ReadHandler>
+    void async_read(
+        as::mutable_buffer buffers,
+        ReadHandler&& handler) {
+        start_watch();
+        read_.buf = buffers;
+        read_.transferred = 0;
+        read_.handler = std::forward<ReadHandler>(handler);
+        as::post(
+            strand_,
+            make_allocating_handler(
+                handler_memory_,
+                [this, self = this->shared_from_this()] {
+                    do_read();
+                }
+            )
+        );
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(
+        ConstBufferSequence const& buffers,
+        WriteHandler&& handler) {
+        start_watch();
+        {
+            std::lock_guard<std::mutex> lck(out_mtx_);
+            write_.bufs.assign(as::buffer_sequence_begin(buffers), as::buffer_sequence_end(buffers));
+            write_.index = 0;
+            write_.offset = 0;
+            write_.transferred = 0;
+            write_.handler = std::forward<WriteHandler>(handler);
+            write_.active = true;
+            // The bytes that write() couldn't put into the ring yet go first.
+            write_.after_overflow = overflow_pending();
+        }
+        as::post(
+            strand_,
+            make_allocating_handler(
+                handler_memory_,
+                [this, self = this->shared_from_this()] {
+                    do_write();
+                }
+            )
+        );
+    }
+
+    /**
+     * @brief Synchronous write. It never blocks.
+     * The bytes that don't fit in the ring are kept in the overflow buffer and
+     * written from the strand as the peer consumes the ring.
+     * @return the number of bytes accepted. It is the whole size of buffers on success.
+     */
+    template <typename ConstBufferSequence>
+    std::size_t write(
+        ConstBufferSequence const& buffers,
+        error_code& ec) {
+        start_watch();
+        std::lock_guard<std::mutex> lck(out_mtx_);
+        if (is_closed()) {
+            ec = as::error::broken_pipe;
+            return 0;
+        }
+        std::size_t total = 0;
+        bool direct = !overflow_pending() && !write_.active;
+        for (auto it = as::buffer_sequence_begin(buffers), end = as::buffer_sequence_end(buffers);
+             it != end;
+             ++it) {
+            as::const_buffer b = *it;
+            if (direct) {
+                auto n = produce(b, ec);
+                if (ec) {
+                    // The link and the waits belong to the strand.
+                    closed_ = true;
+                    post_close();
+                    return total;
+                }
+                b += n;
+                total += n;
+                if (b.size() != 0) direct = false;
+            }
+            overflow_.append(static_cast<char const*>(b.data()), b.size());
+            total += b.size();
+        }
+        // If an async_write() is ahead of the overflow, it starts the flush on completion.
+        if (overflow_pending() && !flushing_ && !(write_.active && !write_.after_overflow)) {
+            flushing_ = true;
+            as::post(
+                strand_,
+                make_allocating_handler(
+                    handler_memory_,
+                    [this, self = this->shared_from_this()] {
+                        do_flush();
+                    }
+                )
+            );
+        }
+        ec = error_code();
+        return total;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(
+        ConstBufferSequence const& buffers) {
+        error_code ec;
+        auto size = write(buffers, ec);
+        if (ec) throw system_error(ec);
+        return size;
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        as::post(
+            strand_,
+            make_allocating_handler(handler_memory_, std::forward<PostHandler>(handler))
+        );
+    }
+
+    /**
+     * @brief Get the memory of the asynchronous operations
+     * @return handler_memory. Its counters show how many allocations fell back to the heap.
+     */
+    handler_memory const& get_handler_memory() const {
+        return *handler_memory_;
+    }
+
+private:
+    struct read_state {
+        as::mutable_buffer buf;
+        std::size_t transferred = 0;
+        std::function<void(error_code, std::size_t)> handler;
+    };
+
+    struct write_state {
+        std::vector<as::const_buffer> bufs;
+        std::size_t index = 0;
+        std::size_t offset = 0;
+        std::size_t transferred = 0;
+        std::function<void(error_code, std::size_t)> handler;
+        bool active = false;
+        bool after_overflow = false;
+        bool waiting_overflow = false;
+    };
+
+    // It can be called on any thread. The link itself is touched only on the strand.
+    // Closing the link locally aborts the watch, and its handler sets closed_.
+    bool is_closed() const {
+        return closed_;
+    }
+
+    void post_close() {
+        as::post(
+            strand_,
+            make_allocating_handler(
+                handler_memory_,
+                [this, self = this->shared_from_this()] {
+                    error_code ignored;
+                    close(ignored);
+                }
+            )
+        );
+    }
+
+    // The peer never writes to the link after the connection is established,
+    // so it becomes readable only when the peer has closed the connection.
+    // The wait is aborted when the link is closed locally.
+    // The wait is started on the strand because write() calls it on any thread.
+    void start_watch() {
+        if (watching_.exchange(true)) return;
+        std::weak_ptr<this_type> wp(this->shared_from_this());
+        as::post(
+            strand_,
+            [this, wp] {
+                auto sp = wp.lock();
+                if (!sp) return;
+                link_.async_wait(
+                    as::socket_base::wait_read,
+                    as::bind_executor(
+                        strand_,
+                        [wp](error_code) {
+                            auto sp = wp.lock();
+                            if (!sp) return;
+                            sp->closed_ = true;
+                            error_code ignored;
+                            sp->data_wait_.cancel(ignored);
+                            sp->space_wait_.cancel(ignored);
+                        }
+                    )
+                );
+            }
+        );
+    }
+
+    // The indices written by the peer are untrusted. If they are inconsistent with the own
+    // index, the following functions report the whole capacity, so that the caller calls
+    // consume() or produce() and gets the error.
+    std::uint64_t available() const {
+        auto n = in_->tail.load(std::memory_order_acquire) - in_head_;
+        return n > capacity_ ? capacity_ : n;
+    }
+
+    std::uint64_t free_space() const {
+        auto n = out_tail_ - out_->head.load(std::memory_order_acquire);
+        return n > capacity_ ? capacity_ : capacity_ - n;
+    }
+
+    bool overflow_pending() const {
+        return overflow_pos_ != overflow_.size();
+    }
+
+    // Sets protocol_error to ec if the peer broke the ring.
+    std::size_t consume(as::mutable_buffer b, error_code& ec) {
+        auto head = in_head_;
+        auto filled = in_->tail.load(std::memory_order_acquire) - head;
+        if (filled > capacity_) {
+            ec = make_error_code(protocol_error_errc);
+            return 0;
+        }
+        auto n = static_cast<std::size_t>(std::min<std::uint64_t>(filled, b.size()));
+        if (n == 0) return 0;
+        auto pos = static_cast<std::size_t>(head & mask_);
+        auto first = std::min<std::size_t>(n, capacity_ - pos);
+        std::memcpy(b.data(), in_data_ + pos, first);
+        std::memcpy(static_cast<char*>(b.data()) + first, in_data_, n - first);
+        in_head_ = head + n;
+        in_->head.store(in_head_, std::memory_order_release);
+        // Pairs with the producer's store of writer_waiting followed by the load of head.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (in_->writer_waiting.load(std::memory_order_relaxed)) signal(peer_space_.get());
+        return n;
+    }
+
+    // Sets protocol_error to ec if the peer broke the ring.
+    // Called with out_mtx_ locked.
+    std::size_t produce(as::const_buffer b, error_code& ec) {
+        auto tail = out_tail_;
+        auto filled = tail - out_->head.load(std::memory_order_acquire);
+        if (filled > capacity_) {
+            ec = make_error_code(protocol_error_errc);
+            return 0;
+        }
+        auto n = static_cast<std::size_t>(std::min<std::uint64_t>(capacity_ - filled, b.size()));
+        if (n == 0) return 0;
+        auto pos = static_cast<std::size_t>(tail & mask_);
+        auto first = std::min<std::size_t>(n, capacity_ - pos);
+        std::memcpy(out_data_ + pos, b.data(), first);
+        std::memcpy(out_data_, static_cast<char const*>(b.data()) + first, n - first);
+        out_tail_ = tail + n;
+        out_->tail.store(out_tail_, std::memory_order_release);
+        // Pairs with the consumer's store of reader_waiting followed by the load of tail.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (out_->reader_waiting.load(std::memory_order_relaxed)) signal(peer_data_.get());
+        return n;
+    }
+
+    static void signal(int fd) {
+        std::uint64_t one = 1;
+        auto r = ::write(fd, &one, sizeof(one));
+        static_cast<void>(r);
+    }
+
+    static void drain(int fd) {
+        std::uint64_t v;
+        auto r = ::read(fd, &v, sizeof(v));
+        static_cast<void>(r);
+    }
+
+    // Returns true if the producer has to wait for the consumer.
+    bool wait_space() {
+        out_->writer_waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (free_space() == 0) return true;
+        out_->writer_waiting.store(0);
+        return false;
+    }
+
+    template <typename Next>
+    void async_wait_space(Next next) {
+        space_wait_.async_wait(
+            as::posix::stream_descriptor::wait_read,
+            as::bind_executor(
+                strand_,
+                make_allocating_handler(
+                    handler_memory_,
+                    [this, self = this->shared_from_this(), next]
+                    (error_code) {
+                        drain(space_wait_.native_handle());
+                        out_->writer_waiting.store(0);
+                        (this->*next)();
+                    }
+                )
+            )
+        );
+    }
+
+    // The following functions run on the strand.
+
+    void do_read() {
+        while (true) {
+            error_code ec;
+            read_.transferred += consume(read_.buf + read_.transferred, ec);
+            if (ec) {
+                error_code ignored;
+                close(ignored);
+                complete_read(ec);
+                return;
+            }
+            if (read_.transferred == read_.buf.size()) {
+                complete_read(error_code());
+                return;
+            }
+            if (is_closed()) {
+                complete_read(as::error::eof);
+                return;
+            }
+            in_->reader_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (available() == 0) break;
+            in_->reader_waiting.store(0);
+        }
+        data_wait_.async_wait(
+            as::posix::stream_descriptor::wait_read,
+            as::bind_executor(
+                strand_,
+                make_allocating_handler(
+                    handler_memory_,
+                    [this, self = this->shared_from_this()]
+                    (error_code) {
+                        drain(data_wait_.native_handle());
+                        in_->reader_waiting.store(0);
+                        do_read();
+                    }
+                )
+            )
+        );
+    }
+
+    void do_write() {
+        std::unique_lock<std::mutex> lck(out_mtx_);
+        while (true) {
+            if (is_closed()) {
+                write_.active = false;
+                lck.unlock();
+                complete_write(as::error::broken_pipe);
+                return;
+            }
+            if (write_.after_overflow) {
+                if (overflow_pending()) {
+                    // do_flush() resumes this write.
+                    write_.waiting_overflow = true;
+                    return;
+                }
+                write_.after_overflow = false;
+            }
+            while (write_.index != write_.bufs.size()) {
+                error_code ec;
+                auto n = produce(write_.bufs[write_.index] + write_.offset, ec);
+                if (ec) {
+                    write_.active = false;
+                    lck.unlock();
+                    error_code ignored;
+                    close(ignored);
+                    complete_write(ec);
+                    return;
+                }
+                write_.offset += n;
+                write_.transferred += n;
+                if (write_.offset == write_.bufs[write_.index].size()) {
+                    ++write_.index;
+                    write_.offset = 0;
+                }
+                else if (n == 0) {
+                    break;
+                }
+            }
+            if (write_.index == write_.bufs.size()) {
+                write_.active = false;
+                bool flush = overflow_pending() && !flushing_;
+                if (flush) flushing_ = true;
+                lck.unlock();
+                if (flush) do_flush();
+                complete_write(error_code());
+                return;
+            }
+            if (wait_space()) break;
+        }
+        lck.unlock();
+        async_wait_space(&this_type::do_write);
+    }
+
+    void do_flush() {
+        std::unique_lock<std::mutex> lck(out_mtx_);
+        while (true) {
+            error_code ec;
+            if (!is_closed()) overflow_pos_ += produce(as::buffer(overflow_) + overflow_pos_, ec);
+            if (ec) {
+                // The waiting async_write() fails on the closed transport.
+                error_code ignored;
+                close(ignored);
+            }
+            if (is_closed()) {
+                overflow_.clear();
+                overflow_pos_ = 0;
+            }
+            if (!overflow_pending()) {
+                overflow_.clear();
+                overflow_pos_ = 0;
+                flushing_ = false;
+                bool resume = write_.waiting_overflow;
+                write_.waiting_overflow = false;
+                lck.unlock();
+                if (resume) do_write();
+                return;
+            }
+            if (wait_space()) break;
+        }
+        lck.unlock();
+        async_wait_space(&this_type::do_flush);
+    }
+
+    // The handler is invoked inline. The caller is already on the strand,
+    // and it is never inside the initiating function.
+    void complete_read(error_code ec) {
+        auto h = force_move(read_.handler);
+        read_.handler = nullptr;
+        h(ec, read_.transferred);
+    }
+
+    void complete_write(error_code ec) {
+        auto h = force_move(write_.handler);
+        write_.handler = nullptr;
+        h(ec, write_.transferred);
+    }
+
+private:
+    Strand strand_;
+    as::ip::tcp::socket link_;
+    as::posix::stream_descriptor data_wait_;
+    as::posix::stream_descriptor space_wait_;
+    detail::unique_fd peer_data_;
+    detail::unique_fd peer_space_;
+    detail::unique_fd memfd_;
+    std::uint64_t capacity_;
+    std::uint64_t mask_;
+    std::uint64_t out_tail_ = 0; // own producer index, guarded by out_mtx_
+    std::uint64_t in_head_ = 0; // own consumer index, used on the strand
+    detail::shm_header* header_ = nullptr;
+    detail::shm_ring_control* out_ = nullptr;
+    detail::shm_ring_control* in_ = nullptr;
+    char* out_data_ = nullptr;
+    char* in_data_ = nullptr;
+    std::atomic<bool> closed_{false};
+    std::atomic<bool> watching_{false};
+    read_state read_;
+    std::mutex out_mtx_; // guards the producer side of the out ring, write_ and the overflow
+    write_state write_;
+    std::string overflow_;
+    std::size_t overflow_pos_ = 0;
+    bool flushing_ = false;
+    std::shared_ptr<handler_memory> handler_memory_ = std::make_shared<handler_memory>();
+};
+
+template <typename Strand, typename MutableBufferSequence, typename ReadHandler>
+inline void async_read(
+    shm_endpoint<Strand>& ep,
+    MutableBufferSequence && buffers,
+    ReadHandler&& handler) {
+    ep.async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    shm_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    shm_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    error_code& ec) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers), ec);
+}
+
+template <typename Strand, typename ConstBufferSequence, typename WriteHandler>
+inline void async_write(
+    shm_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    WriteHandler&& handler) {
+    ep.async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+}
+
+/**
+ * @brief Connect to the server_shm listening on the unix domain socket path.
+ *        The rendezvous is synchronous. After it, the returned transport can be passed
+ *        to an endpoint constructor.
+ * @param ioc io_context that runs the handlers of the transport
+ * @param path unix domain socket path of the server
+ * @param ec error code
+ * @return connected transport. nullptr on error.
+ */
+template <typename Strand = as::io_context::strand>
+inline std::shared_ptr<shm_endpoint<Strand>>
+shm_connect(as::io_context& ioc, std::string const& path, error_code& ec) {
+    as::local::stream_protocol::socket sock(ioc);
+    sock.connect(as::local::stream_protocol::endpoint(path), ec);
+    if (ec) return nullptr;
+    auto fds = detail::shm_recv(sock.native_handle(), ec);
+    if (ec) return nullptr;
+    return std::make_shared<shm_endpoint<Strand>>(ioc, shm_role::client, force_move(fds));
+}
+
+template <typename Strand = as::io_context::strand>
+inline std::shared_ptr<shm_endpoint<Strand>>
+shm_connect(as::io_context& ioc, std::string const& path) {
+    error_code ec;
+    auto ep = shm_connect<Strand>(ioc, path, ec);
+    if (ec) throw system_error(ec);
+    return ep;
+}
+
+} // namespace MQTT_NS
+
+#endif // defined(__linux__)
+
+#endif // MQTT_SHM_ENDPOINT_HPP
@@ -0,0 +1,481 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STATIC_OVERLAY_HPP)
+#define MQTT_STATIC_OVERLAY_HPP
+
+#include <mqtt/variant.hpp> // should be top to configure variant limit
+
+#include <type_traits>
+#include <utility>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/attributes.hpp>
+#include <mqtt/endpoint.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+namespace detail {
+namespace static_dispatch {
+
+// Calls h.name(args...) if Handler has the member function, otherwise returns default_value.
+// has_member_name detects a member with that name whatever its signature is, so a member
+// that can't be called with the arguments is a compile error instead of an ignored handler.
+#define MQTT_STATIC_DISPATCH(name, default_value)                       \
+    template <typename Handler, typename = void>                        \
+    struct has_member_##name : std::false_type {};                      \
+    template <typename Handler>                                         \
+    struct has_member_##name<                                           \
+        Handler,                                                        \
+        decltype(&Handler::name, void())                                \
+    > : std::true_type {};                                              \
+    template <typename Handler, typename... Args>                       \
+    inline auto name(Handler& h, int, Args&&... args)                   \
+        -> decltype(h.name(std::forward<Args>(args)...)) {              \
+        return h.name(std::forward<Args>(args)...);                     \
+    }                                                                   \
+    template <typename Handler, typename... Args>                       \
+    inline auto name(Handler&, long, Args&&...) {                       \
+        static_assert(                                                  \
+            !has_member_##name<Handler>::value,                         \
+            "Handler::" #name " doesn't match the handler's parameters" \
+        );                                                              \
+        return default_value;                                           \
+    }
+
+MQTT_STATIC_DISPATCH(on_pingreq, true)
+MQTT_STATIC_DISPATCH(on_pingresp, true)
+MQTT_STATIC_DISPATCH(on_connect, true)
+MQTT_STATIC_DISPATCH(on_connack, true)
+MQTT_STATIC_DISPATCH(on_publish, true)
+MQTT_STATIC_DISPATCH(on_puback, true)
+MQTT_STATIC_DISPATCH(on_pubrec, true)
+MQTT_STATIC_DISPATCH(on_pubrel, true)
+MQTT_STATIC_DISPATCH(on_pubcomp, true)
+MQTT_STATIC_DISPATCH(on_subscribe, true)
+MQTT_STATIC_DISPATCH(on_suback, true)
+MQTT_STATIC_DISPATCH(on_unsubscribe, true)
+MQTT_STATIC_DISPATCH(on_unsuback, true)
+MQTT_STATIC_DISPATCH(on_disconnect, void())
+MQTT_STATIC_DISPATCH(on_v5_connect, true)
+MQTT_STATIC_DISPATCH(on_v5_connack, true)
+MQTT_STATIC_DISPATCH(on_v5_publish, true)
+MQTT_STATIC_DISPATCH(on_v5_publish_view, true)
+MQTT_STATIC_DISPATCH(on_v5_puback, true)
+MQTT_STATIC_DISPATCH(on_v5_pubrec, true)
+MQTT_STATIC_DISPATCH(on_v5_pubrel, true)
+MQTT_STATIC_DISPATCH(on_v5_pubcomp, true)
+MQTT_STATIC_DISPATCH(on_v5_subscribe, true)
+MQTT_STATIC_DISPATCH(on_v5_suback, true)
+MQTT_STATIC_DISPATCH(on_v5_unsubscribe, true)
+MQTT_STATIC_DISPATCH(on_v5_unsuback, true)
+MQTT_STATIC_DISPATCH(on_v5_disconnect, void())
+MQTT_STATIC_DISPATCH(on_v5_auth, true)
+MQTT_STATIC_DISPATCH(on_close, void())
+MQTT_STATIC_DISPATCH(on_error, void())
+MQTT_STATIC_DISPATCH(on_pub_res_sent, void())
+MQTT_STATIC_DISPATCH(on_serialize_publish_message, void())
+MQTT_STATIC_DISPATCH(on_serialize_v5_publish_message, void())
+MQTT_STATIC_DISPATCH(on_serialize_pubrel_message, void())
+MQTT_STATIC_DISPATCH(on_serialize_v5_pubrel_message, void())
+MQTT_STATIC_DISPATCH(on_serialize_remove, void())
+MQTT_STATIC_DISPATCH(on_pre_send, void())
+MQTT_STATIC_DISPATCH(on_queue_high_watermark, void())
+MQTT_STATIC_DISPATCH(on_queue_low_watermark, void())
+MQTT_STATIC_DISPATCH(check_is_valid_length, true)
+
+#undef MQTT_STATIC_DISPATCH
+
+template <typename Handler, typename = void>
+struct has_on_mqtt_message_processed : std::false_type {};
+
+template <typename Handler>
+struct has_on_mqtt_message_processed<
+    Handler,
+    decltype(std::declval<Handler&>().on_mqtt_message_processed(std::declval<any>()), void())
+> : std::true_type {};
+
+template <typename Handler, typename PacketId, typename = void>
+struct has_on_v5_publish_view : std::false_type {};
+
+template <typename Handler, typename PacketId>
+struct has_on_v5_publish_view<
+    Handler,
+    PacketId,
+    decltype(
+        std::declval<Handler&>().on_v5_publish_view(
+            std::declval<optional<PacketId>>(),
+            std::declval<publish_options>(),
+            std::declval<buffer>(),
+            std::declval<buffer>(),
+            std::declval<v5::property_view>()
+        ),
+        void()
+    )
+> : std::true_type {};
+
+} // namespace static_dispatch
+} // namespace detail
+
+/**
+ * @brief Endpoint whose handlers are member functions of Handler
+ *
+ * callable_overlay keeps each handler in a std::function, so every received packet
+ * pays an indirect call that cannot be inlined. static_overlay calls the member
+ * functions of Handler directly instead, so the handler is inlined into the
+ * override of the endpoint's virtual function.
+ *
+ * Handler has the member functions with the same names and parameters as the
+ * on_*() functions of callable_overlay, e.g.
+ * `bool on_publish(optional<packet_id_t>, publish_options, buffer, buffer)`.
+ * It only needs the ones it handles. The missing ones behave as the unset handlers
+ * of callable_overlay.
+ *
+ * A member function that has the name of a handler but can't be called with its
+ * parameters (e.g. optional<std::uint16_t> packet_id for the 4 byte packet id endpoint)
+ * fails to compile with a static_assert instead of being ignored.
+ * Overloaded and template member functions can't be detected this way, so if none of
+ * the overloads matches, the handler is silently treated as missing and the packet is
+ * processed as if it had no handler (e.g. PUBLISH is acknowledged and dropped).
+ *
+ * @tparam Impl endpoint type, e.g. server_endpoint
+ * @tparam Handler handler type
+ */
+template <typename Impl, typename Handler>
+struct static_overlay final : public Impl
+{
+    using base = Impl;
+    using packet_id_t = typename base::packet_id_t;
+
+    /**
+     * @brief Constructor
+     * @param h handler
+     * @param args arguments of the constructor of Impl
+     */
+    template<typename ... Args>
+    static_overlay(Handler h, Args && ... args)
+     : base(std::forward<Args>(args)...),
+       h_(force_move(h))
+    {
+        // The properties are not decoded if Handler receives them as v5::property_view.
+        base::set_publish_property_view(
+            detail::static_dispatch::has_on_v5_publish_view<Handler, packet_id_t>::value
+        );
+    }
+    ~static_overlay() = default;
+    static_overlay(static_overlay&&) = default;
+    static_overlay(static_overlay const&) = default;
+    static_overlay& operator=(static_overlay&&) = default;
+    static_overlay& operator=(static_overlay const&) = default;
+
+    /**
+     * @brief Get handler
+     * @return handler
+     */
+    Handler& handler() {
+        return h_;
+    }
+
+    /**
+     * @brief Get handler
+     * @return handler
+     */
+    Handler const& handler() const {
+        return h_;
+    }
+
+    // MQTT Common handlers
+
+    MQTT_ALWAYS_INLINE bool on_pingreq() noexcept override final {
+        return detail::static_dispatch::on_pingreq(h_, 0);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_pingresp() noexcept override final {
+        return detail::static_dispatch::on_pingresp(h_, 0);
+    }
+
+    // MQTT v3_1_1 handlers
+
+    MQTT_ALWAYS_INLINE bool on_connect(MQTT_NS::buffer client_id,
+                                       MQTT_NS::optional<MQTT_NS::buffer> user_name,
+                                       MQTT_NS::optional<MQTT_NS::buffer> password,
+                                       MQTT_NS::optional<will> will,
+                                       bool clean_session,
+                                       std::uint16_t keep_alive) noexcept override final {
+        return detail::static_dispatch::on_connect(
+            h_, 0,
+            MQTT_NS::force_move(client_id),
+            MQTT_NS::force_move(user_name),
+            MQTT_NS::force_move(password),
+            MQTT_NS::force_move(will),
+            clean_session,
+            keep_alive);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_connack(bool session_present, connect_return_code return_code) noexcept override final {
+        return detail::static_dispatch::on_connack(h_, 0, session_present, return_code);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_publish(MQTT_NS::optional<packet_id_t> packet_id,
+                                       MQTT_NS::publish_options pubopts,
+                                       MQTT_NS::buffer topic_name,
+                                       MQTT_NS::buffer contents) noexcept override final {
+        return detail::static_dispatch::on_publish(
+            h_, 0,
+            packet_id,
+            pubopts,
+            MQTT_NS::force_move(topic_name),
+            MQTT_NS::force_move(contents));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_puback(packet_id_t packet_id) noexcept override final {
+        return detail::static_dispatch::on_puback(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_pubrec(packet_id_t packet_id) noexcept override final {
+        return detail::static_dispatch::on_pubrec(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_pubrel(packet_id_t packet_id) noexcept override final {
+        return detail::static_dispatch::on_pubrel(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_pubcomp(packet_id_t packet_id) noexcept override final {
+        return detail::static_dispatch::on_pubcomp(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE bool on_subscribe(packet_id_t packet_id,
+                                         std::vector<std::tuple<MQTT_NS::buffer,
+                                                                subscribe_options>> entries) noexcept override final {
+        return detail::static_dispatch::on_subscribe(h_, 0, packet_id, MQTT_NS::force_move(entries));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_suback(packet_id_t packet_id,
+                                      std::vector<MQTT_NS::suback_return_code> reasons) noexcept override final {
+        return detail::static_dispatch::on_suback(h_, 0, packet_id, MQTT_NS::force_move(reasons));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_unsubscribe(packet_id_t packet_id,
+                                           std::vector<MQTT_NS::buffer> topics) noexcept override final {
+        return detail::static_dispatch::on_unsubscribe(h_, 0, packet_id, MQTT_NS::force_move(topics));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_unsuback(packet_id_t packet_id) noexcept override final {
+        return detail::static_dispatch::on_unsuback(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE void on_disconnect() noexcept override final {
+        detail::static_dispatch::on_disconnect(h_, 0);
+    }
+
+    // MQTT v5 handlers
+
+    MQTT_ALWAYS_INLINE bool on_v5_connect(MQTT_NS::buffer client_id,
+                                          MQTT_NS::optional<MQTT_NS::buffer> user_name,
+                                          MQTT_NS::optional<MQTT_NS::buffer> password,
+                                          MQTT_NS::optional<will> will,
+                                          bool clean_start,
+                                          std::uint16_t keep_alive,
+                                          v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_connect(
+            h_, 0,
+            MQTT_NS::force_move(client_id),
+            MQTT_NS::force_move(user_name),
+            MQTT_NS::force_move(password),
+            MQTT_NS::force_move(will),
+            clean_start,
+            keep_alive,
+            MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_connack(bool session_present,
+                                          v5::connect_reason_code reason_code,
+                                          v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_connack(h_, 0, session_present, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_publish(MQTT_NS::optional<packet_id_t> packet_id,
+                                          MQTT_NS::publish_options pubopts,
+                                          MQTT_NS::buffer topic_name,
+                                          MQTT_NS::buffer contents,
+                                          v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_publish(
+            h_, 0,
+            packet_id,
+            pubopts,
+            MQTT_NS::force_move(topic_name),
+            MQTT_NS::force_move(contents),
+            MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_publish_view(MQTT_NS::optional<packet_id_t> packet_id,
+                                               MQTT_NS::publish_options pubopts,
+                                               MQTT_NS::buffer topic_name,
+                                               MQTT_NS::buffer contents,
+                                               v5::property_view props) noexcept override final {
+        return detail::static_dispatch::on_v5_publish_view(
+            h_, 0,
+            packet_id,
+            pubopts,
+            MQTT_NS::force_move(topic_name),
+            MQTT_NS::force_move(contents),
+            MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_puback(packet_id_t packet_id,
+                                         v5::puback_reason_code reason_code,
+                                         v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_puback(h_, 0, packet_id, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_pubrec(packet_id_t packet_id,
+                                         v5::pubrec_reason_code reason_code,
+                                         v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_pubrec(h_, 0, packet_id, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_pubrel(packet_id_t packet_id,
+                                         v5::pubrel_reason_code reason_code,
+                                         v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_pubrel(h_, 0, packet_id, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_pubcomp(packet_id_t packet_id,
+                                          v5::pubcomp_reason_code reason_code,
+                                          v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_pubcomp(h_, 0, packet_id, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_subscribe(packet_id_t packet_id,
+                                            std::vector<std::tuple<MQTT_NS::buffer, subscribe_options>> entries,
+                                            v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_subscribe(h_, 0, packet_id, MQTT_NS::force_move(entries), MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_suback(packet_id_t packet_id,
+                                         std::vector<MQTT_NS::v5::suback_reason_code> reasons,
+                                         v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_suback(h_, 0, packet_id, MQTT_NS::force_move(reasons), MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_unsubscribe(packet_id_t packet_id,
+                                              std::vector<MQTT_NS::buffer> topics,
+                                              v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_unsubscribe(h_, 0, packet_id, MQTT_NS::force_move(topics), MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_unsuback(packet_id_t packet_id,
+                                           std::vector<v5::unsuback_reason_code> reasons,
+                                           v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_unsuback(h_, 0, packet_id, MQTT_NS::force_move(reasons), MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE void on_v5_disconnect(v5::disconnect_reason_code reason_code,
+                                             v5::properties props) noexcept override final {
+        detail::static_dispatch::on_v5_disconnect(h_, 0, reason_code, MQTT_NS::force_move(props));
+    }
+
+    MQTT_ALWAYS_INLINE bool on_v5_auth(v5::auth_reason_code reason_code,
+                                       v5::properties props) noexcept override final {
+        return detail::static_dispatch::on_v5_auth(h_, 0, reason_code, MQTT_NS::force_move(props));
+    }
+
+    // Original handlers
+
+    /**
+     * @brief Close handler
+     * This calls base::on_close() prior to calling the handler.
+     */
+    MQTT_ALWAYS_INLINE void on_close() noexcept override final {
+        base::on_close();
+        detail::static_dispatch::on_close(h_, 0);
+    }
+
+    /**
+     * @brief Error handler
+     * This calls base::on_error() prior to calling the handler.
+     * @param ec error code
+     */
+    MQTT_ALWAYS_INLINE void on_error(error_code ec) noexcept override final {
+        base::on_error(ec);
+        detail::static_dispatch::on_error(h_, 0, ec);
+    }
+
+    MQTT_ALWAYS_INLINE void on_pub_res_sent(packet_id_t packet_id) noexcept override final {
+        detail::static_dispatch::on_pub_res_sent(h_, 0, packet_id);
+    }
+
+    MQTT_ALWAYS_INLINE void on_serialize_publish_message(basic_publish_message<sizeof(packet_id_t)> msg) noexcept override final {
+        detail::static_dispatch::on_serialize_publish_message(h_, 0, msg);
+    }
+
+    MQTT_ALWAYS_INLINE void on_serialize_v5_publish_message(v5::basic_publish_message<sizeof(packet_id_t)> msg) noexcept override final {
+        detail::static_dispatch::on_serialize_v5_publish_message(h_, 0, msg);
+    }
+
+    MQTT_ALWAYS_INLINE void on_serialize_pubrel_message(basic_pubrel_message<sizeof(packet_id_t)> msg) noexcept override final {
+        detail::static_dispatch::on_serialize_pubrel_message(h_, 0, msg);
+    }
+
+    MQTT_ALWAYS_INLINE void on_serialize_v5_pubrel_message(v5::basic_pubrel_message<sizeof(packet_id_t)> msg) noexcept override final {
+        detail::static_dispatch::on_serialize_v5_pubrel_message(h_, 0, msg);
+    }
+
+    MQTT_ALWAYS_INLINE void on_serialize_remove(packet_id_t packet_id) noexcept override final {
+        detail::static_dispatch::on_serialize_remove(h_, 0, packet_id);
+    }
+
+    /**
+     * @brief Pre-send handler
+     * This calls base::on_pre_send() prior to calling the handler.
+     */
+    MQTT_ALWAYS_INLINE void on_pre_send() noexcept override final {
+        base::on_pre_send();
+        detail::static_dispatch::on_pre_send(h_, 0);
+    }
+
+    MQTT_ALWAYS_INLINE void on_queue_high_watermark() noexcept override final {
+        base::on_queue_high_watermark();
+        detail::static_dispatch::on_queue_high_watermark(h_, 0);
+    }
+
+    MQTT_ALWAYS_INLINE void on_queue_low_watermark() noexcept override final {
+        base::on_queue_low_watermark();
+        detail::static_dispatch::on_queue_low_watermark(h_, 0);
+    }
+
+    MQTT_ALWAYS_INLINE bool check_is_valid_length(control_packet_type packet_type, std::size_t remaining_length) noexcept override final {
+        return detail::static_dispatch::check_is_valid_length(h_, 0, packet_type, remaining_length);
+    }
+
+    /**
+     * @brief next read handler
+     * This calls base::on_mqtt_message_processed() only if Handler doesn't have on_mqtt_message_processed().
+     * See callable_overlay::on_mqtt_message_processed().
+     */
+    MQTT_ALWAYS_INLINE void on_mqtt_message_processed(MQTT_NS::any session_life_keeper) noexcept override final {
+        mqtt_message_processed(
+            MQTT_NS::force_move(session_life_keeper),
+            detail::static_dispatch::has_on_mqtt_message_processed<Handler>()
+        );
+    }
+
+private:
+    void mqtt_message_processed(MQTT_NS::any session_life_keeper, std::true_type) {
+        h_.on_mqtt_message_processed(MQTT_NS::force_move(session_life_keeper));
+    }
+
+    void mqtt_message_processed(MQTT_NS::any session_life_keeper, std::false_type) {
+        base::on_mqtt_message_processed(MQTT_NS::force_move(session_life_keeper));
+    }
+
+    Handler h_;
+}; // static_overlay
+
+} // namespace MQTT_NS
+
+#endif // MQTT_STATIC_OVERLAY_HPP
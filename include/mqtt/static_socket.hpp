@@ -0,0 +1,87 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STATIC_SOCKET_HPP)
+#define MQTT_STATIC_SOCKET_HPP
+
+#include <memory>
+#include <utility>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+
+namespace MQTT_NS {
+
+/**
+ * @brief statically typed counterpart of the type erased socket
+ * - static_socket has the same interface as MQTT_NS::socket, and it holds the concrete
+ *   socket (e.g. tcp_endpoint) by shared_ptr.
+ * - The class template endpoint uses it via the Socket template argument
+ *   instead of MQTT_NS::socket. Then the calls to the socket and the completion handlers
+ *   are resolved at compile time, and the handlers are not converted to std::function.
+ * - It is a trade-off against the compile times and the code size. Each socket type
+ *   instantiates the whole endpoint. See shared_any.hpp.
+ */
+template <typename Socket>
+class static_socket {
+public:
+    using socket_type = Socket;
+
+    static_socket(std::shared_ptr<Socket> socket)
+        :socket_(force_move(socket)) {}
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read(MutableBufferSequence&& buffers, ReadHandler&& handler) {
+        socket_->async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(ConstBufferSequence&& buffers, WriteHandler&& handler) {
+        socket_->async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(ConstBufferSequence&& buffers, error_code& ec) {
+        return socket_->write(std::forward<ConstBufferSequence>(buffers), ec);
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        socket_->post(std::forward<PostHandler>(handler));
+    }
+
+    decltype(auto) lowest_layer() {
+        return socket_->lowest_layer();
+    }
+
+    decltype(auto) native_handle() {
+        return socket_->native_handle();
+    }
+
+    void close(error_code& ec) {
+        socket_->close(ec);
+    }
+
+    decltype(auto) get_executor() {
+        return socket_->get_executor();
+    }
+
+    /**
+     * @brief Get the concrete socket
+     * @return reference of the socket
+     */
+    Socket& get() const {
+        return *socket_;
+    }
+
+private:
+    std::shared_ptr<Socket> socket_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_STATIC_SOCKET_HPP
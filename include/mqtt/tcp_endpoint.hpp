@@ -17,12 +17,14 @@
 #if ASIO_STANDALONE
 #include <asio/ssl.hpp>
 #else
-<boost/asio/ssl.hpp>
+#include <boost/asio/ssl.hpp>
 #endif // ASIO_STANDALONE
 #endif // defined(MQTT_USE_TLS)
 
 #include <mqtt/namespace.hpp>
 #include <mqtt/error_code.hpp>
+#include <mqtt/tls_record_buffer.hpp>
+#include <mqtt/handler_allocator.hpp>
 
 namespace MQTT_NS {
 
@@ -94,14 +96,14 @@ public:
             std::forward<MutableBufferSequence>(buffers),
             as::bind_executor(
                 strand_,
-                std::forward<ReadHandler>(handler)
+                make_allocating_handler(handler_memory_, std::forward<ReadHandler>(handler))
             )
         );
     }
 
-    template <typename... Args>
-    std::size_t write(Args&& ... args) {
-        return as::write(tcp_, std::forward<Args>(args)...);
+    template <typename ConstBufferSequence, typename... Args>
+    std::size_t write(ConstBufferSequence && buffers, Args&& ... args) {
+        return write_impl(is_tls_stream<Socket>(), std::forward<ConstBufferSequence>(buffers), std::forward<Args>(args)...);
     }
 
     template <typename ConstBufferSequence, typename WriteHandler>
@@ -110,10 +112,10 @@ public:
         WriteHandler&& handler) {
         as::async_write(
             tcp_,
-            std::forward<ConstBufferSequence>(buffers),
+            stage(is_tls_stream<Socket>(), std::forward<ConstBufferSequence>(buffers)),
             as::bind_executor(
                 strand_,
-                std::forward<WriteHandler>(handler)
+                make_allocating_handler(handler_memory_, std::forward<WriteHandler>(handler))
             )
         );
     }
@@ -122,13 +124,49 @@ public:
     void post(PostHandler&& handler) {
         as::post(
             strand_,
-            std::forward<PostHandler>(handler)
+            make_allocating_handler(handler_memory_, std::forward<PostHandler>(handler))
         );
     }
 
+    /**
+     * @brief Get the memory of the asynchronous operations
+     * @return handler_memory. Its counters show how many allocations fell back to the heap.
+     */
+    handler_memory const& get_handler_memory() const {
+        return *handler_memory_;
+    }
+
+private:
+    template <typename ConstBufferSequence, typename... Args>
+    std::size_t write_impl(std::false_type, ConstBufferSequence && buffers, Args&& ... args) {
+        return as::write(tcp_, std::forward<ConstBufferSequence>(buffers), std::forward<Args>(args)...);
+    }
+
+    template <typename ConstBufferSequence, typename... Args>
+    std::size_t write_impl(std::true_type, ConstBufferSequence && buffers, Args&& ... args) {
+        return as::write(tcp_, sync_staging_.stage(buffers), std::forward<Args>(args)...);
+    }
+
+    template <typename ConstBufferSequence>
+    ConstBufferSequence&& stage(std::false_type, ConstBufferSequence && buffers) {
+        return std::forward<ConstBufferSequence>(buffers);
+    }
+
+    // Write the message as few TLS records as possible.
+    template <typename ConstBufferSequence>
+    const_buffer_span stage(std::true_type, ConstBufferSequence && buffers) {
+        return async_staging_.stage(buffers);
+    }
+
 private:
     Socket tcp_;
     Strand strand_;
+    // The synchronous write can be called while the asynchronous write is in progress,
+    // so each of them has its own buffer. The asynchronous one must stay intact until
+    // the write completes.
+    tls_record_buffer sync_staging_;
+    tls_record_buffer async_staging_;
+    std::shared_ptr<handler_memory> handler_memory_ = std::make_shared<handler_memory>();
 };
 
 template <typename Socket, typename Strand, typename MutableBufferSequence, typename ReadHandler>
@@ -0,0 +1,113 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TLS_RECORD_BUFFER_HPP)
+#define MQTT_TLS_RECORD_BUFFER_HPP
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#if ASIO_STANDALONE
+#include <asio/buffer.hpp>
+#else
+#include <boost/asio/buffer.hpp>
+#endif // ASIO_STANDALONE
+
+#if defined(MQTT_USE_TLS)
+#if ASIO_STANDALONE
+#include <asio/ssl/stream.hpp>
+#else
+#include <boost/asio/ssl/stream.hpp>
+#endif // ASIO_STANDALONE
+#endif // defined(MQTT_USE_TLS)
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/const_buffer_span.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+template <typename Socket>
+struct is_tls_stream : std::false_type {};
+
+#if defined(MQTT_USE_TLS)
+
+template <typename NextLayer>
+struct is_tls_stream<as::ssl::stream<NextLayer>> : std::true_type {};
+
+#endif // defined(MQTT_USE_TLS)
+
+/**
+ * @brief Staging buffer for writes to a TLS stream.
+ * The TLS stream encrypts each buffer of a buffer sequence separately, so a message
+ * that consists of many small buffers (fixed header, remaining length, topic, packet id, ...)
+ * is sent as many small TLS records. The leading buffers of the message are copied into one
+ * record sized buffer, so that the first record is filled. The rest of the message, typically
+ * the large part of the payload, is passed through without copy and fills the following records.
+ */
+class tls_record_buffer {
+public:
+    /**
+     * @param record_size
+     *        The size of the staging buffer. 16384 is the maximum plaintext size of a TLS record.
+     *        The buffer is allocated once.
+     */
+    explicit tls_record_buffer(std::size_t record_size = 16384)
+        :record_size_(record_size) {
+        buf_.reserve(record_size_);
+    }
+
+    /**
+     * @brief Coalesce the leading buffers of the buffer sequence
+     * @param buffers buffer sequence to write
+     * @return buffer sequence that is valid until the next call of stage().
+     *         Its first buffer is up to record_size bytes copied from buffers, and the other
+     *         buffers refer to buffers. If buffers has only one buffer, it is not copied.
+     */
+    template <typename ConstBufferSequence>
+    const_buffer_span stage(ConstBufferSequence const& buffers) {
+        seq_.clear();
+        auto it = as::buffer_sequence_begin(buffers);
+        auto end = as::buffer_sequence_end(buffers);
+        if (it == end) return seq_;
+        if (std::next(it) == end) {
+            seq_.emplace_back(*it);
+            return seq_;
+        }
+
+        buf_.clear();
+        // The first element is the staging buffer. It is set after the copies.
+        seq_.emplace_back();
+        for (; it != end; ++it) {
+            as::const_buffer b = *it;
+            if (buf_.size() < record_size_) {
+                auto n = std::min(b.size(), record_size_ - buf_.size());
+                auto p = static_cast<char const*>(b.data());
+                buf_.insert(buf_.end(), p, p + n);
+                b += n;
+            }
+            if (b.size() != 0) seq_.emplace_back(b);
+        }
+        seq_.front() = as::buffer(buf_);
+        return seq_;
+    }
+
+private:
+    std::size_t record_size_;
+    std::vector<char> buf_;
+    std::vector<as::const_buffer> seq_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_TLS_RECORD_BUFFER_HPP
@@ -0,0 +1,181 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TLS_SESSION_HPP)
+#define MQTT_TLS_SESSION_HPP
+
+#if defined(MQTT_USE_TLS)
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+
+#if ASIO_STANDALONE
+#include <asio/ssl.hpp>
+#else
+#include <boost/asio/ssl.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+/**
+ * @brief Counts full and resumed TLS handshakes
+ */
+class tls_handshake_counter {
+public:
+    /**
+     * @brief Count the handshake that has completed on the connection
+     * @param ssl native handle of the connection
+     */
+    void count(SSL* ssl) {
+        if (SSL_session_reused(ssl)) ++resumed_;
+        else ++full_;
+    }
+
+    std::size_t full() const {
+        return full_;
+    }
+
+    std::size_t resumed() const {
+        return resumed_;
+    }
+
+private:
+    std::atomic<std::size_t> full_{0};
+    std::atomic<std::size_t> resumed_{0};
+};
+
+/**
+ * @brief Set server side TLS session cache
+ * @param ctx ssl context of the server
+ * @param size The number of sessions to cache. 0 disables the cache.
+ * The cached sessions are lost when the server is restarted.
+ * Session tickets with the keys set by set_tls_session_ticket_keys() survive restarts.
+ */
+inline void set_tls_session_cache(as::ssl::context& ctx, std::size_t size) {
+    auto h = ctx.native_handle();
+    if (size == 0) {
+        SSL_CTX_set_session_cache_mode(h, SSL_SESS_CACHE_OFF);
+        return;
+    }
+    // Sessions are cached only if the session id context is set when the client is verified.
+    static unsigned char const id_context[] = "mqtt_cpp";
+    SSL_CTX_set_session_id_context(h, id_context, sizeof(id_context) - 1);
+    SSL_CTX_set_session_cache_mode(h, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(h, static_cast<long>(size));
+}
+
+/**
+ * @brief Set the keys to encrypt session tickets
+ * @param ctx ssl context of the server
+ * @param keys key material. The size depends on the OpenSSL version (80 bytes since OpenSSL 1.1.0).
+ * Servers that share the keys resume the sessions established by each other,
+ * and a server resumes the sessions established before it is restarted.
+ * If the size of keys is invalid, then throw system_error.
+ */
+inline void set_tls_session_ticket_keys(as::ssl::context& ctx, std::string const& keys) {
+    if (SSL_CTX_set_tlsext_ticket_keys(
+            ctx.native_handle(),
+            const_cast<char*>(keys.data()),
+            static_cast<long>(keys.size())) != 1) {
+        throw system_error(error_code(as::error::invalid_argument));
+    }
+}
+
+/**
+ * @brief Client side TLS session that is resumed at the next connection
+ * The session is received via the new session callback of the ssl context,
+ * so a TLS 1.3 session ticket that arrives after the handshake is also kept.
+ */
+class tls_client_session {
+public:
+    tls_client_session() = default;
+    tls_client_session(tls_client_session const&) = delete;
+    tls_client_session& operator=(tls_client_session const&) = delete;
+
+    /**
+     * @brief Start keeping the sessions of the connections of the ctx
+     * @param ctx ssl context of the client. The session must outlive the connections of ctx.
+     */
+    void attach(as::ssl::context& ctx) {
+        auto h = ctx.native_handle();
+        SSL_CTX_set_ex_data(h, index(), this);
+        SSL_CTX_set_session_cache_mode(h, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(h, &tls_client_session::on_new_session);
+    }
+
+    /**
+     * @brief Stop keeping the sessions and forget the kept session
+     * @param ctx ssl context that is passed to attach()
+     */
+    void detach(as::ssl::context& ctx) {
+        auto h = ctx.native_handle();
+        SSL_CTX_sess_set_new_cb(h, nullptr);
+        SSL_CTX_set_session_cache_mode(h, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_ex_data(h, index(), nullptr);
+        std::lock_guard<std::mutex> g(mtx_);
+        session_.reset();
+    }
+
+    /**
+     * @brief Offer the kept session at the handshake of the connection
+     * @param ssl native handle of the connection before the handshake
+     */
+    void apply(SSL* ssl) {
+        std::lock_guard<std::mutex> g(mtx_);
+        if (!session_) return;
+        auto session = copy(session_.get());
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+
+private:
+    static int index() {
+        static int const idx = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+        return idx;
+    }
+
+    static int on_new_session(SSL* ssl, SSL_SESSION* session) {
+        auto self = static_cast<tls_client_session*>(
+            SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), index())
+        );
+        if (!self) return 0;
+        std::lock_guard<std::mutex> g(self->mtx_);
+        self->session_.reset(copy(session), &SSL_SESSION_free);
+        return 0;
+    }
+
+    // OpenSSL marks the session of the connection as not resumable if the connection
+    // is closed without close_notify, as MQTT connections usually are.
+    // The kept session is copied from/to the connection to avoid that.
+    static SSL_SESSION* copy(SSL_SESSION* session) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        return SSL_SESSION_dup(session);
+#else  // OPENSSL_VERSION_NUMBER >= 0x10101000L
+        SSL_SESSION_up_ref(session);
+        return session;
+#endif // OPENSSL_VERSION_NUMBER >= 0x10101000L
+    }
+
+    std::mutex mtx_;
+    std::shared_ptr<SSL_SESSION> session_;
+};
+
+} // namespace MQTT_NS
+
+#endif // defined(MQTT_USE_TLS)
+
+#endif // MQTT_TLS_SESSION_HPP
@@ -0,0 +1,171 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_TABLE_HPP)
+#define MQTT_TOPIC_TABLE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/buffer.hpp>
+#include <mqtt/fnv1a.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/optional.hpp>
+#include <mqtt/string_view.hpp>
+
+namespace MQTT_NS {
+
+class topic_table;
+
+/**
+ * @brief Handle of a topic name that is interned by topic_table
+ * All handles of the same topic name share one storage and one id,
+ * so they are compared by the id without comparing the strings.
+ * The order of operator< is the order of the ids, not the lexicographical order.
+ * The entry is removed from the table when the last handle is destroyed.
+ */
+class interned_topic {
+public:
+    /**
+     * @brief Get the topic name
+     * @return the shared storage of the topic name
+     */
+    buffer const& name() const {
+        return e_->name;
+    }
+
+    /**
+     * @brief Get the id of the topic name
+     *        The id is unique while the topic name is in the table.
+     * @return id
+     */
+    std::size_t id() const {
+        return e_->id;
+    }
+
+    friend bool operator==(interned_topic const& lhs, interned_topic const& rhs) {
+        return lhs.e_ == rhs.e_;
+    }
+
+    friend bool operator!=(interned_topic const& lhs, interned_topic const& rhs) {
+        return !(lhs == rhs);
+    }
+
+    friend bool operator<(interned_topic const& lhs, interned_topic const& rhs) {
+        return lhs.e_->id < rhs.e_->id;
+    }
+
+private:
+    friend class topic_table;
+
+    struct entry {
+        entry(buffer name, std::size_t id)
+            : name(force_move(name)), id(id) {}
+        buffer const name;
+        std::size_t const id;
+    };
+
+    explicit interned_topic(std::shared_ptr<entry const> e)
+        : e_(force_move(e)) {}
+
+    std::shared_ptr<entry const> e_;
+};
+
+/**
+ * @brief Table that maps topic names to interned_topic
+ * It is thread safe, so one table can be shared by all connections.
+ * The handles can outlive the table.
+ */
+class topic_table {
+public:
+    topic_table()
+        : impl_(std::make_shared<impl>()) {}
+
+    topic_table(topic_table const&) = delete;
+    topic_table& operator=(topic_table const&) = delete;
+
+    /**
+     * @brief Get the handle of the topic name, and add it if it is not in the table
+     * @param topic topic name. It is copied only if it is not in the table.
+     * @return handle
+     */
+    interned_topic intern(string_view topic) {
+        std::lock_guard<std::mutex> g(impl_->mtx);
+        auto it = impl_->map.find(topic);
+        if (it != impl_->map.end()) {
+            if (auto e = it->second.lock()) return interned_topic(force_move(e));
+            // The last handle is being destroyed. Replace the entry,
+            // because the key refers to the storage of the destroyed entry.
+            impl_->map.erase(it);
+        }
+        std::weak_ptr<impl> wp = impl_;
+        std::shared_ptr<entry const> e(
+            new entry(allocate_buffer(topic), impl_->next_id++),
+            [wp](entry const* p) {
+                if (auto i = wp.lock()) i->remove(p);
+                delete p;
+            }
+        );
+        impl_->map.emplace(e->name, e);
+        return interned_topic(force_move(e));
+    }
+
+    /**
+     * @brief Get the handle of the topic name if it is in the table
+     *        Use it for lookups, e.g. subscriptions of the received topic name,
+     *        so that topic names that nobody refers to are not added.
+     * @param topic topic name
+     * @return handle if found, otherwise nullopt
+     */
+    optional<interned_topic> find(string_view topic) const {
+        std::lock_guard<std::mutex> g(impl_->mtx);
+        auto it = impl_->map.find(topic);
+        if (it == impl_->map.end()) return nullopt;
+        if (auto e = it->second.lock()) return interned_topic(force_move(e));
+        return nullopt;
+    }
+
+    /**
+     * @brief Get the number of the topic names in the table
+     * @return the number of the topic names
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> g(impl_->mtx);
+        return impl_->map.size();
+    }
+
+private:
+    using entry = interned_topic::entry;
+
+    struct hasher {
+        std::size_t operator()(string_view s) const {
+            return detail::fnv1a(s);
+        }
+    };
+
+    struct impl {
+        void remove(entry const* p) {
+            std::lock_guard<std::mutex> g(mtx);
+            auto it = map.find(p->name);
+            // The entry might have been replaced by intern() already.
+            if (it != map.end() && it->second.expired()) map.erase(it);
+        }
+
+        mutable std::mutex mtx;
+        // The keys refer to the storage of the entries.
+        std::unordered_map<string_view, std::weak_ptr<entry const>, hasher> map;
+        std::size_t next_id = 0;
+    };
+
+    std::shared_ptr<impl> impl_;
+};
+
+} // namespace MQTT_NS
+
+#endif // MQTT_TOPIC_TABLE_HPP
@@ -24,6 +24,7 @@
 #include <mqtt/shared_any.hpp>
 #include <mqtt/error_code.hpp>
 #include <mqtt/any.hpp>
+#include <mqtt/const_buffer_span.hpp>
 
 // I intentionally use old style boost type_erasure member fucntion concept definition.
 // The new style requires compiler extension.
@@ -55,14 +56,16 @@ using namespace boost::type_erasure;
  *   can be used as the initializer of MQTT_NS::socket.
  * - The class template endpoint uses MQTT_NS::socket via listed interface.
  * - lowest_layer is provided for users to configure the socket (e.g. set delay, buffer size, etc)
+ * - async_write and write take const_buffer_span. It refers to the buffers of the caller without copying them.
+ *   The buffers are kept alive until the write is completed.
  *
  */
 using socket = shared_any<
     mpl::vector<
         destructible<>,
         has_async_read<void(as::mutable_buffer, std::function<void(error_code, std::size_t)>)>,
-        has_async_write<void(std::vector<as::const_buffer>, std::function<void(error_code, std::size_t)>)>,
-        has_write<std::size_t(std::vector<as::const_buffer>, error_code&)>,
+        has_async_write<void(const_buffer_span, std::function<void(error_code, std::size_t)>)>,
+        has_write<std::size_t(const_buffer_span, error_code&)>,
         has_post<void(std::function<void()>)>,
         has_lowest_layer<as::ip::tcp::socket::lowest_layer_type&()>,
         has_native_handle<any()>,
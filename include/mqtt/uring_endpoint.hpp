@@ -0,0 +1,1014 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_URING_ENDPOINT_HPP)
+#define MQTT_URING_ENDPOINT_HPP
+
+// The io_uring transport is opt-in. Define MQTT_USE_IO_URING to enable it.
+// It requires the kernel headers of Linux 5.13 or later (IORING_CQE_F_MORE).
+// IORING_OP_RECV and IORING_OP_SENDMSG are enumerators, so the feature macro of
+// the later version is checked instead. If the running kernel doesn't support the
+// opcodes, uring_context::enabled() returns false.
+#if defined(MQTT_USE_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_CQE_F_MORE)
+#define MQTT_HAS_IO_URING 1
+#endif // defined(IORING_CQE_F_MORE)
+#endif // __has_include(<linux/io_uring.h>)
+#endif // defined(MQTT_USE_IO_URING) && defined(__linux__) && defined(__has_include)
+
+#if defined(MQTT_HAS_IO_URING)
+
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#if ASIO_STANDALONE
+#include <asio.hpp>
+#else
+#include <boost/asio.hpp>
+#endif // ASIO_STANDALONE
+
+#include <mqtt/namespace.hpp>
+#include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/handler_allocator.hpp>
+
+namespace MQTT_NS {
+
+#if ASIO_STANDALONE
+namespace as = asio;
+#else
+namespace as = boost::asio;
+#endif // ASIO_STANDALONE
+
+namespace detail {
+
+inline int uring_setup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+inline int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+inline int uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/**
+ * @brief In-flight io_uring request.
+ * The address of the object is used as user_data. The owner keeps the object and reuses it
+ * for the next request after the last CQE of the request is reaped, so no allocation
+ * happens per request. While the request is in flight, keep holds the owner and the object
+ * is linked to the list of the uring_context.
+ */
+struct uring_op {
+    virtual ~uring_op() = default;
+
+    /**
+     * @brief Called for each CQE of the request on the thread that runs the io_context.
+     * keep is still held during the call.
+     */
+    virtual void complete(int res, std::uint32_t flags) = 0;
+
+    std::shared_ptr<void> keep;
+    uring_op* prev = nullptr;
+    uring_op* next = nullptr;
+};
+
+} // namespace detail
+
+/**
+ * @brief io_uring instance shared by uring_endpoints.
+ * Completions are notified via an eventfd that is waited on the io_context,
+ * so the io_context drives the ring as it drives the epoll reactor.
+ *
+ * submit() only fills the SQE. The SQEs filled during one turn of the io_context are
+ * passed to the kernel by one io_uring_enter() call. If the submission queue is full,
+ * the queued SQEs are submitted immediately, and the request is kept in the backlog
+ * if the kernel still doesn't accept it, so submit() never fails.
+ *
+ * If the kernel supports provided buffer rings and multishot receive, one receive request
+ * per connection stays armed and the kernel picks the buffers from the registered ring.
+ *
+ * If io_uring is not available (e.g. old kernel, seccomp, or entries is 0), enabled() returns
+ * false and uring_endpoint falls back to the regular asio socket operations.
+ */
+class uring_context : public std::enable_shared_from_this<uring_context> {
+public:
+    /**
+     * @brief Constructor
+     * @param ioc io_context that reaps the completions
+     * @param entries submission queue size
+     * @param buffer_size size of each provided receive buffer
+     * @param buffer_count number of provided receive buffers. Rounded up to the power of two.
+     */
+    uring_context(
+        as::io_context& ioc,
+        unsigned entries = 256,
+        std::size_t buffer_size = 4096,
+        unsigned buffer_count = 256)
+        :efd_(ioc),
+         buffer_size_(buffer_size) {
+        if (entries == 0) return;
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int fd = detail::uring_setup(entries, &p);
+        if (fd < 0) return;
+        if (!probe(fd) || !map_rings(fd, p)) {
+            ::close(fd);
+            return;
+        }
+        int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd == -1 || detail::uring_register(fd, IORING_REGISTER_EVENTFD, &efd, 1) < 0) {
+            if (efd != -1) ::close(efd);
+            unmap_rings();
+            ::close(fd);
+            return;
+        }
+        efd_.assign(efd);
+        ring_fd_ = fd;
+        setup_buffer_ring(buffer_count);
+    }
+
+    uring_context(uring_context const&) = delete;
+    uring_context& operator=(uring_context const&) = delete;
+
+    ~uring_context() {
+        if (ring_fd_ == -1) return;
+        error_code ec;
+        efd_.close(ec);
+        unmap_rings();
+        ::close(ring_fd_);
+        if (br_) ::munmap(br_, br_size_);
+        // The requests that never completed release their owners.
+        std::vector<std::shared_ptr<void>> keeps;
+        for (auto op = ops_; op; op = op->next) keeps.push_back(force_move(op->keep));
+        ops_ = nullptr;
+    }
+
+    /**
+     * @brief Check io_uring is used
+     * @return false if io_uring is not available and the regular asio path is used
+     */
+    bool enabled() const {
+        return ring_fd_ != -1;
+    }
+
+    /**
+     * @brief Check multishot receive with the provided buffer ring is used
+     */
+    bool multishot() const {
+        return multishot_;
+    }
+
+    std::size_t buffer_size() const {
+        return buffer_size_;
+    }
+
+    /**
+     * @brief Queue one request
+     * The request is passed to the kernel at the end of the current turn of the io_context.
+     * @param op object that receives the CQEs. nullptr if the CQE is not needed.
+     *           It must not have another request in flight.
+     * @param keep owner of op. It is held until the last CQE of the request is reaped.
+     * @param prep function that fills the SQE
+     */
+    template <typename Prep>
+    void submit(detail::uring_op* op, std::shared_ptr<void> keep, Prep&& prep) {
+        io_uring_sqe sqe;
+        std::memset(&sqe, 0, sizeof(sqe));
+        std::forward<Prep>(prep)(sqe);
+        sqe.user_data = reinterpret_cast<std::uint64_t>(op);
+        std::vector<failure> failed;
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            if (op) {
+                op->keep = force_move(keep);
+                link(op);
+            }
+            ++inflight_;
+            if (!backlog_.empty() || !push(sqe)) {
+                // The submission queue is full. Pass the queued SQEs to the kernel and retry.
+                enter(failed);
+                if (!backlog_.empty() || !push(sqe)) backlog_.push_back(sqe);
+            }
+            schedule_flush();
+            arm();
+        }
+        for (auto& f : failed) f.op->complete(f.res, 0);
+    }
+
+    /**
+     * @brief Cancel the request
+     * The op receives -ECANCELED unless the request has already completed.
+     * @param op op passed to submit()
+     */
+    void cancel(detail::uring_op* op) {
+        submit(
+            nullptr,
+            nullptr,
+            [op](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_ASYNC_CANCEL;
+                sqe.addr = reinterpret_cast<std::uint64_t>(op);
+            }
+        );
+    }
+
+    /**
+     * @brief Return the provided buffer to the kernel
+     */
+    void recycle(std::uint16_t bid) {
+        std::lock_guard<std::mutex> g(mtx_);
+        auto tail = br_->tail;
+        auto& b = br_->bufs[tail & br_mask_];
+        b.addr = reinterpret_cast<std::uint64_t>(buffer(bid));
+        b.len = static_cast<std::uint32_t>(buffer_size_);
+        b.bid = bid;
+        __atomic_store_n(&br_->tail, static_cast<std::uint16_t>(tail + 1), __ATOMIC_RELEASE);
+        ++provided_;
+    }
+
+    char* buffer(std::uint16_t bid) {
+        return &buffers_[bid * buffer_size_];
+    }
+
+    void disable_multishot() {
+        multishot_ = false;
+    }
+
+    /**
+     * @brief Check whether every provided buffer is owned by the kernel
+     * If a receive fails with ENOBUFS in that state, the buffer ring doesn't work.
+     */
+    bool all_buffers_provided() {
+        std::lock_guard<std::mutex> g(mtx_);
+        return provided_ == buffer_count_;
+    }
+
+    static constexpr std::uint16_t buffer_group = 0;
+
+private:
+    struct failure {
+        detail::uring_op* op;
+        int res;
+        std::shared_ptr<void> keep;
+    };
+
+    // Check the running kernel supports the opcodes that are used.
+    static bool probe(int fd) {
+        constexpr unsigned num = 256;
+        std::vector<char> mem(sizeof(io_uring_probe) + num * sizeof(io_uring_probe_op));
+        auto p = reinterpret_cast<io_uring_probe*>(mem.data());
+        if (detail::uring_register(fd, IORING_REGISTER_PROBE, p, num) < 0) return false;
+        auto supported =
+            [&](unsigned opcode) {
+                return opcode <= p->last_op && (p->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+            };
+        return
+            supported(IORING_OP_RECV) &&
+            supported(IORING_OP_SENDMSG) &&
+            supported(IORING_OP_ASYNC_CANCEL);
+    }
+
+    bool map_rings(int fd, io_uring_params const& p) {
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        single_mmap_ = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap_) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) return false;
+        cq_ptr_ = single_mmap_
+            ? sq_ptr_
+            : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            ::munmap(sq_ptr_, sq_size_);
+            return false;
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        auto sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (!single_mmap_) ::munmap(cq_ptr_, cq_size_);
+            ::munmap(sq_ptr_, sq_size_);
+            return false;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        auto sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_flags_ = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        sq_entries_ = p.sq_entries;
+        auto cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    void unmap_rings() {
+        ::munmap(sqes_, sqes_size_);
+        if (!single_mmap_) ::munmap(cq_ptr_, cq_size_);
+        ::munmap(sq_ptr_, sq_size_);
+    }
+
+    void setup_buffer_ring(unsigned count) {
+#if defined(IORING_RECV_MULTISHOT)
+        unsigned entries = 1;
+        while (entries < count) entries <<= 1;
+        if (entries > 32768) entries = 32768;
+        br_size_ = entries * sizeof(io_uring_buf);
+        void* br = ::mmap(nullptr, br_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (br == MAP_FAILED) return;
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<std::uint64_t>(br);
+        reg.ring_entries = entries;
+        reg.bgid = buffer_group;
+        if (detail::uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            ::munmap(br, br_size_);
+            return;
+        }
+        br_ = static_cast<io_uring_buf_ring*>(br);
+        br_mask_ = entries - 1;
+        buffers_.resize(entries * buffer_size_);
+        buffer_count_ = entries;
+        for (unsigned i = 0; i != entries; ++i) {
+            recycle(static_cast<std::uint16_t>(i));
+        }
+        multishot_ = true;
+#else  // defined(IORING_RECV_MULTISHOT)
+        static_cast<void>(count);
+#endif // defined(IORING_RECV_MULTISHOT)
+    }
+
+    // The following functions are called with mtx_ locked.
+
+    void link(detail::uring_op* op) {
+        op->prev = nullptr;
+        op->next = ops_;
+        if (ops_) ops_->prev = op;
+        ops_ = op;
+    }
+
+    void unlink(detail::uring_op* op) {
+        if (op->prev) op->prev->next = op->next;
+        else ops_ = op->next;
+        if (op->next) op->next->prev = op->prev;
+        op->prev = op->next = nullptr;
+    }
+
+    bool push(io_uring_sqe const& sqe) {
+        unsigned tail = *sq_tail_;
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (tail - head >= sq_entries_) return false;
+        unsigned idx = tail & *sq_mask_;
+        sqes_[idx] = sqe;
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+        return true;
+    }
+
+    // Pass the filled SQEs to the kernel. If io_uring_enter() fails permanently,
+    // the requests that the kernel hasn't consumed are failed with the error.
+    void enter(std::vector<failure>& failed) {
+        while (true) {
+            while (!backlog_.empty() && push(backlog_.front())) backlog_.pop_front();
+            if (to_submit_ == 0) return;
+            int ret = detail::uring_enter(ring_fd_, to_submit_, 0, 0);
+            if (ret > 0) {
+                to_submit_ -= static_cast<unsigned>(ret);
+                if (backlog_.empty()) return;
+                continue;
+            }
+            if (ret == 0 || errno == EAGAIN || errno == EBUSY || errno == EINTR) {
+                // Temporary shortage (e.g. the completion queue is full). Retried on the next turn.
+                return;
+            }
+            int res = -errno;
+            unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            unsigned tail = *sq_tail_;
+            auto fail =
+                [&](std::uint64_t user_data) {
+                    --inflight_;
+                    auto op = reinterpret_cast<detail::uring_op*>(user_data);
+                    if (!op) return;
+                    unlink(op);
+                    failed.push_back(failure{ op, res, force_move(op->keep) });
+                };
+            for (; head != tail; ++head) {
+                fail(sqes_[sq_array_[head & *sq_mask_]].user_data);
+            }
+            __atomic_store_n(sq_tail_, *sq_head_, __ATOMIC_RELEASE);
+            for (auto const& sqe : backlog_) fail(sqe.user_data);
+            backlog_.clear();
+            to_submit_ = 0;
+            return;
+        }
+    }
+
+    void schedule_flush() {
+        if (flush_scheduled_ || (to_submit_ == 0 && backlog_.empty())) return;
+        flush_scheduled_ = true;
+        as::post(
+            efd_.get_executor(),
+            [self = shared_from_this()] {
+                self->flush();
+            }
+        );
+    }
+
+    void arm() {
+        if (waiting_ || inflight_ == 0) return;
+        waiting_ = true;
+        efd_.async_wait(
+            as::posix::stream_descriptor::wait_read,
+            [self = shared_from_this()]
+            (error_code ec) {
+                if (ec) return;
+                self->reap();
+            }
+        );
+    }
+
+    // The following functions are called on the thread that runs the io_context.
+
+    void flush() {
+        std::vector<failure> failed;
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            flush_scheduled_ = false;
+            enter(failed);
+            schedule_flush();
+        }
+        for (auto& f : failed) f.op->complete(f.res, 0);
+    }
+
+    void reap() {
+        std::uint64_t v;
+        auto r = ::read(efd_.native_handle(), &v, sizeof(v));
+        static_cast<void>(r);
+
+        // Only one reap() runs at a time, so the storage is reused.
+        auto cqes = force_move(reaped_);
+        {
+            std::lock_guard<std::mutex> g(mtx_);
+            if (*sq_flags_ & IORING_SQ_CQ_OVERFLOW) {
+                detail::uring_enter(ring_fd_, 0, 0, IORING_ENTER_GETEVENTS);
+            }
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                auto const& cqe = cqes_[head & *cq_mask_];
+                if (cqe.flags & IORING_CQE_F_BUFFER) --provided_;
+                auto op = reinterpret_cast<detail::uring_op*>(cqe.user_data);
+                if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                    --inflight_;
+                    if (!op) continue;
+                    unlink(op);
+                    // The owner is kept alive until the op has been called.
+                    cqes.push_back(completion{ op, cqe.res, cqe.flags, force_move(op->keep) });
+                }
+                else if (op) {
+                    cqes.push_back(completion{ op, cqe.res, cqe.flags, nullptr });
+                }
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        for (auto const& c : cqes) {
+            c.op->complete(c.res, c.flags);
+        }
+        cqes.clear();
+        reaped_ = force_move(cqes);
+        std::lock_guard<std::mutex> g(mtx_);
+        waiting_ = false;
+        arm();
+    }
+
+private:
+    struct completion {
+        detail::uring_op* op;
+        int res;
+        std::uint32_t flags;
+        std::shared_ptr<void> keep;
+    };
+
+    std::mutex mtx_;
+    as::posix::stream_descriptor efd_;
+    int ring_fd_ = -1;
+    bool single_mmap_ = false;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    std::size_t sq_size_ = 0;
+    std::size_t cq_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_flags_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    std::size_t inflight_ = 0;
+    unsigned to_submit_ = 0;
+    std::deque<io_uring_sqe> backlog_;
+    bool flush_scheduled_ = false;
+    detail::uring_op* ops_ = nullptr; // in-flight ops
+    std::vector<completion> reaped_;
+    bool waiting_ = false;
+    io_uring_buf_ring* br_ = nullptr;
+    std::size_t br_size_ = 0;
+    unsigned br_mask_ = 0;
+    std::size_t buffer_size_;
+    std::vector<char> buffers_;
+    std::size_t buffer_count_ = 0;
+    std::size_t provided_ = 0;
+    std::atomic<bool> multishot_{false};
+};
+
+/**
+ * @brief TCP transport that transfers the bytes via io_uring.
+ * Received bytes are buffered, so the small reads issued by the endpoint
+ * (fixed header, remaining length) don't cost a system call each.
+ * Writes are submitted as one sendmsg request per buffer sequence.
+ *
+ * The request objects are allocated once per connection and reused.
+ * Each CQE is posted to the strand once, and the handler is invoked there directly.
+ *
+ * If uring_context::enabled() is false, the regular asio socket operations are used.
+ * The synchronous write always uses the regular asio socket operation.
+ */
+template <typename Strand>
+class uring_endpoint : public std::enable_shared_from_this<uring_endpoint<Strand>> {
+public:
+    using this_type = uring_endpoint<Strand>;
+
+    uring_endpoint(as::io_context& ioc, std::shared_ptr<uring_context> ctx)
+        :tcp_(ioc),
+         strand_(ioc),
+         ctx_(force_move(ctx)),
+         send_(*this) {
+        if (!ctx_->enabled()) {
+            ctx_.reset();
+            return;
+        }
+        recv_ = std::make_shared<recv_op>(*ctx_);
+    }
+
+    ~uring_endpoint() {
+        if (!ctx_) return;
+        cancel_recv();
+        for (auto const& r : rx_) {
+            if (r.bid != -1) ctx_->recycle(static_cast<std::uint16_t>(r.bid));
+        }
+    }
+
+    uring_endpoint(this_type const&) = delete;
+    uring_endpoint& operator=(this_type const&) = delete;
+
+    void close(error_code& ec) {
+        cancel_recv();
+        tcp_.close(ec);
+    }
+
+    auto get_executor() {
+        return lowest_layer().get_executor();
+    }
+
+    as::ip::tcp::socket& socket() { return tcp_; }
+    as::ip::tcp::socket const& socket() const { return tcp_; }
+
+    as::ip::tcp::socket::lowest_layer_type& lowest_layer() {
+        return tcp_.lowest_layer();
+    }
+
+    as::ip::tcp::socket::native_handle_type native_handle() {
+        return tcp_.native_handle();
+    }
+
+    template <typename... Args>
+    void set_option(Args&& ... args) {
+        tcp_.set_option(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Check io_uring is used for this connection
+     */
+    bool uring_enabled() const {
+        return static_cast<bool>(ctx_);
+    }
+
+    template <typename ReadHandler>
+    void async_read(
+        as::mutable_buffer buffers,
+        ReadHandler&& handler) {
+        if (!ctx_) {
+            as::async_read(
+                tcp_,
+                buffers,
+                as::bind_executor(
+                    strand_,
+                    make_allocating_handler(handler_memory_, std::forward<ReadHandler>(handler))
+                )
+            );
+            return;
+        }
+        // The received bytes are served on the strand, so the handler is set there.
+        as::post(
+            strand_,
+            make_allocating_handler(
+                handler_memory_,
+                [this, self = this->shared_from_this(), buffers, h = std::forward<ReadHandler>(handler)] () mutable {
+                    start_watch();
+                    read_buf_ = buffers;
+                    read_transferred_ = 0;
+                    read_handler_ = force_move(h);
+                    serve();
+                }
+            )
+        );
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(
+        ConstBufferSequence const& buffers,
+        WriteHandler&& handler) {
+        if (!ctx_) {
+            as::async_write(
+                tcp_,
+                buffers,
+                as::bind_executor(
+                    strand_,
+                    make_allocating_handler(handler_memory_, std::forward<WriteHandler>(handler))
+                )
+            );
+            return;
+        }
+        // At most one write is outstanding, so the send request is reused.
+        send_.iov.clear();
+        for (auto it = as::buffer_sequence_begin(buffers), end = as::buffer_sequence_end(buffers);
+             it != end;
+             ++it) {
+            as::const_buffer b = *it;
+            if (b.size() == 0) continue;
+            send_.iov.push_back(::iovec{ const_cast<void*>(b.data()), b.size() });
+        }
+        send_.index = 0;
+        send_.transferred = 0;
+        send_.handler = std::forward<WriteHandler>(handler);
+        as::post(
+            strand_,
+            make_allocating_handler(
+                handler_memory_,
+                [this, self = this->shared_from_this()] {
+                    start_watch();
+                    send();
+                }
+            )
+        );
+    }
+
+    template <typename... Args>
+    std::size_t write(Args&& ... args) {
+        return as::write(tcp_, std::forward<Args>(args)...);
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        as::post(
+            strand_,
+            make_allocating_handler(handler_memory_, std::forward<PostHandler>(handler))
+        );
+    }
+
+    /**
+     * @brief Get the memory of the asynchronous operations
+     * @return handler_memory. Its counters show how many allocations fell back to the heap.
+     */
+    handler_memory const& get_handler_memory() const {
+        return *handler_memory_;
+    }
+
+private:
+    // The in-flight send request keeps the endpoint alive as the asio write does.
+    struct send_op : detail::uring_op {
+        explicit send_op(this_type& ep):ep(ep) {}
+
+        void complete(int res, std::uint32_t) override {
+            as::post(
+                ep.strand_,
+                make_allocating_handler(
+                    ep.handler_memory_,
+                    [self = ep.shared_from_this(), res] {
+                        self->on_send(res);
+                    }
+                )
+            );
+        }
+
+        this_type& ep;
+        std::vector<::iovec> iov;
+        std::size_t index = 0;
+        std::size_t transferred = 0;
+        ::msghdr msg;
+        std::function<void(error_code, std::size_t)> handler;
+    };
+
+    // The receive request doesn't keep the endpoint alive, otherwise the connection is never
+    // closed by releasing the endpoint. This object and the own buffer are kept by the
+    // uring_context until the request completes.
+    struct recv_op : detail::uring_op {
+        explicit recv_op(uring_context& ctx):ctx(ctx) {}
+
+        void complete(int res, std::uint32_t flags) override {
+            auto self = ep.lock();
+            if (!self) {
+                if (flags & IORING_CQE_F_BUFFER) {
+                    ctx.recycle(static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                return;
+            }
+            auto p = self.get();
+            as::post(
+                p->strand_,
+                make_allocating_handler(
+                    p->handler_memory_,
+                    [self = force_move(self), multishot = multishot, res, flags] {
+                        self->on_recv(multishot, res, flags);
+                    }
+                )
+            );
+        }
+
+        uring_context& ctx;
+        std::weak_ptr<this_type> ep;
+        std::vector<char> buf; // own buffer used if multishot is false
+        bool multishot = false;
+    };
+
+    struct received {
+        char* data;
+        std::size_t size;
+        int bid; // -1 means the own buffer
+    };
+
+    // The following functions are called on the strand.
+
+    void send() {
+        if (send_.index == send_.iov.size()) {
+            complete_write(error_code());
+            return;
+        }
+        std::memset(&send_.msg, 0, sizeof(send_.msg));
+        send_.msg.msg_iov = &send_.iov[send_.index];
+        send_.msg.msg_iovlen = send_.iov.size() - send_.index;
+        auto fd = tcp_.native_handle();
+        ctx_->submit(
+            &send_,
+            this->shared_from_this(),
+            [&](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_SENDMSG;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<std::uint64_t>(&send_.msg);
+                sqe.len = 1;
+                sqe.msg_flags = MSG_NOSIGNAL;
+            }
+        );
+    }
+
+    void on_send(int res) {
+        if (res < 0) {
+            complete_write(error_code(-res, as::error::get_system_category()));
+            return;
+        }
+        auto n = static_cast<std::size_t>(res);
+        send_.transferred += n;
+        while (n != 0) {
+            auto& v = send_.iov[send_.index];
+            if (n >= v.iov_len) {
+                n -= v.iov_len;
+                ++send_.index;
+            }
+            else {
+                v.iov_base = static_cast<char*>(v.iov_base) + n;
+                v.iov_len -= n;
+                n = 0;
+            }
+        }
+        send();
+    }
+
+    // The handler is invoked directly. It is never inside the initiating function
+    // because async_write() posts.
+    void complete_write(error_code ec) {
+        auto h = force_move(send_.handler);
+        send_.handler = nullptr;
+        h(ec, send_.transferred);
+    }
+
+    void serve() {
+        while (read_handler_ && read_transferred_ != read_buf_.size() && !rx_.empty()) {
+            auto& r = rx_.front();
+            auto n = as::buffer_copy(read_buf_ + read_transferred_, as::buffer(r.data, r.size));
+            read_transferred_ += n;
+            r.data += n;
+            r.size -= n;
+            if (r.size == 0) {
+                if (r.bid != -1) ctx_->recycle(static_cast<std::uint16_t>(r.bid));
+                rx_.pop_front();
+            }
+        }
+        if (!read_handler_) return;
+        if (read_transferred_ == read_buf_.size()) {
+            complete_read(error_code());
+            return;
+        }
+        if (rx_ec_) {
+            complete_read(rx_ec_);
+            return;
+        }
+        arm_recv();
+    }
+
+    // The handler is invoked directly. It is never inside the initiating function
+    // because async_read() posts.
+    void complete_read(error_code ec) {
+        auto h = force_move(read_handler_);
+        read_handler_ = nullptr;
+        h(ec, read_transferred_);
+    }
+
+    void arm_recv() {
+        if (recv_armed_) return;
+        bool multishot = ctx_->multishot() && !own_buffer_next_;
+        own_buffer_next_ = false;
+        if (!multishot) {
+            if (!rx_.empty()) return;
+            if (recv_->buf.empty()) recv_->buf.resize(ctx_->buffer_size());
+        }
+        recv_->ep = this->shared_from_this();
+        recv_->multishot = multishot;
+        recv_armed_ = true;
+        auto fd = tcp_.native_handle();
+        auto buf = &recv_->buf;
+        ctx_->submit(
+            recv_.get(),
+            recv_,
+            [&](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_RECV;
+                sqe.fd = fd;
+#if defined(IORING_RECV_MULTISHOT)
+                if (multishot) {
+                    sqe.ioprio = IORING_RECV_MULTISHOT;
+                    sqe.flags = IOSQE_BUFFER_SELECT;
+                    sqe.buf_group = uring_context::buffer_group;
+                    return;
+                }
+#endif // defined(IORING_RECV_MULTISHOT)
+                sqe.addr = reinterpret_cast<std::uint64_t>(buf->data());
+                sqe.len = static_cast<std::uint32_t>(buf->size());
+            }
+        );
+    }
+
+    void on_recv(bool multishot, int res, std::uint32_t flags) {
+        if (!(flags & IORING_CQE_F_MORE)) recv_armed_ = false;
+        if (res > 0) {
+            if (multishot) {
+                auto bid = static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+                rx_.push_back(received{ ctx_->buffer(bid), static_cast<std::size_t>(res), bid });
+            }
+            else {
+                rx_.push_back(received{ recv_->buf.data(), static_cast<std::size_t>(res), -1 });
+            }
+        }
+        else if (res == 0) {
+            if (flags & IORING_CQE_F_BUFFER) {
+                ctx_->recycle(static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            rx_ec_ = as::error::eof;
+        }
+        else if (res == -ENOBUFS) {
+            // All provided buffers are in use. If this connection holds some of them,
+            // the receive is armed again after they are read and returned.
+            // Otherwise, receive into the own buffer once.
+            // Some kernels accept the buffer ring registration but never select from it.
+            if (multishot && ctx_->all_buffers_provided()) ctx_->disable_multishot();
+            if (rx_.empty()) own_buffer_next_ = true;
+        }
+        else if (res == -EINVAL && multishot) {
+            // The kernel supports the provided buffer ring but not multishot receive.
+            ctx_->disable_multishot();
+        }
+        else if (res == -ECANCELED) {
+            rx_ec_ = as::error::operation_aborted;
+        }
+        else {
+            rx_ec_ = error_code(-res, as::error::get_system_category());
+        }
+        serve();
+    }
+
+    // The receive request holds a reference to the file, so the connection
+    // is not actually closed until the request is cancelled.
+    void cancel_recv() {
+        if (!ctx_ || !recv_armed_) return;
+        ctx_->cancel(recv_.get());
+    }
+
+    // Closing the socket via lowest_layer() (e.g. endpoint::force_disconnect())
+    // bypasses close(). asio aborts this wait on close, and then the receive is cancelled.
+    void start_watch() {
+        if (watching_) return;
+        watching_ = true;
+        tcp_.async_wait(
+            as::socket_base::wait_error,
+            as::bind_executor(
+                strand_,
+                [wp = std::weak_ptr<this_type>(this->shared_from_this())]
+                (error_code ec) {
+                    if (ec != as::error::operation_aborted) return;
+                    if (auto self = wp.lock()) self->cancel_recv();
+                }
+            )
+        );
+    }
+
+private:
+    as::ip::tcp::socket tcp_;
+    Strand strand_;
+    std::shared_ptr<uring_context> ctx_;
+    send_op send_;
+    std::shared_ptr<recv_op> recv_;
+    as::mutable_buffer read_buf_;
+    std::size_t read_transferred_ = 0;
+    std::function<void(error_code, std::size_t)> read_handler_;
+    std::deque<received> rx_;
+    error_code rx_ec_;
+    bool recv_armed_ = false;
+    bool own_buffer_next_ = false;
+    bool watching_ = false;
+    std::shared_ptr<handler_memory> handler_memory_ = std::make_shared<handler_memory>();
+};
+
+template <typename Strand, typename MutableBufferSequence, typename ReadHandler>
+inline void async_read(
+    uring_endpoint<Strand>& ep,
+    MutableBufferSequence && buffers,
+    ReadHandler&& handler) {
+    ep.async_read(std::forward<MutableBufferSequence>(buffers), std::forward<ReadHandler>(handler));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    uring_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers));
+}
+
+template <typename Strand, typename ConstBufferSequence>
+inline std::size_t write(
+    uring_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    error_code& ec) {
+    return ep.write(std::forward<ConstBufferSequence>(buffers), ec);
+}
+
+template <typename Strand, typename ConstBufferSequence, typename WriteHandler>
+inline void async_write(
+    uring_endpoint<Strand>& ep,
+    ConstBufferSequence && buffers,
+    WriteHandler&& handler) {
+    ep.async_write(std::forward<ConstBufferSequence>(buffers), std::forward<WriteHandler>(handler));
+}
+
+} // namespace MQTT_NS
+
+#endif // defined(MQTT_HAS_IO_URING)
+
+#endif // MQTT_URING_ENDPOINT_HPP
@@ -8,6 +8,7 @@
 #define MQTT_V5_MESSAGE_HPP
 
 #include <string>
+#include <array>
 #include <vector>
 #include <memory>
 #include <algorithm>
@@ -57,8 +58,29 @@ namespace as = boost::asio;
 
 namespace v5 {
 
+/**
+ * @brief Buffer sequence of PUBACK, PUBREC, PUBREL, and PUBCOMP
+ * fixed header, remaining length, packet id, reason code, property length, and properties.
+ * The properties are encoded into one buffer, so the sequence never allocates.
+ */
+using ack_const_buffer_sequence = boost::container::static_vector<as::const_buffer, 6>;
+
 namespace detail {
 
+// Encodes the properties into one shared buffer, so that they are one const buffer.
+inline buffer encode_properties(properties const& props, std::size_t property_length) {
+    if (property_length == 0) return buffer();
+    auto spa = make_shared_ptr_array(property_length);
+    auto ptr = spa.get();
+    auto it = ptr;
+    auto end = ptr + property_length;
+    for (auto const& p : props) {
+        v5::fill(p, it, end);
+        it += v5::size(p);
+    }
+    return buffer(string_view(ptr, property_length), force_move(spa));
+}
+
 class header_only_message {
 public:
     /**
@@ -71,10 +93,20 @@ public:
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The size is fixed, so the sequence is held in place without allocation.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        return { as::buffer(message_.data(), message_.size()) };
+    std::array<as::const_buffer, 1> const_buffer_sequence() const {
+        return {{ as::buffer(message_.data(), message_.size()) }};
+    }
+
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(message_.data(), message_.size()));
     }
 
     /**
@@ -261,43 +293,50 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(protocol_name_and_level_.data(), protocol_name_and_level_.size()));
-        ret.emplace_back(as::buffer(&connect_flags_, 1));
-        ret.emplace_back(as::buffer(keep_alive_buf_.data(), keep_alive_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(protocol_name_and_level_.data(), protocol_name_and_level_.size()));
+        v.emplace_back(as::buffer(&connect_flags_, 1));
+        v.emplace_back(as::buffer(keep_alive_buf_.data(), keep_alive_buf_.size()));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
 
-        ret.emplace_back(as::buffer(client_id_length_buf_.data(), client_id_length_buf_.size()));
-        ret.emplace_back(as::buffer(client_id_));
+        v.emplace_back(as::buffer(client_id_length_buf_.data(), client_id_length_buf_.size()));
+        v.emplace_back(as::buffer(client_id_));
 
         if (connect_flags::has_will_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(will_property_length_buf_.data(), will_property_length_buf_.size()));
+            v.emplace_back(as::buffer(will_property_length_buf_.data(), will_property_length_buf_.size()));
             for (auto const& p : will_props_) {
-                v5::add_const_buffer_sequence(ret, p);
+                v5::add_const_buffer_sequence(v, p);
             }
-            ret.emplace_back(as::buffer(will_topic_name_length_buf_.data(), will_topic_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(will_topic_name_));
-            ret.emplace_back(as::buffer(will_message_length_buf_.data(), will_message_length_buf_.size()));
-            ret.emplace_back(as::buffer(will_message_));
+            v.emplace_back(as::buffer(will_topic_name_length_buf_.data(), will_topic_name_length_buf_.size()));
+            v.emplace_back(as::buffer(will_topic_name_));
+            v.emplace_back(as::buffer(will_message_length_buf_.data(), will_message_length_buf_.size()));
+            v.emplace_back(as::buffer(will_message_));
         }
 
         if (connect_flags::has_user_name_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(user_name_length_buf_.data(), user_name_length_buf_.size()));
-            ret.emplace_back(as::buffer(user_name_));
+            v.emplace_back(as::buffer(user_name_length_buf_.data(), user_name_length_buf_.size()));
+            v.emplace_back(as::buffer(user_name_));
         }
 
         if (connect_flags::has_password_flag(connect_flags_)) {
-            ret.emplace_back(as::buffer(password_length_buf_.data(), password_length_buf_.size()));
-            ret.emplace_back(as::buffer(password_));
+            v.emplace_back(as::buffer(password_length_buf_.data(), password_length_buf_.size()));
+            v.emplace_back(as::buffer(password_));
         }
-
-        return ret;
     }
 
     /**
@@ -472,18 +511,25 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(&connect_acknowledge_flags_, 1));
-        ret.emplace_back(as::buffer(&reason_code_, 1));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(&connect_acknowledge_flags_, 1));
+        v.emplace_back(as::buffer(&reason_code_, 1));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
-
-        return ret;
     }
 
     /**
@@ -573,6 +619,7 @@ public:
               )
           ),
           props_(force_move(props)),
+          props_buf_(detail::encode_properties(props_, property_length_)),
           payload_(payload),
           remaining_length_(
               2                      // topic name length
@@ -589,14 +636,7 @@ public:
               1 +                   // topic name
               ((pubopts.get_qos() == qos::at_most_once) ? 0U : 1U) + // packet id
               1 +                   // property length
-              std::accumulate(
-                  props_.begin(),
-                  props_.end(),
-                  0U,
-                  [](std::size_t total, property_variant const& pv) {
-                      return total + v5::num_of_const_buffer_sequence(pv);
-                  }
-              ) +
+              (props_buf_.empty() ? 0U : 1U) + // properties
               1                     // payload
           )
     {
@@ -677,7 +717,8 @@ public:
         buf.remove_prefix(consume);
         if (buf.size() < property_length_) throw property_length_error();
 
-        props_ = property::parse(buf.substr(0, property_length_));
+        props_buf_ = buf.substr(0, property_length_);
+        props_ = property::parse(props_buf_);
         buf.remove_prefix(property_length_);
         payload_ = as::buffer(buf);
         num_of_const_buffer_sequence_ =
@@ -687,14 +728,7 @@ public:
             1 +                   // topic name
             ((qos_value == qos::at_most_once) ? 0U : 1U) + // packet id
             1 +                   // property length
-            std::accumulate(
-                props_.begin(),
-                props_.end(),
-                0U,
-                [](std::size_t total, property_variant const& pv) {
-                    return total + v5::num_of_const_buffer_sequence(pv);
-                }
-            ) +
+            (props_buf_.empty() ? 0U : 1U) + // properties
             1;                    // payload
     }
 
@@ -706,24 +740,31 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(topic_name_length_buf_.data(), topic_name_length_buf_.size());
-        ret.emplace_back(as::buffer(topic_name_));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(topic_name_length_buf_.data(), topic_name_length_buf_.size());
+        v.emplace_back(as::buffer(topic_name_));
 
         if (!packet_id_.empty()) {
-            ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+            v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
         }
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
-        for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        if (!props_buf_.empty()) {
+            v.emplace_back(as::buffer(props_buf_.data(), props_buf_.size()));
         }
 
-        ret.emplace_back(as::buffer(payload_));
-
-        return ret;
+        v.emplace_back(as::buffer(payload_));
     }
 
     /**
@@ -765,14 +806,7 @@ public:
         ret.append(packet_id_.data(), packet_id_.size());
 
         ret.append(property_length_buf_.data(), property_length_buf_.size());
-
-        auto it = ret.end();
-        ret.resize(ret.size() + property_length_);
-        auto end = ret.end();
-        for (auto const& p : props_) {
-            v5::fill(p, it, end);
-            it += static_cast<std::string::difference_type>(v5::size(p));
-        }
+        ret.append(props_buf_.data(), props_buf_.size());
 
         ret.append(get_pointer(payload_), get_size(payload_));
 
@@ -859,6 +893,7 @@ private:
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
     properties props_;
+    buffer props_buf_;
     as::const_buffer payload_;
     std::size_t remaining_length_;
     boost::container::static_vector<char, 4> remaining_length_buf_;
@@ -887,6 +922,7 @@ struct basic_puback_message {
               )
           ),
           props_(force_move(props)),
+          props_buf_(detail::encode_properties(props_, property_length_)),
           num_of_const_buffer_sequence_(
               1 +                   // fixed header
               1 +                   // remaining length
@@ -909,14 +945,7 @@ struct basic_puback_message {
                           return
                               1 +                   // reason code
                               1 +                   // property length
-                              std::accumulate(      // properties
-                                  props_.begin(),
-                                  props_.end(),
-                                  std::size_t(0U),
-                                  [](std::size_t total, property_variant const& pv) {
-                                      return total + v5::num_of_const_buffer_sequence(pv);
-                                  }
-                              );
+                              1;                    // properties
                       }
                   }
                   else {
@@ -968,15 +997,25 @@ struct basic_puback_message {
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The properties are encoded into one buffer, so the sequence is held in place.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(num_of_const_buffer_sequence());
+    ack_const_buffer_sequence const_buffer_sequence() const {
+        ack_const_buffer_sequence ret;
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    template <typename Container>
+    void add_const_buffer_sequence(Container& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -986,17 +1025,14 @@ struct basic_puback_message {
         // the Reason Code is 0x00 (Success) and there are no Properties.
         // In this case the PUBACK has a Remaining Length of 2.
         if (reason_code_ != v5::puback_reason_code::success || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
             // https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901126
             // If the Remaining Length is less than 4 there is no Property Length and the value of 0 is used.
             if (!props_.empty()) {
-                ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
-                for (auto const& p : props_) {
-                    v5::add_const_buffer_sequence(ret, p);
-                }
+                v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+                v.emplace_back(as::buffer(props_buf_.data(), props_buf_.size()));
             }
         }
-        return ret;
     }
 
     /**
@@ -1067,6 +1103,7 @@ struct basic_puback_message {
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
     properties props_;
+    buffer props_buf_;
     std::size_t num_of_const_buffer_sequence_;
 };
 
@@ -1091,6 +1128,7 @@ struct basic_pubrec_message {
               )
           ),
           props_(force_move(props)),
+          props_buf_(detail::encode_properties(props_, property_length_)),
           num_of_const_buffer_sequence_(
               1 +                   // fixed header
               1 +                   // remaining length
@@ -1113,14 +1151,7 @@ struct basic_pubrec_message {
                           return
                               1 +                   // reason code
                               1 +                   // property length
-                              std::accumulate(      // properties
-                                  props_.begin(),
-                                  props_.end(),
-                                  std::size_t(0U),
-                                  [](std::size_t total, property_variant const& pv) {
-                                      return total + v5::num_of_const_buffer_sequence(pv);
-                                  }
-                              );
+                              1;                    // properties
                       }
                   }
                   else {
@@ -1172,15 +1203,25 @@ struct basic_pubrec_message {
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The properties are encoded into one buffer, so the sequence is held in place.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(num_of_const_buffer_sequence());
+    ack_const_buffer_sequence const_buffer_sequence() const {
+        ack_const_buffer_sequence ret;
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    template <typename Container>
+    void add_const_buffer_sequence(Container& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -1190,17 +1231,14 @@ struct basic_pubrec_message {
         // the Reason Code is 0x00 (Success) and there are no Properties.
         // In this case the PUBREC has a Remaining Length of 2.
         if (reason_code_ != v5::pubrec_reason_code::success || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
             // https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901136
             // If the Remaining Length is less than 4 there is no Property Length and the value of 0 is used.
             if (!props_.empty()) {
-                ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
-                for (auto const& p : props_) {
-                    v5::add_const_buffer_sequence(ret, p);
-                }
+                v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+                v.emplace_back(as::buffer(props_buf_.data(), props_buf_.size()));
             }
         }
-        return ret;
     }
 
     /**
@@ -1272,6 +1310,7 @@ struct basic_pubrec_message {
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
     properties props_;
+    buffer props_buf_;
     std::size_t num_of_const_buffer_sequence_;
 };
 
@@ -1296,6 +1335,7 @@ struct basic_pubrel_message {
               )
           ),
           props_(force_move(props)),
+          props_buf_(detail::encode_properties(props_, property_length_)),
           num_of_const_buffer_sequence_(
               1 +                   // fixed header
               1 +                   // remaining length
@@ -1318,14 +1358,7 @@ struct basic_pubrel_message {
                           return
                               1 +                   // reason code
                               1 +                   // property length
-                              std::accumulate(      // properties
-                                  props_.begin(),
-                                  props_.end(),
-                                  std::size_t(0U),
-                                  [](std::size_t total, property_variant const& pv) {
-                                      return total + v5::num_of_const_buffer_sequence(pv);
-                                  }
-                              );
+                              1;                    // properties
                       }
                   }
                   else {
@@ -1425,7 +1458,8 @@ struct basic_pubrel_message {
             buf.remove_prefix(consume);
             if (buf.size() != property_length_) throw property_length_error();
 
-            props_ = property::parse(buf);
+            props_buf_ = buf.substr(0, property_length_);
+            props_ = property::parse(props_buf_);
             buf.remove_prefix(property_length_);
         }
 
@@ -1451,14 +1485,7 @@ struct basic_pubrel_message {
                         return
                             1 +                   // reason code
                             1 +                   // property length
-                            std::accumulate(      // properties
-                                props_.begin(),
-                                props_.end(),
-                                std::size_t(0U),
-                                [](std::size_t total, property_variant const& pv) {
-                                    return total + v5::num_of_const_buffer_sequence(pv);
-                                }
-                            );
+                            1;                    // properties
                     }
                 }
                 else {
@@ -1470,15 +1497,25 @@ struct basic_pubrel_message {
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The properties are encoded into one buffer, so the sequence is held in place.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(num_of_const_buffer_sequence());
+    ack_const_buffer_sequence const_buffer_sequence() const {
+        ack_const_buffer_sequence ret;
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    template <typename Container>
+    void add_const_buffer_sequence(Container& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -1488,19 +1525,16 @@ struct basic_pubrel_message {
         // the Reason Code is 0x00 (Success) and there are no Properties.
         // In this case the PUBREL has a Remaining Length of 2.
         if(reason_code_ != v5::pubrel_reason_code::success || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
             // https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901146
             // If the Remaining Length is less than 4 there is no Property Length and the value of 0 is used.
             if (!props_.empty()) {
-                ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+                v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
 
-                for (auto const& p : props_) {
-                    v5::add_const_buffer_sequence(ret, p);
-                }
+                v.emplace_back(as::buffer(props_buf_.data(), props_buf_.size()));
             }
         }
-        return ret;
-   }
+    }
 
     /**
      * @brief Get whole size of sequence
@@ -1595,6 +1629,7 @@ struct basic_pubrel_message {
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
     properties props_;
+    buffer props_buf_;
     std::size_t num_of_const_buffer_sequence_;
 };
 
@@ -1620,6 +1655,7 @@ struct basic_pubcomp_message {
               )
           ),
           props_(force_move(props)),
+          props_buf_(detail::encode_properties(props_, property_length_)),
           num_of_const_buffer_sequence_(
               1 +                   // fixed header
               1 +                   // remaining length
@@ -1642,14 +1678,7 @@ struct basic_pubcomp_message {
                           return
                               1 +                   // reason code
                               1 +                   // property length
-                              std::accumulate(      // properties
-                                  props_.begin(),
-                                  props_.end(),
-                                  std::size_t(0U),
-                                  [](std::size_t total, property_variant const& pv) {
-                                      return total + v5::num_of_const_buffer_sequence(pv);
-                                  }
-                              );
+                              1;                    // properties
                       }
                   }
                   else {
@@ -1701,15 +1730,25 @@ struct basic_pubcomp_message {
     /**
      * @brief Create const buffer sequence
      *        it is for boost asio APIs
+     *        The properties are encoded into one buffer, so the sequence is held in place.
      * @return const buffer sequence
      */
-    std::vector<as::const_buffer> const_buffer_sequence() const {
-        std::vector<as::const_buffer> ret;
-        ret.reserve(num_of_const_buffer_sequence());
+    ack_const_buffer_sequence const_buffer_sequence() const {
+        ack_const_buffer_sequence ret;
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    template <typename Container>
+    void add_const_buffer_sequence(Container& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -1719,19 +1758,16 @@ struct basic_pubcomp_message {
         // the Reason Code is 0x00 (Success) and there are no Properties.
         // In this case the PUBCOMP has a Remaining Length of 2.
         if (reason_code_ != v5::pubcomp_reason_code::success || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
             // https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html#_Toc3901156
             // If the Remaining Length is less than 4 there is no Property Length and the value of 0 is used.
             if (!props_.empty()) {
-                ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+                v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
 
-                for (auto const& p : props_) {
-                    v5::add_const_buffer_sequence(ret, p);
-                }
+                v.emplace_back(as::buffer(props_buf_.data(), props_buf_.size()));
             }
         }
-       return ret;
-   }
+    }
 
     /**
      * @brief Get whole size of sequence
@@ -1802,6 +1838,7 @@ struct basic_pubcomp_message {
     std::size_t property_length_;
     boost::container::static_vector<char, 4> property_length_buf_;
     properties props_;
+    buffer props_buf_;
     std::size_t num_of_const_buffer_sequence_;
 };
 
@@ -1900,25 +1937,32 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
 
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
 
         for (auto const& e : entries_) {
-            ret.emplace_back(as::buffer(e.topic_filter_length_buf_.data(), e.topic_filter_length_buf_.size()));
-            ret.emplace_back(as::buffer(e.topic_filter_));
-            ret.emplace_back(as::buffer(&e.options_, 1));
+            v.emplace_back(as::buffer(e.topic_filter_length_buf_.data(), e.topic_filter_length_buf_.size()));
+            v.emplace_back(as::buffer(e.topic_filter_));
+            v.emplace_back(as::buffer(&e.options_, 1));
         }
-
-        return ret;
     }
 
     /**
@@ -2055,19 +2099,26 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
 
-        ret.emplace_back(as::buffer(entries_));
-
-        return ret;
+        v.emplace_back(as::buffer(entries_));
     }
 
     /**
@@ -2218,23 +2269,30 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
 
         for (auto const& e : entries_) {
-            ret.emplace_back(as::buffer(e.topic_filter_length_buf_.data(), e.topic_filter_length_buf_.size()));
-            ret.emplace_back(as::buffer(e.topic_filter_));
+            v.emplace_back(as::buffer(e.topic_filter_length_buf_.data(), e.topic_filter_length_buf_.size()));
+            v.emplace_back(as::buffer(e.topic_filter_));
         }
-
-        return ret;
     }
 
     /**
@@ -2364,19 +2422,26 @@ public:
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
-        ret.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+        v.emplace_back(as::buffer(packet_id_.data(), packet_id_.size()));
 
-        ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+        v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
         for (auto const& p : props_) {
-            v5::add_const_buffer_sequence(ret, p);
+            v5::add_const_buffer_sequence(v, p);
         }
 
-        ret.emplace_back(as::buffer(reinterpret_cast<char const*>(reason_codes_.data()), reason_codes_.size()));
-
-        return ret;
+        v.emplace_back(as::buffer(reinterpret_cast<char const*>(reason_codes_.data()), reason_codes_.size()));
     }
 
     /**
@@ -2529,9 +2594,18 @@ struct disconnect_message {
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -2541,15 +2615,13 @@ struct disconnect_message {
         // the Reason Code is 0x00 (Normal disconnecton) and there are no
         // Properties. In this case the DISCONNECT has a Remaining Length of 0.
         if (reason_code_ != v5::disconnect_reason_code::normal_disconnection || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
 
-            ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+            v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
             for (auto const& p : props_) {
-                v5::add_const_buffer_sequence(ret, p);
+                v5::add_const_buffer_sequence(v, p);
             }
         }
-
-        return ret;
     }
 
     /**
@@ -2699,9 +2771,18 @@ struct auth_message {
     std::vector<as::const_buffer> const_buffer_sequence() const {
         std::vector<as::const_buffer> ret;
         ret.reserve(num_of_const_buffer_sequence());
+        add_const_buffer_sequence(ret);
+        return ret;
+    }
 
-        ret.emplace_back(as::buffer(&fixed_header_, 1));
-        ret.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
+    /**
+     * @brief Add const buffer sequence
+     *        The buffers are appended to v. It doesn't allocate if v has enough capacity.
+     * @param v buffer sequence to be appended
+     */
+    void add_const_buffer_sequence(std::vector<as::const_buffer>& v) const {
+        v.emplace_back(as::buffer(&fixed_header_, 1));
+        v.emplace_back(as::buffer(remaining_length_buf_.data(), remaining_length_buf_.size()));
 
         // TODO: This is wrong. The reason code MUST be provided
         // if there are properties. Not the other way around.
@@ -2711,15 +2792,13 @@ struct auth_message {
         // the Reason Code is 0x00 (Success) and there are no
         // Properties. In this case the AUTH has a Remaining Length of 0.
         if (reason_code_ != v5::auth_reason_code::success || MQTT_ALWAYS_SEND_REASON_CODE) {
-            ret.emplace_back(as::buffer(&reason_code_, 1));
+            v.emplace_back(as::buffer(&reason_code_, 1));
 
-            ret.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
+            v.emplace_back(as::buffer(property_length_buf_.data(), property_length_buf_.size()));
             for (auto const& p : props_) {
-                v5::add_const_buffer_sequence(ret, p);
+                v5::add_const_buffer_sequence(v, p);
             }
         }
-
-        return ret;
     }
 
     /**
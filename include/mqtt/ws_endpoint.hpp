@@ -13,6 +13,7 @@
 
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/buffers_suffix.hpp>
 #if ASIO_STANDALONE
 #include <asio/bind_executor.hpp>
 #else
@@ -22,6 +23,9 @@
 #include <mqtt/namespace.hpp>
 #include <mqtt/string_view.hpp>
 #include <mqtt/error_code.hpp>
+#include <mqtt/move.hpp>
+#include <mqtt/tls_record_buffer.hpp>
+#include <mqtt/handler_allocator.hpp>
 
 namespace MQTT_NS {
 
@@ -31,6 +35,42 @@ namespace as = asio;
 namespace as = boost::asio;
 #endif // ASIO_STANDALONE
 
+/**
+ * @brief permessage-deflate (RFC 7692) settings of WebSocket connections
+ * Compression is used only if both sides of the connection enable it.
+ */
+struct ws_deflate_options {
+    /**
+     * @brief Maximum LZ77 window size in bits (9..15)
+     * A smaller window needs less memory per connection, and compresses less.
+     */
+    int window_bits = 15;
+
+    /**
+     * @brief Memory used for the compression state (1..9)
+     */
+    int mem_level = 4;
+
+    /**
+     * @brief Compression level (0..9)
+     * Higher level compresses more, and uses more CPU time.
+     */
+    int comp_level = 8;
+
+    /**
+     * @brief Messages smaller than this size are sent without compression.
+     * The compression of a small message costs more CPU time than it saves bandwidth.
+     * It requires Boost 1.79.0 or later. Older Boost compresses all messages.
+     */
+    std::size_t threshold = 0;
+
+    /**
+     * @brief If true, the compression state is reset for each message.
+     * It saves the memory between messages, and compresses less.
+     */
+    bool no_context_takeover = false;
+};
+
 template <typename Socket, typename Strand>
 class ws_endpoint {
 public:
@@ -83,6 +123,27 @@ public:
         ws_.set_option(std::forward<T>(t));
     }
 
+    /**
+     * @brief Enable permessage-deflate
+     * @param opts deflate settings
+     * It needs to be called before the handshake.
+     */
+    void set_deflate(ws_deflate_options const& opts) {
+        boost::beast::websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        pmd.client_enable = true;
+        pmd.server_max_window_bits = opts.window_bits;
+        pmd.client_max_window_bits = opts.window_bits;
+        pmd.server_no_context_takeover = opts.no_context_takeover;
+        pmd.client_no_context_takeover = opts.no_context_takeover;
+        pmd.compLevel = opts.comp_level;
+        pmd.memLevel = opts.mem_level;
+#if BOOST_VERSION >= 107900
+        pmd.msg_size_threshold = opts.threshold;
+#endif // BOOST_VERSION >= 107900
+        ws_.set_option(pmd);
+    }
+
     template <typename ConstBufferSequence, typename AcceptHandler>
     void async_accept(
         ConstBufferSequence const& buffers,
@@ -108,73 +169,28 @@ public:
         ws_.handshake(std::forward<Args>(args)...);
     }
 
+    /**
+     * @brief Read the payload of WebSocket binary messages as a byte stream
+     * The payload is decoded into buffers directly, and the handler is called
+     * when buffers is filled.
+     */
     template <typename MutableBufferSequence, typename ReadHandler>
     void async_read(
         MutableBufferSequence const& buffers,
         ReadHandler&& handler) {
-        auto req_size = as::buffer_size(buffers);
-
-        using beast_read_handler_t =
-            std::function<void(error_code ec, std::shared_ptr<void>)>;
-
-        std::shared_ptr<beast_read_handler_t> beast_read_handler;
-        if (req_size <= buffer_.size()) {
-            as::buffer_copy(buffers, buffer_.data(), req_size);
-            buffer_.consume(req_size);
-            handler(boost::system::errc::make_error_code(boost::system::errc::success), req_size);
-            return;
-        }
-
-        beast_read_handler.reset(
-            new beast_read_handler_t(
-                [this, req_size, buffers, handler = std::forward<ReadHandler>(handler)]
-                (error_code ec, std::shared_ptr<void> const& v) mutable {
-                    if (ec) {
-                        std::forward<ReadHandler>(handler)(ec, 0);
-                        return;
-                    }
-                    if (!ws_.got_binary()) {
-                        buffer_.consume(buffer_.size());
-                        std::forward<ReadHandler>(handler)
-                            (boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
-                        return;
-                    }
-                    if (req_size > buffer_.size()) {
-                        auto beast_read_handler = std::static_pointer_cast<beast_read_handler_t>(v);
-                        ws_.async_read(
-                            buffer_,
-                            as::bind_executor(
-                                strand_,
-                                [beast_read_handler]
-                                (error_code ec, std::size_t) {
-                                    (*beast_read_handler)(ec, beast_read_handler);
-                                }
-                            )
-                        );
-                        return;
-                    }
-                    as::buffer_copy(buffers, buffer_.data(), req_size);
-                    buffer_.consume(req_size);
-                    std::forward<ReadHandler>(handler)(boost::system::errc::make_error_code(boost::system::errc::success), req_size);
-                }
-            )
-        );
-        ws_.async_read(
-            buffer_,
-            as::bind_executor(
-                strand_,
-                [beast_read_handler]
-                (error_code ec, std::size_t) {
-                    (*beast_read_handler)(ec, beast_read_handler);
-                }
-            )
-        );
+        read_op<MutableBufferSequence, std::decay_t<ReadHandler>>{
+            *this,
+            boost::beast::buffers_suffix<MutableBufferSequence>(buffers),
+            as::buffer_size(buffers),
+            0,
+            std::forward<ReadHandler>(handler)
+        }.start();
     }
 
     template <typename ConstBufferSequence>
     std::size_t write(
         ConstBufferSequence const& buffers) {
-        ws_.write(buffers);
+        ws_.write(stage(is_tls_stream<Socket>(), sync_staging_, buffers));
         return as::buffer_size(buffers);
     }
 
@@ -182,7 +198,7 @@ public:
     std::size_t write(
         ConstBufferSequence const& buffers,
         error_code& ec) {
-        ws_.write(buffers, ec);
+        ws_.write(stage(is_tls_stream<Socket>(), sync_staging_, buffers), ec);
         return as::buffer_size(buffers);
     }
 
@@ -191,10 +207,10 @@ public:
         ConstBufferSequence const& buffers,
         WriteHandler&& handler) {
         ws_.async_write(
-            buffers,
+            stage(is_tls_stream<Socket>(), async_staging_, buffers),
             as::bind_executor(
                 strand_,
-                std::forward<WriteHandler>(handler)
+                make_allocating_handler(handler_memory_, std::forward<WriteHandler>(handler))
             )
         );
     }
@@ -203,14 +219,91 @@ public:
     void post(PostHandler&& handler) {
         as::post(
             strand_,
-            std::forward<PostHandler>(handler)
+            make_allocating_handler(handler_memory_, std::forward<PostHandler>(handler))
         );
     }
 
+    /**
+     * @brief Get the memory of the asynchronous operations
+     * @return handler_memory. Its counters show how many allocations fell back to the heap.
+     */
+    handler_memory const& get_handler_memory() const {
+        return *handler_memory_;
+    }
+
+private:
+    // The read operation is moved into the next async_read_some of the stream,
+    // so reading the rest of the buffers doesn't allocate.
+    template <typename MutableBufferSequence, typename ReadHandler>
+    struct read_op {
+        void start() {
+            if (req_size == 0) {
+                handler(boost::system::errc::make_error_code(boost::system::errc::success), 0);
+                return;
+            }
+            read_some();
+        }
+
+        void operator()(error_code ec, std::size_t bytes_transferred) {
+            if (ec) {
+                handler(ec, transferred);
+                return;
+            }
+            if (!ep.ws_.got_binary()) {
+                handler(boost::system::errc::make_error_code(boost::system::errc::bad_message), 0);
+                return;
+            }
+            transferred += bytes_transferred;
+            rest.consume(bytes_transferred);
+            if (transferred < req_size) {
+                read_some();
+                return;
+            }
+            handler(ec, transferred);
+        }
+
+    private:
+        void read_some() {
+            // *this is moved to the handler, so take the members before that.
+            auto& ep_ref = ep;
+            auto& ws = ep.ws_;
+            auto buffers = rest;
+            ws.async_read_some(
+                buffers,
+                as::bind_executor(
+                    ep_ref.strand_,
+                    make_allocating_handler(ep_ref.handler_memory_, force_move(*this))
+                )
+            );
+        }
+
+    public:
+        ws_endpoint& ep;
+        boost::beast::buffers_suffix<MutableBufferSequence> rest;
+        std::size_t req_size;
+        std::size_t transferred;
+        ReadHandler handler;
+    };
+
+    template <typename ConstBufferSequence>
+    ConstBufferSequence const& stage(std::false_type, tls_record_buffer&, ConstBufferSequence const& buffers) {
+        return buffers;
+    }
+
+    // The frame header is still a record of its own, but the payload isn't split
+    // into a record per buffer.
+    template <typename ConstBufferSequence>
+    const_buffer_span stage(std::true_type, tls_record_buffer& staging, ConstBufferSequence const& buffers) {
+        return staging.stage(buffers);
+    }
+
 private:
     boost::beast::websocket::stream<Socket> ws_;
-    boost::beast::flat_buffer buffer_;
     Strand strand_;
+    // Separate buffers for the synchronous and the asynchronous write, which can overlap.
+    tls_record_buffer sync_staging_;
+    tls_record_buffer async_staging_;
+    std::shared_ptr<handler_memory> handler_memory_ = std::make_shared<handler_memory>();
 };
 
 template <typename Socket, typename Strand, typename MutableBufferSequence, typename ReadHandler>
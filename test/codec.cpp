@@ -0,0 +1,441 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <mqtt/codec.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_codec)
+
+using namespace MQTT_NS::literals;
+namespace codec = MQTT_NS::codec;
+namespace v5 = MQTT_NS::v5;
+
+namespace {
+
+template <typename Message>
+std::string encode(Message const& m) {
+    codec::encoder enc;
+    std::string s(m.size(), '\0');
+    BOOST_TEST(enc.encode(m, &s[0], s.size()) == s.size());
+    return s;
+}
+
+template <typename Message>
+codec::packet decode(Message const& m, MQTT_NS::protocol_version version) {
+    auto s = encode(m);
+    codec::decoder d(version);
+    d.feed(s.data(), s.size());
+    auto p = d.next();
+    BOOST_TEST(p.has_value());
+    return p.value();
+}
+
+codec::packet decode(std::string const& s, MQTT_NS::protocol_version version) {
+    codec::decoder d(version);
+    d.feed(s.data(), s.size());
+    return d.next().value();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( v3_1_1_publish_byte_by_byte ) {
+    MQTT_NS::v3_1_1::publish_message m(
+        0x1234,
+        as::buffer("topic1"_mb),
+        as::buffer("topic1_contents"_mb),
+        MQTT_NS::qos::at_least_once | MQTT_NS::retain::yes
+    );
+    auto s = encode(m);
+
+    codec::decoder d(MQTT_NS::protocol_version::v3_1_1);
+    for (std::size_t i = 0; i != s.size(); ++i) {
+        BOOST_TEST(!d.next());
+        d.feed(&s[i], 1);
+    }
+    BOOST_TEST(!d.partial());
+    auto p = d.next();
+    BOOST_TEST(p.has_value());
+    BOOST_TEST(!d.next());
+    BOOST_TEST(p.value().type() == MQTT_NS::control_packet_type::publish);
+    BOOST_TEST(p.value().all() == s);
+    BOOST_TEST(p.value().remaining_length() == s.size() - 2);
+    BOOST_TEST(codec::get_packet_id<2>(p.value()).value() == 0x1234);
+
+    auto pm = codec::decode_v3_1_1_publish<2>(p.value());
+    BOOST_TEST(pm.topic() == "topic1");
+    BOOST_TEST(pm.payload() == "topic1_contents");
+    BOOST_TEST(pm.get_qos() == MQTT_NS::qos::at_least_once);
+    BOOST_TEST(pm.is_retain());
+}
+
+BOOST_AUTO_TEST_CASE( v5_packets_in_one_chunk ) {
+    v5::publish_message pub(
+        0,
+        as::buffer("topic1"_mb),
+        as::buffer("topic1_contents"_mb),
+        MQTT_NS::qos::at_most_once,
+        v5::properties {
+            v5::property::content_type("text/plain"_mb),
+            v5::property::user_property("key1"_mb, "val1"_mb),
+        }
+    );
+    v5::puback_message ack(7, v5::puback_reason_code::success, v5::properties{});
+    v5::pingreq_message ping;
+
+    auto s = encode(pub) + encode(ack) + encode(ping);
+    codec::decoder d(MQTT_NS::protocol_version::v5);
+    d.feed(s.data(), s.size());
+
+    auto p1 = d.next();
+    BOOST_TEST(p1.value().type() == MQTT_NS::control_packet_type::publish);
+    BOOST_TEST(!codec::get_packet_id<2>(p1.value()));
+    auto pm = codec::decode_v5_publish<2>(p1.value());
+    BOOST_TEST(pm.topic() == "topic1");
+    BOOST_TEST(pm.payload() == "topic1_contents");
+    BOOST_TEST(pm.props().size() == 2U);
+
+    auto p2 = d.next();
+    BOOST_TEST(p2.value().type() == MQTT_NS::control_packet_type::puback);
+    BOOST_TEST(codec::get_packet_id<2>(p2.value()).value() == 7);
+
+    auto p3 = d.next();
+    BOOST_TEST(p3.value().type() == MQTT_NS::control_packet_type::pingreq);
+    BOOST_TEST(p3.value().body().empty());
+    BOOST_TEST(!d.next());
+}
+
+BOOST_AUTO_TEST_CASE( malformed ) {
+    {
+        // remaining length longer than 4 bytes
+        codec::decoder d(MQTT_NS::protocol_version::v3_1_1);
+        char const s[] = { '\x30', '\xff', '\xff', '\xff', '\xff', '\x01' };
+        BOOST_CHECK_THROW(d.feed(s, sizeof(s)), MQTT_NS::variable_length_error);
+    }
+    {
+        // v3.1.1 CONNACK has remaining length 2
+        codec::decoder d(MQTT_NS::protocol_version::v3_1_1);
+        char const s[] = { '\x20', '\x03' };
+        BOOST_CHECK_THROW(d.feed(s, sizeof(s)), MQTT_NS::remaining_length_error);
+    }
+    {
+        // larger than the maximum packet size
+        codec::decoder d(MQTT_NS::protocol_version::v5, 10);
+        char const s[] = { '\x30', '\x09' };
+        BOOST_CHECK_THROW(d.feed(s, sizeof(s)), MQTT_NS::remaining_length_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( v3_1_1_typed ) {
+    auto version = MQTT_NS::protocol_version::v3_1_1;
+    {
+        MQTT_NS::v3_1_1::connect_message m(
+            30,
+            "cid1"_mb,
+            true,
+            MQTT_NS::will("wt"_mb, "wp"_mb, MQTT_NS::qos::at_least_once | MQTT_NS::retain::yes),
+            "user1"_mb,
+            "pass1"_mb
+        );
+        auto p = decode(m, version);
+        BOOST_TEST((codec::get_protocol_version(p) == version));
+        auto c = codec::v3_1_1::decode_connect(p);
+        BOOST_TEST(c.client_id == "cid1");
+        BOOST_TEST(c.user_name.value() == "user1");
+        BOOST_TEST(c.password.value() == "pass1");
+        BOOST_TEST(c.w.value().topic() == "wt");
+        BOOST_TEST(c.w.value().message() == "wp");
+        BOOST_TEST(c.w.value().get_qos() == MQTT_NS::qos::at_least_once);
+        BOOST_TEST(c.w.value().get_retain() == MQTT_NS::retain::yes);
+        BOOST_TEST(c.clean_session);
+        BOOST_TEST(c.keep_alive == 30);
+        BOOST_CHECK_THROW(codec::v5::decode_connect(p), MQTT_NS::protocol_error);
+    }
+    {
+        auto c = codec::v3_1_1::decode_connack(
+            decode(MQTT_NS::v3_1_1::connack_message(true, MQTT_NS::connect_return_code::not_authorized), version)
+        );
+        BOOST_TEST(c.session_present);
+        BOOST_TEST(c.return_code == MQTT_NS::connect_return_code::not_authorized);
+    }
+    {
+        MQTT_NS::v3_1_1::publish_message m(
+            3,
+            as::buffer("topic1"_mb),
+            as::buffer("contents"_mb),
+            MQTT_NS::qos::exactly_once | MQTT_NS::dup::yes
+        );
+        auto pp = codec::v3_1_1::decode_publish<2>(decode(m, version));
+        BOOST_TEST(pp.packet_id.value() == 3);
+        BOOST_TEST(pp.opts.get_qos() == MQTT_NS::qos::exactly_once);
+        BOOST_TEST(pp.opts.get_dup() == MQTT_NS::dup::yes);
+        BOOST_TEST(pp.topic_name == "topic1");
+        BOOST_TEST(pp.payload == "contents");
+    }
+    BOOST_TEST(codec::v3_1_1::decode_puback<2>(decode(MQTT_NS::v3_1_1::puback_message(1), version)).packet_id == 1);
+    BOOST_TEST(codec::v3_1_1::decode_pubrec<2>(decode(MQTT_NS::v3_1_1::pubrec_message(2), version)).packet_id == 2);
+    BOOST_TEST(codec::v3_1_1::decode_pubrel<2>(decode(MQTT_NS::v3_1_1::pubrel_message(3), version)).packet_id == 3);
+    BOOST_TEST(codec::v3_1_1::decode_pubcomp<2>(decode(MQTT_NS::v3_1_1::pubcomp_message(4), version)).packet_id == 4);
+    BOOST_TEST(codec::v3_1_1::decode_unsuback<2>(decode(MQTT_NS::v3_1_1::unsuback_message(5), version)).packet_id == 5);
+    BOOST_CHECK_THROW(
+        codec::v3_1_1::decode_puback<2>(decode(MQTT_NS::v3_1_1::pubrec_message(2), version)),
+        MQTT_NS::protocol_error
+    );
+    {
+        MQTT_NS::v3_1_1::subscribe_message m(
+            {
+                { as::buffer("t1"_mb), MQTT_NS::qos::at_most_once },
+                { as::buffer("t2"_mb), MQTT_NS::qos::exactly_once },
+            },
+            6
+        );
+        auto sp = codec::v3_1_1::decode_subscribe<2>(decode(m, version));
+        BOOST_TEST(sp.packet_id == 6);
+        BOOST_TEST(sp.entries.size() == 2U);
+        BOOST_TEST(std::get<0>(sp.entries[1]) == "t2");
+        BOOST_TEST(std::get<1>(sp.entries[1]).get_qos() == MQTT_NS::qos::exactly_once);
+    }
+    {
+        MQTT_NS::v3_1_1::suback_message m(
+            { MQTT_NS::suback_return_code::success_maximum_qos_1, MQTT_NS::suback_return_code::failure },
+            7
+        );
+        auto sp = codec::v3_1_1::decode_suback<2>(decode(m, version));
+        BOOST_TEST(sp.packet_id == 7);
+        BOOST_TEST(sp.return_codes.size() == 2U);
+        BOOST_TEST(sp.return_codes[1] == MQTT_NS::suback_return_code::failure);
+    }
+    {
+        MQTT_NS::v3_1_1::unsubscribe_message m({ as::buffer("t1"_mb), as::buffer("t2"_mb) }, 8);
+        auto up = codec::v3_1_1::decode_unsubscribe<2>(decode(m, version));
+        BOOST_TEST(up.packet_id == 8);
+        BOOST_TEST(up.entries.size() == 2U);
+        BOOST_TEST(up.entries[0] == "t1");
+    }
+    codec::v3_1_1::decode_disconnect(decode(MQTT_NS::v3_1_1::disconnect_message(), version));
+}
+
+BOOST_AUTO_TEST_CASE( v5_typed ) {
+    auto version = MQTT_NS::protocol_version::v5;
+    {
+        v5::connect_message m(
+            0,
+            "cid1"_mb,
+            false,
+            MQTT_NS::will("wt"_mb, "wp"_mb, MQTT_NS::qos::exactly_once, { v5::property::content_type("text"_mb) }),
+            MQTT_NS::nullopt,
+            "pass1"_mb,
+            { v5::property::session_expiry_interval(10), v5::property::receive_maximum(20) }
+        );
+        auto p = decode(m, version);
+        BOOST_TEST((codec::get_protocol_version(p) == version));
+        auto c = codec::v5::decode_connect(p);
+        BOOST_TEST(c.client_id == "cid1");
+        BOOST_TEST(!c.user_name);
+        BOOST_TEST(c.password.value() == "pass1");
+        BOOST_TEST(c.w.value().topic() == "wt");
+        BOOST_TEST(c.w.value().get_qos() == MQTT_NS::qos::exactly_once);
+        BOOST_TEST(c.w.value().props().size() == 1U);
+        BOOST_TEST(!c.clean_start);
+        BOOST_TEST(c.props.size() == 2U);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_connect(p), MQTT_NS::protocol_error);
+    }
+    {
+        auto c = codec::v5::decode_connack(
+            decode(
+                v5::connack_message(
+                    false,
+                    v5::connect_reason_code::banned,
+                    { v5::property::reason_string("r"_mb) }
+                ),
+                version
+            )
+        );
+        BOOST_TEST(!c.session_present);
+        BOOST_TEST(c.reason_code == v5::connect_reason_code::banned);
+        BOOST_TEST(c.props.size() == 1U);
+    }
+    {
+        v5::publish_message m(
+            9,
+            as::buffer("topic1"_mb),
+            as::buffer("contents"_mb),
+            MQTT_NS::qos::at_least_once,
+            { v5::property::topic_alias(1) }
+        );
+        auto p = decode(m, version);
+        auto pp = codec::v5::decode_publish<2>(p);
+        BOOST_TEST(pp.packet_id.value() == 9);
+        BOOST_TEST(pp.topic_name == "topic1");
+        BOOST_TEST(pp.payload == "contents");
+        BOOST_TEST(pp.props.size() == 1U);
+        auto view = codec::v5::decode_publish<2>(p, false);
+        BOOST_TEST(view.props.empty());
+        BOOST_TEST(view.raw_props == pp.raw_props);
+        BOOST_TEST(!view.raw_props.empty());
+    }
+    {
+        // reason code and properties are omitted
+        auto a = codec::v5::decode_puback<2>(
+            decode(v5::puback_message(1, v5::puback_reason_code::success, {}), version)
+        );
+        BOOST_TEST(a.packet_id == 1);
+        BOOST_TEST(a.reason_code == v5::puback_reason_code::success);
+        BOOST_TEST(a.props.empty());
+    }
+    {
+        auto a = codec::v5::decode_pubrec<2>(
+            decode(
+                v5::pubrec_message(
+                    2,
+                    v5::pubrec_reason_code::quota_exceeded,
+                    { v5::property::reason_string("r"_mb) }
+                ),
+                version
+            )
+        );
+        BOOST_TEST(a.packet_id == 2);
+        BOOST_TEST(a.reason_code == v5::pubrec_reason_code::quota_exceeded);
+        BOOST_TEST(a.props.size() == 1U);
+    }
+    {
+        // properties are omitted
+        auto a = codec::v5::decode_pubrel<2>(
+            decode(v5::pubrel_message(3, v5::pubrel_reason_code::packet_identifier_not_found, {}), version)
+        );
+        BOOST_TEST(a.reason_code == v5::pubrel_reason_code::packet_identifier_not_found);
+        BOOST_TEST(a.props.empty());
+    }
+    BOOST_TEST(
+        codec::v5::decode_pubcomp<2>(
+            decode(v5::pubcomp_message(4, v5::pubcomp_reason_code::success, {}), version)
+        ).packet_id == 4
+    );
+    {
+        v5::subscribe_message m(
+            {
+                { as::buffer("t1"_mb), MQTT_NS::qos::at_least_once | MQTT_NS::nl::yes },
+            },
+            5,
+            { v5::property::subscription_identifier(3) }
+        );
+        auto sp = codec::v5::decode_subscribe<2>(decode(m, version));
+        BOOST_TEST(sp.packet_id == 5);
+        BOOST_TEST(sp.entries.size() == 1U);
+        BOOST_TEST(std::get<0>(sp.entries[0]) == "t1");
+        BOOST_TEST(std::get<1>(sp.entries[0]).get_nl() == MQTT_NS::nl::yes);
+        BOOST_TEST(sp.props.size() == 1U);
+    }
+    {
+        v5::suback_message m({ v5::suback_reason_code::granted_qos_2 }, 6, {});
+        auto sp = codec::v5::decode_suback<2>(decode(m, version));
+        BOOST_TEST(sp.packet_id == 6);
+        BOOST_TEST(sp.reason_codes.size() == 1U);
+        BOOST_TEST(sp.reason_codes[0] == v5::suback_reason_code::granted_qos_2);
+    }
+    {
+        v5::unsubscribe_message m({ as::buffer("t1"_mb) }, 7, { v5::property::user_property("k"_mb, "v"_mb) });
+        auto up = codec::v5::decode_unsubscribe<2>(decode(m, version));
+        BOOST_TEST(up.packet_id == 7);
+        BOOST_TEST(up.entries.size() == 1U);
+        BOOST_TEST(up.props.size() == 1U);
+    }
+    {
+        v5::unsuback_message m(
+            { v5::unsuback_reason_code::success, v5::unsuback_reason_code::no_subscription_existed },
+            8,
+            {}
+        );
+        auto up = codec::v5::decode_unsuback<2>(decode(m, version));
+        BOOST_TEST(up.packet_id == 8);
+        BOOST_TEST(up.reason_codes.size() == 2U);
+        BOOST_TEST(up.reason_codes[1] == v5::unsuback_reason_code::no_subscription_existed);
+    }
+    {
+        auto d = codec::v5::decode_disconnect(
+            decode(v5::disconnect_message(v5::disconnect_reason_code::server_shutting_down, {}), version)
+        );
+        BOOST_TEST(d.reason_code == v5::disconnect_reason_code::server_shutting_down);
+        // remaining length 0
+        d = codec::v5::decode_disconnect(decode(std::string("\xe0\x00", 2), version));
+        BOOST_TEST(d.reason_code == v5::disconnect_reason_code::normal_disconnection);
+    }
+    {
+        auto a = codec::v5::decode_auth(
+            decode(
+                v5::auth_message(
+                    v5::auth_reason_code::continue_authentication,
+                    { v5::property::authentication_method("m"_mb) }
+                ),
+                version
+            )
+        );
+        BOOST_TEST(a.reason_code == v5::auth_reason_code::continue_authentication);
+        BOOST_TEST(a.props.size() == 1U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( typed_malformed ) {
+    {
+        // extra byte after the packet id
+        auto p = decode(std::string("\xb0\x03\x00\x01\x00", 5), MQTT_NS::protocol_version::v5);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_unsuback<2>(p), MQTT_NS::remaining_length_error);
+    }
+    {
+        // topic filter is longer than the packet
+        auto p = decode(std::string("\x82\x05\x00\x01\x00\x05t", 7), MQTT_NS::protocol_version::v3_1_1);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_subscribe<2>(p), MQTT_NS::remaining_length_error);
+    }
+    {
+        // QoS 3
+        auto p = decode(std::string("\x82\x06\x00\x01\x00\x01t\x03", 8), MQTT_NS::protocol_version::v3_1_1);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_subscribe<2>(p), MQTT_NS::protocol_error);
+    }
+    {
+        // no topic filter
+        auto p = decode(std::string("\xa2\x02\x00\x01", 4), MQTT_NS::protocol_version::v3_1_1);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_unsubscribe<2>(p), MQTT_NS::remaining_length_error);
+    }
+#if defined(MQTT_USE_STR_CHECK)
+    {
+        // ill formed UTF-8 topic name
+        auto p = decode(std::string("\x30\x03\x00\x01\xff", 5), MQTT_NS::protocol_version::v3_1_1);
+        BOOST_CHECK_THROW(codec::v3_1_1::decode_publish<2>(p), MQTT_NS::utf8string_contents_error);
+    }
+#endif // MQTT_USE_STR_CHECK
+    {
+        // unknown property id
+        auto p = decode(std::string("\xe0\x03\x00\x01\x7f", 5), MQTT_NS::protocol_version::v5);
+        BOOST_CHECK_THROW(codec::v5::decode_disconnect(p), MQTT_NS::property_parse_error);
+    }
+    {
+        // malformed property is checked even if the properties are not parsed
+        auto p = decode(std::string("\x30\x06\x00\x01t\x02\x03\x00", 8), MQTT_NS::protocol_version::v5);
+        BOOST_CHECK_THROW(codec::v5::decode_publish<2>(p, false), MQTT_NS::property_parse_error);
+    }
+    {
+        // property length is longer than the packet
+        auto p = decode(std::string("\xf0\x02\x00\x05", 4), MQTT_NS::protocol_version::v5);
+        BOOST_CHECK_THROW(codec::v5::decode_auth(p), MQTT_NS::property_length_error);
+    }
+    {
+        // protocol name is not MQTT
+        auto p = decode(std::string("\x10\x0a\x00\x04MQTX\x04\x02\x00\x00", 12), MQTT_NS::protocol_version::v3_1_1);
+        BOOST_CHECK_THROW(codec::get_protocol_version(p), MQTT_NS::protocol_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( encoder ) {
+    codec::encoder enc;
+    MQTT_NS::message_variant mv = MQTT_NS::v3_1_1::puback_message(0x0102);
+    char out[4];
+    BOOST_TEST(enc.encode(mv, out, 3) == 0U);
+    BOOST_TEST(enc.encode(mv, out, sizeof(out)) == 4U);
+    BOOST_TEST(std::string(out, 4) == std::string("\x40\x02\x01\x02", 4));
+    BOOST_TEST(enc.const_buffer_sequence(mv).size() == 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
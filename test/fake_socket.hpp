@@ -0,0 +1,107 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_FAKE_SOCKET_HPP)
+#define MQTT_TEST_FAKE_SOCKET_HPP
+
+#include <string>
+#include <vector>
+
+#include <mqtt/server.hpp>
+#include <mqtt/static_socket.hpp>
+
+// Socket that records the written packets instead of sending them.
+// Reads never complete. Writes complete when the io_context runs the posted completion.
+class fake_socket {
+public:
+    explicit fake_socket(as::io_context& ioc)
+        :ioc_(ioc), tcp_(ioc) {}
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    void async_read(MutableBufferSequence&&, ReadHandler&&) {
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    void async_write(ConstBufferSequence&& buffers, WriteHandler&& handler) {
+        auto size = record(buffers);
+        as::post(
+            ioc_,
+            [handler = std::forward<WriteHandler>(handler), size] () mutable {
+                handler(MQTT_NS::error_code(), size);
+            }
+        );
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write(ConstBufferSequence&& buffers, MQTT_NS::error_code&) {
+        return record(buffers);
+    }
+
+    template <typename PostHandler>
+    void post(PostHandler&& handler) {
+        as::post(ioc_, std::forward<PostHandler>(handler));
+    }
+
+    as::ip::tcp::socket::lowest_layer_type& lowest_layer() {
+        return tcp_.lowest_layer();
+    }
+
+    int native_handle() {
+        return 0;
+    }
+
+    void close(MQTT_NS::error_code&) {
+    }
+
+    auto get_executor() {
+        return ioc_.get_executor();
+    }
+
+    // The control packet types of the written packets, one per packet.
+    std::vector<MQTT_NS::control_packet_type> const& written() const {
+        return written_;
+    }
+
+    // The number of the write operations.
+    std::size_t writes() const {
+        return writes_;
+    }
+
+private:
+    template <typename ConstBufferSequence>
+    std::size_t record(ConstBufferSequence const& buffers) {
+        std::string bytes(as::buffer_size(buffers), '\0');
+        as::buffer_copy(as::buffer(&bytes[0], bytes.size()), buffers);
+        // Split the packets by their remaining length.
+        std::size_t pos = 0;
+        while (pos < bytes.size()) {
+            written_.push_back(MQTT_NS::get_control_packet_type(static_cast<std::uint8_t>(bytes[pos])));
+            std::size_t rl = 0;
+            std::size_t mul = 1;
+            std::size_t i = pos + 1;
+            while (true) {
+                auto b = static_cast<std::uint8_t>(bytes[i++]);
+                rl += (b & 0x7f) * mul;
+                mul *= 128;
+                if (!(b & 0x80)) break;
+            }
+            pos = i + rl;
+        }
+        ++writes_;
+        return bytes.size();
+    }
+
+    as::io_context& ioc_;
+    as::ip::tcp::socket tcp_;
+    std::vector<MQTT_NS::control_packet_type> written_;
+    std::size_t writes_ = 0;
+};
+
+using fake_endpoint_t = MQTT_NS::callable_overlay<
+    MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2, MQTT_NS::static_socket<fake_socket>>
+>;
+
+#endif // MQTT_TEST_FAKE_SOCKET_HPP
@@ -0,0 +1,347 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "checker.hpp"
+
+#include <mqtt/optional.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_loopback)
+
+using namespace MQTT_NS::literals;
+
+namespace {
+
+// The broker and the client share one io_context and one thread.
+template <typename Test>
+inline void do_loopback_test(
+    Test const& test,
+    MQTT_NS::protocol_version version = MQTT_NS::protocol_version::v3_1_1,
+    MQTT_NS::optional<std::size_t> packet_bulk_read_limit = MQTT_NS::nullopt) {
+    as::io_context ioc;
+    test_broker b(ioc);
+    MQTT_NS::server_loopback<> s(ioc);
+    s.set_accept_handler(
+        [&](con_sp_t spep) {
+            if (packet_bulk_read_limit) spep->set_packet_bulk_read_limit(*packet_bulk_read_limit);
+            b.handle_accept(MQTT_NS::force_move(spep));
+        }
+    );
+    s.listen();
+    auto c = s.connect(ioc, version);
+    if (packet_bulk_read_limit) c->set_packet_bulk_read_limit(*packet_bulk_read_limit);
+    test(
+        ioc,
+        c,
+        [&] {
+            s.close();
+        }
+    );
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pub_qos1_sub_qos1 ) {
+    do_loopback_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            std::string const payload(10000, 'x');
+            packet_id_t pid_sub;
+            packet_id_t pid_pub;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                // publish topic1 QoS1
+                cont("h_publish"),
+                cont("h_puback"),
+                cont("h_close"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(sp == false);
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_suback_handler(
+                [&chk, &c, &pid_sub, &pid_pub, &payload]
+                (packet_id_t packet_id, std::vector<MQTT_NS::suback_return_code> results) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    BOOST_TEST(results.size() == 1U);
+                    BOOST_TEST(results[0] == MQTT_NS::suback_return_code::success_maximum_qos_1);
+                    pid_pub = c->publish("topic1", payload, MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_puback_handler(
+                [&chk, &c, &pid_pub]
+                (packet_id_t packet_id) {
+                    MQTT_CHK("h_puback");
+                    BOOST_TEST(packet_id == pid_pub);
+                    c->disconnect();
+                    return true;
+                });
+            c->set_publish_handler(
+                [&chk, &payload]
+                (MQTT_NS::optional<packet_id_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+                    BOOST_CHECK(packet_id);
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == payload);
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->start_session();
+            c->connect("cid1", MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( async_pub_qos0_sub_qos0 ) {
+    do_loopback_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            std::string const payload(5000, 'y');
+            packet_id_t pid_sub = 1;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                cont("h_publish"),
+                cont("h_close"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    c->async_subscribe(pid_sub, "topic1", MQTT_NS::qos::at_most_once);
+                    return true;
+                });
+            c->set_suback_handler(
+                [&chk, &c, &pid_sub, &payload]
+                (packet_id_t packet_id, std::vector<MQTT_NS::suback_return_code>) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    c->async_publish("topic1", payload, MQTT_NS::qos::at_most_once);
+                    return true;
+                });
+            c->set_publish_handler(
+                [&chk, &c, &payload]
+                (MQTT_NS::optional<packet_id_t>,
+                 MQTT_NS::publish_options,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == payload);
+                    c->async_disconnect();
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->start_session();
+            c->async_connect("cid1"_mb, MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( force_disconnect ) {
+    do_loopback_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            checker chk = {
+                cont("h_connack"),
+                cont("h_error"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c]
+                (bool, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    // Closes the link. The pending read on the transport is aborted.
+                    c->force_disconnect();
+                    return true;
+                });
+            c->set_close_handler(
+                []
+                () {
+                    BOOST_CHECK(false);
+                });
+            c->set_error_handler(
+                [&chk, &finish]
+                (MQTT_NS::error_code) {
+                    MQTT_CHK("h_error");
+                    finish();
+                });
+            c->start_session();
+            c->async_connect("cid1"_mb, MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( v5_field_by_field ) {
+    // The packets are read field by field instead of being decoded by the codec.
+    do_loopback_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            packet_id_t pid_sub;
+            packet_id_t pid_pub;
+            packet_id_t pid_unsub;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                // publish topic1 QoS2
+                cont("h_publish"),
+                cont("h_pubrec"),
+                cont("h_pubcomp"),
+                cont("h_unsuback"),
+                cont("h_close"),
+            };
+
+            c->set_v5_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool sp, MQTT_NS::v5::connect_reason_code reason_code, MQTT_NS::v5::properties /*props*/) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(sp == false);
+                    BOOST_TEST(reason_code == MQTT_NS::v5::connect_reason_code::success);
+                    pid_sub = c->subscribe("topic1", MQTT_NS::qos::exactly_once);
+                    return true;
+                });
+            c->set_v5_suback_handler(
+                [&chk, &c, &pid_sub, &pid_pub]
+                (packet_id_t packet_id, std::vector<MQTT_NS::v5::suback_reason_code> reasons, MQTT_NS::v5::properties /*props*/) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    BOOST_TEST(reasons.size() == 1U);
+                    BOOST_TEST(reasons[0] == MQTT_NS::v5::suback_reason_code::granted_qos_2);
+                    pid_pub = c->publish(
+                        "topic1",
+                        "topic1_contents",
+                        MQTT_NS::qos::exactly_once,
+                        MQTT_NS::v5::properties {
+                            MQTT_NS::v5::property::content_type("text/plain"_mb)
+                        }
+                    );
+                    return true;
+                });
+            c->set_v5_publish_handler(
+                [&chk]
+                (MQTT_NS::optional<packet_id_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents,
+                 MQTT_NS::v5::properties props) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::exactly_once);
+                    BOOST_CHECK(packet_id);
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == "topic1_contents");
+                    BOOST_TEST(props.size() == 1U);
+                    return true;
+                });
+            c->set_v5_pubrec_handler(
+                [&chk, &pid_pub]
+                (packet_id_t packet_id, MQTT_NS::v5::pubrec_reason_code, MQTT_NS::v5::properties /*props*/) {
+                    MQTT_CHK("h_pubrec");
+                    BOOST_TEST(packet_id == pid_pub);
+                    return true;
+                });
+            c->set_v5_pubcomp_handler(
+                [&chk, &c, &pid_pub, &pid_unsub]
+                (packet_id_t packet_id, MQTT_NS::v5::pubcomp_reason_code, MQTT_NS::v5::properties /*props*/) {
+                    MQTT_CHK("h_pubcomp");
+                    BOOST_TEST(packet_id == pid_pub);
+                    pid_unsub = c->unsubscribe("topic1");
+                    return true;
+                });
+            c->set_v5_unsuback_handler(
+                [&chk, &c, &pid_unsub]
+                (packet_id_t packet_id, std::vector<MQTT_NS::v5::unsuback_reason_code> reasons, MQTT_NS::v5::properties /*props*/) {
+                    MQTT_CHK("h_unsuback");
+                    BOOST_TEST(packet_id == pid_unsub);
+                    BOOST_TEST(reasons.size() == 1U);
+                    BOOST_TEST(reasons[0] == MQTT_NS::v5::unsuback_reason_code::success);
+                    c->disconnect();
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->start_session();
+            c->connect(
+                "cid1",
+                MQTT_NS::nullopt,
+                MQTT_NS::nullopt,
+                MQTT_NS::will("topic2"_mb, "will_contents"_mb, MQTT_NS::qos::at_most_once),
+                0,
+                MQTT_NS::v5::properties {
+                    MQTT_NS::v5::property::session_expiry_interval(0)
+                }
+            );
+            ioc.run();
+            BOOST_TEST(chk.all());
+        },
+        MQTT_NS::protocol_version::v5,
+        0
+    );
+}
+
+BOOST_AUTO_TEST_CASE( connect_refused ) {
+    as::io_context ioc;
+    MQTT_NS::server_loopback<> s(ioc);
+    MQTT_NS::error_code ec;
+    auto c = s.connect(ioc, MQTT_NS::protocol_version::v3_1_1, ec);
+    BOOST_TEST(ec == as::error::connection_refused);
+    BOOST_CHECK(!c);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
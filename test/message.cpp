@@ -9,6 +9,7 @@
 #include "checker.hpp"
 
 #include <mqtt/optional.hpp>
+#include <mqtt/message_variant.hpp>
 
 #include <iterator>
 
@@ -344,4 +345,136 @@ BOOST_AUTO_TEST_CASE( pingreq_cbuf ) { // behalf of header only message
     BOOST_TEST(m.continuous_buffer() == expected);
 }
 
+BOOST_AUTO_TEST_CASE( add_cbs ) {
+    static const MQTT_NS::string_view topic("topic1");
+    static const MQTT_NS::string_view payload("payload");
+    MQTT_NS::message_variant publish = MQTT_NS::publish_message(
+        1,
+        as::buffer(topic.data(), topic.size()),
+        as::buffer(payload.data(), payload.size()),
+        MQTT_NS::qos::at_least_once | MQTT_NS::retain::no | MQTT_NS::dup::no
+    );
+    MQTT_NS::message_variant pingreq = MQTT_NS::pingreq_message();
+
+    // The buffers of the messages are appended to the same sequence.
+    std::vector<as::const_buffer> v;
+    MQTT_NS::add_const_buffer_sequence(v, publish);
+    MQTT_NS::add_const_buffer_sequence(v, pingreq);
+    BOOST_TEST(v.size() == MQTT_NS::num_of_const_buffer_sequence(publish) + MQTT_NS::num_of_const_buffer_sequence(pingreq));
+
+    std::string all(as::buffer_size(v), '\0');
+    as::buffer_copy(as::buffer(&all[0], all.size()), v);
+    BOOST_TEST(all == MQTT_NS::continuous_buffer(publish) + MQTT_NS::continuous_buffer(pingreq));
+
+    // The capacity is reused.
+    auto cap = v.capacity();
+    v.clear();
+    MQTT_NS::add_const_buffer_sequence(v, publish);
+    BOOST_TEST(v.capacity() == cap);
+}
+
+BOOST_AUTO_TEST_CASE( fixed_cbs ) {
+    // Fixed-shape messages return the buffer sequence without allocation.
+    auto puback = MQTT_NS::puback_message(0x1234);
+    auto cbs = puback.const_buffer_sequence();
+    static_assert(
+        std::is_same<decltype(cbs), std::array<as::const_buffer, 1>>::value,
+        "puback has a fixed-size buffer sequence"
+    );
+    std::string expected {
+        0b0100'0000,
+        2,
+        0x12,
+        0x34,
+    };
+    BOOST_TEST(std::string(static_cast<char const*>(cbs[0].data()), cbs[0].size()) == expected);
+
+    static_assert(
+        std::is_same<decltype(MQTT_NS::pingreq_message().const_buffer_sequence()), std::array<as::const_buffer, 1>>::value,
+        "pingreq has a fixed-size buffer sequence"
+    );
+    static_assert(
+        std::is_same<decltype(MQTT_NS::v5::pingresp_message().const_buffer_sequence()), std::array<as::const_buffer, 1>>::value,
+        "v5 pingresp has a fixed-size buffer sequence"
+    );
+
+    // message_variant still provides std::vector.
+    MQTT_NS::message_variant mv = puback;
+    BOOST_TEST(MQTT_NS::const_buffer_sequence(mv).size() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( v5_ack_cbs ) {
+    MQTT_NS::v5::properties props;
+    for (int i = 0; i != 10; ++i) {
+        props.emplace_back(
+            MQTT_NS::v5::property::user_property(
+                MQTT_NS::allocate_buffer("key" + std::to_string(i)),
+                MQTT_NS::allocate_buffer("val" + std::to_string(i))
+            )
+        );
+    }
+    auto m = MQTT_NS::v5::pubrel_message(0x1234, MQTT_NS::v5::pubrel_reason_code::packet_identifier_not_found, props);
+    auto cbs = m.const_buffer_sequence();
+    static_assert(
+        std::is_same<decltype(cbs), MQTT_NS::v5::ack_const_buffer_sequence>::value,
+        "v5 acks have a bounded buffer sequence"
+    );
+    // fixed header, remaining length, packet id, reason code, property length, and properties
+    BOOST_TEST(cbs.size() == 6U);
+    BOOST_TEST(m.num_of_const_buffer_sequence() == 6U);
+
+    std::string all(as::buffer_size(cbs), '\0');
+    as::buffer_copy(as::buffer(&all[0], all.size()), cbs);
+    BOOST_TEST(all == m.continuous_buffer());
+
+    // The received message shares the properties.
+    auto received = MQTT_NS::v5::pubrel_message(MQTT_NS::allocate_buffer(all));
+    BOOST_TEST(received.props().size() == 10U);
+    BOOST_TEST(received.num_of_const_buffer_sequence() == 6U);
+    auto rcbs = received.const_buffer_sequence();
+    std::string rall(as::buffer_size(rcbs), '\0');
+    as::buffer_copy(as::buffer(&rall[0], rall.size()), rcbs);
+    BOOST_TEST(rall == all);
+
+    auto puback = MQTT_NS::v5::puback_message(0x1234, MQTT_NS::v5::puback_reason_code::success, {});
+    BOOST_TEST(puback.const_buffer_sequence().size() == puback.num_of_const_buffer_sequence());
+}
+
+BOOST_AUTO_TEST_CASE( v5_publish_props_cbs ) {
+    static const MQTT_NS::string_view topic("topic1");
+    static const MQTT_NS::string_view payload("payload");
+    MQTT_NS::v5::properties props;
+    for (int i = 0; i != 10; ++i) {
+        props.emplace_back(
+            MQTT_NS::v5::property::user_property(
+                MQTT_NS::allocate_buffer("key" + std::to_string(i)),
+                MQTT_NS::allocate_buffer("val" + std::to_string(i))
+            )
+        );
+    }
+    auto m = MQTT_NS::v5::publish_message(
+        1,
+        as::buffer(topic.data(), topic.size()),
+        as::buffer(payload.data(), payload.size()),
+        MQTT_NS::qos::at_least_once,
+        props
+    );
+
+    // The properties are one buffer.
+    auto cbs = m.const_buffer_sequence();
+    BOOST_TEST(cbs.size() == 8U);
+    BOOST_TEST(m.num_of_const_buffer_sequence() == 8U);
+
+    std::string all(as::buffer_size(cbs), '\0');
+    as::buffer_copy(as::buffer(&all[0], all.size()), cbs);
+    BOOST_TEST(all == m.continuous_buffer());
+    BOOST_TEST(all.size() == m.size());
+
+    // The received message shares the properties.
+    auto received = MQTT_NS::v5::publish_message(MQTT_NS::allocate_buffer(all));
+    BOOST_TEST(received.props().size() == 10U);
+    BOOST_TEST(received.num_of_const_buffer_sequence() == 8U);
+    BOOST_TEST(received.continuous_buffer() == all);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
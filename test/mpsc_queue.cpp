@@ -0,0 +1,127 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <stdexcept>
+
+#include <mqtt/mpsc_queue.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_mpsc_queue)
+
+BOOST_AUTO_TEST_CASE( single_thread ) {
+    MQTT_NS::mpsc_queue<std::unique_ptr<int>> q;
+    BOOST_TEST(q.push(std::make_unique<int>(1)));
+    BOOST_TEST(!q.push(std::make_unique<int>(2)));
+    std::vector<int> out;
+    q.consume_all([&](std::unique_ptr<int> v) { out.push_back(*v); });
+    BOOST_TEST((out == std::vector<int>{ 1, 2 }));
+    // Consuming the empty queue keeps it empty.
+    q.consume_all([&](std::unique_ptr<int> v) { out.push_back(*v); });
+    BOOST_TEST(out.size() == 2U);
+    // The queue is empty again, so the next push wakes up the consumer.
+    BOOST_TEST(q.push(std::make_unique<int>(3)));
+    // Destroyed with a remaining value.
+}
+
+BOOST_AUTO_TEST_CASE( throw_in_consumer ) {
+    MQTT_NS::mpsc_queue<int> q;
+    BOOST_TEST(q.push(1));
+    BOOST_TEST(!q.push(2));
+    BOOST_TEST(!q.push(3));
+    std::vector<int> out;
+    BOOST_CHECK_THROW(
+        q.consume_all(
+            [&](int v) {
+                if (v == 2) throw std::runtime_error("consume");
+                out.push_back(v);
+            }
+        ),
+        std::runtime_error
+    );
+    // The consumer is still scheduled, so the push doesn't wake it up.
+    BOOST_TEST(!q.push(4));
+    q.consume_all([&](int v) { out.push_back(v); });
+    BOOST_TEST((out == std::vector<int>{ 1, 3, 4 }));
+    BOOST_TEST(q.push(5));
+}
+
+BOOST_AUTO_TEST_CASE( node_reuse ) {
+    MQTT_NS::mpsc_queue<int> q;
+    auto round = [&](int n) {
+        for (int i = 0; i != n; ++i) q.push(i);
+        q.consume_all([](int) {});
+    };
+    round(10);
+    BOOST_TEST(q.pooled() == 10U);
+    // The nodes are taken from the pool. If they were allocated, the pool would grow.
+    for (int i = 0; i != 100; ++i) round(10);
+    BOOST_TEST(q.pooled() == 10U);
+    // The pool is bounded.
+    round(100);
+    BOOST_TEST(q.pooled() == MQTT_NS::mpsc_queue<int>::pool_size);
+}
+
+BOOST_AUTO_TEST_CASE( multi_producers ) {
+    std::size_t const producers = 4;
+    std::size_t const per_producer = 100000;
+    MQTT_NS::mpsc_queue<std::pair<std::size_t, std::size_t>> q;
+    std::atomic<std::size_t> wake_ups{0};
+    std::atomic<bool> finished{false};
+
+    // The consumer runs while it is woken up, like a handler posted to a strand.
+    std::atomic<std::size_t> scheduled{0};
+    std::vector<std::size_t> next(producers, 0);
+    std::size_t consumed = 0;
+    bool ordered = true;
+    std::thread consumer(
+        [&] {
+            while (!finished || scheduled != 0) {
+                if (scheduled == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                q.consume_all(
+                    [&](std::pair<std::size_t, std::size_t> v) {
+                        // The values of each producer keep their order.
+                        if (v.second != next[v.first]) ordered = false;
+                        ++next[v.first];
+                        ++consumed;
+                    }
+                );
+                --scheduled;
+            }
+        }
+    );
+
+    std::vector<std::thread> ths;
+    for (std::size_t p = 0; p != producers; ++p) {
+        ths.emplace_back(
+            [&, p] {
+                for (std::size_t i = 0; i != per_producer; ++i) {
+                    if (q.push(std::make_pair(p, i))) {
+                        ++wake_ups;
+                        ++scheduled;
+                    }
+                }
+            }
+        );
+    }
+    for (auto& th : ths) th.join();
+    finished = true;
+    consumer.join();
+
+    BOOST_TEST(consumed == producers * per_producer);
+    BOOST_TEST(ordered);
+    BOOST_TEST(wake_ups <= consumed);
+    BOOST_TEST_MESSAGE(wake_ups << " wake ups for " << consumed << " pushes");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
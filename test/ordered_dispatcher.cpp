@@ -0,0 +1,181 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+#include <mqtt/server.hpp>
+#include <mqtt/ordered_dispatcher.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_ordered_dispatcher)
+
+namespace {
+
+using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using endpoint_t = MQTT_NS::callable_overlay<MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2>>;
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( zero_threads ) {
+    BOOST_CHECK_THROW(MQTT_NS::ordered_dispatcher(0), std::invalid_argument);
+    BOOST_CHECK_THROW(MQTT_NS::ordered_dispatcher(0, 4), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( same_key_in_order ) {
+    std::mutex mtx;
+    std::map<std::string, std::vector<std::size_t>> results;
+    {
+        MQTT_NS::ordered_dispatcher d(4);
+        for (std::size_t i = 0; i != 1000; ++i) {
+            std::string key = "key" + std::to_string(i % 3);
+            d.post(
+                key,
+                [&, key, i] {
+                    std::lock_guard<std::mutex> g(mtx);
+                    results[key].push_back(i);
+                }
+            );
+        }
+    }
+    BOOST_TEST(results.size() == 3U);
+    for (auto const& r : results) {
+        BOOST_TEST(r.second.size() >= 333U);
+        BOOST_TEST(std::is_sorted(r.second.begin(), r.second.end()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( throwing_function ) {
+    std::mutex mtx;
+    std::vector<std::size_t> results;
+    std::atomic<std::size_t> errors{0};
+    {
+        MQTT_NS::ordered_dispatcher d(
+            2,
+            0,
+            [&](std::exception_ptr e) {
+                BOOST_CHECK_THROW(std::rethrow_exception(e), std::runtime_error);
+                ++errors;
+            }
+        );
+        for (std::size_t i = 0; i != 10; ++i) {
+            d.post(
+                "key",
+                [&, i] {
+                    {
+                        std::lock_guard<std::mutex> g(mtx);
+                        results.push_back(i);
+                    }
+                    if (i == 3) throw std::runtime_error("error");
+                }
+            );
+        }
+    }
+    BOOST_TEST(errors == 1U);
+    std::vector<std::size_t> expected { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    BOOST_TEST(results == expected);
+}
+
+BOOST_AUTO_TEST_CASE( offload_publish ) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    auto ss = std::make_shared<socket_t>(ioc);
+    std::shared_ptr<endpoint_t> sep;
+
+    std::size_t const messages = 100;
+    std::size_t const max_in_flight = 2;
+    MQTT_NS::ordered_dispatcher d(2);
+    std::shared_ptr<MQTT_NS::ordered_offload<endpoint_t>> offload;
+
+    std::mutex mtx;
+    std::map<std::string, std::vector<std::string>> received;
+    std::atomic<std::size_t> processed{0};
+    std::atomic<bool> over_limit{false};
+
+    std::function<void()> disconnect;
+
+    ac.async_accept(
+        ss->lowest_layer(),
+        [&](MQTT_NS::error_code ec) {
+            BOOST_TEST(!ec);
+            sep = std::make_shared<endpoint_t>(ss, MQTT_NS::protocol_version::v3_1_1);
+            offload = MQTT_NS::make_ordered_offload(d, sep, max_in_flight);
+            sep->set_connect_handler(
+                [&]
+                (MQTT_NS::buffer,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::will>,
+                 bool,
+                 std::uint16_t) {
+                    sep->connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                });
+            sep->set_publish_handler(
+                [&]
+                (MQTT_NS::optional<std::uint16_t>,
+                 MQTT_NS::publish_options,
+                 MQTT_NS::buffer topic_name,
+                 MQTT_NS::buffer contents) {
+                    // Reading is stopped while max_in_flight functions are running.
+                    if (offload->in_flight() >= max_in_flight) over_limit = true;
+                    offload->post(
+                        topic_name,
+                        [&, topic_name, contents] {
+                            std::this_thread::sleep_for(std::chrono::microseconds(100));
+                            {
+                                std::lock_guard<std::mutex> g(mtx);
+                                received[std::string(topic_name)].emplace_back(contents);
+                            }
+                            if (++processed == messages) as::post(ioc, disconnect);
+                        }
+                    );
+                    return true;
+                });
+            sep->set_disconnect_handler(
+                [&] {
+                    sep->force_disconnect();
+                });
+            sep->start_session(sep);
+        }
+    );
+
+    auto c = MQTT_NS::make_client(ioc, "127.0.0.1", ac.local_endpoint().port());
+    disconnect = [&] { c->disconnect(); };
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_connack_handler(
+        [&]
+        (bool, MQTT_NS::connect_return_code) {
+            for (std::size_t i = 0; i != messages; ++i) {
+                c->publish(i % 2 ? "topic1" : "topic2", std::to_string(i), MQTT_NS::qos::at_most_once);
+            }
+            return true;
+        });
+    c->set_error_handler(
+        [](MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        });
+    c->connect();
+    ioc.run();
+    d.join();
+
+    BOOST_TEST(processed == messages);
+    BOOST_TEST(!over_limit);
+    BOOST_TEST(offload->in_flight() == 0U);
+    for (auto const& r : received) {
+        BOOST_TEST(r.second.size() == messages / 2);
+        std::vector<std::size_t> order;
+        for (auto const& s : r.second) order.push_back(std::stoul(s));
+        BOOST_TEST(std::is_sorted(order.begin(), order.end()));
+    }
+    sep.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
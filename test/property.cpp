@@ -174,4 +174,40 @@ BOOST_AUTO_TEST_CASE( user_property ) {
     BOOST_TEST(boost::lexical_cast<std::string>(v1) == "abc:def");
 }
 
+BOOST_AUTO_TEST_CASE( properties_inline ) {
+    // The elements are held in the object itself, not on the heap.
+    auto inline_storage =
+        [](MQTT_NS::v5::properties const& props) {
+            auto p = reinterpret_cast<char const*>(props.data());
+            auto b = reinterpret_cast<char const*>(&props);
+            return b <= p && p < b + sizeof(props);
+        };
+
+    MQTT_NS::v5::properties props;
+    BOOST_TEST(props.capacity() == std::size_t(MQTT_PROPERTIES_INLINE_CAPACITY));
+    BOOST_TEST(inline_storage(props));
+    for (std::size_t i = 0; i != MQTT_PROPERTIES_INLINE_CAPACITY; ++i) {
+        props.emplace_back(MQTT_NS::v5::property::user_property("key"_mb, "val"_mb));
+        BOOST_TEST(props.capacity() == std::size_t(MQTT_PROPERTIES_INLINE_CAPACITY));
+        BOOST_TEST(inline_storage(props));
+    }
+
+    // The parsed properties are held inline too.
+    auto m = MQTT_NS::v5::publish_message(
+        1,
+        as::buffer("topic1", 6),
+        as::buffer("payload", 7),
+        MQTT_NS::qos::at_least_once,
+        props
+    );
+    auto received = MQTT_NS::v5::publish_message(MQTT_NS::allocate_buffer(m.continuous_buffer()));
+    BOOST_TEST(received.props().size() == std::size_t(MQTT_PROPERTIES_INLINE_CAPACITY));
+    BOOST_TEST(received.props().capacity() == std::size_t(MQTT_PROPERTIES_INLINE_CAPACITY));
+    BOOST_TEST(inline_storage(received.props()));
+
+    // One more property goes to the heap.
+    props.emplace_back(MQTT_NS::v5::property::user_property("key"_mb, "val"_mb));
+    BOOST_TEST(!inline_storage(props));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
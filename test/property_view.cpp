@@ -0,0 +1,311 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "checker.hpp"
+
+#include <mqtt/server.hpp>
+#include <mqtt/property_view.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_property_view)
+
+using namespace MQTT_NS::literals;
+namespace v5 = MQTT_NS::v5;
+
+namespace {
+
+using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using endpoint_t = MQTT_NS::callable_overlay<MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2>>;
+
+MQTT_NS::buffer encode(v5::properties const& props) {
+    std::string s;
+    for (auto const& p : props) {
+        auto size = v5::size(p);
+        s.resize(s.size() + size);
+        v5::fill(p, std::prev(s.end(), static_cast<std::ptrdiff_t>(size)), s.end());
+    }
+    return MQTT_NS::allocate_buffer(s);
+}
+
+v5::properties sample() {
+    return {
+        v5::property::content_type("text/plain"_mb),
+        v5::property::user_property("key1"_mb, "val1"_mb),
+        v5::property::subscription_identifier(300),
+        v5::property::topic_alias(7),
+        v5::property::message_expiry_interval(1234),
+    };
+}
+
+// v5 CONNECT with client id "cid1"
+std::string const raw_connect {
+    0x10, 0x11,
+    0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05, 0x02, 0x00, 0x3c, 0x00,
+    0x00, 0x04, 'c', 'i', 'd', '1'
+};
+
+// QoS0 PUBLISH to "topic1" with the encoded properties raw_props
+std::string raw_publish(std::string const& raw_props) {
+    std::string s { 0x00, 0x06, 't', 'o', 'p', 'i', 'c', '1' };
+    s.push_back(static_cast<char>(raw_props.size()));
+    s += raw_props;
+    s.push_back('a');
+    return std::string { 0x30, static_cast<char>(s.size()) } + s;
+}
+
+// Sends the CONNECT and the PUBLISH as raw bytes, and checks that the server endpoint
+// reports the protocol error.
+void check_protocol_error(std::string const& publish, std::size_t packet_bulk_read_limit, bool view) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    auto ss = std::make_shared<socket_t>(ioc);
+    std::shared_ptr<endpoint_t> sep;
+    as::ip::tcp::socket cs(ioc);
+
+    checker chk = {
+        cont("h_connect"),
+        cont("h_error"),
+    };
+
+    ac.async_accept(
+        ss->lowest_layer(),
+        [&](MQTT_NS::error_code ec) {
+            BOOST_TEST(!ec);
+            sep = std::make_shared<endpoint_t>(ss, MQTT_NS::protocol_version::v5);
+            sep->set_packet_bulk_read_limit(packet_bulk_read_limit);
+            sep->set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::will>,
+                 bool,
+                 std::uint16_t,
+                 v5::properties) {
+                    MQTT_CHK("h_connect");
+                    return true;
+                });
+            sep->set_v5_publish_handler(
+                [&]
+                (MQTT_NS::optional<std::uint16_t>,
+                 MQTT_NS::publish_options,
+                 MQTT_NS::buffer,
+                 MQTT_NS::buffer,
+                 v5::properties) {
+                    BOOST_CHECK(false);
+                    return true;
+                });
+            if (view) {
+                sep->set_v5_publish_view_handler(
+                    [&]
+                    (MQTT_NS::optional<std::uint16_t>,
+                     MQTT_NS::publish_options,
+                     MQTT_NS::buffer,
+                     MQTT_NS::buffer,
+                     v5::property_view) {
+                        BOOST_CHECK(false);
+                        return true;
+                    });
+            }
+            sep->set_error_handler(
+                [&]
+                (MQTT_NS::error_code ec) {
+                    MQTT_CHK("h_error");
+                    BOOST_TEST((ec == MQTT_NS::protocol_error_errc));
+                    MQTT_NS::error_code ignored;
+                    cs.close(ignored);
+                    sep->force_disconnect();
+                });
+            sep->start_session(sep);
+        }
+    );
+
+    cs.connect(ac.local_endpoint());
+    as::write(cs, as::buffer(raw_connect + publish));
+    ioc.run();
+    BOOST_TEST(chk.all());
+    sep.reset();
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( iterate ) {
+    auto raw = encode(sample());
+    v5::property_view view(raw);
+    BOOST_TEST(!view.empty());
+    BOOST_TEST(std::distance(view.begin(), view.end()) == 5);
+    BOOST_TEST(view.to_properties().size() == 5U);
+
+    auto it = view.begin();
+    BOOST_TEST(MQTT_NS::variant_get<v5::property::content_type>(*it).val() == "text/plain");
+    ++it;
+    BOOST_TEST(MQTT_NS::variant_get<v5::property::user_property>(*it).key() == "key1");
+    BOOST_TEST(MQTT_NS::variant_get<v5::property::user_property>(*it).val() == "val1");
+
+    BOOST_TEST(v5::property_view().empty());
+    BOOST_TEST((v5::property_view().begin() == v5::property_view().end()));
+}
+
+BOOST_AUTO_TEST_CASE( find ) {
+    auto raw = encode(sample());
+    v5::property_view view(raw);
+
+    auto ta = view.get<v5::property::topic_alias>(v5::property::id::topic_alias);
+    BOOST_TEST(ta.has_value());
+    BOOST_TEST(ta.value().val() == 7);
+    auto mei = view.get<v5::property::message_expiry_interval>(v5::property::id::message_expiry_interval);
+    BOOST_TEST(mei.value().val() == 1234U);
+    auto si = view.get<v5::property::subscription_identifier>(v5::property::id::subscription_identifier);
+    BOOST_TEST(si.value().val() == 300U);
+    BOOST_TEST(!view.find(v5::property::id::response_topic));
+}
+
+BOOST_AUTO_TEST_CASE( well_formed ) {
+    auto raw = encode(sample());
+    BOOST_TEST(v5::property_view::well_formed(raw));
+    BOOST_TEST(v5::property_view::well_formed(MQTT_NS::string_view()));
+    // truncated
+    BOOST_TEST(!v5::property_view::well_formed(raw.substr(0, raw.size() - 1)));
+    // unknown id
+    BOOST_TEST(!v5::property_view::well_formed(MQTT_NS::string_view("\x00\x01", 2)));
+}
+
+BOOST_AUTO_TEST_CASE( publish_view_handler ) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    auto ss = std::make_shared<socket_t>(ioc);
+    std::shared_ptr<endpoint_t> sep;
+
+    checker chk = {
+        // server side
+        cont("h_connect"),
+        // client side
+        cont("h_connack"),
+        deps("h_publish", "h_connack"),
+        deps("h_puback", "h_connack"),
+        deps("h_disconnect", "h_puback", "h_publish"),
+        cont("h_close"),
+    };
+
+    ac.async_accept(
+        ss->lowest_layer(),
+        [&](MQTT_NS::error_code ec) {
+            BOOST_TEST(!ec);
+            sep = std::make_shared<endpoint_t>(ss, MQTT_NS::protocol_version::v5);
+            sep->set_v5_connect_handler(
+                [&]
+                (MQTT_NS::buffer,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::will>,
+                 bool,
+                 std::uint16_t,
+                 v5::properties) {
+                    MQTT_CHK("h_connect");
+                    sep->connack(false, v5::connect_reason_code::success);
+                    return true;
+                });
+            sep->set_v5_publish_handler(
+                [&]
+                (MQTT_NS::optional<std::uint16_t>,
+                 MQTT_NS::publish_options,
+                 MQTT_NS::buffer,
+                 MQTT_NS::buffer,
+                 v5::properties) {
+                    // The view handler is called instead.
+                    BOOST_CHECK(false);
+                    return true;
+                });
+            sep->set_v5_publish_view_handler(
+                [&]
+                (MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic_name,
+                 MQTT_NS::buffer contents,
+                 v5::property_view props) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(packet_id.has_value());
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+                    BOOST_TEST(topic_name == "topic1");
+                    BOOST_TEST(contents == "topic1_contents");
+                    auto ct = props.get<v5::property::content_type>(v5::property::id::content_type);
+                    BOOST_TEST(ct.value().val() == "text/plain");
+                    auto up = props.get<v5::property::user_property>(v5::property::id::user_property);
+                    BOOST_TEST(up.value().key() == "key1");
+                    BOOST_TEST(up.value().val() == "val1");
+                    BOOST_TEST(std::distance(props.begin(), props.end()) == 2);
+                    return true;
+                });
+            sep->set_v5_disconnect_handler(
+                [&]
+                (v5::disconnect_reason_code, v5::properties) {
+                    MQTT_CHK("h_disconnect");
+                    sep->force_disconnect();
+                });
+            sep->start_session(sep);
+        }
+    );
+
+    auto c = MQTT_NS::make_client(ioc, "127.0.0.1", ac.local_endpoint().port(), MQTT_NS::protocol_version::v5);
+    c->set_client_id("cid1");
+    c->set_clean_start(true);
+    c->set_v5_connack_handler(
+        [&]
+        (bool sp, v5::connect_reason_code reason_code, v5::properties) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(reason_code == v5::connect_reason_code::success);
+            c->publish(
+                "topic1",
+                "topic1_contents",
+                MQTT_NS::qos::at_least_once,
+                v5::properties {
+                    v5::property::content_type("text/plain"_mb),
+                    v5::property::user_property("key1"_mb, "val1"_mb),
+                }
+            );
+            return true;
+        });
+    c->set_v5_puback_handler(
+        [&]
+        (std::uint16_t, v5::puback_reason_code, v5::properties) {
+            MQTT_CHK("h_puback");
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+        });
+    c->set_error_handler(
+        [](MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        });
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    sep.reset();
+}
+
+BOOST_AUTO_TEST_CASE( publish_view_malformed ) {
+    // content_type without the length
+    auto publish = raw_publish(std::string { 0x03, 0x00 });
+    // decoded by the codec
+    check_protocol_error(publish, 256, true);
+    // read field by field
+    check_protocol_error(publish, 0, true);
+}
+
+BOOST_AUTO_TEST_CASE( unknown_property_id ) {
+    auto publish = raw_publish(std::string { 0x00, 0x00 });
+    // decoded by the codec
+    check_protocol_error(publish, 256, false);
+    // read field by field
+    check_protocol_error(publish, 0, false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "fake_socket.hpp"
+
+#include <algorithm>
+
+BOOST_AUTO_TEST_SUITE(test_queue_watermark)
+
+using cpt = MQTT_NS::control_packet_type;
+
+BOOST_AUTO_TEST_CASE( messages ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+    ep->set_queue_watermarks(0, 0, 3, 1);
+
+    std::size_t high = 0;
+    std::size_t low = 0;
+    ep->set_queue_high_watermark_handler(
+        [&] {
+            ++high;
+            BOOST_TEST(ep->queued_messages() == 3U);
+        }
+    );
+    ep->set_queue_low_watermark_handler(
+        [&] {
+            ++low;
+            BOOST_TEST(ep->queued_messages() == 1U);
+        }
+    );
+
+    ep->async_publish(0, "topic1", "a");
+    ep->async_publish(0, "topic1", "b");
+    BOOST_TEST(!ep->queue_congested());
+    ep->async_publish(0, "topic1", "c");
+    BOOST_TEST(ep->queue_congested());
+    ep->async_publish(0, "topic1", "d");
+    BOOST_TEST(high == 1U);
+    BOOST_TEST(ep->queued_messages() == 4U);
+
+    ioc.run();
+    BOOST_TEST(low == 1U);
+    BOOST_TEST(!ep->queue_congested());
+    BOOST_TEST(ep->queued_messages() == 0U);
+    BOOST_TEST(ep->queued_bytes() == 0U);
+    BOOST_TEST(s->written().size() == 4U);
+}
+
+BOOST_AUTO_TEST_CASE( bytes ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+    std::string const payload(1000, 'x');
+    ep->set_queue_watermarks(2500, 1000);
+
+    std::size_t high = 0;
+    std::size_t low = 0;
+    ep->set_queue_high_watermark_handler([&] { ++high; });
+    ep->set_queue_low_watermark_handler([&] { ++low; });
+
+    ep->async_publish(0, "topic1", payload);
+    ep->async_publish(0, "topic1", payload);
+    BOOST_TEST(!ep->queue_congested());
+    ep->async_publish(0, "topic1", payload);
+    BOOST_TEST(ep->queue_congested());
+    BOOST_TEST(ep->queued_bytes() > 3000U);
+
+    // Two messages are still queued. It is above the low watermark.
+    ioc.poll_one();
+    ioc.poll_one();
+    BOOST_TEST(ep->queue_congested());
+    ioc.run();
+    BOOST_TEST(high == 1U);
+    BOOST_TEST(low == 1U);
+    BOOST_TEST(!ep->queue_congested());
+}
+
+BOOST_AUTO_TEST_CASE( drop_qos0 ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+    ep->set_queue_watermarks(0, 0, 2, 0);
+    ep->set_queue_overflow_policy(MQTT_NS::queue_overflow_policy::drop_qos0);
+
+    std::vector<MQTT_NS::error_code> results;
+    auto h = [&](MQTT_NS::error_code ec) { results.push_back(ec); };
+    ep->async_publish(0, "topic1", "a", MQTT_NS::qos::at_most_once, h);
+    ep->async_publish(0, "topic1", "b", MQTT_NS::qos::at_most_once, h);
+    ep->async_publish(0, "topic1", "c", MQTT_NS::qos::at_most_once, h);
+    // Only QoS0 publishes are dropped.
+    ep->async_puback(1, h);
+    BOOST_TEST(ep->queued_messages() == 3U);
+    ioc.run();
+
+    BOOST_TEST(results.size() == 4U);
+    for (auto const& ec : results) BOOST_TEST(!ec);
+    BOOST_TEST((s->written() == std::vector<cpt>{
+        cpt::puback, cpt::publish, cpt::publish
+    }));
+}
+
+BOOST_AUTO_TEST_CASE( reject_qos0 ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+    ep->set_queue_watermarks(0, 0, 1, 0);
+    ep->set_queue_overflow_policy(MQTT_NS::queue_overflow_policy::reject_qos0);
+
+    std::vector<MQTT_NS::error_code> results;
+    auto h = [&](MQTT_NS::error_code ec) { results.push_back(ec); };
+    ep->async_publish(0, "topic1", "a", MQTT_NS::qos::at_most_once, h);
+    ep->async_publish(0, "topic1", "b", MQTT_NS::qos::at_most_once, h);
+    ioc.run();
+
+    BOOST_TEST(results.size() == 2U);
+    BOOST_TEST(std::count(results.begin(), results.end(), MQTT_NS::error_code()) == 1);
+    BOOST_TEST(std::count(results.begin(), results.end(), MQTT_NS::error_code(as::error::no_buffer_space)) == 1);
+    BOOST_TEST(s->written().size() == 1U);
+
+    // The queue is drained, so the next publish is sent.
+    ep->async_publish(0, "topic1", "c", MQTT_NS::qos::at_most_once, h);
+    ioc.restart();
+    ioc.run();
+    BOOST_TEST(s->written().size() == 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -13,6 +13,43 @@ BOOST_AUTO_TEST_SUITE(test_resend_new_client)
 
 using namespace MQTT_NS::literals;
 
+namespace {
+
+// Both serialized forms of the store are compared with continuous_buffer() of each stored message.
+template <typename Client>
+inline void check_store_serialization(Client& c, std::size_t num) {
+    std::vector<std::string> expected;
+    c.for_each_store(
+        [&expected]
+        (MQTT_NS::message_variant const& msg) {
+            expected.push_back(MQTT_NS::continuous_buffer(msg));
+        }
+    );
+    BOOST_TEST(expected.size() == num);
+
+    std::vector<std::string> serialized;
+    c.for_each_store(
+        [&serialized]
+        (char const* data, std::size_t size) {
+            serialized.emplace_back(data, size);
+        }
+    );
+    BOOST_TEST(serialized == expected);
+
+    std::vector<std::string> gathered;
+    c.for_each_store_const_buffer_sequence(
+        [&gathered]
+        (std::vector<as::const_buffer> const& cbs) {
+            std::string s;
+            for (auto const& cb : cbs) s.append(MQTT_NS::get_pointer(cb), MQTT_NS::get_size(cb));
+            gathered.push_back(MQTT_NS::force_move(s));
+        }
+    );
+    BOOST_TEST(gathered == expected);
+}
+
+} // anonymous namespace
+
 
 BOOST_AUTO_TEST_CASE( publish_qos1 ) {
     boost::asio::io_context iocb;
@@ -540,6 +577,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
         [&chk, &c1, &c2, &tim]
         (MQTT_NS::error_code) {
             MQTT_CHK("h_error1");
+            check_store_serialization(*c1, 2);
             // Inherit store data from c1 to c2
             c1->for_each_store(
                 [&c2]
@@ -1257,6 +1295,7 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1_v5 ) {
         [&chk, &c1, &c2, &tim]
         (MQTT_NS::error_code) {
             MQTT_CHK("h_error1");
+            check_store_serialization(*c1, 2);
             // Inherit store data from c1 to c2
             c1->for_each_store(
                 [&c2]
@@ -0,0 +1,325 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "checker.hpp"
+
+#include <thread>
+#include <future>
+
+#include <mqtt/optional.hpp>
+
+#include <sys/mman.h>
+
+BOOST_AUTO_TEST_SUITE(test_shm)
+
+using namespace MQTT_NS::literals;
+
+namespace {
+
+constexpr char const* broker_shm_path = "mqtt_cpp_test_shm.sock";
+
+template <typename Test>
+inline void do_shm_test(Test const& test) {
+    as::io_context iocb;
+    test_broker b(iocb);
+    MQTT_NS::optional<MQTT_NS::server_shm<>> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(broker_shm_path, iocb);
+            // Smaller than the payload to exercise wrap around and writer wake up.
+            s->set_ring_capacity(1024);
+            s->set_error_handler(
+                [](MQTT_NS::error_code /*ec*/) {
+                }
+            );
+            s->set_accept_handler(
+                [&](con_sp_t spep) {
+                    b.handle_accept(MQTT_NS::force_move(spep));
+                }
+            );
+            s->listen();
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    as::io_context ioc;
+    auto c = std::make_shared<MQTT_NS::server_shm<>::endpoint_t>(
+        MQTT_NS::shm_connect(ioc, broker_shm_path),
+        MQTT_NS::protocol_version::v3_1_1
+    );
+    test(
+        ioc,
+        c,
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        }
+    );
+    th.join();
+}
+
+using shm_ep_t = MQTT_NS::shm_endpoint<as::io_context::strand>;
+
+// Connect two transports directly, with the rendezvous on a socket pair.
+inline std::pair<std::shared_ptr<shm_ep_t>, std::shared_ptr<shm_ep_t>>
+make_shm_pair(as::io_context& ioc) {
+    MQTT_NS::error_code ec;
+    auto fds = MQTT_NS::detail::shm_create(1024, ec);
+    BOOST_TEST(!ec);
+    as::local::stream_protocol::socket s1(ioc);
+    as::local::stream_protocol::socket s2(ioc);
+    as::local::connect_pair(s1, s2);
+    auto lp = MQTT_NS::detail::make_link_pair(ioc, ioc);
+    MQTT_NS::detail::shm_send(s1.native_handle(), fds, lp.second.native_handle(), ec);
+    BOOST_TEST(!ec);
+    auto client_fds = MQTT_NS::detail::shm_recv(s2.native_handle(), ec);
+    BOOST_TEST(!ec);
+    fds.link.reset(lp.first.release());
+    return {
+        std::make_shared<shm_ep_t>(ioc, MQTT_NS::shm_role::server, MQTT_NS::force_move(fds)),
+        std::make_shared<shm_ep_t>(ioc, MQTT_NS::shm_role::client, MQTT_NS::force_move(client_fds))
+    };
+}
+
+// Map the region of the transport as another process would.
+inline MQTT_NS::detail::shm_header* map_header(shm_ep_t& ep) {
+    void* addr = ::mmap(
+        nullptr,
+        MQTT_NS::detail::shm_region_size(ep.capacity()),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        ep.native_handle(),
+        0);
+    BOOST_TEST(addr != MAP_FAILED);
+    return static_cast<MQTT_NS::detail::shm_header*>(addr);
+}
+
+inline void unmap_header(shm_ep_t& ep, MQTT_NS::detail::shm_header* header) {
+    ::munmap(header, MQTT_NS::detail::shm_region_size(ep.capacity()));
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pub_qos1_sub_qos1 ) {
+    do_shm_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            std::string const payload(10000, 'x');
+            packet_id_t pid_sub;
+            packet_id_t pid_pub;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                // publish topic1 QoS1
+                cont("h_publish"),
+                cont("h_puback"),
+                cont("h_close"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(sp == false);
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_suback_handler(
+                [&chk, &c, &pid_sub, &pid_pub, &payload]
+                (packet_id_t packet_id, std::vector<MQTT_NS::suback_return_code> results) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    BOOST_TEST(results.size() == 1U);
+                    BOOST_TEST(results[0] == MQTT_NS::suback_return_code::success_maximum_qos_1);
+                    pid_pub = c->publish("topic1", payload, MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_puback_handler(
+                [&chk, &c, &pid_pub]
+                (packet_id_t packet_id) {
+                    MQTT_CHK("h_puback");
+                    BOOST_TEST(packet_id == pid_pub);
+                    c->disconnect();
+                    return true;
+                });
+            c->set_publish_handler(
+                [&chk, &payload]
+                (MQTT_NS::optional<packet_id_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+                    BOOST_CHECK(packet_id);
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == payload);
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->start_session();
+            c->connect("cid1", MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( async_pub_qos0_sub_qos0 ) {
+    do_shm_test(
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            std::string const payload(5000, 'y');
+            packet_id_t pid_sub = 1;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                cont("h_publish"),
+                cont("h_close"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    c->async_subscribe(pid_sub, "topic1", MQTT_NS::qos::at_most_once);
+                    return true;
+                });
+            c->set_suback_handler(
+                [&chk, &c, &pid_sub, &payload]
+                (packet_id_t packet_id, std::vector<MQTT_NS::suback_return_code>) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    c->async_publish("topic1", payload, MQTT_NS::qos::at_most_once);
+                    return true;
+                });
+            c->set_publish_handler(
+                [&chk, &c, &payload]
+                (MQTT_NS::optional<packet_id_t>,
+                 MQTT_NS::publish_options,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == payload);
+                    c->async_disconnect();
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->start_session();
+            c->async_connect("cid1"_mb, MQTT_NS::nullopt, MQTT_NS::nullopt, MQTT_NS::nullopt, 0);
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( corrupted_ring_read ) {
+    as::io_context ioc;
+    auto eps = make_shm_pair(ioc);
+    auto& c = *eps.second;
+    auto header = map_header(c);
+    // The server claims that it produced more than the capacity.
+    header->rings[0].tail.store(c.capacity() * 4);
+    unmap_header(c, header);
+
+    char buf[16];
+    bool called = false;
+    c.async_read(
+        as::buffer(buf),
+        [&](MQTT_NS::error_code ec, std::size_t) {
+            called = true;
+            BOOST_TEST(ec == make_error_code(MQTT_NS::protocol_error_errc));
+        }
+    );
+    ioc.run();
+    BOOST_TEST(called);
+    BOOST_TEST(!c.lowest_layer().is_open());
+}
+
+BOOST_AUTO_TEST_CASE( corrupted_ring_write ) {
+    as::io_context ioc;
+    auto eps = make_shm_pair(ioc);
+    auto& c = *eps.second;
+    auto header = map_header(c);
+    // The server claims that it consumed bytes that were never produced.
+    header->rings[1].head.store(5);
+    unmap_header(c, header);
+
+    std::string const data(100, 'z');
+    bool called = false;
+    c.async_write(
+        as::buffer(data),
+        [&](MQTT_NS::error_code ec, std::size_t) {
+            called = true;
+            BOOST_TEST(ec == make_error_code(MQTT_NS::protocol_error_errc));
+        }
+    );
+    ioc.run();
+    BOOST_TEST(called);
+
+    MQTT_NS::error_code ec;
+    c.write(as::buffer(data), ec);
+    BOOST_TEST(ec);
+}
+
+BOOST_AUTO_TEST_CASE( invalid_rendezvous ) {
+    as::io_context ioc;
+    auto check = [&](std::uint64_t capacity) {
+        MQTT_NS::error_code ec;
+        auto fds = MQTT_NS::detail::shm_create(64, ec);
+        BOOST_TEST(!ec);
+        fds.capacity = capacity;
+        as::local::stream_protocol::socket s1(ioc);
+        as::local::stream_protocol::socket s2(ioc);
+        as::local::connect_pair(s1, s2);
+        auto lp = MQTT_NS::detail::make_link_pair(ioc, ioc);
+        MQTT_NS::detail::shm_send(s1.native_handle(), fds, lp.second.native_handle(), ec);
+        BOOST_TEST(!ec);
+        MQTT_NS::detail::shm_recv(s2.native_handle(), ec);
+        BOOST_TEST(ec == make_error_code(MQTT_NS::protocol_error_errc));
+    };
+    check(0);
+    check(1000);
+    check(MQTT_NS::detail::shm_max_capacity * 2);
+    // Power of two, but larger than the memfd.
+    check(1 << 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
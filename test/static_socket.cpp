@@ -0,0 +1,125 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "checker.hpp"
+
+#include <mqtt/server.hpp>
+#include <mqtt/static_socket.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_static_socket)
+
+namespace {
+
+using socket_t = MQTT_NS::tcp_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using endpoint_t = MQTT_NS::callable_overlay<
+    MQTT_NS::server_endpoint<std::mutex, std::lock_guard, 2, MQTT_NS::static_socket<socket_t>>
+>;
+
+static_assert(
+    std::is_same<
+        std::remove_reference_t<decltype(std::declval<endpoint_t&>().socket())>,
+        MQTT_NS::static_socket<socket_t>
+    >::value,
+    "endpoint holds the concrete socket"
+);
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( pub_qos1 ) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    auto ss = std::make_shared<socket_t>(ioc);
+    std::shared_ptr<endpoint_t> sep;
+
+    checker chk = {
+        // server side
+        cont("h_connect"),
+        // client side
+        cont("h_connack"),
+        deps("h_publish", "h_connack"),
+        deps("h_puback", "h_connack"),
+        deps("h_disconnect", "h_puback", "h_publish"),
+        cont("h_close"),
+    };
+
+    std::string const payload(10000, 'x');
+    ac.async_accept(
+        ss->lowest_layer(),
+        [&](MQTT_NS::error_code ec) {
+            BOOST_TEST(!ec);
+            sep = std::make_shared<endpoint_t>(ss, MQTT_NS::protocol_version::v3_1_1);
+            auto& ep = *sep;
+            ep.set_connect_handler(
+                [&]
+                (MQTT_NS::buffer client_id,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::buffer>,
+                 MQTT_NS::optional<MQTT_NS::will>,
+                 bool,
+                 std::uint16_t) {
+                    MQTT_CHK("h_connect");
+                    BOOST_TEST(client_id == "cid1");
+                    sep->connack(false, MQTT_NS::connect_return_code::accepted);
+                    return true;
+                });
+            ep.set_publish_handler(
+                [&]
+                (MQTT_NS::optional<std::uint16_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic_name,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(packet_id.has_value());
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+                    BOOST_TEST(topic_name == "topic1");
+                    BOOST_TEST(contents == payload);
+                    return true;
+                });
+            ep.set_disconnect_handler(
+                [&] {
+                    MQTT_CHK("h_disconnect");
+                    sep->force_disconnect();
+                });
+            ep.start_session(sep);
+        }
+    );
+
+    auto c = MQTT_NS::make_client(ioc, "127.0.0.1", ac.local_endpoint().port());
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    c->set_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            MQTT_CHK("h_connack");
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            c->publish("topic1", payload, MQTT_NS::qos::at_least_once);
+            return true;
+        });
+    c->set_puback_handler(
+        [&]
+        (std::uint16_t) {
+            MQTT_CHK("h_puback");
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&] {
+            MQTT_CHK("h_close");
+        });
+    c->set_error_handler(
+        [](MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        });
+    c->connect();
+    ioc.run();
+    BOOST_TEST(chk.all());
+    sep.reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -19,6 +19,7 @@
 
 #include <mqtt_server_cpp.hpp>
 #include <mqtt/optional.hpp>
+#include <mqtt/topic_table.hpp>
 #include <mqtt/visitor_util.hpp>
 
 #include "test_settings.hpp"
@@ -599,12 +600,12 @@ private:
                     // But *only* for this connection
                     // Not every connection in the broker.
                     ep.publish(
-                        as::buffer(item.topic),
+                        as::buffer(item.topic.name()),
                         as::buffer(d.contents),
                         // TODO: why is this 'retain'?
                         std::min(item.qos_value, d.qos_value) | MQTT_NS::retain::yes,
                         *(d.props),
-                        std::make_tuple(item.topic, d.contents, *(d.props))
+                        std::make_tuple(item.topic.name(), d.contents, *(d.props))
                         );
                 }
                 subs_.emplace(item.topic, spep, item.qos_value, item.rap_value);
@@ -702,12 +703,11 @@ private:
             std::vector<MQTT_NS::suback_return_code> res;
             res.reserve(entries.size());
             for (auto const& e : entries) {
-                MQTT_NS::buffer topic = std::get<0>(e);
                 MQTT_NS::qos qos_value = std::get<1>(e).get_qos();
                 res.emplace_back(MQTT_NS::qos_to_suback_return_code(qos_value)); // converts to granted_qos_x
                 // TODO: This doesn't handle situations where we receive a new subscription for the same topic.
                 // MQTT 3.1.1 - 3.8.4 Response - paragraph 3.
-                subs_.emplace(MQTT_NS::force_move(topic), spep, qos_value);
+                subs_.emplace(topics_.intern(std::get<0>(e)), spep, qos_value);
             }
             // Acknowledge the subscriptions, and the registered QOS settings
             ep.suback(packet_id, MQTT_NS::force_move(res));
@@ -718,13 +718,12 @@ private:
             std::vector<MQTT_NS::v5::suback_reason_code> res;
             res.reserve(entries.size());
             for (auto const& e : entries) {
-                MQTT_NS::buffer topic = std::get<0>(e);
                 MQTT_NS::qos qos_value = std::get<1>(e).get_qos();
                 MQTT_NS::rap rap_value = std::get<1>(e).get_rap();
                 res.emplace_back(MQTT_NS::v5::qos_to_suback_reason_code(qos_value)); // converts to granted_qos_x
                 // TODO: This doesn't handle situations where we receive a new subscription for the same topic.
                 // MQTT 3.1.1 - 3.8.4 Response - paragraph 3.
-                subs_.emplace(MQTT_NS::force_move(topic), spep, qos_value, rap_value);
+                subs_.emplace(topics_.intern(std::get<0>(e)), spep, qos_value, rap_value);
             }
             if (h_subscribe_props_) h_subscribe_props_(props);
             // Acknowledge the subscriptions, and the registered QOS settings
@@ -737,17 +736,18 @@ private:
         }
 
         for (auto const& e : entries) {
-            MQTT_NS::buffer const& topic = std::get<0>(e);
+            auto topic = topics_.find(std::get<0>(e));
+            if (!topic) continue;
             MQTT_NS::subscribe_options options = std::get<1>(e);
             // Publish any retained messages that match the newly subscribed topic.
-            auto it = retains_.find(topic);
+            auto it = retains_.find(topic.value());
             if (it != retains_.end()) {
                 ep.publish(
-                    as::buffer(it->topic),
+                    as::buffer(it->topic.name()),
                     as::buffer(it->contents),
                     std::min(it->qos_value, options.get_qos()) | MQTT_NS::retain::yes,
                     it->props,
-                    std::make_pair(it->topic, it->contents)
+                    std::make_pair(it->topic.name(), it->contents)
                 );
             }
         }
@@ -762,6 +762,13 @@ private:
 
         auto& ep = *spep;
 
+        // Topics that are not in the table have no subscriptions.
+        std::vector<MQTT_NS::interned_topic> interned;
+        interned.reserve(topics.size());
+        for (auto const& topic : topics) {
+            if (auto t = topics_.find(topic)) interned.push_back(MQTT_NS::force_move(t.value()));
+        }
+
         // For each subscription that this connection has
         // Compare against the list of topics, and remove
         // the subscription if the topic is in the list.
@@ -770,7 +777,7 @@ private:
             auto const& range = boost::make_iterator_range(idx.equal_range(spep));
             for(auto it = range.begin(); it != range.end(); ) {
                 bool match = false;
-                for(auto const& topic : topics) {
+                for(auto const& topic : interned) {
                     if(it->topic == topic) {
                         /*
                          * Advance the iterator using the return from erase.
@@ -797,7 +804,7 @@ private:
 
         for(auto const& item : boost::make_iterator_range( subs_.get<tag_con>().equal_range(spep))) {
             (void)item;
-            for(auto const& topic : topics) {
+            for(auto const& topic : interned) {
                 (void)topic;
                 BOOST_ASSERT(item.topic != topic);
             }
@@ -832,8 +839,17 @@ private:
         MQTT_NS::buffer contents,
         MQTT_NS::publish_options pubopts,
         MQTT_NS::v5::properties props) {
+        // A topic that is not in the table has neither subscriptions nor retained message.
+        auto interned =
+            pubopts.get_retain() == MQTT_NS::retain::yes && !contents.empty()
+            ? MQTT_NS::optional<MQTT_NS::interned_topic>(topics_.intern(topic))
+            : topics_.find(topic);
+        if (!interned) return;
+        // The received topic buffer is replaced with the shared storage.
+        topic = interned.value().name();
+
         // For each active subscription registered for this topic
-        for(auto const& sub : boost::make_iterator_range(subs_.get<tag_topic>().equal_range(topic))) {
+        for(auto const& sub : boost::make_iterator_range(subs_.get<tag_topic>().equal_range(interned.value()))) {
             // publish the message to subscribers.
             // TODO: Probably this should be switched to async_publish?
             //       Given the async_client / sync_client seperation
@@ -865,7 +881,7 @@ private:
             //
             // TODO: This does not properly handle wildcards!
             auto & idx = saved_subs_.get<tag_topic>();
-            auto range = boost::make_iterator_range(idx.equal_range(topic));
+            auto range = boost::make_iterator_range(idx.equal_range(interned.value()));
             if( ! range.empty()) {
                 auto sp_props = std::make_shared<MQTT_NS::v5::properties>(props);
                 for(auto it = range.begin(); it != range.end(); std::advance(it, 1)) {
@@ -905,13 +921,13 @@ private:
          */
         if (pubopts.get_retain() == MQTT_NS::retain::yes) {
             if (contents.empty()) {
-                retains_.erase(topic);
-                BOOST_ASSERT(retains_.count(topic) == 0);
+                retains_.erase(interned.value());
+                BOOST_ASSERT(retains_.count(interned.value()) == 0);
             }
             else {
-                auto const& it = retains_.find(topic);
+                auto const& it = retains_.find(interned.value());
                 if(it == retains_.end()) {
-                    auto const& ret = retains_.emplace(MQTT_NS::force_move(topic),
+                    auto const& ret = retains_.emplace(MQTT_NS::force_move(interned.value()),
                                                        MQTT_NS::force_move(contents),
                                                        MQTT_NS::force_move(props),
                                                        pubopts.get_qos());
@@ -1014,7 +1030,7 @@ private:
                                                           item.rap_value);
                     (void)ret;
                     BOOST_ASSERT(ret.second);
-                    BOOST_ASSERT(ret.first == saved_subs_.find(client_id));
+                    BOOST_ASSERT(ret.first->client_id == client_id);
                 }
                 idx.erase(range.begin(), range.end());
             }
@@ -1116,12 +1132,12 @@ private:
     // Mapping between connection object and subscription topics
     struct sub_con {
         sub_con(
-            MQTT_NS::buffer topic,
+            MQTT_NS::interned_topic topic,
             con_sp_t con,
             MQTT_NS::qos qos_value,
             MQTT_NS::rap rap_value = MQTT_NS::rap::dont)
             :topic(MQTT_NS::force_move(topic)), con(MQTT_NS::force_move(con)), qos_value(qos_value), rap_value(rap_value) {}
-        MQTT_NS::buffer topic;
+        MQTT_NS::interned_topic topic;
         con_sp_t con;
         MQTT_NS::qos qos_value;
         MQTT_NS::rap rap_value;
@@ -1131,7 +1147,7 @@ private:
         mi::indexed_by<
             mi::ordered_non_unique<
                 mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::buffer, topic)
+                BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::interned_topic, topic)
             >,
             mi::ordered_non_unique<
                 mi::tag<tag_con>,
@@ -1145,7 +1161,7 @@ private:
                 mi::composite_key<
                     sub_con,
                     BOOST_MULTI_INDEX_MEMBER(sub_con, con_sp_t, con),
-                    BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::buffer, topic)
+                    BOOST_MULTI_INDEX_MEMBER(sub_con, MQTT_NS::interned_topic, topic)
                 >
             >
         >
@@ -1155,7 +1171,7 @@ private:
     // case clients add a new subscription to the associated topics.
     struct retain {
         retain(
-            MQTT_NS::buffer topic,
+            MQTT_NS::interned_topic topic,
             MQTT_NS::buffer contents,
             MQTT_NS::v5::properties props,
             MQTT_NS::qos qos_value)
@@ -1164,7 +1180,7 @@ private:
              props(MQTT_NS::force_move(props)),
              qos_value(qos_value)
         { }
-        MQTT_NS::buffer topic;
+        MQTT_NS::interned_topic topic;
         MQTT_NS::buffer contents;
         MQTT_NS::v5::properties props;
         MQTT_NS::qos qos_value;
@@ -1174,7 +1190,7 @@ private:
         mi::indexed_by<
             mi::ordered_unique<
                 mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(retain, MQTT_NS::buffer, topic)
+                BOOST_MULTI_INDEX_MEMBER(retain, MQTT_NS::interned_topic, topic)
             >
         >
     >;
@@ -1199,12 +1215,12 @@ private:
     struct session_subscription {
         session_subscription(
             MQTT_NS::buffer client_id,
-            MQTT_NS::buffer topic,
+            MQTT_NS::interned_topic topic,
             MQTT_NS::qos qos_value,
             MQTT_NS::rap rap_value)
             :client_id(MQTT_NS::force_move(client_id)), topic(MQTT_NS::force_move(topic)), qos_value(qos_value), rap_value(rap_value) {}
         MQTT_NS::buffer client_id;
-        MQTT_NS::buffer topic;
+        MQTT_NS::interned_topic topic;
         std::vector<saved_message> messages;
         MQTT_NS::qos qos_value;
         MQTT_NS::rap rap_value;
@@ -1221,7 +1237,7 @@ private:
             // Allow multiple topics for the same client id
             mi::ordered_non_unique<
                 mi::tag<tag_topic>,
-                BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, topic)
+                BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::interned_topic, topic)
             >,
             // Don't allow the same client id to have the same topic multiple times.
             // Note that this index does not get used by any code in the broker
@@ -1230,7 +1246,7 @@ private:
             mi::ordered_unique<
                 mi::composite_key<
                     session_subscription,
-                    BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, topic),
+                    BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::interned_topic, topic),
                     BOOST_MULTI_INDEX_MEMBER(session_subscription, MQTT_NS::buffer, client_id)
                 >
             >
@@ -1243,6 +1259,7 @@ private:
 
     mi_active_sessions active_sessions_; ///< Map of active client id and connections
     mi_non_active_sessions non_active_sessions_; ///< Storage for sessions not currently active. Indexed by client id.
+    MQTT_NS::topic_table topics_; ///< Topic names shared by subscriptions and retained messages
     mi_sub_con subs_; ///< Map of topic subscriptions to client ids
     mi_session_subscription saved_subs_; ///< Topics and associated messages for clientids that are currently disconnected
     mi_retain retains_; ///< A list of messages retained so they can be sent to newly subscribed clients.
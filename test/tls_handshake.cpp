@@ -0,0 +1,132 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "test_ctx_init.hpp"
+
+#include <thread>
+#include <future>
+#include <mutex>
+
+#include <mqtt/optional.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_tls_handshake)
+
+namespace {
+
+std::mutex mtx;
+std::vector<std::thread::id> handshake_threads;
+
+inline void record_handshake_thread(SSL const* /*ssl*/, int where, int /*ret*/) {
+    if (where & SSL_CB_HANDSHAKE_DONE) {
+        std::lock_guard<std::mutex> g(mtx);
+        handshake_threads.push_back(std::this_thread::get_id());
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( offload ) {
+    {
+        std::lock_guard<std::mutex> g(mtx);
+        handshake_threads.clear();
+    }
+    as::io_context iocb;
+    as::io_context ioc_hs;
+    auto work = as::make_work_guard(ioc_hs);
+    std::thread th_hs([&] { ioc_hs.run(); });
+    auto handshake_thread = th_hs.get_id();
+
+    test_broker b(iocb);
+    MQTT_NS::optional<MQTT_NS::server_tls<>> s;
+    std::vector<std::thread::id> accept_threads;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            ctx_init ci;
+            SSL_CTX_set_info_callback(ci.ctx.native_handle(), record_handshake_thread);
+            s.emplace(
+                as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_tls_port),
+                std::move(ci.ctx),
+                iocb,
+                [](auto& acceptor) {
+                    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+                }
+            );
+            s->set_handshake_io_context(ioc_hs);
+            s->set_error_handler(
+                [](MQTT_NS::error_code /*ec*/) {
+                }
+            );
+            s->set_accept_handler(
+                [&](con_sp_t spep) {
+                    accept_threads.push_back(std::this_thread::get_id());
+                    b.handle_accept(MQTT_NS::force_move(spep));
+                }
+            );
+            s->listen();
+            p.set_value();
+            iocb.run();
+        }
+    );
+    auto broker_thread = th.get_id();
+    f.wait();
+
+    as::io_context ioc;
+    auto c = MQTT_NS::make_tls_client(ioc, broker_url, broker_tls_port);
+    std::string path = boost::unit_test::framework::master_test_suite().argv[0];
+    std::size_t pos = path.find_last_of("/\\");
+    std::string base = (pos == std::string::npos) ? "" : path.substr(0, pos + 1);
+    c->get_ssl_context().load_verify_file(base + "cacert.pem");
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+
+    std::size_t const times = 3;
+    std::size_t connected = 0;
+    c->set_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            ++connected;
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&]
+        () {
+            if (connected < times) c->connect();
+        });
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        });
+    c->connect();
+    ioc.run();
+    BOOST_TEST(connected == times);
+
+    as::post(
+        iocb,
+        [&] {
+            s->close();
+        }
+    );
+    th.join();
+    work.reset();
+    th_hs.join();
+
+    BOOST_TEST(accept_threads.size() == times);
+    for (auto const& id : accept_threads) BOOST_TEST((id == broker_thread));
+    std::lock_guard<std::mutex> g(mtx);
+    BOOST_TEST(handshake_threads.size() == times);
+    for (auto const& id : handshake_threads) BOOST_TEST((id == handshake_thread));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
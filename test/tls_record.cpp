@@ -0,0 +1,150 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_ctx_init.hpp"
+
+#include <mqtt/tcp_endpoint.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_tls_record)
+
+namespace {
+
+using tls_socket_t = as::ssl::stream<as::ip::tcp::socket>;
+using endpoint_t = MQTT_NS::tcp_endpoint<tls_socket_t, as::io_context::strand>;
+
+// Count the TLS records written on the connection.
+inline void count_records(
+    int write_p, int /*version*/, int content_type,
+    void const* /*buf*/, std::size_t /*len*/, SSL* /*ssl*/, void* arg) {
+    if (write_p && content_type == SSL3_RT_HEADER) ++*static_cast<std::size_t*>(arg);
+}
+
+// The buffer sequence of a QoS1 PUBLISH as the endpoint sends it.
+inline std::vector<as::const_buffer> publish_buffers(std::string const& payload) {
+    static char const fixed_header[] = { 0x32 };
+    static char const remaining_length[] = { 0x00, 0x00 };
+    static char const topic_length[] = { 0x00, 0x06 };
+    static char const topic[] = "topic1";
+    static char const packet_id[] = { 0x00, 0x01 };
+    return {
+        as::buffer(fixed_header),
+        as::buffer(remaining_length),
+        as::buffer(topic_length),
+        as::buffer(topic, 6),
+        as::buffer(packet_id),
+        as::buffer(payload)
+    };
+}
+
+// Returns the number of records written for each message.
+template <typename Write>
+inline double records_per_message(std::string const& payload, std::size_t messages, Write const& write) {
+    as::io_context ioc;
+    ctx_init ci;
+    as::ssl::context cctx(as::ssl::context::tlsv12);
+    cctx.set_verify_mode(as::ssl::verify_none);
+
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    tls_socket_t server(ioc, ci.ctx);
+    endpoint_t client(ioc, cctx);
+    client.lowest_layer().connect(ac.local_endpoint());
+    ac.accept(server.lowest_layer());
+
+    server.async_handshake(as::ssl::stream_base::server, [](MQTT_NS::error_code ec) { BOOST_TEST(!ec); });
+    client.async_handshake(as::ssl::stream_base::client, [](MQTT_NS::error_code ec) { BOOST_TEST(!ec); });
+    ioc.run();
+    ioc.restart();
+
+    std::size_t records = 0;
+    SSL_set_msg_callback(client.native_handle(), count_records);
+    SSL_set_msg_callback_arg(client.native_handle(), &records);
+
+    auto buffers = publish_buffers(payload);
+    auto size = as::buffer_size(buffers);
+    std::vector<char> received(size);
+    for (std::size_t i = 0; i != messages; ++i) {
+        write(ioc, client, buffers);
+        as::read(server, as::buffer(received));
+        BOOST_TEST(std::string(received.data() + size - payload.size(), payload.size()) == payload);
+    }
+    return static_cast<double>(records) / static_cast<double>(messages);
+}
+
+inline void compare(std::string const& payload) {
+    std::size_t const messages = 100;
+    auto before = records_per_message(
+        payload,
+        messages,
+        [](as::io_context&, endpoint_t& ep, std::vector<as::const_buffer> const& buffers) {
+            as::write(ep.socket(), buffers);
+        }
+    );
+    auto after = records_per_message(
+        payload,
+        messages,
+        [](as::io_context&, endpoint_t& ep, std::vector<as::const_buffer> const& buffers) {
+            MQTT_NS::write(ep, buffers);
+        }
+    );
+    auto after_async = records_per_message(
+        payload,
+        messages,
+        [](as::io_context& ioc, endpoint_t& ep, std::vector<as::const_buffer> const& buffers) {
+            MQTT_NS::async_write(ep, buffers, [](MQTT_NS::error_code ec, std::size_t) { BOOST_TEST(!ec); });
+            ioc.run();
+            ioc.restart();
+        }
+    );
+    BOOST_TEST_MESSAGE(
+        "payload " << payload.size() << " bytes: "
+        << before << " records/message before, "
+        << after << " records/message after (sync), "
+        << after_async << " records/message after (async)"
+    );
+    BOOST_TEST(after <= before);
+    BOOST_TEST(after == after_async);
+    // 16384 bytes is the maximum plaintext size of a TLS record.
+    BOOST_TEST(after == static_cast<double>((payload.size() + 11 + 16383) / 16384));
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( small_payload ) {
+    compare(std::string(100, 'x'));
+}
+
+BOOST_AUTO_TEST_CASE( middle_payload ) {
+    // asio linearizes up to 8KiB of the sequence by itself, and the rest goes to another record.
+    compare(std::string(10000, 'x'));
+}
+
+BOOST_AUTO_TEST_CASE( large_payload ) {
+    compare(std::string(40000, 'x'));
+}
+
+BOOST_AUTO_TEST_CASE( stage_large_payload ) {
+    std::string const payload(100000, 'x');
+    auto buffers = publish_buffers(payload);
+    MQTT_NS::tls_record_buffer staging;
+    auto staged = staging.stage(buffers);
+    // One record is staged, and the rest of the payload is not copied.
+    BOOST_TEST(staged.size() == 2U);
+    BOOST_TEST(staged.data()[0].size() == 16384U);
+    BOOST_TEST(staged.data()[1].size() == as::buffer_size(buffers) - 16384U);
+    BOOST_TEST(
+        static_cast<char const*>(staged.data()[1].data()) + staged.data()[1].size() ==
+        payload.data() + payload.size()
+    );
+    std::string linear(as::buffer_size(staged), '\0');
+    as::buffer_copy(as::buffer(&linear[0], linear.size()), staged);
+    std::string expected(as::buffer_size(buffers), '\0');
+    as::buffer_copy(as::buffer(&expected[0], expected.size()), buffers);
+    BOOST_TEST(linear == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,177 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "test_ctx_init.hpp"
+
+#include <thread>
+#include <future>
+
+#include <mqtt/optional.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_tls_session)
+
+using namespace MQTT_NS::literals;
+
+namespace {
+
+template <typename Configure, typename Test>
+inline void do_tls_session_test(Configure const& configure, Test const& test) {
+    as::io_context iocb;
+    test_broker b(iocb);
+    MQTT_NS::optional<MQTT_NS::server_tls<>> s;
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            ctx_init ci;
+            s.emplace(
+                as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_tls_port),
+                std::move(ci.ctx),
+                iocb,
+                [](auto& acceptor) {
+                    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+                }
+            );
+            configure(*s);
+            s->set_error_handler(
+                [](MQTT_NS::error_code /*ec*/) {
+                }
+            );
+            s->set_accept_handler(
+                [&](con_sp_t spep) {
+                    b.handle_accept(MQTT_NS::force_move(spep));
+                }
+            );
+            s->listen();
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    test(*s);
+    as::post(
+        iocb,
+        [&] {
+            s->close();
+        }
+    );
+    th.join();
+}
+
+inline auto make_client(as::io_context& ioc) {
+    auto c = MQTT_NS::make_tls_client(ioc, broker_url, broker_tls_port);
+    std::string path = boost::unit_test::framework::master_test_suite().argv[0];
+    std::size_t pos = path.find_last_of("/\\");
+    std::string base = (pos == std::string::npos) ? "" : path.substr(0, pos + 1);
+    c->get_ssl_context().load_verify_file(base + "cacert.pem");
+    c->set_client_id("cid1");
+    c->set_clean_session(true);
+    return c;
+}
+
+template <typename Client>
+inline void connect_disconnect(as::io_context& ioc, Client& c, std::size_t times) {
+    std::size_t connected = 0;
+    c->set_connack_handler(
+        [&]
+        (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+            ++connected;
+            c->disconnect();
+            return true;
+        });
+    c->set_close_handler(
+        [&]
+        () {
+            if (connected < times) c->connect();
+        });
+    c->set_error_handler(
+        []
+        (MQTT_NS::error_code) {
+            BOOST_CHECK(false);
+        });
+    c->connect();
+    ioc.run();
+    ioc.restart();
+    BOOST_TEST(connected == times);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( resume ) {
+    do_tls_session_test(
+        [](auto& s) {
+            s.set_tls_session_cache_size(100);
+        },
+        [](auto& s) {
+            as::io_context ioc;
+            auto c = make_client(ioc);
+            c->set_tls_session_reuse(true);
+            connect_disconnect(ioc, c, 3);
+            BOOST_TEST(c->tls_full_handshakes() == 1U);
+            BOOST_TEST(c->tls_resumed_handshakes() == 2U);
+            BOOST_TEST(s.tls_full_handshakes() == 1U);
+            BOOST_TEST(s.tls_resumed_handshakes() == 2U);
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( no_reuse ) {
+    do_tls_session_test(
+        [](auto&) {
+        },
+        [](auto& s) {
+            as::io_context ioc;
+            auto c = make_client(ioc);
+            connect_disconnect(ioc, c, 2);
+            BOOST_TEST(c->tls_full_handshakes() == 2U);
+            BOOST_TEST(c->tls_resumed_handshakes() == 0U);
+            BOOST_TEST(s.tls_full_handshakes() == 2U);
+            BOOST_TEST(s.tls_resumed_handshakes() == 0U);
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( resume_after_restart ) {
+    // The session cache is lost at the restart, but the ticket encrypted by the same keys is accepted.
+    std::string const keys(80, 'k');
+    as::io_context ioc;
+    auto c = make_client(ioc);
+    c->set_tls_session_reuse(true);
+    auto configure =
+        [&](auto& s) {
+            s.set_tls_session_cache_size(0);
+            s.set_tls_session_ticket_keys(keys);
+        };
+    do_tls_session_test(
+        configure,
+        [&](auto& s) {
+            connect_disconnect(ioc, c, 1);
+            BOOST_TEST(s.tls_full_handshakes() == 1U);
+        }
+    );
+    do_tls_session_test(
+        configure,
+        [&](auto& s) {
+            connect_disconnect(ioc, c, 1);
+            BOOST_TEST(s.tls_full_handshakes() == 0U);
+            BOOST_TEST(s.tls_resumed_handshakes() == 1U);
+        }
+    );
+    BOOST_TEST(c->tls_full_handshakes() == 1U);
+    BOOST_TEST(c->tls_resumed_handshakes() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( invalid_ticket_keys ) {
+    ctx_init ci;
+    BOOST_CHECK_THROW(MQTT_NS::set_tls_session_ticket_keys(ci.ctx, "short"), MQTT_NS::system_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
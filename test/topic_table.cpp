@@ -0,0 +1,94 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <mqtt/topic_table.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_topic_table)
+
+BOOST_AUTO_TEST_CASE( intern ) {
+    MQTT_NS::topic_table t;
+    std::string s1("topic1");
+    std::string s2("topic1");
+    auto a = t.intern(s1);
+    auto b = t.intern(s2);
+    auto c = t.intern("topic2");
+    BOOST_TEST(t.size() == 2U);
+    BOOST_TEST((a == b));
+    BOOST_TEST(a.id() == b.id());
+    BOOST_TEST(static_cast<void const*>(a.name().data()) == static_cast<void const*>(b.name().data()));
+    BOOST_TEST(a.name() == "topic1");
+    BOOST_TEST((a != c));
+    BOOST_TEST((a < c || c < a));
+    // The storage is not the source string.
+    BOOST_TEST(static_cast<void const*>(a.name().data()) != static_cast<void const*>(s1.data()));
+}
+
+BOOST_AUTO_TEST_CASE( find ) {
+    MQTT_NS::topic_table t;
+    BOOST_TEST(!t.find("topic1"));
+    auto a = t.intern("topic1");
+    auto f = t.find("topic1");
+    BOOST_TEST(f.has_value());
+    BOOST_TEST((f.value() == a));
+    // find() doesn't add.
+    BOOST_TEST(!t.find("topic2"));
+    BOOST_TEST(t.size() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( erase_last_handle ) {
+    MQTT_NS::topic_table t;
+    std::size_t id;
+    {
+        auto a = t.intern("topic1");
+        id = a.id();
+        auto b = a;
+        BOOST_TEST(t.size() == 1U);
+    }
+    BOOST_TEST(t.size() == 0U);
+    BOOST_TEST(!t.find("topic1"));
+    // The id is not reused.
+    BOOST_TEST(t.intern("topic1").id() != id);
+}
+
+BOOST_AUTO_TEST_CASE( outlive_table ) {
+    MQTT_NS::optional<MQTT_NS::interned_topic> a;
+    {
+        MQTT_NS::topic_table t;
+        a = t.intern("topic1");
+    }
+    BOOST_TEST(a.value().name() == "topic1");
+    a = MQTT_NS::nullopt;
+}
+
+BOOST_AUTO_TEST_CASE( concurrent ) {
+    MQTT_NS::topic_table t;
+    auto keep = t.intern("topic0");
+    // Boost.Test assertions are not thread safe.
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> ths;
+    for (int i = 0; i != 4; ++i) {
+        ths.emplace_back(
+            [&] {
+                for (int j = 0; j != 10000; ++j) {
+                    auto a = t.intern("topic" + std::to_string(j % 10));
+                    auto b = t.intern("topic" + std::to_string(j % 10));
+                    if (a != b || t.intern("topic0") != keep) ok = false;
+                }
+            }
+        );
+    }
+    for (auto& th : ths) th.join();
+    BOOST_TEST(ok);
+    BOOST_TEST(t.size() == 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "test_broker.hpp"
+#include "checker.hpp"
+
+#include <thread>
+#include <future>
+
+#include <mqtt/optional.hpp>
+#include <mqtt/sync_client.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_uring)
+
+using namespace MQTT_NS::literals;
+
+namespace {
+
+// The path that the broker actually used.
+struct uring_state {
+    bool enabled;
+    bool multishot;
+};
+
+// entries == 0 disables io_uring to test the fallback path.
+template <typename Test>
+inline uring_state do_uring_test(unsigned entries, Test const& test) {
+    as::io_context iocb;
+    test_broker b(iocb);
+    MQTT_NS::optional<MQTT_NS::server_uring<>> s;
+    auto ctx = std::make_shared<MQTT_NS::uring_context>(iocb, entries, 1024, 16);
+    std::promise<void> p;
+    auto f = p.get_future();
+    std::thread th(
+        [&] {
+            s.emplace(
+                as::ip::tcp::endpoint(as::ip::tcp::v4(), broker_notls_port),
+                iocb,
+                [](auto& acceptor) {
+                    acceptor.set_option(as::ip::tcp::acceptor::reuse_address(true));
+                }
+            );
+            s->set_uring_context(ctx);
+            s->set_error_handler(
+                [](MQTT_NS::error_code /*ec*/) {
+                }
+            );
+            s->set_accept_handler(
+                [&](con_sp_t spep) {
+                    b.handle_accept(MQTT_NS::force_move(spep));
+                }
+            );
+            s->listen();
+            p.set_value();
+            iocb.run();
+        }
+    );
+    f.wait();
+    as::io_context ioc;
+    auto c = MQTT_NS::make_sync_client(ioc, broker_url, broker_notls_port);
+    test(
+        ioc,
+        c,
+        [&] {
+            as::post(
+                iocb,
+                [&] {
+                    s->close();
+                }
+            );
+        }
+    );
+    th.join();
+    return uring_state { ctx->enabled(), ctx->multishot() };
+}
+
+inline uring_state pub_qos1_sub_qos1(unsigned entries) {
+    return do_uring_test(
+        entries,
+        [](as::io_context& ioc, auto& c, auto finish) {
+            using packet_id_t = typename std::remove_reference_t<decltype(*c)>::packet_id_t;
+            // Spans some provided buffers.
+            std::string const payload(10000, 'x');
+            packet_id_t pid_sub;
+            packet_id_t pid_pub;
+
+            checker chk = {
+                cont("h_connack"),
+                cont("h_suback"),
+                // publish topic1 QoS1
+                cont("h_publish"),
+                cont("h_puback"),
+                cont("h_close"),
+            };
+
+            c->set_connack_handler(
+                [&chk, &c, &pid_sub]
+                (bool sp, MQTT_NS::connect_return_code connack_return_code) {
+                    MQTT_CHK("h_connack");
+                    BOOST_TEST(sp == false);
+                    BOOST_TEST(connack_return_code == MQTT_NS::connect_return_code::accepted);
+                    pid_sub = c->subscribe("topic1", MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_suback_handler(
+                [&chk, &c, &pid_sub, &pid_pub, &payload]
+                (packet_id_t packet_id, std::vector<MQTT_NS::suback_return_code> results) {
+                    MQTT_CHK("h_suback");
+                    BOOST_TEST(packet_id == pid_sub);
+                    BOOST_TEST(results.size() == 1U);
+                    BOOST_TEST(results[0] == MQTT_NS::suback_return_code::success_maximum_qos_1);
+                    pid_pub = c->publish("topic1", payload, MQTT_NS::qos::at_least_once);
+                    return true;
+                });
+            c->set_puback_handler(
+                [&chk, &c, &pid_pub]
+                (packet_id_t packet_id) {
+                    MQTT_CHK("h_puback");
+                    BOOST_TEST(packet_id == pid_pub);
+                    c->disconnect();
+                    return true;
+                });
+            c->set_publish_handler(
+                [&chk, &payload]
+                (MQTT_NS::optional<packet_id_t> packet_id,
+                 MQTT_NS::publish_options pubopts,
+                 MQTT_NS::buffer topic,
+                 MQTT_NS::buffer contents) {
+                    MQTT_CHK("h_publish");
+                    BOOST_TEST(pubopts.get_qos() == MQTT_NS::qos::at_least_once);
+                    BOOST_CHECK(packet_id);
+                    BOOST_TEST(topic == "topic1");
+                    BOOST_TEST(contents == payload);
+                    return true;
+                });
+            c->set_close_handler(
+                [&chk, &finish]
+                () {
+                    MQTT_CHK("h_close");
+                    finish();
+                });
+            c->set_error_handler(
+                []
+                (MQTT_NS::error_code) {
+                    BOOST_CHECK(false);
+                });
+            c->set_client_id("cid1");
+            c->set_clean_session(true);
+            c->connect();
+            ioc.run();
+            BOOST_TEST(chk.all());
+        }
+    );
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( uring ) {
+    {
+        as::io_context ioc;
+        if (!MQTT_NS::uring_context(ioc, 256).enabled()) {
+            // Otherwise this would only repeat the fallback test.
+            BOOST_TEST_MESSAGE("io_uring is not available, skipped");
+            return;
+        }
+    }
+    auto st = pub_qos1_sub_qos1(256);
+    BOOST_TEST(st.enabled);
+    BOOST_TEST_MESSAGE("io_uring multishot receive: " << (st.multishot ? "used" : "not supported"));
+}
+
+BOOST_AUTO_TEST_CASE( fallback ) {
+    auto st = pub_qos1_sub_qos1(0);
+    BOOST_TEST(!st.enabled);
+    BOOST_TEST(!st.multishot);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
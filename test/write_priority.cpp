@@ -0,0 +1,73 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+#include "fake_socket.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_write_priority)
+
+using cpt = MQTT_NS::control_packet_type;
+
+BOOST_AUTO_TEST_CASE( acks_ahead_of_publishes ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+
+    std::string const payload(100000, 'x');
+    ep->async_publish(0, "topic1", payload);
+    ep->async_publish(0, "topic1", payload);
+    ep->async_puback(1);
+    ep->async_pingresp();
+    ep->async_publish(0, "topic1", payload);
+    ep->async_pubrel(2);
+    ioc.run();
+
+    BOOST_TEST((s->written() == std::vector<cpt>{
+        cpt::puback, cpt::pingresp, cpt::pubrel,
+        cpt::publish, cpt::publish, cpt::publish
+    }));
+}
+
+BOOST_AUTO_TEST_CASE( at_next_write_boundary ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+
+    std::string const payload(100000, 'x');
+    ep->async_publish(0, "topic1", payload);
+    ep->async_publish(0, "topic1", payload);
+    // The first publish is being written.
+    ioc.poll_one();
+    BOOST_TEST(s->writes() == 1U);
+    ep->async_pingresp();
+    ioc.run();
+
+    BOOST_TEST((s->written() == std::vector<cpt>{
+        cpt::publish, cpt::pingresp, cpt::publish
+    }));
+}
+
+BOOST_AUTO_TEST_CASE( batch ) {
+    as::io_context ioc;
+    auto s = std::make_shared<fake_socket>(ioc);
+    auto ep = std::make_shared<fake_endpoint_t>(s, MQTT_NS::protocol_version::v3_1_1);
+    ep->set_max_queue_send_count(0);
+
+    ep->async_publish(0, "topic1", "a");
+    ep->async_puback(1);
+    ep->async_publish(0, "topic1", "b");
+    ep->async_pingresp();
+    ioc.run();
+
+    // One write with the acks first.
+    BOOST_TEST(s->writes() == 1U);
+    BOOST_TEST((s->written() == std::vector<cpt>{
+        cpt::puback, cpt::pingresp, cpt::publish, cpt::publish
+    }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+// Copyright Takatoshi Kondo 2020
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include "test_main.hpp"
+#include "test_settings.hpp"
+
+#include <mqtt/ws_endpoint.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_ws_read)
+
+namespace {
+
+using endpoint_t = MQTT_NS::ws_endpoint<as::ip::tcp::socket, as::io_context::strand>;
+using peer_t = boost::beast::websocket::stream<as::ip::tcp::socket>;
+
+// Connect the endpoint to the peer, then call test.
+template <typename Test>
+inline void do_ws_read_test(Test const& test, bool deflate = false) {
+    as::io_context ioc;
+    as::ip::tcp::acceptor ac(ioc, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+    peer_t peer(ioc);
+    endpoint_t ep(ioc);
+    if (deflate) {
+        boost::beast::websocket::permessage_deflate pmd;
+        pmd.server_enable = true;
+        peer.set_option(pmd);
+        ep.set_deflate(MQTT_NS::ws_deflate_options());
+    }
+    ep.lowest_layer().connect(ac.local_endpoint());
+    ac.accept(peer.next_layer());
+
+    peer.async_accept([](MQTT_NS::error_code ec) { BOOST_TEST(!ec); });
+    ep.async_handshake("localhost", "/", [](MQTT_NS::error_code ec) { BOOST_TEST(!ec); });
+    ioc.run();
+    ioc.restart();
+    peer.binary(true);
+    test(ioc, peer, ep);
+}
+
+inline std::string read(as::io_context& ioc, endpoint_t& ep, std::size_t size) {
+    std::string buf(size, '\0');
+    bool called = false;
+    ep.async_read(
+        as::buffer(&buf[0], size),
+        [&](MQTT_NS::error_code ec, std::size_t bytes_transferred) {
+            BOOST_TEST(!ec);
+            BOOST_TEST(bytes_transferred == size);
+            called = true;
+        }
+    );
+    ioc.run();
+    ioc.restart();
+    BOOST_TEST(called);
+    return buf;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( split_and_joined ) {
+    do_ws_read_test(
+        [](as::io_context& ioc, peer_t& peer, endpoint_t& ep) {
+            peer.write(as::buffer(std::string("abcdef")));
+            peer.write(as::buffer(std::string("ghi")));
+            peer.write(as::buffer(std::string("jklmnopqrstuvwxyz")));
+            // Within a message.
+            BOOST_TEST(read(ioc, ep, 1) == "a");
+            BOOST_TEST(read(ioc, ep, 2) == "bc");
+            // Across messages.
+            BOOST_TEST(read(ioc, ep, 10) == "defghijklm");
+            BOOST_TEST(read(ioc, ep, 13) == "nopqrstuvwxyz");
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( fragmented ) {
+    do_ws_read_test(
+        [](as::io_context& ioc, peer_t& peer, endpoint_t& ep) {
+            std::string payload(100000, 'x');
+            for (std::size_t i = 0; i != payload.size(); ++i) payload[i] = static_cast<char>('a' + i % 26);
+            peer.auto_fragment(true);
+            peer.write_buffer_bytes(4096);
+            peer.write(as::buffer(payload));
+            BOOST_TEST(read(ioc, ep, payload.size()) == payload);
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( text_message ) {
+    do_ws_read_test(
+        [](as::io_context& ioc, peer_t& peer, endpoint_t& ep) {
+            peer.text(true);
+            peer.write(as::buffer(std::string("abc")));
+            char c;
+            bool called = false;
+            ep.async_read(
+                as::buffer(&c, 1),
+                [&](MQTT_NS::error_code ec, std::size_t) {
+                    BOOST_TEST(ec == boost::system::errc::bad_message);
+                    called = true;
+                }
+            );
+            ioc.run();
+            BOOST_TEST(called);
+        }
+    );
+}
+
+BOOST_AUTO_TEST_CASE( deflate_read ) {
+    do_ws_read_test(
+        [](as::io_context& ioc, peer_t& peer, endpoint_t& ep) {
+            std::string payload(10000, 'a');
+            peer.write(as::buffer(payload));
+            peer.write(as::buffer(payload));
+            BOOST_TEST(read(ioc, ep, 1) == "a");
+            BOOST_TEST(read(ioc, ep, payload.size()) == payload);
+            BOOST_TEST(read(ioc, ep, payload.size() - 1) == std::string(payload.size() - 1, 'a'));
+        },
+        true
+    );
+}
+
+BOOST_AUTO_TEST_CASE( deflate_write ) {
+    do_ws_read_test(
+        [](as::io_context&, peer_t& peer, endpoint_t& ep) {
+            std::string payload(10000, 'a');
+            MQTT_NS::write(ep, std::vector<as::const_buffer>{ as::buffer(payload) });
+            // Check the frame header on the wire.
+            unsigned char header[2];
+            as::read(peer.next_layer(), as::buffer(header));
+            BOOST_TEST((header[0] & 0x40) != 0); // RSV1 means compressed
+            BOOST_TEST((header[1] & 0x7f) < 126);
+        },
+        true
+    );
+}
+
+BOOST_AUTO_TEST_SUITE_END()